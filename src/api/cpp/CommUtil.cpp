@@ -146,6 +146,245 @@ GRAVITY_API int sendGravityDataProduct(void* socket, const GravityDataProduct& d
 	return rc;
 }
 
+static void releaseOwnedData(void* data, void* hint)
+{
+    delete static_cast<std::shared_ptr<const uint8_t>*>(hint);
+}
+
+GRAVITY_API void initGravityDataProductMessages(const GravityDataProduct& dataProduct, zmq_msg_t* envelope, zmq_msg_t* data)
+{
+    string serialized;
+    dataProduct.serializeEnvelope(serialized);
+    zmq_msg_init_size(envelope, serialized.size());
+    memcpy(zmq_msg_data(envelope), serialized.data(), serialized.size());
+
+    // The data is handed over as is if the data product doesn't hold it in its protobuf
+    if (dataProduct.ownedData && dataProduct.ownedDataSize > 0)
+    {
+        zmq_msg_init_data(data, const_cast<uint8_t*>(dataProduct.ownedData.get()), dataProduct.ownedDataSize,
+                          releaseOwnedData, new std::shared_ptr<const uint8_t>(dataProduct.ownedData));
+    }
+    else
+    {
+        zmq_msg_init_size(data, dataProduct.getDataSize64());
+        memcpy(zmq_msg_data(data), dataProduct.getDataPointer(), dataProduct.getDataSize64());
+    }
+}
+
+GRAVITY_API int sendGravityDataProductFrames(void* socket, const GravityDataProduct& dataProduct, int flags)
+{
+    // Send the envelope followed by the data
+    zmq_msg_t envelope, data;
+    initGravityDataProductMessages(dataProduct, &envelope, &data);
+    zmq_sendmsg(socket, &envelope, flags | ZMQ_SNDMORE);
+    zmq_msg_close(&envelope);
+    int rc = zmq_sendmsg(socket, &data, flags);
+    zmq_msg_close(&data);
+
+    return rc;
+}
+
+static void closeSharedMessage(zmq_msg_t* msg)
+{
+    zmq_msg_close(msg);
+    delete msg;
+}
+
+GRAVITY_API std::shared_ptr<zmq_msg_t> readSharedMessage(void* socket, int flags)
+{
+    std::shared_ptr<zmq_msg_t> msg(new zmq_msg_t, closeSharedMessage);
+    zmq_msg_init(msg.get());
+    if (zmq_recvmsg(socket, msg.get(), flags) == -1)
+    {
+        msg.reset();
+    }
+    return msg;
+}
+
+GRAVITY_API std::shared_ptr<zmq_msg_t> moveSharedMessage(zmq_msg_t* msg)
+{
+    std::shared_ptr<zmq_msg_t> shared(new zmq_msg_t, closeSharedMessage);
+    zmq_msg_init(shared.get());
+    zmq_msg_move(shared.get(), msg);
+    zmq_msg_close(msg);
+    return shared;
+}
+
+GRAVITY_API bool hasMoreFrames(void* socket)
+{
+    int more = 0;
+    size_t size = sizeof(more);
+    zmq_getsockopt(socket, ZMQ_RCVMORE, &more, &size);
+    return more != 0;
+}
+
+GRAVITY_API const std::string& wireFormatV2Prefix()
+{
+    static const string prefix("\0GV2", 4);
+    return prefix;
+}
+
+// Rate limited topics are the prefix, the interval in decimal, ':' then the filter
+static const string& rateLimitedPrefix()
+{
+    static const string prefix("\0GR", 3);
+    return prefix;
+}
+
+GRAVITY_API std::string rateLimitedTopic(uint64_t interval, const std::string& filter)
+{
+    ostringstream topic;
+    topic << rateLimitedPrefix() << interval << ':' << filter;
+    return topic.str();
+}
+
+GRAVITY_API bool parseRateLimitedTopic(const std::string& topic, uint64_t& interval, std::string& filter)
+{
+    const string& prefix = rateLimitedPrefix();
+    if (topic.compare(0, prefix.length(), prefix) != 0)
+    {
+        return false;
+    }
+    size_t position = prefix.length();
+    interval = 0;
+    while (position < topic.length() && topic[position] >= '0' && topic[position] <= '9')
+    {
+        interval = interval * 10 + (topic[position++] - '0');
+    }
+    if (position == prefix.length() || position == topic.length() || topic[position] != ':')
+    {
+        return false;
+    }
+    filter.assign(topic, position + 1, string::npos);
+    return true;
+}
+
+// Predicate topics are the prefix, the interval in decimal, ':', the predicate, '\0' then the filter
+static const string& predicatePrefix()
+{
+    static const string prefix("\0GQ", 3);
+    return prefix;
+}
+
+GRAVITY_API std::string predicateTopic(uint64_t interval, const std::string& predicate, const std::string& filter)
+{
+    ostringstream topic;
+    topic << predicatePrefix() << interval << ':' << predicate << '\0' << filter;
+    return topic.str();
+}
+
+GRAVITY_API bool parsePredicateTopic(const std::string& topic, uint64_t& interval, std::string& predicate, std::string& filter)
+{
+    const string& prefix = predicatePrefix();
+    if (topic.compare(0, prefix.length(), prefix) != 0)
+    {
+        return false;
+    }
+    size_t position = prefix.length();
+    interval = 0;
+    while (position < topic.length() && topic[position] >= '0' && topic[position] <= '9')
+    {
+        interval = interval * 10 + (topic[position++] - '0');
+    }
+    size_t end = topic.find('\0', position);
+    if (position == prefix.length() || end == string::npos || topic[position] != ':')
+    {
+        return false;
+    }
+    predicate.assign(topic, position + 1, end - position - 1);
+    filter.assign(topic, end + 1, string::npos);
+    return true;
+}
+
+// Retransmit topics are the prefix, the first and last sequence numbers in decimal separated by '-', ':' then the
+// filter text
+static const string& retransmitPrefix()
+{
+    static const string prefix("\0GN", 3);
+    return prefix;
+}
+
+GRAVITY_API std::string retransmitTopic(uint64_t first, uint64_t last, const std::string& filterText)
+{
+    ostringstream topic;
+    topic << retransmitPrefix() << first << '-' << last << ':' << filterText;
+    return topic.str();
+}
+
+GRAVITY_API bool parseRetransmitTopic(const std::string& topic, uint64_t& first, uint64_t& last, std::string& filterText)
+{
+    const string& prefix = retransmitPrefix();
+    if (topic.compare(0, prefix.length(), prefix) != 0)
+    {
+        return false;
+    }
+    size_t position = prefix.length();
+    first = 0;
+    while (position < topic.length() && topic[position] >= '0' && topic[position] <= '9')
+    {
+        first = first * 10 + (topic[position++] - '0');
+    }
+    if (position == prefix.length() || position == topic.length() || topic[position] != '-')
+    {
+        return false;
+    }
+    size_t start = ++position;
+    last = 0;
+    while (position < topic.length() && topic[position] >= '0' && topic[position] <= '9')
+    {
+        last = last * 10 + (topic[position++] - '0');
+    }
+    if (position == start || position == topic.length() || topic[position] != ':')
+    {
+        return false;
+    }
+    filterText.assign(topic, position + 1, string::npos);
+    return true;
+}
+
+// Lag report topics are the prefix, the lag, dropped count and report count in decimal separated by '-', ':' then the
+// subscriber ID
+static const string& lagReportPrefix()
+{
+    static const string prefix("\0GL", 3);
+    return prefix;
+}
+
+GRAVITY_API std::string lagReportTopic(uint64_t lag, uint64_t dropped, uint64_t report, const std::string& subscriberID)
+{
+    ostringstream topic;
+    topic << lagReportPrefix() << lag << '-' << dropped << '-' << report << ':' << subscriberID;
+    return topic.str();
+}
+
+GRAVITY_API bool parseLagReportTopic(const std::string& topic, uint64_t& lag, uint64_t& dropped, uint64_t& report,
+                                     std::string& subscriberID)
+{
+    const string& prefix = lagReportPrefix();
+    if (topic.compare(0, prefix.length(), prefix) != 0)
+    {
+        return false;
+    }
+    size_t position = prefix.length();
+    uint64_t* values[] = {&lag, &dropped, &report};
+    for (int i = 0; i < 3; i++)
+    {
+        size_t start = position;
+        *values[i] = 0;
+        while (position < topic.length() && topic[position] >= '0' && topic[position] <= '9')
+        {
+            *values[i] = *values[i] * 10 + (topic[position++] - '0');
+        }
+        if (position == start || position == topic.length() || topic[position] != (i < 2 ? '-' : ':'))
+        {
+            return false;
+        }
+        position++;
+    }
+    subscriberID.assign(topic, position, string::npos);
+    return true;
+}
+
 GRAVITY_API int sendProtobufMessage(void* socket, const google::protobuf::Message& pb, int flags)
 {
     // Send data product
@@ -35,6 +35,7 @@
 #include <WinSock2.h>
 #include <memory>
 #endif
+#include <zmq.h>
 #include <vector>
 #include <string>
 
@@ -46,6 +47,14 @@
 #define DEFAULT_BROADCAST_TIMEOUT_SEC 10 
 #define MAXRECVSTRING 255
 
+/// Version of the wire format for published data products.  Version 2 sends the envelope and the data as separate frames.
+/// Version 3 publishers also send data products at a limited rate to subscribers that ask for it (see rateLimitedTopic).
+/// Version 4 publishers also send only the data products that match a predicate on request (see predicateTopic).
+/// Version 5 publishers also number the data products of reliable publications and send again those that subscribers
+/// missed on request (see retransmitTopic).
+/// Version 6 publishers also monitor subscribers that report how far behind they are (see lagReportTopic).
+#define GRAVITY_WIRE_FORMAT_VERSION 6
+
 namespace gravity
 {
 
@@ -98,6 +107,112 @@ GRAVITY_API void sendUint32Message(void* socket, uint32_t val, int flags); ///<
 GRAVITY_API int sendGravityDataProduct(void* socket, const GravityDataProduct& dataProduct, int flags); 
 GRAVITY_API int sendProtobufMessage(void* socket, const google::protobuf::Message& pb, int flags); ///< \copydoc sendGravityDataProduct(void*,const GravityDataProduct&,int)
 
+/**
+ * Send a GravityDataProduct as two frames: the serialized envelope (every field but the data) followed by the data itself.
+ * \copydetails sendGravityDataProduct(void*,const GravityDataProduct&,int)
+ */
+GRAVITY_API int sendGravityDataProductFrames(void* socket, const GravityDataProduct& dataProduct, int flags);
+
+/**
+ * Initialize the messages for the two frames that sendGravityDataProductFrames sends.
+ * \param dataProduct data product to send
+ * \param envelope message to initialize with the serialized envelope
+ * \param data message to initialize with the data
+ */
+GRAVITY_API void initGravityDataProductMessages(const GravityDataProduct& dataProduct, zmq_msg_t* envelope, zmq_msg_t* data);
+
+/**
+ * Move an initialized message into one that is closed when the last reference to it is released.
+ * \param msg message to move (closed once moved)
+ */
+GRAVITY_API std::shared_ptr<zmq_msg_t> moveSharedMessage(zmq_msg_t* msg);
+
+/**
+ * Read the next frame from a zmq socket into a message that is closed when the last reference to it is released.
+ * \param flags a zmq flag (see \ref readStringMessage(void*,int))
+ * \return the message, or an empty pointer if no message could be read
+ */
+GRAVITY_API std::shared_ptr<zmq_msg_t> readSharedMessage(void* socket, int flags);
+
+/**
+ * Check whether more frames of the current multi-part message are waiting to be read.
+ */
+GRAVITY_API bool hasMoreFrames(void* socket);
+
+/**
+ * Prefix that subscribers which understand wire format version 2 add to their subscription filter.  Publishers send
+ * those subscribers the same prefix ahead of the filter text, so they can tell the two kinds of subscribers apart.
+ */
+GRAVITY_API const std::string& wireFormatV2Prefix();
+
+/**
+ * Topic that subscribers subscribe to for data products at a limited rate, from publishers that understand wire format
+ * version 3.  Publishers send such subscribers the data products whose filter text starts with the filter, at most
+ * one for each filter text per interval, with the same topic ahead of the filter text.  Subscribers asking for the
+ * same interval share the one stream.
+ * \param interval fewest microseconds between data products
+ * \param filter subscription filter (or filter text, when publishing)
+ */
+GRAVITY_API std::string rateLimitedTopic(uint64_t interval, const std::string& filter);
+
+/**
+ * Split a topic made by rateLimitedTopic
+ * \return false if it isn't one
+ */
+GRAVITY_API bool parseRateLimitedTopic(const std::string& topic, uint64_t& interval, std::string& filter);
+
+/**
+ * Topic that subscribers subscribe to for only the data products matching a predicate on their content (see
+ * GravityPredicate), from publishers that understand wire format version 4.  As with rateLimitedTopic, but publishers
+ * only send the data products the predicate holds for (or can't be tested against here), optionally at a limited rate.
+ * \param interval fewest microseconds between data products (0 for every one)
+ * \param predicate on the fields of the data products (which can't contain '\0')
+ * \param filter subscription filter (or filter text, when publishing)
+ */
+GRAVITY_API std::string predicateTopic(uint64_t interval, const std::string& predicate, const std::string& filter);
+
+/**
+ * Split a topic made by predicateTopic
+ * \return false if it isn't one
+ */
+GRAVITY_API bool parsePredicateTopic(const std::string& topic, uint64_t& interval, std::string& predicate, std::string& filter);
+
+/**
+ * Topic that subscribers subscribe to in order to ask a publisher that understands wire format version 5 for the data
+ * products of a reliable publication that they missed.  The publisher sends those it still has, in order, with this
+ * topic ahead of them (so only the subscribers asking receive them).  If it has none of them, it sends the oldest it
+ * has, so that the subscribers know they're gone.
+ * \param first sequence number of the first data product missed
+ * \param last sequence number of the last data product missed
+ * \param filterText filter text the data products were published with
+ */
+GRAVITY_API std::string retransmitTopic(uint64_t first, uint64_t last, const std::string& filterText);
+
+/**
+ * Split a topic made by retransmitTopic
+ * \return false if it isn't one
+ */
+GRAVITY_API bool parseRetransmitTopic(const std::string& topic, uint64_t& first, uint64_t& last, std::string& filterText);
+
+/**
+ * Topic that subscribers subscribe to in order to report to a publisher that monitors its subscribers how far behind
+ * they are.  Each report replaces the subscriber's last, and the publisher answers a slow subscriber with what it's to
+ * do on the topic of its latest report (so only that subscriber receives it): nothing more to disconnect, or the fewest
+ * microseconds between the data products it's to ask for instead (see rateLimitedTopic).
+ * \param lag most milliseconds a data product reached the subscriber after its timestamp since its last report
+ * \param dropped data products the subscriber has missed since it subscribed
+ * \param report count of the subscriber's reports, so that each has a topic of its own
+ * \param subscriberID identifies the subscriber (its socket) to the publisher
+ */
+GRAVITY_API std::string lagReportTopic(uint64_t lag, uint64_t dropped, uint64_t report, const std::string& subscriberID);
+
+/**
+ * Split a topic made by lagReportTopic
+ * \return false if it isn't one
+ */
+GRAVITY_API bool parseLagReportTopic(const std::string& topic, uint64_t& lag, uint64_t& dropped, uint64_t& report,
+                                     std::string& subscriberID);
+
 /**
  * Bind the given zmq socket to the first available port.
  * \return zero if successfully bound to a port. Otherwise it shall return -1.
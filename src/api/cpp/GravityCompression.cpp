@@ -0,0 +1,129 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityCompression.cpp
+ *
+ */
+
+#include "GravityCompression.h"
+#include <limits.h>
+
+// The codecs are optional dependencies, enabled by the build when they are found
+#ifdef GRAVITY_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef GRAVITY_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace gravity
+{
+
+bool isCompressionSupported(GravityCompressionType type)
+{
+    switch (type)
+    {
+    case GravityCompressionTypes::NONE:
+        return true;
+#ifdef GRAVITY_WITH_LZ4
+    case GravityCompressionTypes::LZ4:
+        return true;
+#endif
+#ifdef GRAVITY_WITH_ZSTD
+    case GravityCompressionTypes::ZSTD:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+size_t compressBound(GravityCompressionType type, size_t size)
+{
+    switch (type)
+    {
+    case GravityCompressionTypes::NONE:
+        return size;
+#ifdef GRAVITY_WITH_LZ4
+    case GravityCompressionTypes::LZ4:
+        return size > LZ4_MAX_INPUT_SIZE ? 0 : LZ4_compressBound((int)size);
+#endif
+#ifdef GRAVITY_WITH_ZSTD
+    case GravityCompressionTypes::ZSTD:
+        return ZSTD_compressBound(size);
+#endif
+    default:
+        return 0;
+    }
+}
+
+size_t compressData(const GravityCompressionPolicy& policy, const void* source, size_t sourceSize,
+                    void* destination, size_t destinationSize)
+{
+    switch (policy.type)
+    {
+#ifdef GRAVITY_WITH_LZ4
+    case GravityCompressionTypes::LZ4:
+    {
+        if (sourceSize > LZ4_MAX_INPUT_SIZE)
+            return 0;
+        int size = LZ4_compress_default((const char*)source, (char*)destination, (int)sourceSize,
+                                        destinationSize > INT_MAX ? INT_MAX : (int)destinationSize);
+        return size > 0 ? size : 0;
+    }
+#endif
+#ifdef GRAVITY_WITH_ZSTD
+    case GravityCompressionTypes::ZSTD:
+    {
+        size_t size = ZSTD_compress(destination, destinationSize, source, sourceSize, policy.level);
+        return ZSTD_isError(size) ? 0 : size;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+bool decompressData(GravityCompressionType type, const void* source, size_t sourceSize,
+                    void* destination, size_t destinationSize)
+{
+    switch (type)
+    {
+#ifdef GRAVITY_WITH_LZ4
+    case GravityCompressionTypes::LZ4:
+    {
+        if (sourceSize > INT_MAX || destinationSize > INT_MAX)
+            return false;
+        int size = LZ4_decompress_safe((const char*)source, (char*)destination, (int)sourceSize, (int)destinationSize);
+        return size >= 0 && (size_t)size == destinationSize;
+    }
+#endif
+#ifdef GRAVITY_WITH_ZSTD
+    case GravityCompressionTypes::ZSTD:
+    {
+        size_t size = ZSTD_decompress(destination, destinationSize, source, sourceSize);
+        return !ZSTD_isError(size) && size == destinationSize;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+} /* namespace gravity */
@@ -0,0 +1,100 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityCompression.h
+ *
+ */
+
+#ifndef GRAVITYCOMPRESSION_H_
+#define GRAVITYCOMPRESSION_H_
+
+#include "Utility.h"
+#include <stddef.h>
+
+namespace gravity
+{
+
+/**
+ * Namespace to hold Gravity Compression Types.
+ */
+namespace GravityCompressionTypes
+{
+    /**
+     * Codecs with which the data of a published data product can be compressed.  The values are recorded
+     * in the compression field of the GravityDataProductPB.
+     */
+    enum Types
+    {
+        NONE = 0, ///< Data is sent as is
+        LZ4 = 1, ///< LZ4 block compression (fast, moderate ratio)
+        ZSTD = 2 ///< Zstandard compression (slower, better ratio, level selectable)
+    };
+}
+typedef GravityCompressionTypes::Types GravityCompressionType;
+
+/**
+ * How the data of a published data product is compressed.  Data is compressed once when it is published,
+ * and decompressed once when it is received, regardless of the number of subscribers.
+ */
+typedef struct GravityCompressionPolicy
+{
+    GravityCompressionType type; ///< Codec to use
+    int level; ///< Compression level (ZSTD only, 0 for the codec's default)
+    int minimumSize; ///< Data smaller than this many bytes is sent uncompressed
+
+    GravityCompressionPolicy(GravityCompressionType type = GravityCompressionTypes::NONE, int level = 0, int minimumSize = 0)
+        : type(type), level(level), minimumSize(minimumSize) {}
+} GravityCompressionPolicy;
+
+/**
+ * Whether this build of Gravity supports the given codec.
+ */
+GRAVITY_API bool isCompressionSupported(GravityCompressionType type);
+
+/**
+ * Largest size that compressing size bytes with the given codec can produce (0 if the codec is not supported).
+ */
+GRAVITY_API size_t compressBound(GravityCompressionType type, size_t size);
+
+/**
+ * Compress data.
+ * \param policy codec and level to compress with
+ * \param source data to compress
+ * \param sourceSize size of the data to compress
+ * \param destination buffer for the compressed data
+ * \param destinationSize size of destination, at least compressBound(policy.type, sourceSize) to always succeed
+ * \return size of the compressed data, or 0 if it could not be compressed
+ */
+GRAVITY_API size_t compressData(const GravityCompressionPolicy& policy, const void* source, size_t sourceSize,
+                                void* destination, size_t destinationSize);
+
+/**
+ * Decompress data.
+ * \param type codec the data was compressed with
+ * \param source compressed data
+ * \param sourceSize size of the compressed data
+ * \param destination buffer for the decompressed data
+ * \param destinationSize size of the decompressed data
+ * \return success flag
+ */
+GRAVITY_API bool decompressData(GravityCompressionType type, const void* source, size_t sourceSize,
+                                void* destination, size_t destinationSize);
+
+} /* namespace gravity */
+#endif /* GRAVITYCOMPRESSION_H_ */
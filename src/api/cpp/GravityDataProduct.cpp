@@ -24,113 +24,661 @@
  */
 
 #include "GravityDataProduct.h"
+#include "GravitySemaphore.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <string.h>
+#include <limits.h>
+#include "GravityCompression.h"
 
 namespace gravity {
 
 using namespace std;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+/**
+ * Serialized form of a received data product.  The envelope is decoded with a single pass over the
+ * top-level fields (the data field is skipped, not copied) and the protobuf message is only parsed
+ * when something needs it.  The data either lives inside the envelope (the single frame format) or
+ * in a separate buffer (wire format version 2).
+ */
+class GravityDataProduct::WireView
+{
+public:
+    WireView(std::shared_ptr<const void> buffer, const char* bytes, int size,
+             std::shared_ptr<const void> dataBuffer, const char* dataBytes, uint64_t dataBytesSize,
+             std::shared_ptr<google::protobuf::Arena> arena);
+
+    GravityDataProductPB* parsed();
+    GravityDataProductPB& parse();
+    bool stamp(int field, uint64_t value);
+    int getSize();
+    void serialize(char* target);
+    void serializeEnvelope(std::string& envelope);
+    std::shared_ptr<const google::protobuf::Message> getParsedData();
+    void setParsedData(std::shared_ptr<const google::protobuf::Message> data);
+    bool decompress(uint64_t sizeLimit);
+
+    const char* bytes;
+    int size;
+    bool valid;
+    uint64_t timestamp;
+    uint64_t receivedTimestamp;
+    uint32_t registrationTime;
+    bool futureResponse;
+    bool cached;
+    bool relayed;
+    uint32_t compression;
+    uint64_t uncompressedSize;
+    uint64_t chunkOffset;
+    uint64_t totalSize;
+    uint64_t sequenceNumber;
+    uint64_t timeToLive;
+    bool monitored;
+    bool unreliable;
+    const char* dataProductID;
+    int dataProductIDSize;
+    const char* componentID;
+    int componentIDSize;
+    const char* domain;
+    int domainSize;
+    const char* data;
+    uint64_t dataSize;
+
+private:
+    bool decode();
+    int envelopeSize();
+
+    std::shared_ptr<const void> buffer;
+    std::shared_ptr<const void> dataBuffer;
+    bool separateData;
+    int dataFieldStart;
+    int dataFieldEnd;
+    std::shared_ptr<google::protobuf::Arena> arena;
+    GravityDataProductPB* pb;
+    std::shared_ptr<GravityDataProductPB> ownedPB;
+    std::string trailer; ///< fields set since receipt, appended to the envelope when re-serialized
+    std::shared_ptr<const google::protobuf::Message> parsedData; ///< data parsed for (and shared by) typed subscribers
+    Semaphore lock;
+};
+
+GravityDataProduct::WireView::WireView(std::shared_ptr<const void> buffer, const char* bytes, int size,
+                                       std::shared_ptr<const void> dataBuffer, const char* dataBytes, uint64_t dataBytesSize,
+                                       std::shared_ptr<google::protobuf::Arena> arena)
+    : bytes(bytes), size(size), timestamp(0), receivedTimestamp(0), registrationTime(0), futureResponse(false), cached(false), relayed(false),
+      compression(0), uncompressedSize(0), chunkOffset(0), totalSize(0), sequenceNumber(0), timeToLive(0), monitored(false), unreliable(false), dataProductID(""), dataProductIDSize(0), componentID(""), componentIDSize(0), domain(""), domainSize(0),
+      data(""), dataSize(0), buffer(buffer), dataBuffer(dataBuffer), separateData(dataBuffer.get() != NULL),
+      dataFieldStart(-1), dataFieldEnd(-1), arena(arena), pb(NULL)
+{
+    valid = decode();
+    if (separateData)
+    {
+        data = dataBytes;
+        dataSize = dataBytesSize;
+    }
+}
+
+bool GravityDataProduct::WireView::decode()
+{
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(bytes), size);
+    uint32_t tag;
+    int fieldStart = 0;
+    while ((tag = input.ReadTag()) != 0)
+    {
+        int field = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType type = WireFormatLite::GetTagWireType(tag);
+        if (type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+        {
+            uint32_t length;
+            if (!input.ReadVarint32(&length) || length > (uint32_t)(size - input.CurrentPosition()))
+                return false;
+            const char* value = bytes + input.CurrentPosition();
+            switch (field)
+            {
+            case GravityDataProductPB::kDataProductIDFieldNumber:
+                dataProductID = value;
+                dataProductIDSize = length;
+                break;
+            case GravityDataProductPB::kDataFieldNumber:
+                // Only a single data field is expected when the data is not sent separately
+                if (separateData || dataFieldStart >= 0)
+                    return false;
+                data = value;
+                dataSize = length;
+                dataFieldStart = fieldStart;
+                dataFieldEnd = input.CurrentPosition() + length;
+                break;
+            case GravityDataProductPB::kComponentIDFieldNumber:
+                componentID = value;
+                componentIDSize = length;
+                break;
+            case GravityDataProductPB::kDomainFieldNumber:
+                domain = value;
+                domainSize = length;
+                break;
+            }
+            input.Skip(length);
+        }
+        else if (type == WireFormatLite::WIRETYPE_VARINT)
+        {
+            uint64_t value;
+            if (!input.ReadVarint64(&value))
+                return false;
+            switch (field)
+            {
+            case GravityDataProductPB::kTimestampFieldNumber:
+                timestamp = value;
+                break;
+            case GravityDataProductPB::kReceivedTimestampFieldNumber:
+                receivedTimestamp = value;
+                break;
+            case GravityDataProductPB::kRegistrationTimeFieldNumber:
+                registrationTime = (uint32_t)value;
+                break;
+            case GravityDataProductPB::kFutureResponseFieldNumber:
+                futureResponse = value != 0;
+                break;
+            case GravityDataProductPB::kIsCachedDataproductFieldNumber:
+                cached = value != 0;
+                break;
+            case GravityDataProductPB::kIsRelayedDataproductFieldNumber:
+                relayed = value != 0;
+                break;
+            case GravityDataProductPB::kCompressionFieldNumber:
+                compression = (uint32_t)value;
+                break;
+            case GravityDataProductPB::kUncompressedSizeFieldNumber:
+                uncompressedSize = value;
+                break;
+            case GravityDataProductPB::kChunkOffsetFieldNumber:
+                chunkOffset = value;
+                break;
+            case GravityDataProductPB::kTotalSizeFieldNumber:
+                totalSize = value;
+                break;
+            case GravityDataProductPB::kSequenceNumberFieldNumber:
+                sequenceNumber = value;
+                break;
+            case GravityDataProductPB::kTimeToLiveFieldNumber:
+                timeToLive = value;
+                break;
+            case GravityDataProductPB::kMonitoredFieldNumber:
+                monitored = value != 0;
+                break;
+            case GravityDataProductPB::kUnreliableFieldNumber:
+                unreliable = value != 0;
+                break;
+            }
+        }
+        else if (!WireFormatLite::SkipField(&input, tag))
+        {
+            return false;
+        }
+        fieldStart = input.CurrentPosition();
+    }
+    return input.ConsumedEntireMessage();
+}
+
+GravityDataProductPB* GravityDataProduct::WireView::parsed()
+{
+    lock.Lock();
+    GravityDataProductPB* ret = pb;
+    lock.Unlock();
+    return ret;
+}
+
+GravityDataProductPB& GravityDataProduct::WireView::parse()
+{
+    lock.Lock();
+    if (!pb)
+    {
+        if (arena)
+        {
+            pb = google::protobuf::Arena::CreateMessage<GravityDataProductPB>(arena.get());
+        }
+        else
+        {
+            ownedPB.reset(new GravityDataProductPB());
+            pb = ownedPB.get();
+        }
+        pb->ParseFromArray(bytes, size);
+        if (separateData)
+            pb->set_data(data, dataSize);
+        if (!trailer.empty())
+            pb->MergeFromString(trailer);
+    }
+    lock.Unlock();
+    return *pb;
+}
+
+bool GravityDataProduct::WireView::stamp(int field, uint64_t value)
+{
+    lock.Lock();
+    bool ret = pb == NULL;
+    if (ret)
+    {
+        // Later occurrences of a field take precedence, so set fields are simply appended
+        uint8_t encoded[16];
+        uint8_t* end = WireFormatLite::WriteUInt64ToArray(field, value, encoded);
+        trailer.append((const char*)encoded, end - encoded);
+        switch (field)
+        {
+        case GravityDataProductPB::kReceivedTimestampFieldNumber:
+            receivedTimestamp = value;
+            break;
+        case GravityDataProductPB::kIsCachedDataproductFieldNumber:
+            cached = value != 0;
+            break;
+        case GravityDataProductPB::kIsRelayedDataproductFieldNumber:
+            relayed = value != 0;
+            break;
+        }
+    }
+    lock.Unlock();
+    return ret;
+}
+
+int GravityDataProduct::WireView::envelopeSize()
+{
+    return dataFieldStart < 0 ? size : size - (dataFieldEnd - dataFieldStart);
+}
+
+int GravityDataProduct::WireView::getSize()
+{
+    if (!separateData)
+        return size + trailer.size();
+    return envelopeSize() + 1 + CodedOutputStream::VarintSize64(dataSize) + dataSize + trailer.size();
+}
+
+void GravityDataProduct::WireView::serialize(char* target)
+{
+    if (!separateData)
+    {
+        memcpy(target, bytes, size);
+        target += size;
+    }
+    else
+    {
+        // Leave out the data field of the wrapped bytes, if any - the data now lives elsewhere
+        int start = dataFieldStart < 0 ? size : dataFieldStart;
+        memcpy(target, bytes, start);
+        target += start;
+        if (dataFieldStart >= 0)
+        {
+            memcpy(target, bytes + dataFieldEnd, size - dataFieldEnd);
+            target += size - dataFieldEnd;
+        }
+        uint8_t* t = WireFormatLite::WriteTagToArray(GravityDataProductPB::kDataFieldNumber,
+                                                     WireFormatLite::WIRETYPE_LENGTH_DELIMITED, (uint8_t*)target);
+        t = CodedOutputStream::WriteVarint64ToArray(dataSize, t);
+        memcpy(t, data, dataSize);
+        target = (char*)t + dataSize;
+    }
+    memcpy(target, trailer.data(), trailer.size());
+}
+
+void GravityDataProduct::WireView::serializeEnvelope(std::string& envelope)
+{
+    if (dataFieldStart < 0)
+    {
+        envelope.assign(bytes, size);
+    }
+    else
+    {
+        envelope.assign(bytes, dataFieldStart);
+        envelope.append(bytes + dataFieldEnd, size - dataFieldEnd);
+    }
+    envelope.append(trailer);
+}
+
+bool GravityDataProduct::WireView::decompress(uint64_t sizeLimit)
+{
+    lock.Lock();
+    bool ret = compression == GravityCompressionTypes::NONE;
+    if (!ret && uncompressedSize <= sizeLimit && uncompressedSize <= SIZE_MAX)
+    {
+        std::shared_ptr<char> buffer(new char[uncompressedSize > 0 ? uncompressedSize : 1], std::default_delete<char[]>());
+        ret = decompressData((GravityCompressionType)compression, data, dataSize, buffer.get(), uncompressedSize);
+        if (ret)
+        {
+            dataBuffer = buffer;
+            data = buffer.get();
+            dataSize = uncompressedSize;
+            separateData = true;
+            compression = GravityCompressionTypes::NONE;
+            if (pb)
+            {
+                pb->set_data(data, dataSize);
+                pb->clear_compression();
+                pb->clear_uncompressed_size();
+            }
+            else
+            {
+                uint8_t encoded[4];
+                uint8_t* end = WireFormatLite::WriteUInt32ToArray(GravityDataProductPB::kCompressionFieldNumber,
+                                                                  GravityCompressionTypes::NONE, encoded);
+                trailer.append((const char*)encoded, end - encoded);
+            }
+        }
+    }
+    lock.Unlock();
+    return ret;
+}
 
-GravityDataProduct::GravityDataProduct(string dataProductID) : gravityDataProductPB(new GravityDataProductPB())
+std::shared_ptr<const google::protobuf::Message> GravityDataProduct::WireView::getParsedData()
+{
+    lock.Lock();
+    std::shared_ptr<const google::protobuf::Message> ret = parsedData;
+    lock.Unlock();
+    return ret;
+}
+
+void GravityDataProduct::WireView::setParsedData(std::shared_ptr<const google::protobuf::Message> data)
+{
+    lock.Lock();
+    parsedData = data;
+    lock.Unlock();
+}
+
+GravityDataProduct::GravityDataProduct(string dataProductID) : gravityDataProductPB(new GravityDataProductPB()), ownedDataSize(0)
 {
     gravityDataProductPB->set_dataproductid(dataProductID);
 }
 
-GravityDataProduct::GravityDataProduct(const void* arrayPtr, int size) : gravityDataProductPB(new GravityDataProductPB())
+GravityDataProduct::GravityDataProduct(const void* arrayPtr, int size) : gravityDataProductPB(new GravityDataProductPB()), ownedDataSize(0)
 {
     gravityDataProductPB->ParseFromArray(arrayPtr, size);
 }
 
+GravityDataProduct::GravityDataProduct(std::shared_ptr<const void> buffer, const void* arrayPtr, int size,
+                                       std::shared_ptr<google::protobuf::Arena> arena)
+    : wireView(new WireView(buffer, (const char*)arrayPtr, size, std::shared_ptr<const void>(), NULL, 0, arena)), ownedDataSize(0)
+{}
+
+GravityDataProduct::GravityDataProduct(std::shared_ptr<const void> envelopeBuffer, const void* envelopePtr, int envelopeSize,
+                                       std::shared_ptr<const void> dataBuffer, const void* dataPtr, uint64_t dataSize,
+                                       std::shared_ptr<google::protobuf::Arena> arena)
+    : wireView(new WireView(envelopeBuffer, (const char*)envelopePtr, envelopeSize, dataBuffer, (const char*)dataPtr, dataSize, arena)),
+      ownedDataSize(0)
+{}
+
 GravityDataProduct::~GravityDataProduct() {}
 
+GravityDataProductPB& GravityDataProduct::message() const
+{
+    if (wireView)
+        return wireView->parse();
+    return *gravityDataProductPB;
+}
+
+const GravityDataProduct::WireView* GravityDataProduct::unparsed() const
+{
+    if (!wireView || !wireView->valid || wireView->parsed())
+        return NULL;
+    return wireView.get();
+}
+
+void GravityDataProduct::releaseOwnedData()
+{
+    ownedData.reset();
+    ownedDataSize = 0;
+}
+
 std::string GravityDataProduct::getDataProductID() const
 {
-    return gravityDataProductPB->dataproductid();
+    const WireView* view = unparsed();
+    if (view)
+        return string(view->dataProductID, view->dataProductIDSize);
+    return message().dataproductid();
 }
 
 void GravityDataProduct::setSoftwareVersion(string softwareVersion)
 {
-    gravityDataProductPB->set_softwareversion(softwareVersion);
+    message().set_softwareversion(softwareVersion);
 }
 
 std::string GravityDataProduct::getSoftwareVersion() const
 {
-    return gravityDataProductPB->softwareversion();
+    return message().softwareversion();
 }
 
 uint64_t GravityDataProduct::getReceivedTimestamp() const
 {
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return view->receivedTimestamp;
+	}
+
 	uint64_t receivedTimestamp = 0;
-	if (gravityDataProductPB->has_received_timestamp())
+	if (message().has_received_timestamp())
 	{
-		receivedTimestamp = gravityDataProductPB->received_timestamp();
+		receivedTimestamp = message().received_timestamp();
 	}
     return receivedTimestamp;
 }
 
+void GravityDataProduct::setReceivedTimestamp(uint64_t ts) const
+{
+    if (!wireView || !wireView->stamp(GravityDataProductPB::kReceivedTimestampFieldNumber, ts))
+        message().set_received_timestamp(ts);
+}
+
 uint64_t GravityDataProduct::getGravityTimestamp() const
 {
-    return gravityDataProductPB->timestamp();
+    const WireView* view = unparsed();
+    if (view)
+        return view->timestamp;
+    return message().timestamp();
 }
 
 void GravityDataProduct::setData(const void* data, int size)
 {
-    delete gravityDataProductPB->release_data(); //Looking at the protobuf, this seems necessary.
-    gravityDataProductPB->set_data(data, size);
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    releaseOwnedData();
+    delete message().release_data(); //Looking at the protobuf, this seems necessary.
+    message().set_data(data, size);
+}
+
+void GravityDataProduct::setData64(const void* data, uint64_t size)
+{
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    releaseOwnedData();
+    delete message().release_data();
+    message().set_data(data, size);
+}
+
+void GravityDataProduct::setData(std::unique_ptr<uint8_t[]> data, size_t size)
+{
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    delete message().release_data();
+    ownedData.reset(data.release(), std::default_delete<uint8_t[]>());
+    ownedDataSize = size;
+}
+
+void GravityDataProduct::setData(std::vector<uint8_t>&& data)
+{
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    delete message().release_data();
+    std::shared_ptr<std::vector<uint8_t> > buffer(new std::vector<uint8_t>(std::move(data)));
+    ownedData = std::shared_ptr<const uint8_t>(buffer, buffer->data());
+    ownedDataSize = buffer->size();
 }
 
 void GravityDataProduct::setData(const google::protobuf::Message& data)
 {
-    char* vdata = (char*)malloc(data.ByteSize());
-    data.SerializeToArray(vdata, data.ByteSize());
-    delete gravityDataProductPB->release_data(); //Looking at the protobuf, this seems necessary.
-    gravityDataProductPB->set_data(vdata, data.ByteSize());
-    free(vdata);
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    releaseOwnedData();
+
+    // Serialize directly into the data field
+    size_t size = data.ByteSizeLong();
+    std::string* buffer = message().mutable_data();
+    buffer->resize(size);
+    if (size > 0)
+        data.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(&(*buffer)[0]));
     // Also implicitly set the message protocol and data_type.
-    gravityDataProductPB->set_protocol("protobuf2");
-    gravityDataProductPB->set_type_name(data.GetTypeName());
+    message().set_protocol("protobuf2");
+    message().set_type_name(data.GetTypeName());
 }
 
 bool GravityDataProduct::getData(void* data, int size) const
 {
-    memcpy(data, gravityDataProductPB->data().c_str(), size);
+    memcpy(data, getDataPointer(), size);
 
     return true;
 }
 
 int GravityDataProduct::getDataSize() const
 {
-    return gravityDataProductPB->data().length();
+    uint64_t size = getDataSize64();
+    return size > INT_MAX ? INT_MAX : (int)size;
+}
+
+uint64_t GravityDataProduct::getDataSize64() const
+{
+    if (ownedData)
+        return ownedDataSize;
+    const WireView* view = unparsed();
+    if (view)
+        return view->dataSize;
+    return message().data().length();
+}
+
+const char* GravityDataProduct::getDataPointer() const
+{
+    if (ownedData)
+        return (const char*)ownedData.get();
+    const WireView* view = unparsed();
+    if (view)
+        return view->data;
+    return message().data().c_str();
 }
 
 bool GravityDataProduct::populateMessage(google::protobuf::Message& data) const
 {
-    return data.ParseFromArray((void*)gravityDataProductPB->data().c_str(), getDataSize());
+    return data.ParseFromArray(getDataPointer(), getDataSize());
+}
+
+bool GravityDataProduct::decompress(uint64_t sizeLimit)
+{
+    if (wireView)
+        return wireView->decompress(sizeLimit);
+
+    GravityDataProductPB& pb = message();
+    if (pb.compression() == GravityCompressionTypes::NONE)
+        return true;
+    if (pb.uncompressed_size() > INT_MAX || pb.uncompressed_size() > sizeLimit)
+        return false;
+    std::string data(pb.uncompressed_size(), '\0');
+    if (!decompressData((GravityCompressionType)pb.compression(), pb.data().data(), pb.data().size(), &data[0], data.size()))
+        return false;
+    pb.mutable_data()->swap(data);
+    pb.clear_compression();
+    pb.clear_uncompressed_size();
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    return true;
+}
+
+bool GravityDataProduct::getChunkInfo(uint64_t& offset, uint64_t& totalSize) const
+{
+    const WireView* view = unparsed();
+    if (view)
+    {
+        offset = view->chunkOffset;
+        totalSize = view->totalSize;
+    }
+    else
+    {
+        offset = message().chunk_offset();
+        totalSize = message().total_size();
+    }
+    return totalSize > 0;
+}
+
+std::shared_ptr<const google::protobuf::Message> GravityDataProduct::getCachedData() const
+{
+    if (wireView)
+        return wireView->getParsedData();
+    return std::shared_ptr<const google::protobuf::Message>();
+}
+
+void GravityDataProduct::setCachedData(std::shared_ptr<const google::protobuf::Message> data) const
+{
+    if (wireView)
+        wireView->setParsedData(data);
 }
 
 int GravityDataProduct::getSize() const
 {
-    return gravityDataProductPB->ByteSize();
+    if (unparsed())
+        return wireView->getSize();
+    if (ownedData)
+        return message().ByteSize() + 1 + CodedOutputStream::VarintSize64(ownedDataSize) + ownedDataSize;
+    return message().ByteSize();
 }
 
 void GravityDataProduct::parseFromArray(const void* arrayPtr, int size)
 {
-    gravityDataProductPB->ParseFromArray(arrayPtr, size);
+    setCachedData(std::shared_ptr<const google::protobuf::Message>());
+    releaseOwnedData();
+    message().ParseFromArray(arrayPtr, size);
 }
 
 bool GravityDataProduct::serializeToArray(void* arrayPtr) const
 {
-    return gravityDataProductPB->SerializeToArray(arrayPtr, gravityDataProductPB->ByteSize());
+    if (unparsed())
+    {
+        wireView->serialize((char*)arrayPtr);
+        return true;
+    }
+    if (ownedData)
+    {
+        // The data isn't in the message, so it follows the rest of the fields
+        int size = message().ByteSize();
+        if (!message().SerializeToArray(arrayPtr, size))
+            return false;
+        uint8_t* target = WireFormatLite::WriteTagToArray(GravityDataProductPB::kDataFieldNumber,
+                                                          WireFormatLite::WIRETYPE_LENGTH_DELIMITED, (uint8_t*)arrayPtr + size);
+        target = CodedOutputStream::WriteVarint64ToArray(ownedDataSize, target);
+        memcpy(target, ownedData.get(), ownedDataSize);
+        return true;
+    }
+    return message().SerializeToArray(arrayPtr, message().ByteSize());
+}
+
+void GravityDataProduct::serializeEnvelope(std::string& envelope) const
+{
+    if (unparsed())
+    {
+        wireView->serializeEnvelope(envelope);
+        return;
+    }
+
+    // Temporarily move the data out of the message rather than copying the message without it
+    GravityDataProductPB& pb = message();
+    if (!pb.has_data())
+    {
+        pb.SerializeToString(&envelope);
+        return;
+    }
+    std::string data;
+    pb.mutable_data()->swap(data);
+    pb.clear_data();
+    pb.SerializeToString(&envelope);
+    pb.mutable_data()->swap(data);
 }
 
 bool GravityDataProduct::operator==(const GravityDataProduct &gdp) const
 {
     // fastest test first...
-    if (getDataSize() != gdp.getDataSize())
+    if (getDataSize64() != gdp.getDataSize64())
         return false;
     if (getDataProductID().compare(gdp.getDataProductID()) != 0)
         return false;
-    return memcmp(gravityDataProductPB->data().c_str(), gdp.gravityDataProductPB->data().c_str(), getDataSize()) == 0;
+    return memcmp(getDataPointer(), gdp.getDataPointer(), getDataSize64()) == 0;
 }
-
 bool GravityDataProduct::operator!=(const GravityDataProduct &gdp) const
 {
   return !operator==(gdp);
@@ -138,66 +686,143 @@ bool GravityDataProduct::operator!=(const GravityDataProduct &gdp) const
 
 std::string GravityDataProduct::getComponentId() const
 {
-	return gravityDataProductPB->componentid();
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return string(view->componentID, view->componentIDSize);
+	}
+	return message().componentid();
 }
 
 std::string GravityDataProduct::getDomain() const
 {
-	return gravityDataProductPB->domain();
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return string(view->domain, view->domainSize);
+	}
+	return message().domain();
 }
 
 bool GravityDataProduct::isFutureResponse() const
 {
-	return gravityDataProductPB->future_response();
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return view->futureResponse;
+	}
+	return message().future_response();
 }
 
 bool GravityDataProduct::isCachedDataproduct() const
 {
-	return(gravityDataProductPB->has_is_cached_dataproduct() && gravityDataProductPB->is_cached_dataproduct());	
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return view->cached;
+	}
+	return(message().has_is_cached_dataproduct() && message().is_cached_dataproduct());	
 }
 
 void GravityDataProduct::setIsCachedDataproduct(bool cached)
 {
-	gravityDataProductPB->set_is_cached_dataproduct(cached);
-	
+	if (!wireView || !wireView->stamp(GravityDataProductPB::kIsCachedDataproductFieldNumber, cached))
+	{
+		message().set_is_cached_dataproduct(cached);
+	}
 }
+
 std::string GravityDataProduct::getFutureSocketUrl() const
 {
-	return gravityDataProductPB->future_socket_url();
+	return message().future_socket_url();
 }
 
 bool GravityDataProduct::isRelayedDataproduct() const
 {
-	return(gravityDataProductPB->has_is_relayed_dataproduct() && gravityDataProductPB->is_relayed_dataproduct());
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return view->relayed;
+	}
+	return(message().has_is_relayed_dataproduct() && message().is_relayed_dataproduct());
 }
 
 void GravityDataProduct::setIsRelayedDataproduct(bool relayed)
 {
-	gravityDataProductPB->set_is_relayed_dataproduct(relayed);
+	if (!wireView || !wireView->stamp(GravityDataProductPB::kIsRelayedDataproductFieldNumber, relayed))
+	{
+		message().set_is_relayed_dataproduct(relayed);
+	}
 }
 
 void GravityDataProduct::setProtocol(const std::string& protocol) {
-	gravityDataProductPB->set_protocol(protocol);
+	message().set_protocol(protocol);
 }
 
 const std::string& GravityDataProduct::getProtocol() const {
-	return gravityDataProductPB->protocol();
+	return message().protocol();
 }
 
 void GravityDataProduct::setTypeName(const std::string& dataType) {
-	gravityDataProductPB->set_type_name(dataType);
+	message().set_type_name(dataType);
 }
 
 const std::string& GravityDataProduct::getTypeName() const {
-	return gravityDataProductPB->type_name();
+	return message().type_name();
+}
+
+uint64_t GravityDataProduct::getSequenceNumber() const
+{
+    const WireView* view = unparsed();
+    if (view)
+        return view->sequenceNumber;
+    return message().sequence_number();
+}
+
+uint64_t GravityDataProduct::getTimeToLive() const
+{
+    const WireView* view = unparsed();
+    if (view)
+        return view->timeToLive;
+    return message().time_to_live();
+}
+
+bool GravityDataProduct::isReliable() const
+{
+    const WireView* view = unparsed();
+    if (view)
+        return view->sequenceNumber > 0 && !view->unreliable;
+    return message().sequence_number() > 0 && !message().unreliable();
+}
+
+bool GravityDataProduct::isMonitored() const
+{
+    const WireView* view = unparsed();
+    if (view)
+        return view->monitored;
+    return message().monitored();
+}
+
+bool GravityDataProduct::isExpired(uint64_t currentTime, uint64_t timeToLive) const
+{
+    uint64_t publisherTimeToLive = getTimeToLive();
+    if (publisherTimeToLive > 0 && (timeToLive == 0 || publisherTimeToLive < timeToLive))
+        timeToLive = publisherTimeToLive;
+    return timeToLive > 0 && currentTime > getGravityTimestamp() + timeToLive;
 }
 
 uint32_t GravityDataProduct::getRegistrationTime() const
 {
+	const WireView* view = unparsed();
+	if (view)
+	{
+		return view->registrationTime;
+	}
+
 	uint64_t registrationTime = 0;
-	if (gravityDataProductPB->has_registration_time())
+	if (message().has_registration_time())
 	{
-		registrationTime = gravityDataProductPB->registration_time();
+		registrationTime = message().registration_time();
 	}
 	return registrationTime;
 }
@@ -31,13 +31,20 @@
 // #else
 #include <memory>
 // #endif
+#include <vector>
 #include "protobuf/GravityDataProductPB.pb.h"
 #include "Utility.h"
 
+struct zmq_msg_t;
+
 namespace gravity
 {
 
 class GravityNode;
+class GravityDataProduct;
+GRAVITY_API int sendGravityDataProductFrames(void* socket, const GravityDataProduct& dataProduct, int flags);
+GRAVITY_API void initGravityDataProductMessages(const GravityDataProduct& dataProduct, zmq_msg_t* envelope, zmq_msg_t* data);
+static const uint64_t DEFAULT_DECOMPRESS_LIMIT = 1024 * 1024 * 1024; ///< Same as the default ChunkReassemblyLimitMB
 
 /**
  * Generic Data Product for the Gravity Infrastructure
@@ -49,12 +56,87 @@ protected:
     friend class GravityNode;
     friend class GravityMetricsManager;
 	friend class GravityServiceManager;
+	friend class GravitySubscriptionManager;
     friend void* Heartbeat(void*);
+    friend int sendGravityDataProductFrames(void* socket, const GravityDataProduct& dataProduct, int flags);
+    friend void initGravityDataProductMessages(const GravityDataProduct& dataProduct, zmq_msg_t* envelope, zmq_msg_t* data);
+
+    /**
+     * Constructor that wraps a serialized GravityDataProduct without copying or parsing it (used on the
+     * subscription receive path).  Envelope fields and the data are read directly from the wrapped bytes;
+     * the protobuf representation is only built if it is needed.
+     * \param buffer owner of the serialized bytes, held for as long as this data product references them
+     * \param arrayPtr pointer to the serialized GravityDataProduct within buffer
+     * \param size size of serialized data
+     * \param arena arena from which to allocate the protobuf representation (may be empty)
+     */
+    GravityDataProduct(std::shared_ptr<const void> buffer, const void* arrayPtr, int size,
+                       std::shared_ptr<google::protobuf::Arena> arena);
+
+    /**
+     * Constructor that wraps a GravityDataProduct received as separate envelope and data buffers (wire format
+     * version 2) without copying or parsing either of them.
+     * \param envelopeBuffer owner of the serialized envelope (every field but the data)
+     * \param envelopePtr pointer to the serialized envelope within envelopeBuffer
+     * \param envelopeSize size of the serialized envelope
+     * \param dataBuffer owner of the application data
+     * \param dataPtr pointer to the application data within dataBuffer
+     * \param dataSize size of the application data
+     * \param arena arena from which to allocate the protobuf representation (may be empty)
+     */
+    GravityDataProduct(std::shared_ptr<const void> envelopeBuffer, const void* envelopePtr, int envelopeSize,
+                       std::shared_ptr<const void> dataBuffer, const void* dataPtr, uint64_t dataSize,
+                       std::shared_ptr<google::protobuf::Arena> arena);
+
+    /**
+     * Serialize every field of this data product except the application data (the envelope of wire format version 2).
+     * \param envelope string to receive the serialized envelope
+     */
+    void serializeEnvelope(std::string& envelope) const;
+
+    /**
+     * Access the protobuf representation, building it first if this data product still wraps serialized bytes.
+     */
+    GRAVITY_API GravityDataProductPB& message() const;
+
+    /**
+     * Decompress the data if it was compressed when published (done once, as the data product is received).
+     * \param sizeLimit most bytes the data may decompress to.  The size is read from the data product itself, so
+     *        this keeps a corrupt one from asking for an arbitrarily large buffer.
+     * \return success flag (false if the data could not be decompressed, or would be larger than sizeLimit)
+     */
+    GRAVITY_API bool decompress(uint64_t sizeLimit = DEFAULT_DECOMPRESS_LIMIT);
+
+    /**
+     * Get where the data of this data product lies within the whole, if it is a chunk of data that was published in chunks.
+     * \param offset set to the offset of this data product's data within the whole
+     * \param totalSize set to the size of the whole data (0 if this isn't a chunk)
+     * \return true if this data product is a chunk
+     */
+    GRAVITY_API bool getChunkInfo(uint64_t& offset, uint64_t& totalSize) const;
+
+    /**
+     * Get the parsed data kept by getParsedData (empty if there is none).
+     */
+    GRAVITY_API std::shared_ptr<const google::protobuf::Message> getCachedData() const;
+
+    /**
+     * Keep parsed data for getParsedData (only received data products keep it, until their data is set).
+     */
+    GRAVITY_API void setCachedData(std::shared_ptr<const google::protobuf::Message> data) const;
+
+private:
+    class WireView;
+    std::shared_ptr<WireView> wireView; ///< serialized form of a received data product that has not yet been parsed
+    std::shared_ptr<const uint8_t> ownedData; ///< data handed over with setData(std::unique_ptr...), kept out of the protobuf
+    uint64_t ownedDataSize; ///< size of ownedData
+    const WireView* unparsed() const;
+    void releaseOwnedData();
 public:
     /**
      * Default Constructor
      */
-    GRAVITY_API GravityDataProduct() {}
+    GRAVITY_API GravityDataProduct() : ownedDataSize(0) {}
 
     /**
      * Constructor
@@ -115,6 +197,29 @@ public:
      */
     GRAVITY_API void setData(const void* data, int size);
 
+    /**
+     * Set the application-specific data for this data product, when it may be larger than 2GB
+     * \param data pointer to arbitrary data
+     * \param size length of data
+     */
+    GRAVITY_API void setData64(const void* data, uint64_t size);
+
+    /**
+     * Set the application-specific data for this data product, taking ownership of the buffer holding it rather
+     * than copying it.  When the data product is published the buffer is handed to ZeroMQ as is, and freed once it
+     * has been sent and this data product (and any copy of it) no longer refers to it.
+     * \param data buffer holding the data
+     * \param size length of data
+     */
+    GRAVITY_API void setData(std::unique_ptr<uint8_t[]> data, size_t size);
+
+    /**
+     * Set the application-specific data for this data product, taking ownership of the vector holding it rather
+     * than copying it (see setData(std::unique_ptr<uint8_t[]>, size_t)).
+     * \param data vector holding the data
+     */
+    GRAVITY_API void setData(std::vector<uint8_t>&& data);
+
     /**
      * Set the application-specific data for this data product
      * \param data A Google Protocol Buffer Message object containing the data
@@ -131,10 +236,23 @@ public:
 
     /**
      * Get the size of the data contained within this data product
-     * \return size in bytes of contained data
+     * \return size in bytes of contained data (at most INT_MAX, see getDataSize64)
      */
     GRAVITY_API int getDataSize() const;
 
+    /**
+     * Get the size of the data contained within this data product, when it may be larger than 2GB
+     * \return size in bytes of contained data
+     */
+    GRAVITY_API uint64_t getDataSize64() const;
+
+    /**
+     * Get read-only access to the data contained within this data product without copying it.  For a
+     * received data product this points directly into the received message buffer.
+     * \return pointer to the contained data, valid for the lifetime of this data product (or until it is modified)
+     */
+    GRAVITY_API const char* getDataPointer() const;
+
     /**
      * Populate a protobuf object with the data contained in this data product
      * \param data Google Protocol Buffer Message object to populate
@@ -142,6 +260,25 @@ public:
      */
     GRAVITY_API bool populateMessage(google::protobuf::Message& data) const;
 
+    /**
+     * Get the data contained in this data product parsed as a protobuf message.  For received data products the
+     * parsed message is kept, so that every subscriber to the data product shares the result of a single parse.
+     * \return the parsed message, or an empty pointer if the data could not be parsed as a T
+     */
+    template<typename T>
+    std::shared_ptr<const T> getParsedData() const
+    {
+        std::shared_ptr<const google::protobuf::Message> cached = getCachedData();
+        if (cached && cached->GetDescriptor() == T::descriptor())
+            return std::static_pointer_cast<const T>(cached);
+
+        std::shared_ptr<T> data(new T());
+        if (!populateMessage(*data))
+            return std::shared_ptr<const T>();
+        setCachedData(data);
+        return data;
+    }
+
     /**
      * Get the size for this message
      * \return size in bytes for this data product
@@ -215,25 +352,25 @@ public:
      * Set the timestamp on this GravityDataProduct (typically set by infrastructure at publish)
      * \param ts Timestamp (epoch microseconds) for this GravityDataProduct
      */
-    GRAVITY_API void setTimestamp(uint64_t ts) const { gravityDataProductPB->set_timestamp(ts); }
+    GRAVITY_API void setTimestamp(uint64_t ts) const { message().set_timestamp(ts); }
 
 	/**
      * Set the received timestamp on this GravityDataProduct (typically set by infrastructure on receipt)
      * \param ts Received timestamp (epoch microseconds) for this GravityDataProduct
      */
-    GRAVITY_API void setReceivedTimestamp(uint64_t ts) const { gravityDataProductPB->set_received_timestamp(ts); }
+    GRAVITY_API void setReceivedTimestamp(uint64_t ts) const;
 
     /**
      * Set the component id on this GravityDataProduct (typically set by infrastructure at publish)
      * \param componentId ID of the component that produces this GravityDataProduct
      */
-	GRAVITY_API void setComponentId(std::string componentId) const { gravityDataProductPB->set_componentid(componentId);}
+	GRAVITY_API void setComponentId(std::string componentId) const { message().set_componentid(componentId);}
 
     /**
      * Set the domain on this GravityDataProduct (typically set by infrastructure at publish)
      * \param domain name of the domain on which this GravityDataProduct is produced
      */
-	GRAVITY_API void setDomain(std::string domain) const { gravityDataProductPB->set_domain(domain);}
+	GRAVITY_API void setDomain(std::string domain) const { message().set_domain(domain);}
 
 	/**
 	 * Get the flag indicating if this message has been relayed by a Relay component
@@ -276,7 +413,45 @@ public:
 	* Set the registration time on this GravityDataProduct (typically set by infrastructure when created)
 	* \param ts Registration time (epoch seconds) for this GravityDataProduct
 	*/
-	GRAVITY_API void setRegistrationTime(uint32_t ts) const { gravityDataProductPB->set_registration_time(ts); }
+	GRAVITY_API void setRegistrationTime(uint32_t ts) const { message().set_registration_time(ts); }
+
+	/**
+	 * Get the position of this data product among those published with the same filter text, counting from 1.  Only
+	 * reliable publications (see GravityPublicationOptions::reliable) and those that monitor their subscribers (see
+	 * GravityPublicationOptions::maxSubscriberLag) number their data products, and subscribers receive those of a
+	 * reliable publication they missed late, after later ones, so this tells them apart.
+	 * \return sequence number (0 if not set)
+	 */
+	GRAVITY_API uint64_t getSequenceNumber() const;
+
+	/**
+	 * Check whether this data product was published by a reliable publication, which sends data products again to
+	 * subscribers that missed them (see GravityPublicationOptions::reliable)
+	 */
+	GRAVITY_API bool isReliable() const;
+
+	/**
+	 * Check whether this data product was published by a publication that monitors its subscribers, which report to it
+	 * how far behind they are (see GravityPublicationOptions::maxSubscriberLag)
+	 */
+	GRAVITY_API bool isMonitored() const;
+
+	/**
+	 * Get the microseconds after its timestamp that this data product is no longer wanted, set by publications with a
+	 * time to live (see GravityPublicationOptions::timeToLive)
+	 * \return time to live (0 if not set)
+	 */
+	GRAVITY_API uint64_t getTimeToLive() const;
+
+	/**
+	 * Check whether this data product has outlived its time to live, or a shorter one, without parsing it.  Timestamps
+	 * are compared across hosts, so their clocks should be in sync.
+	 * \param currentTime current time (microseconds, see getCurrentTime)
+	 * \param timeToLive microseconds after its timestamp that the data product is wanted, if less than its own time to
+	 *                   live (0 to only use its own)
+	 * \return true if expired
+	 */
+	GRAVITY_API bool isExpired(uint64_t currentTime, uint64_t timeToLive = 0) const;
 };
 
 } /* namespace gravity */
@@ -0,0 +1,50 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityHandoffPolicy.h
+ *
+ */
+
+#ifndef GRAVITYHANDOFFPOLICY_H_
+#define GRAVITYHANDOFFPOLICY_H_
+
+namespace gravity
+{
+
+/**
+ * Namespace to hold Gravity Handoff Policies.
+ */
+namespace GravityHandoffPolicies
+{
+    /**
+     * What a publish does when as many publishes of its data product as its publication allows (see
+     * GravityPublicationOptions::handoffLimit) are already waiting to be published by the publishing thread.
+     */
+    enum Types
+    {
+        BLOCK = 0, ///< Wait for one of them to be published, failing with QUEUE_TIMEOUT after the handoff timeout (the default)
+        DROP_OLDEST = 1, ///< Drop the oldest of them rather than wait, so the latest data is published (once as many have
+                         ///< been dropped as may wait, this publish is dropped instead, failing with QUEUE_FULL)
+        REJECT = 2 ///< Drop this publish rather than wait, failing with QUEUE_FULL
+    };
+}
+typedef GravityHandoffPolicies::Types GravityHandoffPolicy;
+
+} /* namespace gravity */
+#endif /* GRAVITYHANDOFFPOLICY_H_ */
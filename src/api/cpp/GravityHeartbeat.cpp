@@ -256,7 +256,7 @@ void* Heartbeat(void* thread_context)
 	GravityDataProduct gdp(params->componentID);
 	gdp.setData((void*)"Good", 5);
 
-	void *heartbeatSocket = zmq_socket(params->zmq_context,ZMQ_PUB);
+	void *heartbeatSocket = zmq_socket(params->zmq_context,ZMQ_PUSH);
 	zmq_connect(heartbeatSocket,PUB_MGR_HB_URL);
 
 	Heartbeat::setHeartbeatRunning(true);
@@ -271,11 +271,7 @@ void* Heartbeat(void* thread_context)
 		sendStringMessage(heartbeatSocket, gdp.getDataProductID(), ZMQ_SNDMORE);
 		sendUint64Message(heartbeatSocket, gdp.getGravityTimestamp(), ZMQ_SNDMORE);
 		sendStringMessage(heartbeatSocket, "", ZMQ_SNDMORE);
-		zmq_msg_t msg;
-		zmq_msg_init_size(&msg, gdp.getSize());
-		gdp.serializeToArray(zmq_msg_data(&msg));
-		zmq_sendmsg(heartbeatSocket, &msg, ZMQ_DONTWAIT);
-		zmq_msg_close(&msg);
+		sendGravityDataProductFrames(heartbeatSocket, gdp, ZMQ_DONTWAIT);
 #ifdef WIN32
 		Sleep(params->interval_in_microseconds/1000);
 #else
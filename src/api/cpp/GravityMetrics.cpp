@@ -51,6 +51,55 @@ void GravityMetrics::incrementByteCount(string dataProductID, int count)
     metrics[dataProductID].byteCount += count;
 }
 
+void GravityMetrics::incrementGapCount(string dataProductID, int count)
+{
+    metrics[dataProductID].gapCount += count;
+}
+
+void GravityMetrics::incrementRetransmitCount(string dataProductID, int count)
+{
+    metrics[dataProductID].retransmitCount += count;
+}
+
+void GravityMetrics::incrementLostCount(string dataProductID, int count)
+{
+    metrics[dataProductID].lostCount += count;
+}
+
+void GravityMetrics::incrementExpiredCount(string dataProductID, int count)
+{
+    metrics[dataProductID].expiredCount += count;
+}
+
+void GravityMetrics::incrementSlowSubscriberCount(string dataProductID, int count)
+{
+    metrics[dataProductID].slowSubscriberCount += count;
+}
+
+void GravityMetrics::incrementSubscriberDropCount(string dataProductID, int count)
+{
+    metrics[dataProductID].subscriberDropCount += count;
+}
+
+void GravityMetrics::updateMaxSubscriberLag(string dataProductID, int lag)
+{
+    MetricsSample& sample = metrics[dataProductID];
+    if (lag > sample.maxSubscriberLag)
+    {
+        sample.maxSubscriberLag = lag;
+    }
+}
+
+void GravityMetrics::incrementHandoffDropCount(string dataProductID, int count)
+{
+    metrics[dataProductID].handoffDropCount += count;
+}
+
+void GravityMetrics::incrementHandoffBlockedTime(string dataProductID, uint64_t time)
+{
+    metrics[dataProductID].handoffBlockedTime += time;
+}
+
 void GravityMetrics::reset()
 {
     map<string, MetricsSample>::iterator it;
@@ -58,6 +107,15 @@ void GravityMetrics::reset()
     {
         it->second.messageCount = 0;
         it->second.byteCount = 0;
+        it->second.gapCount = 0;
+        it->second.retransmitCount = 0;
+        it->second.lostCount = 0;
+        it->second.expiredCount = 0;
+        it->second.slowSubscriberCount = 0;
+        it->second.subscriberDropCount = 0;
+        it->second.maxSubscriberLag = 0;
+        it->second.handoffDropCount = 0;
+        it->second.handoffBlockedTime = 0;
     }
     startTime = gravity::getCurrentTime();
     endTime = 0;
@@ -95,6 +153,96 @@ int GravityMetrics::getByteCount(string dataProductID)
     return count;
 }
 
+int GravityMetrics::getGapCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].gapCount;
+    }
+    return count;
+}
+
+int GravityMetrics::getRetransmitCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].retransmitCount;
+    }
+    return count;
+}
+
+int GravityMetrics::getLostCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].lostCount;
+    }
+    return count;
+}
+
+int GravityMetrics::getExpiredCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].expiredCount;
+    }
+    return count;
+}
+
+int GravityMetrics::getSlowSubscriberCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].slowSubscriberCount;
+    }
+    return count;
+}
+
+int GravityMetrics::getSubscriberDropCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].subscriberDropCount;
+    }
+    return count;
+}
+
+int GravityMetrics::getMaxSubscriberLag(string dataProductID)
+{
+    int lag = -1;
+    if (metrics.count(dataProductID))
+    {
+        lag = metrics[dataProductID].maxSubscriberLag;
+    }
+    return lag;
+}
+
+int GravityMetrics::getHandoffDropCount(string dataProductID)
+{
+    int count = -1;
+    if (metrics.count(dataProductID))
+    {
+        count = metrics[dataProductID].handoffDropCount;
+    }
+    return count;
+}
+
+uint64_t GravityMetrics::getHandoffBlockedTime(string dataProductID)
+{
+    uint64_t time = 0;
+    if (metrics.count(dataProductID))
+    {
+        time = metrics[dataProductID].handoffBlockedTime;
+    }
+    return time;
+}
+
 uint64_t GravityMetrics::getStartTime()
 {
     return startTime;
@@ -136,6 +284,15 @@ void GravityMetrics::sendAsMessage(void* socket)
             sendStringMessage(socket, it->first, ZMQ_SNDMORE);
             sendIntMessage(socket, it->second.messageCount, ZMQ_SNDMORE);
             sendIntMessage(socket, it->second.byteCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.gapCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.retransmitCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.lostCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.expiredCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.slowSubscriberCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.subscriberDropCount, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.maxSubscriberLag, ZMQ_SNDMORE);
+            sendIntMessage(socket, it->second.handoffDropCount, ZMQ_SNDMORE);
+            sendUint64Message(socket, it->second.handoffBlockedTime, ZMQ_SNDMORE);
         }
 	sendUint64Message(socket, startTime, ZMQ_SNDMORE);
 	sendUint64Message(socket, endTime, ZMQ_DONTWAIT);
@@ -153,6 +310,15 @@ void GravityMetrics::populateFromMessage(void* socket)
             std::string dataProductID = readStringMessage(socket);
             metrics[dataProductID].messageCount = readIntMessage(socket);
             metrics[dataProductID].byteCount = readIntMessage(socket);
+            metrics[dataProductID].gapCount = readIntMessage(socket);
+            metrics[dataProductID].retransmitCount = readIntMessage(socket);
+            metrics[dataProductID].lostCount = readIntMessage(socket);
+            metrics[dataProductID].expiredCount = readIntMessage(socket);
+            metrics[dataProductID].slowSubscriberCount = readIntMessage(socket);
+            metrics[dataProductID].subscriberDropCount = readIntMessage(socket);
+            metrics[dataProductID].maxSubscriberLag = readIntMessage(socket);
+            metrics[dataProductID].handoffDropCount = readIntMessage(socket);
+            metrics[dataProductID].handoffBlockedTime = readUint64Message(socket);
         }
         startTime = readUint64Message(socket);
         endTime = readUint64Message(socket);
@@ -45,6 +45,15 @@ private:
     {
         int messageCount;
         int byteCount;
+        int gapCount;
+        int retransmitCount;
+        int lostCount;
+        int expiredCount;
+        int slowSubscriberCount;
+        int subscriberDropCount;
+        int maxSubscriberLag;
+        int handoffDropCount;
+        uint64_t handoffBlockedTime;
     } MetricsSample;
 
     std::map<std::string, MetricsSample> metrics;
@@ -82,6 +91,70 @@ public:
      */
     GRAVITY_API void incrementByteCount(std::string dataProductID, int count);
 
+    /**
+     * Increment the count of data products of a reliable publication found missing for the given data product ID.
+     * \param dataProductID data product ID for which the gap count is to be incremented
+     * \param count amount by which to increment the gap count
+     */
+    GRAVITY_API void incrementGapCount(std::string dataProductID, int count);
+
+    /**
+     * Increment the count of data products sent again (by a publisher) or received again (by a subscriber) for the
+     * given data product ID.
+     * \param dataProductID data product ID for which the retransmit count is to be incremented
+     * \param count amount by which to increment the retransmit count
+     */
+    GRAVITY_API void incrementRetransmitCount(std::string dataProductID, int count);
+
+    /**
+     * Increment the count of data products missed that couldn't be received again for the given data product ID.
+     * \param dataProductID data product ID for which the lost count is to be incremented
+     * \param count amount by which to increment the lost count
+     */
+    GRAVITY_API void incrementLostCount(std::string dataProductID, int count);
+
+    /**
+     * Increment the count of data products dropped for outliving their time to live for the given data product ID.
+     * \param dataProductID data product ID for which the expired count is to be incremented
+     * \param count amount by which to increment the expired count
+     */
+    GRAVITY_API void incrementExpiredCount(std::string dataProductID, int count);
+
+    /**
+     * Increment the count of subscribers found to be slow for the given data product ID.
+     * \param dataProductID data product ID for which the slow subscriber count is to be incremented
+     * \param count amount by which to increment the slow subscriber count
+     */
+    GRAVITY_API void incrementSlowSubscriberCount(std::string dataProductID, int count);
+
+    /**
+     * Increment the count of data products subscribers reported missing for the given data product ID.
+     * \param dataProductID data product ID for which the subscriber drop count is to be incremented
+     * \param count amount by which to increment the subscriber drop count
+     */
+    GRAVITY_API void incrementSubscriberDropCount(std::string dataProductID, int count);
+
+    /**
+     * Raise the most milliseconds a subscriber reported falling behind for the given data product ID.
+     * \param dataProductID data product ID for which the subscriber lag is to be raised
+     * \param lag milliseconds reported, which only replaces a lesser lag
+     */
+    GRAVITY_API void updateMaxSubscriberLag(std::string dataProductID, int lag);
+
+    /**
+     * Increment the count of publishes dropped before reaching the publishing thread for the given data product ID.
+     * \param dataProductID data product ID for which the handoff drop count is to be incremented
+     * \param count amount by which to increment the handoff drop count
+     */
+    GRAVITY_API void incrementHandoffDropCount(std::string dataProductID, int count);
+
+    /**
+     * Increment the time publishes spent waiting to be handed to the publishing thread for the given data product ID.
+     * \param dataProductID data product ID for which the handoff blocked time is to be incremented
+     * \param time microseconds by which to increment the handoff blocked time
+     */
+    GRAVITY_API void incrementHandoffBlockedTime(std::string dataProductID, uint64_t time);
+
     /**
      * Reset the metrics. This will reset all counts to zero and set the startTime for each
      * sample to the current time but maintain list of data product IDs
@@ -113,6 +186,69 @@ public:
      */
     GRAVITY_API int getByteCount(std::string dataProductID);
 
+    /**
+     * Method to return the gap count for the given data product ID
+     * \param dataProductID data product ID for which gap count is returned
+     * \return gap count
+     */
+    GRAVITY_API int getGapCount(std::string dataProductID);
+
+    /**
+     * Method to return the retransmit count for the given data product ID
+     * \param dataProductID data product ID for which retransmit count is returned
+     * \return retransmit count
+     */
+    GRAVITY_API int getRetransmitCount(std::string dataProductID);
+
+    /**
+     * Method to return the lost count for the given data product ID
+     * \param dataProductID data product ID for which lost count is returned
+     * \return lost count
+     */
+    GRAVITY_API int getLostCount(std::string dataProductID);
+
+    /**
+     * Method to return the expired count for the given data product ID
+     * \param dataProductID data product ID for which expired count is returned
+     * \return expired count
+     */
+    GRAVITY_API int getExpiredCount(std::string dataProductID);
+
+    /**
+     * Method to return the slow subscriber count for the given data product ID
+     * \param dataProductID data product ID for which slow subscriber count is returned
+     * \return slow subscriber count
+     */
+    GRAVITY_API int getSlowSubscriberCount(std::string dataProductID);
+
+    /**
+     * Method to return the subscriber drop count for the given data product ID
+     * \param dataProductID data product ID for which subscriber drop count is returned
+     * \return subscriber drop count
+     */
+    GRAVITY_API int getSubscriberDropCount(std::string dataProductID);
+
+    /**
+     * Method to return the most milliseconds a subscriber reported falling behind for the given data product ID
+     * \param dataProductID data product ID for which the subscriber lag is returned
+     * \return subscriber lag
+     */
+    GRAVITY_API int getMaxSubscriberLag(std::string dataProductID);
+
+    /**
+     * Method to return the handoff drop count for the given data product ID
+     * \param dataProductID data product ID for which handoff drop count is returned
+     * \return handoff drop count
+     */
+    GRAVITY_API int getHandoffDropCount(std::string dataProductID);
+
+    /**
+     * Method to return the microseconds publishes waited to be handed off for the given data product ID
+     * \param dataProductID data product ID for which handoff blocked time is returned
+     * \return handoff blocked time (microseconds)
+     */
+    GRAVITY_API uint64_t getHandoffBlockedTime(std::string dataProductID);
+
     /**
      * Method to return the sample period start time
      * \return sample period start time (microsecond epoch time)
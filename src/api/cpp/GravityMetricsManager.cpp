@@ -28,6 +28,7 @@
 #include "CommUtil.h"
 #include "GravityMetricsUtil.h"
 #include "GravityMetrics.h"
+#include "GravityPublishManager.h"
 #include "zmq.h"
 #include <sstream>
 #include <iostream>
@@ -42,6 +43,7 @@ namespace gravity
         // This is the zmq context that is shared with the GravityNode. Must use
         // a shared context to establish an inproc socket.
         this->context = context;
+        registrationTime = 0;
     }
 
     GravityMetricsManager::~GravityMetricsManager() {}
@@ -56,14 +58,16 @@ namespace gravity
         zmq_connect(metricsControlSocket, GRAVITY_METRICS_CONTROL);
         zmq_setsockopt(metricsControlSocket, ZMQ_SUBSCRIBE, NULL, 0);
 
-        // Setup comms channel to request metrics from the GravityPublishManager
-        pubMetricsSocket = zmq_socket(context, ZMQ_REQ);
+        // Setup comms channel to request metrics from the GravityPublishManager (connected to any other publish
+        // threads when metrics are enabled)
+        void* pubMetricsSocket = zmq_socket(context, ZMQ_REQ);
         int ret = zmq_connect(pubMetricsSocket, GRAVITY_PUB_METRICS_REQ);
         while (ret == -1)
         {
             sleep(1000);
             ret = zmq_connect(pubMetricsSocket, GRAVITY_PUB_METRICS_REQ);
         }
+        pubMetricsSockets.push_back(pubMetricsSocket);
 
         // Setup comms channel to request metrics from the GravitySubscriptionManager
         subMetricsSocket = zmq_socket(context, ZMQ_REQ);
@@ -116,10 +120,24 @@ namespace gravity
 
                     componentID = readStringMessage(metricsControlSocket);
                     ipAddr = readStringMessage(metricsControlSocket);
+                    domain = readStringMessage(metricsControlSocket);
+                    registrationTime = readUint32Message(metricsControlSocket);
+
+                    int publishThreads = readIntMessage(metricsControlSocket);
+                    while ((int)pubMetricsSockets.size() < publishThreads)
+                    {
+                        void* socket = zmq_socket(context, ZMQ_REQ);
+                        zmq_connect(socket, GravityPublishManager::shardURL(GRAVITY_PUB_METRICS_REQ, pubMetricsSockets.size()).c_str());
+                        pubMetricsSockets.push_back(socket);
+                    }
 
                     // Send metrics enable message to the collectors
-                    sendStringMessage(pubMetricsSocket, command, ZMQ_DONTWAIT);
-                    string s = readStringMessage(pubMetricsSocket);
+                    string s;
+                    for (size_t i = 0; i < pubMetricsSockets.size(); i++)
+                    {
+                        sendStringMessage(pubMetricsSockets[i], command, ZMQ_DONTWAIT);
+                        s = readStringMessage(pubMetricsSockets[i]);
+                    }
                     sendStringMessage(subMetricsSocket, command, ZMQ_DONTWAIT);
                     s = readStringMessage(subMetricsSocket);
                 }
@@ -141,7 +159,11 @@ namespace gravity
             {
                 // Wait for samplePeriod seconds and make metrics request
                 gravity::sleep(samplePeriod * 1000);
-                collectMetrics(pubMetricsSocket, GravityMetricsPB::PUBLICATION);
+                // (each publish thread has the metrics of its own data products)
+                for (size_t i = 0; i < pubMetricsSockets.size(); i++)
+                {
+                    collectMetrics(pubMetricsSockets[i], GravityMetricsPB::PUBLICATION);
+                }
                 collectMetrics(subMetricsSocket, GravityMetricsPB::SUBSCRIPTION);
 
                 // If we've collected samplesPerPublish samples, publish metrics
@@ -156,7 +178,10 @@ namespace gravity
         // Clean up sockets
         zmq_close(metricsPubSocket);
         zmq_close(metricsControlSocket);
-        zmq_close(pubMetricsSocket);
+        for (size_t i = 0; i < pubMetricsSockets.size(); i++)
+        {
+            zmq_close(pubMetricsSockets[i]);
+        }
         zmq_close(subMetricsSocket);
     }
 
@@ -194,6 +219,15 @@ namespace gravity
             }
             gmPB.add_numbytes(metrics.getByteCount(dataProductID));
             gmPB.add_nummessages(metrics.getMessageCount(dataProductID));
+            gmPB.add_numgaps(metrics.getGapCount(dataProductID));
+            gmPB.add_numretransmits(metrics.getRetransmitCount(dataProductID));
+            gmPB.add_numlost(metrics.getLostCount(dataProductID));
+            gmPB.add_numexpired(metrics.getExpiredCount(dataProductID));
+            gmPB.add_numslowsubscribers(metrics.getSlowSubscriberCount(dataProductID));
+            gmPB.add_numsubscriberdrops(metrics.getSubscriberDropCount(dataProductID));
+            gmPB.add_maxsubscriberlag(metrics.getMaxSubscriberLag(dataProductID));
+            gmPB.add_numhandoffdrops(metrics.getHandoffDropCount(dataProductID));
+            gmPB.add_handoffblockedtime(metrics.getHandoffBlockedTime(dataProductID));
             gmPB.add_starttime(metrics.getStartTime());
             gmPB.add_endtime(metrics.getEndTime());
             metricsData[key] = gmPB;
@@ -215,14 +249,19 @@ namespace gravity
 
         GravityDataProduct gdp(GRAVITY_METRICS_DATA_PRODUCT_ID);
         gdp.setTimestamp(gravity::getCurrentTime());
+        gdp.setRegistrationTime(registrationTime);
+        gdp.setComponentId(componentID);
+        gdp.setDomain(domain);
         gdp.setData(metrics);
 
-        // Send publish command and empty filter
+        // Send the publish command as GravityNode does: data product ID, timestamp and empty filter
         sendStringMessage(metricsPubSocket, "publish", ZMQ_SNDMORE);
+        sendStringMessage(metricsPubSocket, GRAVITY_METRICS_DATA_PRODUCT_ID, ZMQ_SNDMORE);
+        sendUint64Message(metricsPubSocket, gdp.getGravityTimestamp(), ZMQ_SNDMORE);
         sendStringMessage(metricsPubSocket, "", ZMQ_SNDMORE);
 
         // Publish metrics
-        sendGravityDataProduct(metricsPubSocket, gdp, ZMQ_DONTWAIT);
+        sendGravityDataProductFrames(metricsPubSocket, gdp, ZMQ_DONTWAIT);
 
         // Clear metrics data for next round
         metricsData.clear();
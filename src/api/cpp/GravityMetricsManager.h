@@ -51,7 +51,7 @@ class GravityMetricsManager
 private:
 	void* context;
 	void* metricsControlSocket;
-	void* pubMetricsSocket;
+	std::vector<void*> pubMetricsSockets; ///< one for each of the GravityNode's publish threads
 	void* subMetricsSocket;
 	void* metricsPubSocket;
 	std::vector<zmq_pollitem_t> pollItems;
@@ -64,6 +64,8 @@ private:
 	int samplesPerPublish;
 	std::string componentID;
 	std::string ipAddr;
+	std::string domain;
+	uint32_t registrationTime; ///< of the metrics data product, which subscribers check it's published with
 	std::map<std::pair<std::string,GravityMetricsPB_MessageType>,  GravityMetricsPB> metricsData;
 
 	void collectMetrics(void* socket, GravityMetricsPB_MessageType type);
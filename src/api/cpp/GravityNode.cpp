@@ -42,11 +42,16 @@
 #include <sstream>
 #include <signal.h>
 #include <memory>
+#include <algorithm>
 #include <cmath>
+#include <string.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 
 #include "GravityMetricsUtil.h"
 #include "GravityMetricsManager.h"
 #include "GravitySubscriptionManager.h"
+#include "GravitySubscriptionDispatcher.h"
 #include "GravityPublishManager.h"
 #include "GravityRequestManager.h"
 #include "GravityServiceManager.h"
@@ -67,19 +72,19 @@
 
 #include "GravityNode.h" //Needs to be last on Windows so it is included after nb30.h for the DUPLICATE definition.
 
-static void* startSubscriptionManager(void* context)
+static void* startSubscriptionManager(void* context, std::shared_ptr<gravity::GravitySubscriptionDispatcher> dispatcher)
 {
 	// Create and start the GravitySubscriptionManager
-	gravity::GravitySubscriptionManager subManager(context);
+	gravity::GravitySubscriptionManager subManager(context, dispatcher);
 	subManager.start();
 
 	return NULL;
 }
 
-static void* startPublishManager(void* context)
+static void* startPublishManager(void* context, unsigned int shard, std::shared_ptr<gravity::CacheBudget> cacheBudget)
 {
-	// Create and start the GravitySubscriptionManager
-	gravity::GravityPublishManager pubManager(context);
+	// Create and start the GravityPublishManager
+	gravity::GravityPublishManager pubManager(context, shard, cacheBudget);
 	pubManager.start();
 
 	return NULL;
@@ -153,21 +158,27 @@ void* Heartbeat(void* thread_context);
 
 
 using namespace std;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
 
 GravityNode::GravityNodeDomainListener::GravityNodeDomainListener(void* context)
 {
 	this->context=context;
-	sock = 0;
+	sock = -1;
 	running = false;
 }
 
 GravityNode::GravityNodeDomainListener::~GravityNodeDomainListener()
 {
-	#ifdef _WIN32
-	closesocket(sock);
-	#else
-	close(sock);
-	#endif
+	// Only if start didn't already close it, since by now its descriptor may belong to someone else's socket
+	if (sock >= 0)
+	{
+		#ifdef _WIN32
+		closesocket(sock);
+		#else
+		close(sock);
+		#endif
+	}
 }
 
 void GravityNode::GravityNodeDomainListener::start()
@@ -346,6 +357,7 @@ void GravityNode::GravityNodeDomainListener::start()
 	#else
 	close(sock);
 	#endif
+	sock = -1;
 	zmq_close(gravityNodeSocket);
 	zmq_close(domainSocket);
 }
@@ -401,6 +413,9 @@ GravityNode::GravityNode()
 	logInitialized = false;
 	listenerEnabled=false;
 	heartbeatStarted=false;
+	lastPublishTimestamp = 0;
+	requestDropCount = 0;
+	requestBlockedTime = 0;
 
 	parser = NULL;
 }
@@ -422,6 +437,9 @@ GravityNode::GravityNode(std::string componentID)
 	initialized=false;
 	logInitialized=false;
 	heartbeatStarted=false;
+	lastPublishTimestamp = 0;
+	requestDropCount = 0;
+	requestBlockedTime = 0;
 
 	parser = NULL;
 
@@ -474,14 +492,14 @@ GravityNode::~GravityNode()
     zmq_close(requestManagerRepSWL.socket);
   }
 
-  if (publishManagerPublishSWL.socket)
+  for (size_t i = 0; i < publishManagerPublishSWLs.size(); i++)
   {
-    sendStringMessage(publishManagerPublishSWL.socket, "kill", ZMQ_DONTWAIT);
-    zmq_close(publishManagerPublishSWL.socket);
-  } 
-  if (publishManagerRequestSWL.socket)
+    sendStringMessage(publishManagerPublishSWLs[i]->socket, "kill", ZMQ_DONTWAIT);
+    zmq_close(publishManagerPublishSWLs[i]->socket);
+  }
+  for (size_t i = 0; i < publishManagerRequestSockets.size(); i++)
   {
-    zmq_close(publishManagerRequestSWL.socket);
+    zmq_close(publishManagerRequestSockets[i]);
   }
 
   if (serviceManagerSWL.socket)
@@ -521,6 +539,12 @@ GravityNode::~GravityNode()
   {
     subscriptionManagerThread.join();
   }
+
+  // and then for any subscribers being called from the dispatch threads
+  if (subscriptionDispatcher)
+  {
+    subscriptionDispatcher->stop();
+  }
 }
 
 GravityReturnCode GravityNode::init()
@@ -578,17 +602,40 @@ GravityReturnCode GravityNode::init(std::string componentID)
     // Setup zmq context
 	if(!initialized)
 	{
+		// Get the gravity configuration from files, some of which is needed to set up the context
+		parser = new GravityConfigParser(componentID);
+
+		parser->ParseConfigFile("Gravity.ini");
+		std::string config_file_name = componentID + ".ini";
+		if(gravity::IsValidFilename(config_file_name))
+		{
+			parser->ParseConfigFile(config_file_name.c_str());
+		}
+
 		context = zmq_init(1);
 		if (!context)
 		{
 			ret = GravityReturnCodes::FAILURE;
 		}
+		else
+		{
+			// Each publication and each publisher subscribed to has a socket, beyond zmq's default limit of 1023 sockets
+			// for nodes with thousands of them
+			int maxSockets = getIntParam("MaxSockets", 0);
+			if (maxSockets > 0 && zmq_ctx_set(context, ZMQ_MAX_SOCKETS, maxSockets) != 0)
+			{
+				Log::warning("Unable to allow %d sockets, using zmq's default", maxSockets);
+			}
+		}
 
 		void* initSocket = zmq_socket(context, ZMQ_REP);
 		zmq_bind(initSocket, "inproc://gravity_init");
 
-		// Setup up communication channel to subscription manager
-		subscriptionManagerSWL.socket = zmq_socket(context, ZMQ_PUB);
+		// Setup up communication channel to subscription manager, which never drops a command (subscribers may
+		// subscribe from their callbacks, so waiting on the subscription manager for room could deadlock)
+		int unlimited = 0;
+		subscriptionManagerSWL.socket = zmq_socket(context, ZMQ_PUSH);
+		zmq_setsockopt(subscriptionManagerSWL.socket, ZMQ_SNDHWM, &unlimited, sizeof(unlimited));
 		zmq_bind(subscriptionManagerSWL.socket, "inproc://gravity_subscription_manager");
 		subscriptionManagerConfigSWL.socket = zmq_socket(context,ZMQ_PUB);
 		zmq_bind(subscriptionManagerConfigSWL.socket,"inproc://gravity_subscription_manager_configure");
@@ -598,18 +645,24 @@ GravityReturnCode GravityNode::init(std::string componentID)
 		zmq_bind(metricsManagerSocket, GRAVITY_METRICS_CONTROL);
 
 		// Setup the subscription manager
-    subscriptionManagerThread = std::thread(startSubscriptionManager, context);
+		// Subscribers are called from the subscription manager's thread unless configured otherwise
+		subscriptionDispatcher = std::shared_ptr<GravitySubscriptionDispatcher>(new GravitySubscriptionDispatcher());
+    subscriptionManagerThread = std::thread(startSubscriptionManager, context, subscriptionDispatcher);
 
-		// Setup up publish channel to publish manager
-		publishManagerPublishSWL.socket = zmq_socket(context, ZMQ_PUB);
-		zmq_bind(publishManagerPublishSWL.socket, PUB_MGR_PUB_URL);
+		// Setup up publish channels to publish manager
+		bindPublishChannels(0);
 
-		// Setup the publish manager
-    std::thread publishManagerThread(startPublishManager, context);
+		// No limit on cached values until configured
+		publishCacheBudget = std::shared_ptr<CacheBudget>(new CacheBudget());
+		publishCacheBudget->limit = 0;
+		publishCacheBudget->size = 0;
+
+		// Setup the publish manager (the first publish thread; any others are started once configured)
+    std::thread publishManagerThread(startPublishManager, context, 0u, publishCacheBudget);
     publishManagerThread.detach();
 
-		// Setup up communication channel to request manager
-		requestManagerSWL.socket = zmq_socket(context, ZMQ_PUB);
+		// Setup up communication channel to request manager (requests wait for room in it, see sendRequest)
+		requestManagerSWL.socket = zmq_socket(context, ZMQ_PUSH);
 		zmq_bind(requestManagerSWL.socket, "inproc://gravity_request_manager");
 		requestManagerRepSWL.socket = zmq_socket(context, ZMQ_REQ);
 		zmq_bind(requestManagerRepSWL.socket, "inproc://gravity_request_rep");
@@ -653,22 +706,14 @@ GravityReturnCode GravityNode::init(std::string componentID)
 			raise(s_interrupted);
 
 		// connect down here to make sure manager has bound address.
-		publishManagerRequestSWL.socket = zmq_socket(context, ZMQ_REQ);
-		zmq_connect(publishManagerRequestSWL.socket, PUB_MGR_REQ_URL);
+		publishManagerRequestSockets.push_back(zmq_socket(context, ZMQ_REQ));
+		zmq_connect(publishManagerRequestSockets[0], PUB_MGR_REQ_URL);
 
 		serviceManagerSWL.socket = zmq_socket(context, ZMQ_REQ);
 		zmq_connect(serviceManagerSWL.socket, SERVICE_MGR_URL);
 
 		////////////////////////////////////////////////////////
-		//Now that Gravity is set up, get gravity configuration.
-		parser = new GravityConfigParser(componentID);
-
-		parser->ParseConfigFile("Gravity.ini");
-		std::string config_file_name = componentID + ".ini";
-		if(gravity::IsValidFilename(config_file_name))
-		{
-			parser->ParseConfigFile(config_file_name.c_str());
-		}
+		//Now that Gravity is set up, get the rest of the gravity configuration.
 
 		// Setup Logging as soon as config parser is available.
 		if(!logInitialized)
@@ -685,6 +730,17 @@ GravityReturnCode GravityNode::init(std::string componentID)
 			logInitialized=true;
 		}
 
+		// Start any more publish threads, which share the publications between them
+		int publishThreads = getIntParam("PublishThreads", 1);
+		if (publishThreads < 1)
+		{
+			Log::warning("Invalid PublishThreads = %d. Ignoring.", publishThreads);
+		}
+		else
+		{
+			startPublishShards(publishThreads);
+		}
+
 		// Configure high water marks
 		int publishHWM = getIntParam("PublishHWM", 1000);
 		if (publishHWM < 0)
@@ -693,11 +749,14 @@ GravityReturnCode GravityNode::init(std::string componentID)
 		}
 		else
 		{
-			// Send HWM (REQ/REP)
-			sendStringMessage(publishManagerRequestSWL.socket, "set_hwm", ZMQ_SNDMORE);
-			sendIntMessage(publishManagerRequestSWL.socket, publishHWM, ZMQ_DONTWAIT);
-			// Read ACK
-			readStringMessage(publishManagerRequestSWL.socket);
+			// Send HWM (REQ/REP) to each publish thread
+			for (size_t i = 0; i < publishManagerRequestSockets.size(); i++)
+			{
+				sendStringMessage(publishManagerRequestSockets[i], "set_hwm", ZMQ_SNDMORE);
+				sendIntMessage(publishManagerRequestSockets[i], publishHWM, ZMQ_DONTWAIT);
+				// Read ACK
+				readStringMessage(publishManagerRequestSockets[i]);
+			}
 		}
 		int subscribeHWM = getIntParam("SubscribeHWM", 1000);
 		if (subscribeHWM < 0)
@@ -710,6 +769,41 @@ GravityReturnCode GravityNode::init(std::string componentID)
 			sendStringMessage(subscriptionManagerSWL.socket, "set_hwm", ZMQ_SNDMORE);
 			sendIntMessage(subscriptionManagerSWL.socket, subscribeHWM, ZMQ_DONTWAIT);
 		}
+		int dispatchThreads = getIntParam("SubscriptionDispatchThreads", 0);
+		int queueLimit = getIntParam("SubscriptionQueueLimit", 1000);
+		if (dispatchThreads < 0 || queueLimit < 0)
+		{
+			Log::warning("Invalid SubscriptionDispatchThreads = %d or SubscriptionQueueLimit = %d. Ignoring.", dispatchThreads, queueLimit);
+		}
+		else if (dispatchThreads > 0)
+		{
+			// Call subscribers from a pool of threads, in order for each subscriber (or subscriber and data product)
+			subscriptionDispatcher->start(dispatchThreads, queueLimit, getBoolParam("SubscriptionStrandPerProduct", false));
+		}
+		int reassemblyLimit = getIntParam("ChunkReassemblyLimitMB", 1024);
+		if (reassemblyLimit < 0)
+		{
+			Log::warning("Invalid ChunkReassemblyLimitMB = %d. Ignoring.", reassemblyLimit);
+		}
+		else
+		{
+			// Bytes of chunked data products that may be being reassembled at once
+			sendStringMessage(subscriptionManagerSWL.socket, "set_reassembly_limit", ZMQ_SNDMORE);
+			sendUint64Message(subscriptionManagerSWL.socket, (uint64_t)reassemblyLimit * 1024 * 1024, ZMQ_DONTWAIT);
+		}
+		int cacheLimit = getIntParam("PublishCacheLimitMB", 1024);
+		if (cacheLimit < 0)
+		{
+			Log::warning("Invalid PublishCacheLimitMB = %d. Ignoring.", cacheLimit);
+		}
+		else
+		{
+			// Bytes of data products cached for late subscribers (0 for no limit), shared by all the publish threads
+			sendStringMessage(publishManagerRequestSockets[0], "set_cache_limit", ZMQ_SNDMORE);
+			sendUint64Message(publishManagerRequestSockets[0], (uint64_t)cacheLimit * 1024 * 1024, ZMQ_DONTWAIT);
+			// Read ACK
+			readStringMessage(publishManagerRequestSockets[0]);
+		}
 
 		//get the Domain name of the Service Directory to connect to
 		std::string serviceDirectoryDomain = getStringParam("Domain");
@@ -822,8 +916,12 @@ GravityReturnCode GravityNode::init(std::string componentID)
 			metricsEnabled = getBoolParam("GravityMetricsEnabled", false);
 			if (metricsEnabled)
 			{
-				// Register our metrics data product with the service directory
-				registerDataProduct(GRAVITY_METRICS_DATA_PRODUCT_ID, GravityTransportTypes::TCP);
+				// Register our metrics data product with the service directory (the metrics manager hands it to the
+				// publish thread itself, so it takes no room in the publish channel)
+				GravityPublicationOptions metricsOptions;
+				metricsOptions.handoffLimit = 0;
+				registerDataProduct(GRAVITY_METRICS_DATA_PRODUCT_ID, GravityTransportTypes::TCP, defaultCacheLastSentDataprodut,
+				                    metricsOptions);
 
 				// Command the GravityMetricsManager thread to start collecting metrics
 				sendStringMessage(metricsManagerSocket, "MetricsEnable", ZMQ_SNDMORE);
@@ -837,9 +935,15 @@ GravityReturnCode GravityNode::init(std::string componentID)
 				sendIntMessage(metricsManagerSocket, samplePeriod, ZMQ_SNDMORE);
 				sendIntMessage(metricsManagerSocket, samplesPerPublish, ZMQ_SNDMORE);
 
-				// Finally, send our component id & ip address (to be published with metrics)
+				// Finally, send our component id & ip address (to be published with metrics), and the domain and
+				// registration time to publish them with as publish() would
 				sendStringMessage(metricsManagerSocket, componentID, ZMQ_SNDMORE);
-				sendStringMessage(metricsManagerSocket, getIP(), ZMQ_DONTWAIT);
+				sendStringMessage(metricsManagerSocket, getIP(), ZMQ_SNDMORE);
+				sendStringMessage(metricsManagerSocket, myDomain, ZMQ_SNDMORE);
+				sendUint32Message(metricsManagerSocket, dataRegistrationTimeMap[GRAVITY_METRICS_DATA_PRODUCT_ID], ZMQ_SNDMORE);
+
+				// and the number of publish threads to collect publish metrics from
+				sendIntMessage(metricsManagerSocket, (int)publishManagerRequestSockets.size(), ZMQ_DONTWAIT);
 			}
 
 			if(componentID != "ConfigServer" && getBoolParam("NoConfigServer", false) != true)
@@ -1162,6 +1266,109 @@ GravityReturnCode GravityNode::sendRequestToServiceDirectory(const GravityDataPr
     return ret;
 }
 
+static void freeCompressedData(void* data, void* hint)
+{
+    free(data);
+}
+
+static void freeOwnedArray(void* data, void* hint)
+{
+    delete[] static_cast<uint8_t*>(data);
+}
+
+static void freeOwnedVector(void* data, void* hint)
+{
+    delete static_cast<std::vector<uint8_t>*>(hint);
+}
+
+/**
+ * Compress data into a new zmq message, if compressing makes it smaller.
+ */
+static bool compressMessage(const GravityCompressionPolicy& policy, const void* data, size_t size, zmq_msg_t* compressed)
+{
+    size_t bound = compressBound(policy.type, size);
+    if (bound == 0)
+    {
+        return false;
+    }
+    void* buffer = malloc(bound);
+    size_t compressedSize = buffer ? compressData(policy, data, size, buffer, bound) : 0;
+    if (compressedSize == 0 || compressedSize >= size)
+    {
+        free(buffer);
+        return false;
+    }
+    // The message only uses the start of the buffer, which avoids copying it to one of the exact size
+    zmq_msg_init_data(compressed, buffer, compressedSize, freeCompressedData, NULL);
+    return true;
+}
+
+/**
+ * Append the fields that mark a data product's data as compressed to its serialized envelope.
+ */
+static void appendCompressionFields(GravityCompressionType type, uint64_t uncompressedSize, string& envelope)
+{
+    uint8_t fields[32];
+    uint8_t* end = WireFormatLite::WriteUInt32ToArray(GravityDataProductPB::kCompressionFieldNumber, type, fields);
+    end = WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kUncompressedSizeFieldNumber, uncompressedSize, end);
+    envelope.append(reinterpret_cast<const char*>(fields), end - fields);
+}
+
+/**
+ * Compress (if needed) the data of a publication and initialize the envelope for it: the publication's registered
+ * fields plus the timestamp and, for protobuf data, its type.
+ */
+static void prepareMessages(const string& registered, const GravityCompressionPolicy& compression, zmq_msg_t* data,
+                            const string& typeName, uint64_t timestamp, zmq_msg_t* envelope)
+{
+    size_t uncompressedSize = zmq_msg_size(data);
+    bool isCompressed = false;
+    if (compression.type != GravityCompressionTypes::NONE &&
+            uncompressedSize >= static_cast<size_t>(compression.minimumSize))
+    {
+        zmq_msg_t compressed;
+        isCompressed = compressMessage(compression, zmq_msg_data(data), uncompressedSize, &compressed);
+        if (isCompressed)
+        {
+            // Releases the uncompressed data
+            zmq_msg_move(data, &compressed);
+        }
+    }
+
+    static const string protocol = "protobuf2";
+    size_t size = registered.size() + 1 + CodedOutputStream::VarintSize64(timestamp);
+    if (!typeName.empty())
+    {
+        size += WireFormatLite::StringSize(protocol) + WireFormatLite::StringSize(typeName) + 2;
+    }
+    string compressionFields;
+    if (isCompressed)
+    {
+        appendCompressionFields(compression.type, uncompressedSize, compressionFields);
+        size += compressionFields.size();
+    }
+    zmq_msg_init_size(envelope, size);
+    uint8_t* target = static_cast<uint8_t*>(zmq_msg_data(envelope));
+    memcpy(target, registered.data(), registered.size());
+    target = WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kTimestampFieldNumber, timestamp, target + registered.size());
+    if (!typeName.empty())
+    {
+        target = WireFormatLite::WriteStringToArray(GravityDataProductPB::kProtocolFieldNumber, protocol, target);
+        target = WireFormatLite::WriteStringToArray(GravityDataProductPB::kTypeNameFieldNumber, typeName, target);
+    }
+    memcpy(target, compressionFields.data(), compressionFields.size());
+}
+
+/**
+ * Prepare a value elided for want of subscribers, for the publish thread to cache once a subscription wants it.
+ */
+static void prepareElidedValue(const PublicationAudience& audience, ElidedValue& value)
+{
+    zmq_msg_t envelope;
+    prepareMessages(audience.envelope, audience.compression, value.data.get(), value.typeName, value.timestamp, &envelope);
+    value.envelope = moveSharedMessage(&envelope);
+}
+
 GravityReturnCode GravityNode::registerDataProduct(string dataProductID, GravityTransportType transportType){
 	return registerDataProduct(dataProductID, transportType, defaultCacheLastSentDataprodut);
 }
@@ -1171,25 +1378,83 @@ GravityReturnCode GravityNode::registerDataProduct(string dataProductID, Gravity
 	return registerDataProductInternal(dataProductID, transportType, cacheLastValue, false, "");
 }
 
+GravityReturnCode GravityNode::registerDataProduct(string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+		PublicationHandle& handle)
+{
+	return registerDataProduct(dataProductID, transportType, cacheLastValue, GravityPublicationOptions(), handle);
+}
+
+GravityReturnCode GravityNode::registerDataProduct(string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+		const GravityCompressionPolicy& compression)
+{
+	GravityPublicationOptions options;
+	options.compression = compression;
+	return registerDataProduct(dataProductID, transportType, cacheLastValue, options);
+}
+
+GravityReturnCode GravityNode::registerDataProduct(string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+		const GravityCompressionPolicy& compression, PublicationHandle& handle)
+{
+	GravityPublicationOptions options;
+	options.compression = compression;
+	return registerDataProduct(dataProductID, transportType, cacheLastValue, options, handle);
+}
+
+GravityReturnCode GravityNode::registerDataProduct(string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+		const GravityPublicationOptions& options)
+{
+	return registerDataProductInternal(dataProductID, transportType, cacheLastValue, false, "", options);
+}
+
+GravityReturnCode GravityNode::registerDataProduct(string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+		const GravityPublicationOptions& options, PublicationHandle& handle)
+{
+	handle = INVALID_PUBLICATION_HANDLE;
+	GravityReturnCode ret = registerDataProductInternal(dataProductID, transportType, cacheLastValue, false, "", options);
+	if (ret == GravityReturnCodes::SUCCESS)
+	{
+		publishManagerRequestLock.Lock();
+		map<string, PublicationHandle>::const_iterator iter = publicationHandleMap.find(dataProductID);
+		if (iter != publicationHandleMap.end())
+		{
+			handle = iter->second;
+		}
+		publishManagerRequestLock.Unlock();
+	}
+	return ret;
+}
+
 GravityReturnCode GravityNode::registerDataProductInternal(std::string dataProductID, GravityTransportType transportType,
-		                                                    bool cacheLastValue, bool isRelay, bool localOnly)
+		                                                    bool cacheLastValue, bool isRelay, bool localOnly,
+		                                                    const GravityPublicationOptions& options)
 {
     if (!initialized)
     {
         return GravityReturnCodes::NOT_INITIALIZED;
     }
+    if (!isCompressionSupported(options.compression.type))
+    {
+        Log::warning("Compression type %d is not supported by this build, can't register %s", options.compression.type, dataProductID.c_str());
+        return GravityReturnCodes::INVALID_PARAMETER;
+    }
+    if (static_cast<unsigned int>(options.priority) >= GravityPriorities::COUNT || (options.reliable && options.retransmitDepth == 0) ||
+        static_cast<unsigned int>(options.slowSubscriberPolicy) > GravitySlowSubscriberPolicies::CONFLATE ||
+        static_cast<unsigned int>(options.handoffPolicy) > GravityHandoffPolicies::REJECT)
+    {
+        return GravityReturnCodes::INVALID_PARAMETER;
+    }
     std::string transportType_str;
     GravityReturnCode ret = GravityReturnCodes::SUCCESS;
 
 
     // we can't allow multiple threads to make request calls to the pub manager at the same time
     // because the requests will step on each other.  Manage access to publishMap as well.
-    publishManagerRequestSWL.lock.Lock();
+    publishManagerRequestLock.Lock();
 
     if (publishMap.count(dataProductID) > 0)
     {
         Log::warning("attempt to register duplicate data product ID: %s", dataProductID.c_str());
-        publishManagerRequestSWL.lock.Unlock();
+        publishManagerRequestLock.Unlock();
         return GravityReturnCodes::SUCCESS;
     }
 
@@ -1224,23 +1489,60 @@ GravityReturnCode GravityNode::registerDataProductInternal(std::string dataProdu
 
 	// Registration timestamp - will serve as a unique identifier for this registered publication
 	uint64_t timestamp = getCurrentTime();
-	
+
+	// A data product ID keeps its handle across registrations, otherwise take the next one
+	map<string, PublicationHandle>::const_iterator handleIter = publicationHandleMap.find(dataProductID);
+	PublicationHandle handle = handleIter != publicationHandleMap.end() ? handleIter->second : static_cast<PublicationHandle>(publications.size());
+
+	// The data product is published by one of the publish threads
+	unsigned int shard = publishShard(dataProductID);
+	void* requestSocket = publishManagerRequestSockets[shard];
+
     // Send publish details via the request socket.  This allows us to retrieve
     // register url in response so that we can register with the ServiceDirectory.
-	sendStringMessage(publishManagerRequestSWL.socket, "register", ZMQ_SNDMORE);
-	sendStringMessage(publishManagerRequestSWL.socket, dataProductID, ZMQ_SNDMORE);
-	sendIntMessage(publishManagerRequestSWL.socket, cacheLastValue, ZMQ_SNDMORE);
-    sendStringMessage(publishManagerRequestSWL.socket, transportType_str, ZMQ_SNDMORE);
+	sendStringMessage(requestSocket, "register", ZMQ_SNDMORE);
+	sendStringMessage(requestSocket, dataProductID, ZMQ_SNDMORE);
+	sendUint32Message(requestSocket, handle, ZMQ_SNDMORE);
+	sendIntMessage(requestSocket, cacheLastValue, ZMQ_SNDMORE);
+	sendUint64Message(requestSocket, options.chunkSize, ZMQ_SNDMORE);
+	sendIntMessage(requestSocket, options.directPublish, ZMQ_SNDMORE);
+	sendUint32Message(requestSocket, options.historyDepth, ZMQ_SNDMORE);
+	sendUint64Message(requestSocket, options.historyMaxAge, ZMQ_SNDMORE);
+	sendUint32Message(requestSocket, options.reliable ? options.retransmitDepth : 0, ZMQ_SNDMORE);
+	sendUint64Message(requestSocket, options.timeToLive, ZMQ_SNDMORE);
+	sendIntMessage(requestSocket, options.elideWithoutSubscribers, ZMQ_SNDMORE);
+	sendUint32Message(requestSocket, options.maxSubscriberLag, ZMQ_SNDMORE);
+	sendIntMessage(requestSocket, options.slowSubscriberPolicy, ZMQ_SNDMORE);
+	sendUint32Message(requestSocket, options.slowSubscriberTimeout, ZMQ_SNDMORE);
+    sendStringMessage(requestSocket, transportType_str, ZMQ_SNDMORE);
     if(transportType == GravityTransportTypes::TCP)
     {
         int minPort = getIntParam("MinPort", MIN_PORT);
         int maxPort = getIntParam("MaxPort", MAX_PORT);
-        sendIntMessage(publishManagerRequestSWL.socket, minPort, ZMQ_SNDMORE);
-        sendIntMessage(publishManagerRequestSWL.socket, maxPort, ZMQ_SNDMORE);
+        sendIntMessage(requestSocket, minPort, ZMQ_SNDMORE);
+        sendIntMessage(requestSocket, maxPort, ZMQ_SNDMORE);
     }
-	sendStringMessage(publishManagerRequestSWL.socket, endpoint, ZMQ_DONTWAIT);
+	sendStringMessage(requestSocket, endpoint, ZMQ_DONTWAIT);
 
-	string connectionURL = readStringMessage(publishManagerRequestSWL.socket);
+	string connectionURL = readStringMessage(requestSocket);
+
+	// The publication's audience, and a direct publication, are handed over along with the URL
+	std::shared_ptr<PublicationAudience> audience;
+	std::shared_ptr<PublishDetails> direct;
+	if (connectionURL.size() > 0)
+	{
+		std::shared_ptr<PublicationAudience>* audienceReference =
+				reinterpret_cast<std::shared_ptr<PublicationAudience>*>(static_cast<uintptr_t>(readUint64Message(requestSocket)));
+		audience = *audienceReference;
+		delete audienceReference;
+		std::shared_ptr<PublishDetails>* reference =
+				reinterpret_cast<std::shared_ptr<PublishDetails>*>(static_cast<uintptr_t>(readUint64Message(requestSocket)));
+		if (reference)
+		{
+			direct = *reference;
+			delete reference;
+		}
+	}
 
 	if (connectionURL.size() == 0)
 	{
@@ -1258,6 +1560,7 @@ GravityReturnCode GravityNode::registerDataProductInternal(std::string dataProdu
             registration.set_component_id(componentID);
 			registration.set_timestamp(timestamp);
 			registration.set_is_relay(isRelay);
+			registration.set_wire_format_version(GRAVITY_WIRE_FORMAT_VERSION);
 			if (localOnly)
 			{
 				registration.set_ip_address(getIP());
@@ -1319,9 +1622,9 @@ GravityReturnCode GravityNode::registerDataProductInternal(std::string dataProdu
 	{
 	    Log::warning("Failed to register %s at url %s with error %s", dataProductID.c_str(), connectionURL.c_str(), getCodeString(ret).c_str());
 	    // if we didn't succesfully register with the SD, then unregister with the publish manager
-	    sendStringMessage(publishManagerRequestSWL.socket, "unregister", ZMQ_SNDMORE);
-	    sendStringMessage(publishManagerRequestSWL.socket, dataProductID, ZMQ_DONTWAIT);
-	    readStringMessage(publishManagerRequestSWL.socket);
+	    sendStringMessage(requestSocket, "unregister", ZMQ_SNDMORE);
+	    sendStringMessage(requestSocket, dataProductID, ZMQ_DONTWAIT);
+	    readStringMessage(requestSocket);
 	}
 	else
 	{
@@ -1329,9 +1632,53 @@ GravityReturnCode GravityNode::registerDataProductInternal(std::string dataProdu
         publishMap[dataProductID] = connectionURL;
 		urlInstanceMap[connectionURL] = timestamp;
 		dataRegistrationTimeMap[dataProductID] = static_cast<uint32_t>(timestamp / 1e6); // Maintained in epoch seconds
+
+		// Pre-serialize the fields that publishing by handle fills in
+		GravityDataProductPB envelope;
+		envelope.set_dataproductid(dataProductID);
+		envelope.set_componentid(componentID);
+		envelope.set_domain(myDomain);
+		envelope.set_registration_time(dataRegistrationTimeMap[dataProductID]);
+
+		std::shared_ptr<PublicationDetails> publication(new PublicationDetails);
+		publication->dataProductID = dataProductID;
+		publication->handle = handle;
+		envelope.SerializeToString(&publication->envelope);
+		publication->compression = options.compression;
+		publication->direct = direct;
+		publication->audience = audience;
+		publication->shard = shard;
+		publication->priority = options.priority;
+
+		// Values elided for want of subscribers are prepared by the publish thread once they're wanted
+		audience->lock.Lock();
+		audience->envelope = publication->envelope;
+		audience->compression = options.compression;
+		audience->prepare = prepareElidedValue;
+		if (!direct && options.handoffLimit > 0)
+		{
+			// Direct publications are published by the caller, so only the others wait for the publish thread
+			audience->handoffSlots.reset(new Semaphore(options.handoffLimit));
+			audience->handoffLimit = options.handoffLimit;
+			audience->handoffPolicy = options.handoffPolicy;
+			audience->handoffTimeout = options.handoffTimeout;
+		}
+		audience->lock.Unlock();
+
+		publicationsLock.Lock();
+		if (handle == publications.size())
+		{
+			publications.push_back(publication);
+			publicationHandleMap[dataProductID] = handle;
+		}
+		else
+		{
+			publications[handle] = publication;
+		}
+		publicationsLock.Unlock();
 	}
 
-    publishManagerRequestSWL.lock.Unlock();
+    publishManagerRequestLock.Unlock();
 
 	return ret;
 }
@@ -1344,22 +1691,27 @@ GravityReturnCode GravityNode::unregisterDataProduct(string dataProductID)
     }
     GravityReturnCode ret = GravityReturnCodes::SUCCESS;
 
-    publishManagerRequestSWL.lock.Lock();
+    publishManagerRequestLock.Lock();
     if (publishMap.count(dataProductID) == 0)
     {
         ret = GravityReturnCodes::REGISTRATION_CONFLICT;
     }
     else
     {
-        sendStringMessage(publishManagerRequestSWL.socket, "unregister", ZMQ_SNDMORE);
-        sendStringMessage(publishManagerRequestSWL.socket, dataProductID, ZMQ_DONTWAIT);
-        readStringMessage(publishManagerRequestSWL.socket);
+        void* requestSocket = publishManagerRequestSockets[publishShard(dataProductID)];
+        sendStringMessage(requestSocket, "unregister", ZMQ_SNDMORE);
+        sendStringMessage(requestSocket, dataProductID, ZMQ_DONTWAIT);
+        readStringMessage(requestSocket);
     	string url = publishMap[dataProductID];
         publishMap.erase(dataProductID);
 		urlInstanceMap.erase(url);
 		uint32_t regTime = dataRegistrationTimeMap[dataProductID];
 		dataRegistrationTimeMap.erase(dataProductID);
 
+		publicationsLock.Lock();
+		publications[publicationHandleMap[dataProductID]].reset();
+		publicationsLock.Unlock();
+
         if (!serviceDirectoryNode.ipAddress.empty())
         {
             ServiceDirectoryUnregistrationPB unregistration;
@@ -1410,7 +1762,7 @@ GravityReturnCode GravityNode::unregisterDataProduct(string dataProductID)
             }
         }
     }
-    publishManagerRequestSWL.lock.Unlock();
+    publishManagerRequestLock.Unlock();
 
     return ret;
 }
@@ -1492,13 +1844,29 @@ GravityReturnCode GravityNode::subscribe(string dataProductID, const GravitySubs
     return ret;
 }
 
-GravityReturnCode GravityNode::subscribeInternal(string dataProductID, const GravitySubscriber& subscriber, string filter, string domain, bool receiveLastCachedValue)
+GravityReturnCode GravityNode::subscribe(string dataProductID, const GravitySubscriber& subscriber, string filter, string domain,
+                                         bool receiveLastCachedValue, const GravitySubscriptionOptions& options)
+{
+    subscriptionManagerSWL.lock.Lock();
+    GravityReturnCode ret = subscribeInternal(dataProductID, subscriber, filter, domain, receiveLastCachedValue, options);
+    subscriptionManagerSWL.lock.Unlock();
+    return ret;
+}
+
+GravityReturnCode GravityNode::subscribeInternal(string dataProductID, const GravitySubscriber& subscriber, string filter, string domain,
+                                                 bool receiveLastCachedValue, const GravitySubscriptionOptions& options)
 {
     if (!initialized)
     {
         return GravityReturnCodes::NOT_INITIALIZED;
     }
 
+    // The predicate is sent to publishers as part of the topic, ended by '\0'
+    if (options.predicate.find('\0') != string::npos || static_cast<unsigned int>(options.priority) >= GravityPriorities::COUNT)
+    {
+        return GravityReturnCodes::INVALID_PARAMETER;
+    }
+
     if (domain.empty())
     {
         domain = myDomain;
@@ -1541,6 +1909,12 @@ GravityReturnCode GravityNode::subscribeInternal(string dataProductID, const Gra
 	sendStringMessage(subscriptionManagerSWL.socket, "subscribe", ZMQ_SNDMORE);
 	sendStringMessage(subscriptionManagerSWL.socket, dataProductID, ZMQ_SNDMORE);
 	sendIntMessage(subscriptionManagerSWL.socket, receiveLastCachedValue, ZMQ_SNDMORE);
+	sendIntMessage(subscriptionManagerSWL.socket, options.conflate, ZMQ_SNDMORE);
+	// Publishers are asked for the fewest microseconds between data products
+	sendUint64Message(subscriptionManagerSWL.socket, options.maxRate > 0 ? (uint64_t)(1e6 / options.maxRate) : 0, ZMQ_SNDMORE);
+	sendStringMessage(subscriptionManagerSWL.socket, options.predicate, ZMQ_SNDMORE);
+	sendIntMessage(subscriptionManagerSWL.socket, options.priority, ZMQ_SNDMORE);
+	sendUint64Message(subscriptionManagerSWL.socket, options.timeToLive, ZMQ_SNDMORE);
 	sendUint32Message(subscriptionManagerSWL.socket, publisherInfoPBs.size(), ZMQ_SNDMORE);
 	for (unsigned int i = 0; i < publisherInfoPBs.size(); i++)
 	{
@@ -1563,6 +1937,7 @@ GravityReturnCode GravityNode::subscribeInternal(string dataProductID, const Gra
 	details.filter = filter;
 	details.receiveLastCachedValue = receiveLastCachedValue;
 	details.subscriber = &subscriber;
+	details.options = options;
 	subscriptionList.push_back(details);
 
     return GravityReturnCodes::SUCCESS;
@@ -1619,6 +1994,183 @@ GravityReturnCode GravityNode::unsubscribeInternal(string dataProductID, const G
 	return GravityReturnCodes::SUCCESS;
 }
 
+size_t GravityNode::getSubscriptionQueueDepth(const GravitySubscriber& subscriber, string dataProductID)
+{
+    if (!subscriptionDispatcher)
+    {
+        return 0;
+    }
+    return subscriptionDispatcher->queueDepth(&subscriber, dataProductID);
+}
+
+uint64_t GravityNode::getConflatedCount(const GravitySubscriber& subscriber, string dataProductID)
+{
+    if (!subscriptionDispatcher)
+    {
+        return 0;
+    }
+    return subscriptionDispatcher->conflatedCount(&subscriber, dataProductID);
+}
+
+uint64_t GravityNode::getExpiredCount(const GravitySubscriber& subscriber, string dataProductID)
+{
+    if (!subscriptionDispatcher)
+    {
+        return 0;
+    }
+    return subscriptionDispatcher->expiredCount(&subscriber, dataProductID);
+}
+
+bool GravityNode::hasSubscribers(std::string dataProductID)
+{
+    return getSubscriberCount(dataProductID) > 0;
+}
+
+bool GravityNode::hasSubscribers(std::string dataProductID, std::string filterText)
+{
+    return getSubscriberCount(dataProductID, filterText) > 0;
+}
+
+uint32_t GravityNode::getSubscriberCount(std::string dataProductID)
+{
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return 0;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.lock.Lock();
+    uint32_t count = audience.subscriberCount;
+    audience.lock.Unlock();
+    return count;
+}
+
+uint32_t GravityNode::getSubscriberCount(std::string dataProductID, std::string filterText)
+{
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return 0;
+    }
+    return GravityPublishManager::subscriberCount(*publication->audience, filterText);
+}
+
+uint64_t GravityNode::getPublishDropCount(std::string dataProductID)
+{
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return 0;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.lock.Lock();
+    uint64_t count = audience.handoffDropCount;
+    audience.lock.Unlock();
+    return count;
+}
+
+uint64_t GravityNode::getPublishBlockedTime(std::string dataProductID)
+{
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return 0;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.lock.Lock();
+    uint64_t time = audience.handoffBlockedTime;
+    audience.lock.Unlock();
+    return time;
+}
+
+uint64_t GravityNode::getRequestDropCount()
+{
+    requestManagerSWL.lock.Lock();
+    uint64_t count = requestDropCount;
+    requestManagerSWL.lock.Unlock();
+    return count;
+}
+
+uint64_t GravityNode::getRequestBlockedTime()
+{
+    requestManagerSWL.lock.Lock();
+    uint64_t time = requestBlockedTime;
+    requestManagerSWL.lock.Unlock();
+    return time;
+}
+
+GravityReturnCode GravityNode::registerSubscriberCountListener(std::string dataProductID, const GravitySubscriberCountListener& listener)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.listenerLock.Lock();
+    audience.listener = const_cast<GravitySubscriberCountListener*>(&listener);
+    audience.listenerLock.Unlock();
+    return GravityReturnCodes::SUCCESS;
+}
+
+GravityReturnCode GravityNode::unregisterSubscriberCountListener(std::string dataProductID)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.listenerLock.Lock();
+    audience.listener = NULL;
+    audience.listenerLock.Unlock();
+    return GravityReturnCodes::SUCCESS;
+}
+
+GravityReturnCode GravityNode::registerSlowSubscriberListener(std::string dataProductID, const GravitySlowSubscriberListener& listener)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.listenerLock.Lock();
+    audience.slowSubscriberListener = const_cast<GravitySlowSubscriberListener*>(&listener);
+    audience.listenerLock.Unlock();
+    return GravityReturnCodes::SUCCESS;
+}
+
+GravityReturnCode GravityNode::unregisterSlowSubscriberListener(std::string dataProductID)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (!publication)
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    PublicationAudience& audience = *publication->audience;
+    audience.listenerLock.Lock();
+    audience.slowSubscriberListener = NULL;
+    audience.listenerLock.Unlock();
+    return GravityReturnCodes::SUCCESS;
+}
+
 GravityReturnCode GravityNode::publish(const GravityDataProduct& dataProduct, std::string filterText, uint64_t timestamp)
 {
     if (!initialized)
@@ -1652,26 +2204,495 @@ GravityReturnCode GravityNode::publish(const GravityDataProduct& dataProduct, st
 		dataProduct.setDomain(myDomain);
 	}
 
-	// Send subscription details
-    publishManagerPublishSWL.lock.Lock();
+    std::shared_ptr<const PublicationDetails> publication = findPublication(dataProductID);
+    if (publication && unwanted(*publication, filterText))
+    {
+        return GravityReturnCodes::SUCCESS;
+    }
 
-    sendStringMessage(publishManagerPublishSWL.socket, "publish", ZMQ_SNDMORE);
-    sendStringMessage(publishManagerPublishSWL.socket, dataProductID, ZMQ_SNDMORE);
-    sendUint64Message(publishManagerPublishSWL.socket, dataProduct.getGravityTimestamp(), ZMQ_SNDMORE);
-	sendStringMessage(publishManagerPublishSWL.socket, filterText, ZMQ_SNDMORE);
+    // Compress outside of the lock so that other publishers aren't held up
+    zmq_msg_t envelope, data;
+    bool isCompressed = false;
+    if (publication && publication->compression.type != GravityCompressionTypes::NONE &&
+            dataProduct.getDataSize64() >= static_cast<uint64_t>(publication->compression.minimumSize))
+    {
+        isCompressed = compressMessage(publication->compression, dataProduct.getDataPointer(), dataProduct.getDataSize64(), &data);
+        if (isCompressed)
+        {
+            string serialized;
+            dataProduct.serializeEnvelope(serialized);
+            appendCompressionFields(publication->compression.type, dataProduct.getDataSize64(), serialized);
+            zmq_msg_init_size(&envelope, serialized.size());
+            memcpy(zmq_msg_data(&envelope), serialized.data(), serialized.size());
+        }
+    }
+    if (!isCompressed)
+    {
+        initGravityDataProductMessages(dataProduct, &envelope, &data);
+    }
+    if (publication && publication->audience->elide &&
+            GravityPublishManager::elide(*publication->audience, filterText, dataProduct.getGravityTimestamp(), "", &envelope, &data))
+    {
+        return GravityReturnCodes::SUCCESS;
+    }
 
-	
-	zmq_msg_t msg;
-	zmq_msg_init_size(&msg, dataProduct.getSize());
-	dataProduct.serializeToArray(zmq_msg_data(&msg));
-	zmq_sendmsg(publishManagerPublishSWL.socket, &msg, ZMQ_DONTWAIT);
-	zmq_msg_close(&msg);
+    if (publication && publication->direct)
+    {
+        return publishDirect(*publication, filterText, dataProduct.getGravityTimestamp(), &envelope, &data);
+    }
+    if (publication)
+    {
+        GravityReturnCode handedOff = handOff(*publication);
+        if (handedOff != GravityReturnCodes::SUCCESS)
+        {
+            zmq_msg_close(&envelope);
+            zmq_msg_close(&data);
+            return handedOff;
+        }
+    }
+
+	// Send subscription details to the publish thread that publishes it
+    SocketWithLock& publishSWL = *publishManagerPublishSWLs[publication ? publishChannel(publication->shard, publication->priority) :
+                                                                          publishChannel(publishShard(dataProductID), GravityPriorities::NORMAL)];
+    publishSWL.lock.Lock();
+    sendStringMessage(publishSWL.socket, "publish", ZMQ_SNDMORE);
+    sendStringMessage(publishSWL.socket, dataProductID, ZMQ_SNDMORE);
+    sendUint64Message(publishSWL.socket, dataProduct.getGravityTimestamp(), ZMQ_SNDMORE);
+	sendStringMessage(publishSWL.socket, filterText, ZMQ_SNDMORE);
+	zmq_sendmsg(publishSWL.socket, &envelope, ZMQ_SNDMORE);
+	zmq_sendmsg(publishSWL.socket, &data, ZMQ_DONTWAIT);
+    publishSWL.lock.Unlock();
 
-    publishManagerPublishSWL.lock.Unlock();
+    zmq_msg_close(&envelope);
+    zmq_msg_close(&data);
 
     return GravityReturnCodes::SUCCESS;
 }
 
+GravityReturnCode GravityNode::publish(PublicationHandle handle, const google::protobuf::Message& payload, const std::string& filterText, uint64_t timestamp)
+{
+    return publishProtobuf(handle, payload, payload.GetTypeName(), filterText, timestamp);
+}
+
+GravityReturnCode GravityNode::publishProtobuf(PublicationHandle handle, const google::protobuf::Message& payload, const std::string& typeName,
+                                               const std::string& filterText, uint64_t timestamp)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+
+    std::shared_ptr<const PublicationDetails> publication = findPublication(handle, timestamp);
+    if (!publication)
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    if (unwanted(*publication, filterText))
+    {
+        return GravityReturnCodes::SUCCESS;
+    }
+
+    // Serialize straight into the message that will be handed to the publish manager
+    zmq_msg_t data;
+    zmq_msg_init_size(&data, payload.ByteSizeLong());
+    payload.SerializeWithCachedSizesToArray(static_cast<uint8_t*>(zmq_msg_data(&data)));
+    return publishMessage(*publication, &data, typeName, filterText, timestamp);
+}
+
+GravityReturnCode GravityNode::publish(PublicationHandle handle, const void* payload, uint64_t size, const std::string& filterText, uint64_t timestamp)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+    if (size > 0 && payload == NULL)
+    {
+        return GravityReturnCodes::INVALID_PARAMETER;
+    }
+
+    std::shared_ptr<const PublicationDetails> publication = findPublication(handle, timestamp);
+    if (!publication)
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    if (unwanted(*publication, filterText))
+    {
+        return GravityReturnCodes::SUCCESS;
+    }
+
+    zmq_msg_t data;
+    if (static_cast<size_t>(size) != size || zmq_msg_init_size(&data, size) != 0)
+    {
+        Log::warning("Unable to allocate %llu bytes to publish", (unsigned long long)size);
+        return GravityReturnCodes::INVALID_PARAMETER;
+    }
+    if (size > 0)
+    {
+        memcpy(zmq_msg_data(&data), payload, size);
+    }
+    return publishMessage(*publication, &data, "", filterText, timestamp);
+}
+
+GravityReturnCode GravityNode::publish(PublicationHandle handle, std::unique_ptr<uint8_t[]> payload, size_t size,
+                                       const std::string& filterText, uint64_t timestamp)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+    if (size > 0 && !payload)
+    {
+        return GravityReturnCodes::INVALID_PARAMETER;
+    }
+
+    zmq_msg_t data;
+    if (size == 0)
+    {
+        zmq_msg_init(&data);
+    }
+    else
+    {
+        zmq_msg_init_data(&data, payload.get(), size, freeOwnedArray, NULL);
+        payload.release();
+    }
+    return publishMessage(handle, &data, "", filterText, timestamp);
+}
+
+GravityReturnCode GravityNode::publish(PublicationHandle handle, std::vector<uint8_t>&& payload,
+                                       const std::string& filterText, uint64_t timestamp)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+
+    zmq_msg_t data;
+    if (payload.empty())
+    {
+        zmq_msg_init(&data);
+    }
+    else
+    {
+        std::vector<uint8_t>* buffer = new std::vector<uint8_t>(std::move(payload));
+        zmq_msg_init_data(&data, buffer->data(), buffer->size(), freeOwnedVector, buffer);
+    }
+    return publishMessage(handle, &data, "", filterText, timestamp);
+}
+
+uint64_t GravityNode::nextPublishTimestamp()
+{
+    // Subscribers take a data product with the same timestamp and data as the last one for a resend of it, and drop
+    // data products older than the last one, so these always increase
+    uint64_t timestamp = getCurrentTime();
+    if (timestamp <= lastPublishTimestamp)
+    {
+        timestamp = lastPublishTimestamp + 1;
+    }
+    lastPublishTimestamp = timestamp;
+    return timestamp;
+}
+
+unsigned int GravityNode::publishShard(const std::string& dataProductID)
+{
+    // The heartbeat and metrics are published through sockets only the first publish thread has
+    if (publishManagerRequestSockets.size() == 1 || dataProductID == componentID + "_GravityHeartbeat" ||
+            dataProductID == GRAVITY_METRICS_DATA_PRODUCT_ID)
+    {
+        return 0;
+    }
+    return static_cast<unsigned int>(std::hash<std::string>()(dataProductID) % publishManagerRequestSockets.size());
+}
+
+unsigned int GravityNode::publishChannel(unsigned int shard, GravityPriority priority)
+{
+    return shard * GravityPriorities::COUNT + priority;
+}
+
+void GravityNode::bindPublishChannels(unsigned int shard)
+{
+    // One channel for each priority, so that the publish thread can handle the more urgent publishes first
+    for (unsigned int priority = 0; priority < GravityPriorities::COUNT; priority++)
+    {
+        // Never drops a publish; publications limit how many of theirs may wait here instead
+        int unlimited = 0;
+        std::shared_ptr<SocketWithLock> publishSWL(new SocketWithLock());
+        publishSWL->socket = zmq_socket(context, ZMQ_PUSH);
+        zmq_setsockopt(publishSWL->socket, ZMQ_SNDHWM, &unlimited, sizeof(unlimited));
+        zmq_bind(publishSWL->socket, GravityPublishManager::channelURL(shard, static_cast<GravityPriority>(priority)).c_str());
+        publishManagerPublishSWLs.push_back(publishSWL);
+    }
+}
+
+void GravityNode::startPublishShards(int count)
+{
+    for (unsigned int shard = 1; shard < static_cast<unsigned int>(count); shard++)
+    {
+        // Setup up publish channels to the publish thread
+        bindPublishChannels(shard);
+
+        std::thread publishManagerThread(startPublishManager, context, shard, publishCacheBudget);
+        publishManagerThread.detach();
+
+        // Requests wait in the socket until the publish thread binds its end
+        void* requestSocket = zmq_socket(context, ZMQ_REQ);
+        zmq_connect(requestSocket, GravityPublishManager::shardURL(PUB_MGR_REQ_URL, shard).c_str());
+        publishManagerRequestSockets.push_back(requestSocket);
+    }
+}
+
+GravityReturnCode GravityNode::publishDirect(const PublicationDetails& publication, const std::string& filterText, uint64_t timestamp,
+                                             void* zmqEnvelope, void* zmqData)
+{
+    bool replay = false;
+    if (!GravityPublishManager::publishDirect(*publication.direct, filterText, timestamp, moveSharedMessage(static_cast<zmq_msg_t*>(zmqEnvelope)),
+                                              moveSharedMessage(static_cast<zmq_msg_t*>(zmqData)), replay))
+    {
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+
+    // Have the GravityPublishManager send the cached values to the new subscribers this turned up
+    if (replay)
+    {
+        SocketWithLock& publishSWL = *publishManagerPublishSWLs[publishChannel(publication.shard, publication.priority)];
+        publishSWL.lock.Lock();
+        sendStringMessage(publishSWL.socket, "replay", ZMQ_SNDMORE);
+        sendUint32Message(publishSWL.socket, publication.direct->handle, ZMQ_DONTWAIT);
+        publishSWL.lock.Unlock();
+    }
+    return GravityReturnCodes::SUCCESS;
+}
+
+void GravityNode::preparePublish(const PublicationDetails& publication, void* zmqMessage, const std::string& typeName,
+                                 uint64_t timestamp, void* zmqEnvelope)
+{
+    prepareMessages(publication.envelope, publication.compression, static_cast<zmq_msg_t*>(zmqMessage), typeName, timestamp,
+                    static_cast<zmq_msg_t*>(zmqEnvelope));
+}
+
+GravityReturnCode GravityNode::publishMessage(PublicationHandle handle, void* zmqMessage, const std::string& typeName,
+                                              const std::string& filterText, uint64_t timestamp)
+{
+    std::shared_ptr<const PublicationDetails> publication = findPublication(handle, timestamp);
+    if (!publication)
+    {
+        zmq_msg_close(static_cast<zmq_msg_t*>(zmqMessage));
+        return GravityReturnCodes::NOT_REGISTERED;
+    }
+    return publishMessage(*publication, zmqMessage, typeName, filterText, timestamp);
+}
+
+std::shared_ptr<const GravityNode::PublicationDetails> GravityNode::findPublication(PublicationHandle handle, uint64_t& timestamp)
+{
+    publicationsLock.Lock();
+    std::shared_ptr<const PublicationDetails> publication;
+    if (handle < publications.size())
+    {
+        publication = publications[handle];
+    }
+    if (timestamp == 0)
+    {
+        timestamp = nextPublishTimestamp();
+    }
+    publicationsLock.Unlock();
+    return publication;
+}
+
+std::shared_ptr<const GravityNode::PublicationDetails> GravityNode::findPublication(const std::string& dataProductID)
+{
+    publicationsLock.Lock();
+    std::shared_ptr<const PublicationDetails> publication;
+    map<string, PublicationHandle>::const_iterator iter = publicationHandleMap.find(dataProductID);
+    if (iter != publicationHandleMap.end())
+    {
+        publication = publications[iter->second];
+    }
+    publicationsLock.Unlock();
+    return publication;
+}
+
+bool GravityNode::unwanted(const PublicationDetails& publication, const std::string& filterText)
+{
+    PublicationAudience& audience = *publication.audience;
+    return audience.elide && !audience.keepElided && GravityPublishManager::subscriberCount(audience, filterText) == 0;
+}
+
+GravityReturnCode GravityNode::handOff(const PublicationDetails& publication)
+{
+    PublicationAudience& audience = *publication.audience;
+    if (GravityPublishManager::enqueuePublish(audience))
+    {
+        return GravityReturnCodes::SUCCESS;
+    }
+    Log::debug("Dropped a publish of %s waiting to be published", publication.dataProductID.c_str());
+    return audience.handoffPolicy == GravityHandoffPolicies::BLOCK ? GravityReturnCodes::QUEUE_TIMEOUT : GravityReturnCodes::QUEUE_FULL;
+}
+
+GravityReturnCode GravityNode::publishMessage(const PublicationDetails& publication, void* zmqMessage, const std::string& typeName,
+                                              const std::string& filterText, uint64_t timestamp)
+{
+    zmq_msg_t* data = static_cast<zmq_msg_t*>(zmqMessage);
+    if (publication.audience->elide && GravityPublishManager::elide(*publication.audience, filterText, timestamp, typeName, NULL, data))
+    {
+        return GravityReturnCodes::SUCCESS;
+    }
+
+    // Compress and build the envelope outside of the lock so that other publishers aren't held up
+    zmq_msg_t envelope;
+    preparePublish(publication, data, typeName, timestamp, &envelope);
+
+    if (publication.direct)
+    {
+        return publishDirect(publication, filterText, timestamp, &envelope, data);
+    }
+    GravityReturnCode handedOff = handOff(publication);
+    if (handedOff != GravityReturnCodes::SUCCESS)
+    {
+        zmq_msg_close(&envelope);
+        zmq_msg_close(data);
+        return handedOff;
+    }
+
+    SocketWithLock& publishSWL = *publishManagerPublishSWLs[publishChannel(publication.shard, publication.priority)];
+    publishSWL.lock.Lock();
+    sendStringMessage(publishSWL.socket, "publishHandle", ZMQ_SNDMORE);
+    sendUint32Message(publishSWL.socket, publication.handle, ZMQ_SNDMORE);
+    sendUint64Message(publishSWL.socket, timestamp, ZMQ_SNDMORE);
+    sendStringMessage(publishSWL.socket, filterText, ZMQ_SNDMORE);
+    zmq_sendmsg(publishSWL.socket, &envelope, ZMQ_SNDMORE);
+    zmq_sendmsg(publishSWL.socket, data, ZMQ_DONTWAIT);
+    publishSWL.lock.Unlock();
+
+    zmq_msg_close(&envelope);
+    zmq_msg_close(data);
+
+    return GravityReturnCodes::SUCCESS;
+}
+
+GravityReturnCode GravityNode::publish(const std::vector<PublishItem>& items)
+{
+    if (!initialized)
+    {
+        return GravityReturnCodes::NOT_INITIALIZED;
+    }
+
+    GravityReturnCode ret = GravityReturnCodes::SUCCESS;
+    std::vector<std::shared_ptr<const PublicationDetails> > itemPublications(items.size());
+    std::vector<uint64_t> timestamps(items.size());
+    publicationsLock.Lock();
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (items[i].handle < publications.size())
+        {
+            itemPublications[i] = publications[items[i].handle];
+        }
+        timestamps[i] = items[i].timestamp == 0 ? nextPublishTimestamp() : items[i].timestamp;
+    }
+    publicationsLock.Unlock();
+
+    // Build every message of the batch outside of the lock: for each data product a header (handle, timestamp and
+    // filter text), the envelope and the data
+    std::vector<zmq_msg_t> messages(3 * items.size());
+    std::vector<unsigned int> channels(items.size());
+    uint32_t count = 0;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        const PublishItem& item = items[i];
+        if (!itemPublications[i])
+        {
+            ret = GravityReturnCodes::NOT_REGISTERED;
+            continue;
+        }
+        if ((item.size > 0 && item.payload == NULL) || static_cast<size_t>(item.size) != item.size)
+        {
+            ret = GravityReturnCodes::INVALID_PARAMETER;
+            continue;
+        }
+        if (unwanted(*itemPublications[i], item.filterText))
+        {
+            continue;
+        }
+        zmq_msg_t* header = &messages[3 * count];
+        zmq_msg_t* envelope = header + 1;
+        zmq_msg_t* data = header + 2;
+        if (zmq_msg_init_size(data, item.size) != 0)
+        {
+            Log::warning("Unable to allocate %llu bytes to publish", (unsigned long long)item.size);
+            ret = GravityReturnCodes::INVALID_PARAMETER;
+            continue;
+        }
+        if (item.size > 0)
+        {
+            memcpy(zmq_msg_data(data), item.payload, item.size);
+        }
+        uint64_t timestamp = timestamps[i];
+        PublicationAudience& audience = *itemPublications[i]->audience;
+        if (audience.elide && GravityPublishManager::elide(audience, item.filterText, timestamp, "", NULL, data))
+        {
+            continue;
+        }
+        preparePublish(*itemPublications[i], data, "", timestamp, envelope);
+        if (itemPublications[i]->direct)
+        {
+            if (publishDirect(*itemPublications[i], item.filterText, timestamp, envelope, data) != GravityReturnCodes::SUCCESS)
+            {
+                ret = GravityReturnCodes::NOT_REGISTERED;
+            }
+            continue;
+        }
+        GravityReturnCode handedOff = handOff(*itemPublications[i]);
+        if (handedOff != GravityReturnCodes::SUCCESS)
+        {
+            zmq_msg_close(envelope);
+            zmq_msg_close(data);
+            ret = handedOff;
+            continue;
+        }
+
+        zmq_msg_init_size(header, sizeof(uint32_t) + sizeof(uint64_t) + item.filterText.size());
+        char* target = static_cast<char*>(zmq_msg_data(header));
+        memcpy(target, &item.handle, sizeof(uint32_t));
+        memcpy(target + sizeof(uint32_t), &timestamp, sizeof(uint64_t));
+        memcpy(target + sizeof(uint32_t) + sizeof(uint64_t), item.filterText.data(), item.filterText.size());
+        channels[count] = publishChannel(itemPublications[i]->shard, itemPublications[i]->priority);
+        count++;
+    }
+    if (count == 0)
+    {
+        return ret;
+    }
+
+    // Each publish thread is sent the part of the batch it publishes, over the channel for its priority
+    for (unsigned int channel = 0; channel < publishManagerPublishSWLs.size(); channel++)
+    {
+        uint32_t channelCount = static_cast<uint32_t>(std::count(channels.begin(), channels.begin() + count, channel));
+        if (channelCount == 0)
+        {
+            continue;
+        }
+        SocketWithLock& publishSWL = *publishManagerPublishSWLs[channel];
+        publishSWL.lock.Lock();
+        sendStringMessage(publishSWL.socket, "publishBatch", ZMQ_SNDMORE);
+        sendUint32Message(publishSWL.socket, channelCount, ZMQ_SNDMORE);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (channels[i] == channel)
+            {
+                channelCount--;
+                zmq_sendmsg(publishSWL.socket, &messages[3 * i], ZMQ_SNDMORE);
+                zmq_sendmsg(publishSWL.socket, &messages[3 * i + 1], ZMQ_SNDMORE);
+                zmq_sendmsg(publishSWL.socket, &messages[3 * i + 2], channelCount > 0 ? ZMQ_SNDMORE : ZMQ_DONTWAIT);
+            }
+        }
+        publishSWL.lock.Unlock();
+    }
+
+    for (uint32_t i = 0; i < 3 * count; i++)
+    {
+        zmq_msg_close(&messages[i]);
+    }
+    return ret;
+}
+
 /**
  * Used to re-register if we see that the ServiceDirectory has restarted.
  */
@@ -1685,7 +2706,7 @@ GravityReturnCode GravityNode::ServiceDirectoryReregister(string componentId, st
 	updateServiceDirectoryUrl(url);
 
     // GravityPublishManager already has this info, so just need to update the ServiceDirectory
-    publishManagerRequestSWL.lock.Lock();
+    publishManagerRequestLock.Lock();
     for (map<string, string>::const_iterator iter = publishMap.begin(); iter != publishMap.end(); ++iter)
     {
         ServiceDirectoryRegistrationPB registration;
@@ -1694,6 +2715,7 @@ GravityReturnCode GravityNode::ServiceDirectoryReregister(string componentId, st
         registration.set_type(ServiceDirectoryRegistrationPB::DATA);
         registration.set_component_id(componentId);
 		registration.set_timestamp(urlInstanceMap[iter->second]);
+		registration.set_wire_format_version(GRAVITY_WIRE_FORMAT_VERSION);
 
         // Wrap request in GravityDataProduct
         GravityDataProduct request("RegistrationRequest");
@@ -1720,7 +2742,7 @@ GravityReturnCode GravityNode::ServiceDirectoryReregister(string componentId, st
             ret = pubRet;
         }
     }
-    publishManagerRequestSWL.lock.Unlock();
+    publishManagerRequestLock.Unlock();
 
     // GravityServiceManager already has this info, so just need to update the ServiceDirectory
     serviceManagerSWL.lock.Lock();
@@ -1767,12 +2789,12 @@ GravityReturnCode GravityNode::ServiceDirectoryReregister(string componentId, st
 
     for (list<SubscriptionDetails>::const_iterator iter = origList.begin(); iter != origList.end(); ++iter)
     {
-		GravityReturnCode subRet = subscribeInternal(iter->dataProductID, *iter->subscriber, iter->filter, iter->domain);
+		GravityReturnCode subRet = subscribeInternal(iter->dataProductID, *iter->subscriber, iter->filter, iter->domain, true, iter->options);
         int numTries = 3;
         while (subRet != GravityReturnCodes::SUCCESS && numTries-- > 0)
         {
 			Log::debug("Error re-subscribing, retrying...");
-            subRet = subscribeInternal(iter->dataProductID, *iter->subscriber, iter->filter, iter->domain);
+            subRet = subscribeInternal(iter->dataProductID, *iter->subscriber, iter->filter, iter->domain, true, iter->options);
         }
         Log::message("Successfully re-subscribed %s", iter->dataProductID.c_str());
     }
@@ -1868,6 +2890,23 @@ GravityReturnCode GravityNode::request(string connectionURL, string serviceID, c
 	// Send subscription details
     requestManagerSWL.lock.Lock();
 
+	// Wait (no longer than the request itself would) for room in the channel to the request manager
+	zmq_pollitem_t pollItem;
+	pollItem.socket = requestManagerSWL.socket;
+	pollItem.events = ZMQ_POLLOUT;
+	pollItem.fd = 0;
+	pollItem.revents = 0;
+	uint64_t waitStart = getCurrentTime();
+	int ready = zmq_poll(&pollItem, 1, timeout_milliseconds < 0 ? -1 : timeout_milliseconds);
+	requestBlockedTime += getCurrentTime() - waitStart;
+	if (ready <= 0)
+	{
+		requestDropCount++;
+		requestManagerSWL.lock.Unlock();
+		Log::warning("Request for service '%s' timed out waiting to be sent", serviceID.c_str());
+		return GravityReturnCodes::QUEUE_TIMEOUT;
+	}
+
 	//set Component ID
 	dataProduct.setComponentId(componentID);
 
@@ -2238,7 +3277,10 @@ GravityReturnCode GravityNode::startHeartbeat(int64_t interval_in_microseconds)
 	//Gravity Heartbeats named by component ID
 	heartbeatName = componentID + "_GravityHeartbeat";
 
-	this->registerDataProduct(heartbeatName, GravityTransportTypes::TCP);
+	// The heartbeat thread hands heartbeats to the publish thread itself, so they take no room in the publish channel
+	GravityPublicationOptions heartbeatOptions;
+	heartbeatOptions.handoffLimit = 0;
+	this->registerDataProduct(heartbeatName, GravityTransportTypes::TCP, defaultCacheLastSentDataprodut, heartbeatOptions);
 
 	HBParams* params = new HBParams(); //(freed by thread)
 	params->zmq_context = context;
@@ -2636,7 +3678,9 @@ static std::map<GravityReturnCode,std::string> code_strings =
     {GravityReturnCodes::NO_SERVICE_PROVIDER, "NO_SERVICE_PROVIDER"},
     {GravityReturnCodes::NO_PORTS_AVAILABLE, "NO_PORTS_AVAILABLE"},
     {GravityReturnCodes::INVALID_PARAMETER, "INVALID_PARAMETER"},
-    {GravityReturnCodes::NOT_INITIALIZED, "NOT_INITIALIZED"}
+    {GravityReturnCodes::NOT_INITIALIZED, "NOT_INITIALIZED"},
+    {GravityReturnCodes::QUEUE_FULL, "QUEUE_FULL"},
+    {GravityReturnCodes::QUEUE_TIMEOUT, "QUEUE_TIMEOUT"}
   };
 
 
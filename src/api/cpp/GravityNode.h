@@ -29,13 +29,20 @@
 #include "GravitySubscriber.h"
 #include "GravityRequestor.h"
 #include "GravityHeartbeatListener.h"
+#include "GravitySubscriberCountListener.h"
+#include "GravitySlowSubscriberListener.h"
 #include "GravitySemaphore.h"
 #include "GravityServiceProvider.h"
 #include "GravitySubscriptionMonitor.h"
+#include "GravityCompression.h"
+#include "GravityPriority.h"
+#include "GravityHandoffPolicy.h"
 #include "Utility.h"
 #include "protobuf/ComponentDataLookupResponsePB.pb.h"
 #include <thread>
 #include <list>
+#include <vector>
+#include <type_traits>
 
 //This is defined in Windows for NetBIOS in nb30.h
 #ifdef DUPLICATE
@@ -50,6 +57,11 @@
 namespace gravity
 {
 
+struct PublishDetails;
+struct PublicationAudience;
+struct CacheBudget;
+class GravitySubscriptionDispatcher;
+
 /**
  * Namespace to hold Gravity Return Codes.
  */
@@ -76,7 +88,9 @@ namespace GravityReturnCodes
         NO_SERVICE_PROVIDER = -10, ///< No service provider found.
         NO_PORTS_AVAILABLE = -11, ///< No ports available
 		INVALID_PARAMETER = -12, ///< Invalid parameter. (Ex: entered a negative number for time)
-		NOT_INITIALIZED = -13  ///< The GravityNode has not successfully completed initialization yet (i.e. init has not been called or did not succeed).
+		NOT_INITIALIZED = -13,  ///< The GravityNode has not successfully completed initialization yet (i.e. init has not been called or did not succeed).
+		QUEUE_FULL = -14, ///< Too many publishes were waiting to be published to take another, so it was dropped
+		QUEUE_TIMEOUT = -15 ///< Gave up waiting for room to hand the publish or request to the thread that sends it
     };
 }
 typedef GravityReturnCodes::Codes GravityReturnCode;
@@ -102,6 +116,162 @@ namespace GravityTransportTypes
 }
 typedef GravityTransportTypes::Types GravityTransportType;
 
+/**
+ * Numeric handle for a data product registered by a GravityNode, used to publish without any
+ * lookups by data product ID.
+ */
+typedef uint32_t PublicationHandle;
+static const PublicationHandle INVALID_PUBLICATION_HANDLE = 0xFFFFFFFF; ///< Never returned for a registered data product
+
+/**
+ * Options for how the data of a registered data product is published.
+ */
+typedef struct GravityPublicationOptions
+{
+    GravityCompressionPolicy compression; ///< How the data is compressed when it is published
+    /**
+     * Data larger than this many bytes is sent to subscribers in chunks of (at most) this size, which they
+     * reassemble (or process as they arrive, see GravitySubscriber::dataChunkReceived).  0 never chunks.  Each
+     * chunk counts against the publish and subscribe high water marks, so the chunks of the largest data
+     * should fit within them.  Subscribers running a version of Gravity without chunking receive the data whole.
+     */
+    uint64_t chunkSize;
+    /**
+     * Publish from the calling thread, straight to the data product's socket, rather than handing each publish off to
+     * the GravityNode's publishing thread.  This saves a thread hop (lower latency, and publishes from different
+     * threads aren't serialized through one thread), at the cost of the calling thread doing the sending.
+     */
+    bool directPublish;
+    /**
+     * Number of values cached for each filter text (when the data product is registered with cacheLastValue set),
+     * which subscribers that join late receive in timestamp order.  0 keeps any number, for historyMaxAge to limit.
+     * Cached values of all of a GravityNode's publications are kept within PublishCacheLimitMB (in the ini file) by
+     * dropping the least recently used.
+     */
+    uint32_t historyDepth;
+    uint64_t historyMaxAge; ///< Microseconds that a value is cached for, 0 for no limit
+    /**
+     * Priority of the data product's publishes.  Each priority has its own channel to the publishing thread, which
+     * handles REALTIME publishes as soon as they arrive, and NORMAL publishes ahead of BULK ones.
+     */
+    GravityPriority priority;
+    /**
+     * Number the data products published with each filter text, so that subscribers can tell when they've missed any
+     * (dropped at a high water mark, or while reconnecting) once a later one arrives, and ask for them again.  The last
+     * retransmitDepth data products of each filter text are kept to send again.  Subscribers receive the ones they
+     * missed late, after later ones (see GravityDataProduct::getSequenceNumber), and those no longer kept are lost.  The
+     * numbers found missing, received again and lost are reported in the GravityNode's metrics.  Subscriptions at a
+     * limited rate or with a predicate aren't sent every data product, so don't ask for any again.
+     */
+    bool reliable;
+    uint32_t retransmitDepth; ///< Data products of each filter text kept to send again, when reliable
+    /**
+     * Microseconds after its timestamp that a data product is no longer wanted, 0 for no limit.  Data products that
+     * have waited longer to be published, or are cached for longer, are dropped rather than sent, and subscribers drop
+     * those that reach them (or wait to be delivered) too late.  The number dropped is reported in the metrics.
+     */
+    uint64_t timeToLive;
+    /**
+     * Drop publishes that no subscription wants (see GravityNode::hasSubscribers) in the publishing thread, before the
+     * data is compressed or handed to the GravityNode's publishing thread, and protobuf or copied data before it's
+     * serialized or copied.  When the last value is cached, the last value of each filter text published is kept as
+     * it is and cached once a subscription wants it, so late subscribers still receive it.
+     */
+    bool elideWithoutSubscribers;
+    /**
+     * Milliseconds a subscriber may fall behind, 0 not to monitor the subscribers.  Subscribers report to the publisher
+     * every second how late data products reach them and how many they've missed (dropped at a high water mark, which
+     * the data products are numbered to find), and one is slow while data products reach it later than this, or it
+     * misses any.  Subscribers becoming slow and recovering are reported to a GravitySlowSubscriberListener (see
+     * GravityNode::registerSlowSubscriberListener) and in the metrics, and slowSubscriberPolicy is applied to those that
+     * stay slow.  Timestamps are compared across hosts, so their clocks should be in sync.  Subscribers running older
+     * versions of Gravity don't report.
+     */
+    uint32_t maxSubscriberLag;
+    GravitySlowSubscriberPolicy slowSubscriberPolicy; ///< What's done about subscribers that stay slow
+    uint32_t slowSubscriberTimeout; ///< Seconds a subscriber may stay slow before slowSubscriberPolicy is applied
+    /**
+     * Most publishes of the data product that may wait to be published by the GravityNode's publishing thread, 0 for
+     * no limit.  Nothing handed to the publishing thread is lost, so when it falls this far behind handoffPolicy says
+     * what a publish does instead.  The publishes dropped and the time spent waiting are reported by
+     * GravityNode::getPublishDropCount and GravityNode::getPublishBlockedTime, and in the metrics.  Direct publications
+     * aren't handed off.  Note that by default (1000 publishes, BLOCK, a 1 second handoffTimeout) a publish can block for
+     * up to a second and then fail with QUEUE_TIMEOUT, where before the handoff never blocked (publishes beyond the
+     * socket's high water mark were silently dropped instead).
+     */
+    uint32_t handoffLimit;
+    GravityHandoffPolicy handoffPolicy; ///< What a publish does while handoffLimit publishes are waiting
+    uint32_t handoffTimeout; ///< Milliseconds a BLOCK publish waits for room before failing, 0 to wait as long as it takes
+
+    GravityPublicationOptions() : chunkSize(0), directPublish(false), historyDepth(1), historyMaxAge(0), priority(GravityPriorities::NORMAL),
+                                  reliable(false), retransmitDepth(1000), timeToLive(0), elideWithoutSubscribers(false),
+                                  maxSubscriberLag(0), slowSubscriberPolicy(GravitySlowSubscriberPolicies::DROP), slowSubscriberTimeout(5),
+                                  handoffLimit(1000), handoffPolicy(GravityHandoffPolicies::BLOCK), handoffTimeout(1000) {}
+} GravityPublicationOptions;
+
+/**
+ * Options for how the data products of a subscription are delivered to the subscriber.
+ */
+typedef struct GravitySubscriptionOptions
+{
+    /**
+     * Deliver only the latest data product received for the subscription (data product ID and filter) rather than
+     * every one.  Newer data products replace any the subscriber hasn't been called with yet, so a slow subscriber
+     * catches up at once rather than working through stale data.  The number replaced is reported by
+     * GravityNode::getConflatedCount.
+     */
+    bool conflate;
+    /**
+     * Most data products per second to receive with each filter text, 0 for all of them.  Publishers send a
+     * decimated stream, shared by every subscriber asking for the same rate, so the rest never cross the network.
+     * Subscribers in one GravityNode with the same data product ID and filter share the highest rate any of them asks
+     * for, and publishers running older versions of Gravity send every data product.
+     */
+    double maxRate;
+    /**
+     * Deliver only the data products whose content matches this predicate, empty for all of them.  A predicate
+     * compares fields of the data's protobuf message with values, joined with && and ||, e.g.
+     * "range < 10000 && kind == \"track\"" (see GravityPredicate for the details).  Publishers test it before sending, so
+     * data products that don't match never cross the network, and the subscription manager tests it again for data
+     * compressed or of a type the publisher doesn't know, and for publishers running older versions of Gravity.  Data
+     * products whose type the predicate doesn't fit (or that have no type) are dropped with a warning, and data
+     * published in chunks is only tested once it's reassembled.
+     */
+    std::string predicate;
+    /**
+     * Priority of the subscription.  Data products of more urgent subscriptions are read from the network and delivered
+     * to subscribers first (when SubscriptionDispatchThreads are configured, ahead of any less urgent deliveries queued
+     * for the same subscriber).  Subscriptions to the same data product in one GravityNode are received with the
+     * most urgent priority any of them asks for.
+     */
+    GravityPriority priority;
+    /**
+     * Microseconds after its timestamp that a data product is no longer wanted by the subscriber, 0 for no limit.  Data
+     * products that have been queued longer (by the publisher, the network or waiting to be delivered) are dropped
+     * rather than delivered, as are those older than the publisher's time to live.  Timestamps are compared across
+     * hosts, so their clocks should be in sync.  The number dropped is reported by GravityNode::getExpiredCount.
+     */
+    uint64_t timeToLive;
+
+    GravitySubscriptionOptions() : conflate(false), maxRate(0), priority(GravityPriorities::NORMAL), timeToLive(0) {}
+} GravitySubscriptionOptions;
+
+/**
+ * One data product to publish with GravityNode::publish(const std::vector<PublishItem>&).
+ */
+typedef struct PublishItem
+{
+    PublicationHandle handle; ///< PublicationHandle returned when the data product was registered
+    const void* payload; ///< data to publish (copied when published)
+    uint64_t size; ///< size of the data to publish
+    std::string filterText; ///< text filter associated with the publish
+    uint64_t timestamp; ///< time the data was created (0 for the time of the publish)
+
+    PublishItem(PublicationHandle handle = INVALID_PUBLICATION_HANDLE, const void* payload = NULL, uint64_t size = 0,
+                const std::string& filterText = "", uint64_t timestamp = 0)
+        : handle(handle), payload(payload), size(size), filterText(filterText), timestamp(timestamp) {}
+} PublishItem;
+
 typedef struct SocketWithLock
 {
 	void *socket = nullptr;
@@ -184,8 +354,21 @@ private:
 		bool receiveLastCachedValue;
 		bool isRelay;
         const GravitySubscriber* subscriber;
+        GravitySubscriptionOptions options;
     } SubscriptionDetails;
 
+    typedef struct PublicationDetails
+    {
+        std::string dataProductID;
+        PublicationHandle handle;
+        std::string envelope; ///< Serialized data product fields that are the same for every publish
+        GravityCompressionPolicy compression;
+        std::shared_ptr<PublishDetails> direct; ///< Publication to publish to directly (empty if published via the publish manager)
+        std::shared_ptr<PublicationAudience> audience; ///< Subscriptions to the publication, counted by the publish thread
+        unsigned int shard; ///< Publish thread that publishes it
+        GravityPriority priority; ///< Channel to the publish thread it's published over
+    } PublicationDetails;
+
     static const int NETWORK_TIMEOUT = 3000; // msec
     static const int NETWORK_RETRIES = 3; // attempts to connect
     bool metricsEnabled;
@@ -202,11 +385,16 @@ private:
     void* context = nullptr;
     SocketWithLock subscriptionManagerSWL;
     SocketWithLock subscriptionManagerConfigSWL;
-    SocketWithLock publishManagerRequestSWL;
-    SocketWithLock publishManagerPublishSWL;
+    std::shared_ptr<GravitySubscriptionDispatcher> subscriptionDispatcher; // Delivers to subscribers for the subscription manager
+    Semaphore publishManagerRequestLock; // Held to make requests of the publish threads
+    std::vector<void*> publishManagerRequestSockets; // Request socket of each publish thread
+    std::vector<std::shared_ptr<SocketWithLock> > publishManagerPublishSWLs; // Publish socket of each publish thread and priority (see publishChannel)
+    std::shared_ptr<CacheBudget> publishCacheBudget; // Limit on the values cached by the publish threads
     SocketWithLock serviceManagerSWL;
 	SocketWithLock serviceManagerConfigSWL;
     SocketWithLock requestManagerSWL;
+    uint64_t requestDropCount; // Requests that gave up waiting for room in requestManagerSWL (guarded by its lock)
+    uint64_t requestBlockedTime; // Microseconds requests spent waiting for room in requestManagerSWL (guarded by its lock)
 	SocketWithLock requestManagerRepSWL;
 	SocketWithLock domainListenerSWL;
 	SocketWithLock domainRecvSWL;
@@ -230,6 +418,9 @@ private:
     std::string myDomain;
     std::string componentID;
 	std::map<std::string, uint32_t> dataRegistrationTimeMap; // Maps data product id to registration time
+	std::map<std::string, PublicationHandle> publicationHandleMap; // Maps data product id to its PublicationHandle
+	std::vector<std::shared_ptr<const PublicationDetails> > publications; // Indexed by PublicationHandle (empty if unregistered), guarded by publicationsLock
+	Semaphore publicationsLock;
 	GravityConfigParser* parser;
 
 	GravityReturnCode ServiceDirectoryServiceLookup(std::string serviceOrDPID, std::string &url, std::string &domain, uint32_t &regTime);
@@ -240,15 +431,47 @@ private:
 
     // Separate actual functionality of sub/unsub methods so that they can be locked correctly
     GravityReturnCode subscribeInternal(std::string dataProductID, const GravitySubscriber& subscriber,
-                                            std::string filter, std::string domain, bool receiveLastCachedValue = true);
+                                            std::string filter, std::string domain, bool receiveLastCachedValue = true,
+                                            const GravitySubscriptionOptions& options = GravitySubscriptionOptions());
     GravityReturnCode unsubscribeInternal(std::string dataProductID, const GravitySubscriber& subscriber,
                                                 std::string filter, std::string domain);
 
     GravityReturnCode request(std::string connectionURL, std::string serviceID, const GravityDataProduct& dataProduct,
 		const GravityRequestor& requestor, uint32_t regTime, std::string requestID = "", int timeout_milliseconds = -1);
 
+    // Publish thread that publishes the given data product
+    unsigned int publishShard(const std::string& dataProductID);
+    unsigned int publishChannel(unsigned int shard, GravityPriority priority);
+    void bindPublishChannels(unsigned int shard);
+    // Start the publish threads after the first, configured by PublishThreads
+    void startPublishShards(int count);
+    // Timestamp for a publish by handle without one, guarded by publicationsLock
+    uint64_t nextPublishTimestamp();
+    uint64_t lastPublishTimestamp;
+    // Compress (if needed) the zmq_msg_t data of the given publication and initialize the zmq_msg_t envelope for it
+    void preparePublish(const PublicationDetails& publication, void* zmqMessage, const std::string& typeName,
+                        uint64_t timestamp, void* zmqEnvelope);
+    // Publish the zmq_msg_t envelope and data (which are closed) of a direct publication from this thread
+    GravityReturnCode publishDirect(const PublicationDetails& publication, const std::string& filterText, uint64_t timestamp,
+                                    void* zmqEnvelope, void* zmqData);
+    // Publish an initialized zmq_msg_t (which is closed) as the data of the given publication
+    GravityReturnCode publishMessage(PublicationHandle handle, void* zmqMessage, const std::string& typeName,
+                                        const std::string& filterText, uint64_t timestamp);
+    GravityReturnCode publishMessage(const PublicationDetails& publication, void* zmqMessage, const std::string& typeName,
+                                        const std::string& filterText, uint64_t timestamp);
+    // Publication with the given handle (empty if there isn't one), and the timestamp for a publish of it if not given
+    std::shared_ptr<const PublicationDetails> findPublication(PublicationHandle handle, uint64_t& timestamp);
+    std::shared_ptr<const PublicationDetails> findPublication(const std::string& dataProductID);
+    // True if a publish of the publication with the filter text would be elided and not kept, so needn't be made at all
+    static bool unwanted(const PublicationDetails& publication, const std::string& filterText);
+    // Takes room for a publish of the publication in its channel to the publish thread, or why there wasn't any
+    static GravityReturnCode handOff(const PublicationDetails& publication);
+    GRAVITY_API GravityReturnCode publishProtobuf(PublicationHandle handle, const google::protobuf::Message& payload,
+                                                    const std::string& typeName, const std::string& filterText, uint64_t timestamp);
+
     GRAVITY_API GravityReturnCode registerDataProductInternal(std::string dataProductID, GravityTransportType transportType,
-    		                                                  bool cacheLastValue, bool isRelay, bool localOnly);
+    		                                                  bool cacheLastValue, bool isRelay, bool localOnly,
+    		                                                  const GravityPublicationOptions& options = GravityPublicationOptions());
 
 	static void* startGravityDomainListener(void* context);
 	
@@ -296,7 +519,9 @@ public:
     GRAVITY_API void waitForExit();
 
     /**
-     * Setup a subscription to a data product through the Gravity Service Directory.
+     * Setup a subscription to a data product through the Gravity Service Directory.  Unlike publishes and requests,
+     * subscribing never waits for the subscription manager to catch up or fails for it being behind: subscribers may
+     * subscribe from their own callbacks, which the subscription manager calls, so waiting on it could deadlock.
      * \param dataProductID string ID of the data product of interest
      * \param subscriber object that implements the GravitySubscriber interface and will be notified of data availability
      * \return success flag
@@ -324,6 +549,14 @@ public:
      */
 	GRAVITY_API GravityReturnCode subscribe(std::string dataProductID, const GravitySubscriber& subscriber, std::string filter, std::string domain, bool receiveLastCachedValue);
 
+    /**
+     * \copybrief subscribe(std::string,const GravitySubscriber&,std::string,std::string,bool)
+     * \param options how the data products are delivered to the subscriber
+     * \copydetails subscribe(std::string,const GravitySubscriber&,std::string,std::string,bool)
+     */
+	GRAVITY_API GravityReturnCode subscribe(std::string dataProductID, const GravitySubscriber& subscriber, std::string filter, std::string domain,
+	                                        bool receiveLastCachedValue, const GravitySubscriptionOptions& options);
+
     /**
      * Un-subscribe from a data product
      * \param dataProductID ID of data product for which subscription is to be removed
@@ -336,23 +569,202 @@ public:
 												std::string filter="", std::string domain = "");
 
     /**
-     * Publish a data product to the Gravity Service Directory.
+     * Number of deliveries of data products queued for a subscriber.  Deliveries are only queued when
+     * SubscriptionDispatchThreads (in the ini file) has subscribers called from a pool of threads, up to
+     * SubscriptionQueueLimit for each subscriber (or each subscriber and data product, with SubscriptionStrandPerProduct),
+     * beyond which the oldest are dropped.
+     * \param subscriber the subscriber
+     * \param dataProductID only count deliveries of this data product (empty for all)
+     * \return number of calls to the subscriber's subscriptionFilled waiting to be made
+     */
+    GRAVITY_API size_t getSubscriptionQueueDepth(const GravitySubscriber& subscriber, std::string dataProductID = "");
+
+    /**
+     * Number of data products a subscriber subscribed with GravitySubscriptionOptions::conflate wasn't called with, as
+     * newer data products replaced them.  The count is kept while it's subscribed to the data product (with any
+     * filter), and dropped once it unsubscribes.
+     * \param subscriber the subscriber
+     * \param dataProductID only count data products with this ID (empty for all)
+     * \return number of data products conflated
+     */
+    GRAVITY_API uint64_t getConflatedCount(const GravitySubscriber& subscriber, std::string dataProductID = "");
+
+    /**
+     * Number of data products a subscriber wasn't called with as they outlived its time to live (see
+     * GravitySubscriptionOptions::timeToLive), or the publisher's while waiting to be delivered.  Those that reach the
+     * GravityNode past the publisher's time to live are dropped for every subscriber, and counted in the metrics
+     * instead.  The count is kept while it's subscribed to the data product (with any filter), and dropped once it
+     * unsubscribes.
+     * \param subscriber the subscriber
+     * \param dataProductID only count data products with this ID (empty for all)
+     * \return number of data products expired
+     */
+    GRAVITY_API uint64_t getExpiredCount(const GravitySubscriber& subscriber, std::string dataProductID = "");
+
+    /**
+     * Publish a data product to the Gravity Service Directory.  With the default GravityPublicationOptions (such as
+     * when registered without any), this blocks for up to a second while the publishing thread has 1000 publishes of
+     * the data product waiting, then fails with QUEUE_TIMEOUT.  Earlier versions never blocked here, silently dropping
+     * the publish instead; register with a handoffPolicy of REJECT for a publish that fails at once.
      * \param dataProduct GravityDataProduct to publish, making it available to any subscribers
      * \param filterText text filter associated with the publish
      * \param timestamp time dataProduct was created
-     * \return success flag
+     * \return success flag (QUEUE_FULL or QUEUE_TIMEOUT if it was dropped, see GravityPublicationOptions::handoffPolicy)
      */
     GRAVITY_API GravityReturnCode publish(const GravityDataProduct& dataProduct, std::string filterText = "", uint64_t timestamp = 0);
 
+    /**
+     * Publish a data product by its PublicationHandle. The data product ID, component ID, domain and registration
+     * time are filled in from the registration, so only the payload and filter are passed on to be published.
+     * \param handle PublicationHandle returned when the data product was registered
+     * \param payload protobuf message to publish as the data product's data
+     * \param filterText text filter associated with the publish
+     * \param timestamp time the data was created (defaults to now)
+     * \return success flag (NOT_REGISTERED if the handle does not refer to a registered data product, QUEUE_FULL or
+     *         QUEUE_TIMEOUT if the publish was dropped, see GravityPublicationOptions::handoffPolicy)
+     */
+    GRAVITY_API GravityReturnCode publish(PublicationHandle handle, const google::protobuf::Message& payload,
+                                            const std::string& filterText = "", uint64_t timestamp = 0);
+
+    /**
+     * Publish a data product by its PublicationHandle with raw bytes as its data.
+     * \param handle PublicationHandle returned when the data product was registered
+     * \param payload pointer to the data to publish
+     * \param size size of the data to publish
+     * \param filterText text filter associated with the publish
+     * \param timestamp time the data was created (defaults to now)
+     * \return success flag (NOT_REGISTERED if the handle does not refer to a registered data product, QUEUE_FULL or
+     *         QUEUE_TIMEOUT if the publish was dropped)
+     */
+    GRAVITY_API GravityReturnCode publish(PublicationHandle handle, const void* payload, uint64_t size,
+                                            const std::string& filterText = "", uint64_t timestamp = 0);
+
+    /**
+     * Publish a data product by its PublicationHandle, handing over the buffer holding its data rather than copying
+     * it.  The buffer is freed once the data has been sent (and is no longer cached for late subscribers).
+     * \param handle PublicationHandle returned when the data product was registered
+     * \param payload buffer holding the data to publish
+     * \param size size of the data to publish
+     * \param filterText text filter associated with the publish
+     * \param timestamp time the data was created (defaults to now)
+     * \return success flag (NOT_REGISTERED if the handle does not refer to a registered data product, QUEUE_FULL or
+     *         QUEUE_TIMEOUT if the publish was dropped)
+     */
+    GRAVITY_API GravityReturnCode publish(PublicationHandle handle, std::unique_ptr<uint8_t[]> payload, size_t size,
+                                            const std::string& filterText = "", uint64_t timestamp = 0);
+
+    /**
+     * Publish a data product by its PublicationHandle, handing over the vector holding its data rather than copying
+     * it (see publish(PublicationHandle, std::unique_ptr<uint8_t[]>, size_t, const std::string&, uint64_t)).
+     * \param handle PublicationHandle returned when the data product was registered
+     * \param payload vector holding the data to publish
+     * \param filterText text filter associated with the publish
+     * \param timestamp time the data was created (defaults to now)
+     * \return success flag (NOT_REGISTERED if the handle does not refer to a registered data product, QUEUE_FULL or
+     *         QUEUE_TIMEOUT if the publish was dropped)
+     */
+    GRAVITY_API GravityReturnCode publish(PublicationHandle handle, std::vector<uint8_t>&& payload,
+                                            const std::string& filterText = "", uint64_t timestamp = 0);
+
+    /**
+     * Publish a batch of data products.  The batch is handed to the publishing thread all at once, which costs much
+     * less per data product than publishing each one separately when many small data products are published together.
+     * Data products are sent in the order given.
+     * \param items data products to publish
+     * \return success flag (NOT_REGISTERED if any handle does not refer to a registered data product, INVALID_PARAMETER
+     *         if any payload is missing, QUEUE_FULL or QUEUE_TIMEOUT if any was dropped - the other data products are
+     *         still published)
+     */
+    GRAVITY_API GravityReturnCode publish(const std::vector<PublishItem>& items);
+
+    /**
+     * Check whether anything subscribes to a data product this GravityNode publishes.  Subscriptions are counted as
+     * publishers see them: each GravityNode subscribed with a different filter (or rate, or predicate) counts once,
+     * however many GravitySubscribers it delivers to.
+     * \param dataProductID ID of the registered data product
+     * \return true if there are any subscriptions to it
+     */
+    GRAVITY_API bool hasSubscribers(std::string dataProductID);
+
+    /**
+     * Check whether anything subscribes to the data products published with a filter text.
+     * \param dataProductID ID of the registered data product
+     * \param filterText text filter the data products are published with
+     * \return true if there are any subscriptions with a filter that the filter text starts with
+     */
+    GRAVITY_API bool hasSubscribers(std::string dataProductID, std::string filterText);
+
+    /**
+     * Get the number of subscriptions to a data product this GravityNode publishes (see hasSubscribers).
+     * \param dataProductID ID of the registered data product
+     * \return number of subscriptions, with any filter (0 if the data product isn't registered)
+     */
+    GRAVITY_API uint32_t getSubscriberCount(std::string dataProductID);
+
+    /**
+     * Get the number of subscriptions that receive the data products published with a filter text.
+     * \param dataProductID ID of the registered data product
+     * \param filterText text filter the data products are published with
+     * \return number of subscriptions with a filter that the filter text starts with
+     */
+    GRAVITY_API uint32_t getSubscriberCount(std::string dataProductID, std::string filterText);
+
+    /**
+     * Get the number of publishes of a data product this GravityNode publishes that were dropped for finding too many
+     * waiting to be published (see GravityPublicationOptions::handoffLimit).
+     * \param dataProductID ID of the registered data product
+     * \return number dropped since it was registered (0 if it isn't registered)
+     */
+    GRAVITY_API uint64_t getPublishDropCount(std::string dataProductID);
+
+    /**
+     * Get the time publishes of a data product this GravityNode publishes have spent waiting for room to be handed to
+     * the publishing thread (see GravityPublicationOptions::handoffPolicy).
+     * \param dataProductID ID of the registered data product
+     * \return microseconds waited since it was registered (0 if it isn't registered)
+     */
+    GRAVITY_API uint64_t getPublishBlockedTime(std::string dataProductID);
+
+    /**
+     * Get the number of requests this GravityNode gave up on for finding too many waiting to be sent (see
+     * request(std::string,const GravityDataProduct&,const GravityRequestor&,std::string,int,std::string)).
+     * \return number dropped since the GravityNode was initialized
+     */
+    GRAVITY_API uint64_t getRequestDropCount();
+
+    /**
+     * Get the time requests have spent waiting for room to be handed to the thread that sends them.
+     * \return microseconds waited since the GravityNode was initialized
+     */
+    GRAVITY_API uint64_t getRequestBlockedTime();
+
+    /**
+     * Publish a protobuf message of a known type by its PublicationHandle.  Same as publish(PublicationHandle,
+     * const google::protobuf::Message&, const std::string&, uint64_t), but the type name recorded with the data is
+     * taken from T without any per-message lookup.
+     * \param handle PublicationHandle returned when the data product was registered
+     * \param payload protobuf message to publish as the data product's data
+     * \param filterText text filter associated with the publish
+     * \param timestamp time the data was created (defaults to now)
+     * \return success flag (NOT_REGISTERED if the handle does not refer to a registered data product)
+     */
+    template<typename T>
+    typename std::enable_if<std::is_base_of<google::protobuf::Message, T>::value, GravityReturnCode>::type
+    publish(PublicationHandle handle, const T& payload, const std::string& filterText = "", uint64_t timestamp = 0)
+    {
+        return publishProtobuf(handle, payload, T::descriptor()->full_name(), filterText, timestamp);
+    }
+
     /**
      * Make an asynchronous request against a service provider through the Gravity Service Directory
      * \param serviceID The registered service ID of a service provider
      * \param request data product representation of the request
      * \param requestor object implementing the GravityRequestor interface that will be notified of the response
      * \param requestID identifier for this request
-     * \param timeout_milliseconds Timeout in Milliseconds (-1 for no timeout)
+     * \param timeout_milliseconds Timeout in Milliseconds (-1 for no timeout), which also limits how long it waits to be
+     *        handed to the thread that sends requests, should too many be waiting
      * \param domain domain of the network components
-     * \return success flag
+     * \return success flag (QUEUE_TIMEOUT if it couldn't be handed off in time)
      */
     GRAVITY_API GravityReturnCode request(std::string serviceID, const GravityDataProduct& request,
 										const GravityRequestor& requestor, std::string requestID = "", 
@@ -426,6 +838,65 @@ public:
      */
     GRAVITY_API GravityReturnCode registerDataProduct(std::string dataProductID, GravityTransportType transportType, bool cacheLastValue);
 
+    /**
+     * Register a data product and get a PublicationHandle with which to publish it.  A data product ID keeps the same
+     * handle if it is unregistered and registered again.
+     * \param dataProductID string ID used to uniquely identify this published data product
+     * \param transportType transport type (e.g. 'tcp', 'ipc')
+     * \param cacheLastValue flag used to signify whether or not GravityNode will cache the last sent value for a published dataproduct
+     * \param handle set to the PublicationHandle for this data product on success, INVALID_PUBLICATION_HANDLE otherwise
+     * \return success flag
+     */
+    GRAVITY_API GravityReturnCode registerDataProduct(std::string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+                                                        PublicationHandle& handle);
+
+    /**
+     * Register a data product whose data is compressed when it is published.  Subscribers decompress it as it is
+     * received; subscribers running a version of Gravity without compression support will see the compressed bytes.
+     * \param dataProductID string ID used to uniquely identify this published data product
+     * \param transportType transport type (e.g. 'tcp', 'ipc')
+     * \param cacheLastValue flag used to signify whether or not GravityNode will cache the last sent value for a published dataproduct
+     * \param compression codec, level and minimum size of data to compress
+     * \return success flag (INVALID_PARAMETER if this build of Gravity doesn't support the codec)
+     */
+    GRAVITY_API GravityReturnCode registerDataProduct(std::string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+                                                        const GravityCompressionPolicy& compression);
+
+    /**
+     * Register a data product whose data is compressed when it is published, and get a PublicationHandle with which to publish it.
+     * \param dataProductID string ID used to uniquely identify this published data product
+     * \param transportType transport type (e.g. 'tcp', 'ipc')
+     * \param cacheLastValue flag used to signify whether or not GravityNode will cache the last sent value for a published dataproduct
+     * \param compression codec, level and minimum size of data to compress
+     * \param handle set to the PublicationHandle for this data product on success, INVALID_PUBLICATION_HANDLE otherwise
+     * \return success flag (INVALID_PARAMETER if this build of Gravity doesn't support the codec)
+     */
+    GRAVITY_API GravityReturnCode registerDataProduct(std::string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+                                                        const GravityCompressionPolicy& compression, PublicationHandle& handle);
+
+    /**
+     * Register a data product with options for how its data is published (compression, chunking).
+     * \param dataProductID string ID used to uniquely identify this published data product
+     * \param transportType transport type (e.g. 'tcp', 'ipc')
+     * \param cacheLastValue flag used to signify whether or not GravityNode will cache the last sent value for a published dataproduct
+     * \param options how the data is published
+     * \return success flag (INVALID_PARAMETER if this build of Gravity doesn't support the options)
+     */
+    GRAVITY_API GravityReturnCode registerDataProduct(std::string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+                                                        const GravityPublicationOptions& options);
+
+    /**
+     * Register a data product with options for how its data is published, and get a PublicationHandle with which to publish it.
+     * \param dataProductID string ID used to uniquely identify this published data product
+     * \param transportType transport type (e.g. 'tcp', 'ipc')
+     * \param cacheLastValue flag used to signify whether or not GravityNode will cache the last sent value for a published dataproduct
+     * \param options how the data is published
+     * \param handle set to the PublicationHandle for this data product on success, INVALID_PUBLICATION_HANDLE otherwise
+     * \return success flag (INVALID_PARAMETER if this build of Gravity doesn't support the options)
+     */
+    GRAVITY_API GravityReturnCode registerDataProduct(std::string dataProductID, GravityTransportType transportType, bool cacheLastValue,
+                                                        const GravityPublicationOptions& options, PublicationHandle& handle);
+
     /**
      * Un-register a data product, resulting in its removal from the Gravity Service Directory
      * \param dataProductID string ID used to uniquely identify this published data product
@@ -467,6 +938,39 @@ public:
      */
     GRAVITY_API GravityReturnCode unregisterHeartbeatListener(std::string componentID, std::string domain = "");
 
+    /**
+     * Registers a callback to be called when a subscription to a data product this GravityNode publishes is added or
+     * removed, replacing any registered before.
+     * \param dataProductID ID of the registered data product
+     * \param listener instance of a GravitySubscriberCountListener that will be notified of the subscriber count
+     * \return success flag (NOT_REGISTERED if the data product isn't registered)
+     */
+    GRAVITY_API GravityReturnCode registerSubscriberCountListener(std::string dataProductID, const GravitySubscriberCountListener& listener);
+
+    /**
+     * Unregisters the callback for changes to the subscriptions to a data product.  It isn't called once this returns.
+     * \param dataProductID ID of the registered data product
+     * \return success flag (NOT_REGISTERED if the data product isn't registered)
+     */
+    GRAVITY_API GravityReturnCode unregisterSubscriberCountListener(std::string dataProductID);
+
+    /**
+     * Registers a callback to be called when a subscriber to a data product this GravityNode publishes becomes slow,
+     * recovers or has the slow subscriber policy applied to it (see GravityPublicationOptions::maxSubscriberLag),
+     * replacing any registered before.
+     * \param dataProductID ID of the registered data product
+     * \param listener instance of a GravitySlowSubscriberListener that will be notified of slow subscribers
+     * \return success flag (NOT_REGISTERED if the data product isn't registered)
+     */
+    GRAVITY_API GravityReturnCode registerSlowSubscriberListener(std::string dataProductID, const GravitySlowSubscriberListener& listener);
+
+    /**
+     * Unregisters the callback for slow subscribers to a data product.  It isn't called once this returns.
+     * \param dataProductID ID of the registered data product
+     * \return success flag (NOT_REGISTERED if the data product isn't registered)
+     */
+    GRAVITY_API GravityReturnCode unregisterSlowSubscriberListener(std::string dataProductID);
+
     /**
      * Register a Relay that will act as a pass-through for the given dataProductID.  It will be a publisher and subscriber
      * for the given dataProductID, but other components will only subscribe to this data if they are on the same host (localOnly == true), or
@@ -0,0 +1,245 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityPoller.cpp
+ *
+ */
+
+#include "GravityPoller.h"
+#include "GravityLogger.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace gravity
+{
+
+using namespace std;
+
+// Most events taken from epoll per wait
+#define MAX_EVENTS 256
+
+GravityPoller::GravityPoller()
+{
+	epollFd = -1;
+#ifdef __linux__
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd == -1)
+	{
+		Log::critical("Unable to create epoll instance, errno %d", errno);
+	}
+#endif
+}
+
+GravityPoller::~GravityPoller()
+{
+#ifdef __linux__
+	if (epollFd != -1)
+	{
+		close(epollFd);
+	}
+#endif
+}
+
+unsigned int GravityPoller::add(void* socket)
+{
+	unsigned int slot;
+	if (freeSlots.empty())
+	{
+		slot = slots.size();
+		slots.push_back(Slot());
+		slots[slot].pending = false;
+	}
+	else
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	slots[slot].socket = socket;
+
+#ifdef __linux__
+	int fd;
+	size_t fdSize = sizeof(fd);
+	zmq_getsockopt(socket, ZMQ_FD, &fd, &fdSize);
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.u64 = 0;
+	event.data.u32 = slot;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+	{
+		Log::critical("Unable to add socket to epoll instance, errno %d", errno);
+	}
+#else
+	zmq_pollitem_t pollItem;
+	pollItem.socket = socket;
+	pollItem.fd = 0;
+	pollItem.events = ZMQ_POLLIN;
+	pollItem.revents = 0;
+	slots[slot].pollIndex = pollItems.size();
+	pollItems.push_back(pollItem);
+	pollSlots.push_back(slot);
+#endif
+
+	// It may already have messages
+	setPending(slot);
+	return slot;
+}
+
+void GravityPoller::remove(unsigned int slot)
+{
+	if (slot >= slots.size() || slots[slot].socket == NULL)
+	{
+		return;
+	}
+
+#ifdef __linux__
+	int fd;
+	size_t fdSize = sizeof(fd);
+	zmq_getsockopt(slots[slot].socket, ZMQ_FD, &fd, &fdSize);
+	struct epoll_event event;
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, &event);
+#else
+	// Move the last poll item into the one removed
+	unsigned int index = slots[slot].pollIndex;
+	pollItems[index] = pollItems.back();
+	pollSlots[index] = pollSlots.back();
+	slots[pollSlots[index]].pollIndex = index;
+	pollItems.pop_back();
+	pollSlots.pop_back();
+#endif
+
+	// Left in pendingSlots (if it's there) until the next wait skips it
+	slots[slot].socket = NULL;
+	freeSlots.push_back(slot);
+}
+
+void GravityPoller::touch(unsigned int slot)
+{
+	if (slot < slots.size() && slots[slot].socket != NULL)
+	{
+		setPending(slot);
+	}
+}
+
+void* GravityPoller::socket(unsigned int slot) const
+{
+	return slot < slots.size() ? slots[slot].socket : NULL;
+}
+
+void GravityPoller::setPending(unsigned int slot)
+{
+#ifdef __linux__
+	if (!slots[slot].pending)
+	{
+		slots[slot].pending = true;
+		pendingSlots.push_back(slot);
+	}
+#endif
+}
+
+int GravityPoller::readable(unsigned int slot)
+{
+	if (slots[slot].socket == NULL)
+	{
+		return 0;
+	}
+	int events = 0;
+	size_t eventsSize = sizeof(events);
+	if (zmq_getsockopt(slots[slot].socket, ZMQ_EVENTS, &events, &eventsSize) == -1)
+	{
+		// e.g. the context was terminated
+		return -1;
+	}
+	return (events & ZMQ_POLLIN) != 0 ? 1 : 0;
+}
+
+int GravityPoller::wait(long timeout, vector<unsigned int>& ready)
+{
+	ready.clear();
+
+#ifdef __linux__
+	// Sockets reported readable (or touched) since the last wait won't signal again until read to the end, so check
+	// them directly. Those still readable stay pending until they're found not to be.
+	vector<unsigned int> pending;
+	pending.swap(pendingSlots);
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		slots[pending[i]].pending = false;
+	}
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		int rc = readable(pending[i]);
+		if (rc == -1)
+		{
+			return -1;
+		}
+		if (rc == 1)
+		{
+			ready.push_back(pending[i]);
+			setPending(pending[i]);
+		}
+	}
+
+	struct epoll_event events[MAX_EVENTS];
+	int count = epoll_wait(epollFd, events, MAX_EVENTS, ready.empty() ? (int) timeout : 0);
+	if (count == -1)
+	{
+		return errno == EINTR && !ready.empty() ? (int) ready.size() : -1;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		// The file descriptor signals a change of state, which may not be that there are messages to read
+		unsigned int slot = events[i].data.u32;
+		if (slot >= slots.size() || slots[slot].pending)
+		{
+			continue;
+		}
+		int rc = readable(slot);
+		if (rc == -1)
+		{
+			return -1;
+		}
+		if (rc == 1)
+		{
+			ready.push_back(slot);
+			setPending(slot);
+		}
+	}
+#else
+	int count = zmq_poll(pollItems.empty() ? NULL : &pollItems[0], (int) pollItems.size(), timeout);
+	if (count == -1)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < pollItems.size() && (int) ready.size() < count; i++)
+	{
+		if (pollItems[i].revents & ZMQ_POLLIN)
+		{
+			ready.push_back(pollSlots[i]);
+		}
+	}
+#endif
+
+	return (int) ready.size();
+}
+
+} /* namespace gravity */
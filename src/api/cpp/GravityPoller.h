@@ -0,0 +1,103 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityPoller.h
+ *
+ */
+
+#ifndef GRAVITYPOLLER_H_
+#define GRAVITYPOLLER_H_
+
+#include <zmq.h>
+#include <vector>
+
+namespace gravity
+{
+
+/**
+ * The GravityPoller is a component used internally to wait on many zmq sockets, reporting only those that are
+ * readable.  Each socket added gets a slot, a small number reused once the socket is removed, that callers can index
+ * their own per-socket state by.  On Linux the sockets' file descriptors are watched with epoll, so the cost of a wait
+ * is in the sockets that are ready rather than all those added.  Elsewhere it falls back to zmq_poll.
+ */
+class GravityPoller
+{
+private:
+	typedef struct Slot
+	{
+		void* socket; ///< NULL if the slot is free
+		bool pending; ///< in pendingSlots
+		unsigned int pollIndex; ///< index of the socket's poll item (zmq_poll only)
+	} Slot;
+
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeSlots;
+	/// Slots to check before waiting, as a zmq socket's file descriptor only signals when its state changes: once read
+	/// from (or otherwise used) a socket may still have messages without signalling again.
+	std::vector<unsigned int> pendingSlots;
+	int epollFd;
+	std::vector<zmq_pollitem_t> pollItems; ///< sockets to zmq_poll (zmq_poll only)
+	std::vector<unsigned int> pollSlots; ///< slot of each poll item (zmq_poll only)
+
+	int readable(unsigned int slot);
+	void setPending(unsigned int slot);
+public:
+	/**
+	 * Constructor GravityPoller
+	 */
+	GravityPoller();
+
+	/**
+	 * Destructor.  Doesn't close the sockets.
+	 */
+	virtual ~GravityPoller();
+
+	/**
+	 * Start waiting on a socket
+	 * \return the socket's slot
+	 */
+	unsigned int add(void* socket);
+
+	/**
+	 * Stop waiting on the socket in a slot, freeing the slot.  Must be called before the socket is closed.
+	 */
+	void remove(unsigned int slot);
+
+	/**
+	 * Check the socket in a slot on the next wait.  Must be called after using a socket other than to read messages
+	 * from it once it's been reported readable, e.g. after changing its subscriptions.
+	 */
+	void touch(unsigned int slot);
+
+	/**
+	 * The socket in a slot, NULL if the slot is free
+	 */
+	void* socket(unsigned int slot) const;
+
+	/**
+	 * Wait for sockets to be readable
+	 * \param timeout milliseconds to wait, -1 to wait indefinitely
+	 * \param ready the slots of the readable sockets
+	 * \return the number of readable sockets, or -1 if interrupted or the context was terminated
+	 */
+	int wait(long timeout, std::vector<unsigned int>& ready);
+};
+
+} /* namespace gravity */
+#endif /* GRAVITYPOLLER_H_ */
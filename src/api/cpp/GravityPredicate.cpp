@@ -0,0 +1,448 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityPredicate.cpp
+ *
+ */
+
+#include "GravityPredicate.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace gravity
+{
+
+using namespace std;
+using google::protobuf::Descriptor;
+using google::protobuf::DescriptorPool;
+using google::protobuf::EnumValueDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+namespace
+{
+
+namespace TokenTypes
+{
+	enum Types { END, NAME, NUMBER, STRING, OPERATOR, AND, OR, INVALID };
+}
+typedef TokenTypes::Types TokenType;
+
+typedef struct Token
+{
+	TokenType type;
+	string text; ///< name, number, unescaped string or operator
+} Token;
+
+// Splits the text of a predicate into tokens
+class Tokenizer
+{
+private:
+	const string& text;
+	size_t position;
+public:
+	Tokenizer(const string& text) : text(text), position(0) {}
+
+	Token next()
+	{
+		Token token;
+		while (position < text.length() && isspace((unsigned char)text[position]))
+			position++;
+		if (position == text.length())
+		{
+			token.type = TokenTypes::END;
+			return token;
+		}
+
+		size_t start = position;
+		char c = text[position];
+		if (isalpha((unsigned char)c) || c == '_')
+		{
+			while (position < text.length() && (isalnum((unsigned char)text[position]) || text[position] == '_' || text[position] == '.'))
+				position++;
+			token.type = TokenTypes::NAME;
+		}
+		else if (isdigit((unsigned char)c) || c == '-' || c == '+' || c == '.')
+		{
+			position++;
+			while (position < text.length() && (isalnum((unsigned char)text[position]) || text[position] == '.' ||
+			       ((text[position] == '-' || text[position] == '+') && (text[position - 1] == 'e' || text[position - 1] == 'E'))))
+				position++;
+			token.type = TokenTypes::NUMBER;
+		}
+		else if (c == '"')
+		{
+			position++;
+			token.type = TokenTypes::INVALID;
+			while (position < text.length())
+			{
+				c = text[position++];
+				if (c == '"')
+				{
+					token.type = TokenTypes::STRING;
+					break;
+				}
+				if (c == '\\' && position < text.length())
+					c = text[position++];
+				token.text += c;
+			}
+			return token;
+		}
+		else if (text.compare(position, 2, "&&") == 0 || text.compare(position, 2, "||") == 0)
+		{
+			position += 2;
+			token.type = c == '&' ? TokenTypes::AND : TokenTypes::OR;
+		}
+		else if (text.compare(position, 2, "==") == 0 || text.compare(position, 2, "!=") == 0 ||
+		         text.compare(position, 2, "<=") == 0 || text.compare(position, 2, ">=") == 0)
+		{
+			position += 2;
+			token.type = TokenTypes::OPERATOR;
+		}
+		else if (c == '<' || c == '>')
+		{
+			position++;
+			token.type = TokenTypes::OPERATOR;
+		}
+		else
+		{
+			token.type = TokenTypes::INVALID;
+			return token;
+		}
+		token.text.assign(text, start, position - start);
+		return token;
+	}
+};
+
+bool parseSigned(const string& text, int64_t& value)
+{
+	char* end;
+	errno = 0;
+	value = strtoll(text.c_str(), &end, 0);
+	return *end == '\0' && errno == 0;
+}
+
+bool parseUnsigned(const string& text, uint64_t& value)
+{
+	char* end;
+	errno = 0;
+	value = strtoull(text.c_str(), &end, 0);
+	return text[0] != '-' && *end == '\0' && errno == 0;
+}
+
+bool parseFloating(const string& text, double& value)
+{
+	char* end;
+	value = strtod(text.c_str(), &end);
+	return *end == '\0';
+}
+
+} /* namespace */
+
+std::shared_ptr<GravityPredicate> GravityPredicate::compile(const string& text, const string& typeName, string& error)
+{
+	const Descriptor* type = DescriptorPool::generated_pool()->FindMessageTypeByName(typeName);
+	if (type == NULL)
+	{
+		error = "unknown message type " + typeName;
+		return std::shared_ptr<GravityPredicate>();
+	}
+	return compile(text, type, error);
+}
+
+std::shared_ptr<GravityPredicate> GravityPredicate::compile(const string& text, const Descriptor* type, string& error)
+{
+	std::shared_ptr<GravityPredicate> predicate(new GravityPredicate());
+	predicate->disjuncts.push_back(vector<Comparison>());
+	Tokenizer tokenizer(text);
+	while (true)
+	{
+		// field
+		Token token = tokenizer.next();
+		if (token.type != TokenTypes::NAME)
+		{
+			error = "expected a field name";
+			return std::shared_ptr<GravityPredicate>();
+		}
+		Comparison comparison;
+		const Descriptor* messageType = type;
+		const FieldDescriptor* field = NULL;
+		size_t start = 0;
+		while (true)
+		{
+			size_t end = token.text.find('.', start);
+			string name = token.text.substr(start, end == string::npos ? string::npos : end - start);
+			field = messageType ? messageType->FindFieldByName(name) : NULL;
+			if (field == NULL)
+			{
+				error = "no field " + token.text + " in " + type->full_name();
+				return std::shared_ptr<GravityPredicate>();
+			}
+			if (field->is_repeated())
+			{
+				error = "can't compare repeated field " + token.text;
+				return std::shared_ptr<GravityPredicate>();
+			}
+			comparison.path.push_back(field->number());
+			if (end == string::npos)
+				break;
+			messageType = field->message_type();
+			start = end + 1;
+		}
+		if (field->message_type() != NULL)
+		{
+			error = "can't compare message field " + token.text;
+			return std::shared_ptr<GravityPredicate>();
+		}
+		comparison.type = field->type();
+
+		// operator
+		token = tokenizer.next();
+		if (token.type != TokenTypes::OPERATOR)
+		{
+			error = "expected a comparison after " + field->name();
+			return std::shared_ptr<GravityPredicate>();
+		}
+		comparison.op = token.text == "==" ? EQ : token.text == "!=" ? NE : token.text == "<" ? LT :
+		                token.text == "<=" ? LE : token.text == ">" ? GT : GE;
+
+		// value, and the field's default
+		token = tokenizer.next();
+		bool valid = false;
+		Value& value = comparison.value;
+		Value& defaultValue = comparison.defaultValue;
+		switch (field->cpp_type())
+		{
+		case FieldDescriptor::CPPTYPE_STRING:
+			comparison.kind = STRING;
+			value.stringValue = token.text;
+			valid = token.type == TokenTypes::STRING;
+			defaultValue.stringValue = field->default_value_string();
+			break;
+		case FieldDescriptor::CPPTYPE_BOOL:
+			comparison.kind = UNSIGNED;
+			valid = (token.type == TokenTypes::NAME && (token.text == "true" || token.text == "false")) ||
+			        (token.type == TokenTypes::NUMBER && (token.text == "0" || token.text == "1"));
+			value.unsignedValue = token.text == "true" || token.text == "1" ? 1 : 0;
+			defaultValue.unsignedValue = field->default_value_bool() ? 1 : 0;
+			break;
+		case FieldDescriptor::CPPTYPE_ENUM:
+			comparison.kind = SIGNED;
+			if (token.type == TokenTypes::NAME)
+			{
+				const EnumValueDescriptor* enumValue = field->enum_type()->FindValueByName(token.text);
+				valid = enumValue != NULL;
+				value.signedValue = valid ? enumValue->number() : 0;
+			}
+			else
+			{
+				valid = token.type == TokenTypes::NUMBER && parseSigned(token.text, value.signedValue);
+			}
+			defaultValue.signedValue = field->default_value_enum()->number();
+			break;
+		case FieldDescriptor::CPPTYPE_INT32:
+		case FieldDescriptor::CPPTYPE_INT64:
+			comparison.kind = SIGNED;
+			valid = token.type == TokenTypes::NUMBER && parseSigned(token.text, value.signedValue);
+			defaultValue.signedValue = field->cpp_type() == FieldDescriptor::CPPTYPE_INT32 ? field->default_value_int32() : field->default_value_int64();
+			break;
+		case FieldDescriptor::CPPTYPE_UINT32:
+		case FieldDescriptor::CPPTYPE_UINT64:
+			comparison.kind = UNSIGNED;
+			valid = token.type == TokenTypes::NUMBER && parseUnsigned(token.text, value.unsignedValue);
+			defaultValue.unsignedValue = field->cpp_type() == FieldDescriptor::CPPTYPE_UINT32 ? field->default_value_uint32() : field->default_value_uint64();
+			break;
+		default:
+			comparison.kind = FLOATING;
+			defaultValue.floatingValue = field->cpp_type() == FieldDescriptor::CPPTYPE_FLOAT ? field->default_value_float() : field->default_value_double();
+			break;
+		}
+		// Integer fields compared with other numbers (e.g. fractions) are compared as floating point
+		if (!valid && token.type == TokenTypes::NUMBER && comparison.kind != STRING && field->cpp_type() != FieldDescriptor::CPPTYPE_BOOL)
+		{
+			valid = parseFloating(token.text, value.floatingValue);
+			defaultValue.floatingValue = comparison.kind == SIGNED ? (double)defaultValue.signedValue :
+			                             comparison.kind == UNSIGNED ? (double)defaultValue.unsignedValue : defaultValue.floatingValue;
+			comparison.kind = FLOATING;
+		}
+		if (!valid)
+		{
+			error = "invalid value for " + field->name();
+			return std::shared_ptr<GravityPredicate>();
+		}
+		predicate->disjuncts.back().push_back(comparison);
+
+		// && or || or the end
+		token = tokenizer.next();
+		if (token.type == TokenTypes::END)
+			break;
+		if (token.type == TokenTypes::OR)
+			predicate->disjuncts.push_back(vector<Comparison>());
+		else if (token.type != TokenTypes::AND)
+		{
+			error = "expected && or || after the comparison of " + field->name();
+			return std::shared_ptr<GravityPredicate>();
+		}
+	}
+	return predicate;
+}
+
+bool GravityPredicate::find(const uint8_t* data, int size, const Comparison& comparison, size_t depth, Value& value, bool& found) const
+{
+	// The last occurrence of a field is the one that counts, and a nested message may be split across occurrences
+	CodedInputStream input(data, size);
+	bool last = depth + 1 == comparison.path.size();
+	WireFormatLite::WireType wireType = last ? WireFormatLite::WireTypeForFieldType((WireFormatLite::FieldType)comparison.type) :
+	                                           WireFormatLite::WIRETYPE_LENGTH_DELIMITED;
+	while (uint32_t tag = input.ReadTag())
+	{
+		if (WireFormatLite::GetTagFieldNumber(tag) != comparison.path[depth] || WireFormatLite::GetTagWireType(tag) != wireType)
+		{
+			if (!WireFormatLite::SkipField(&input, tag))
+				return false;
+			continue;
+		}
+
+		if (!last)
+		{
+			uint32_t length;
+			if (!input.ReadVarint32(&length) || length > (uint32_t)(size - input.CurrentPosition()))
+				return false;
+			if (!find(data + input.CurrentPosition(), length, comparison, depth + 1, value, found) || !input.Skip(length))
+				return false;
+			continue;
+		}
+
+		uint64_t varint = 0;
+		uint32_t fixed32 = 0;
+		uint64_t fixed64 = 0;
+		bool ok = true;
+		switch (wireType)
+		{
+		case WireFormatLite::WIRETYPE_VARINT: ok = input.ReadVarint64(&varint); break;
+		case WireFormatLite::WIRETYPE_FIXED32: ok = input.ReadLittleEndian32(&fixed32); break;
+		case WireFormatLite::WIRETYPE_FIXED64: ok = input.ReadLittleEndian64(&fixed64); break;
+		default:
+		{
+			uint32_t length;
+			ok = input.ReadVarint32(&length) && input.ReadString(&value.stringValue, length);
+			break;
+		}
+		}
+		if (!ok)
+			return false;
+
+		switch (comparison.type)
+		{
+		case FieldDescriptor::TYPE_INT32:
+		case FieldDescriptor::TYPE_INT64:
+		case FieldDescriptor::TYPE_ENUM: value.signedValue = (int64_t)varint; break;
+		case FieldDescriptor::TYPE_SINT32: value.signedValue = WireFormatLite::ZigZagDecode32((uint32_t)varint); break;
+		case FieldDescriptor::TYPE_SINT64: value.signedValue = WireFormatLite::ZigZagDecode64(varint); break;
+		case FieldDescriptor::TYPE_UINT32:
+		case FieldDescriptor::TYPE_UINT64: value.unsignedValue = varint; break;
+		case FieldDescriptor::TYPE_BOOL: value.unsignedValue = varint != 0 ? 1 : 0; break;
+		case FieldDescriptor::TYPE_FIXED32: value.unsignedValue = fixed32; break;
+		case FieldDescriptor::TYPE_SFIXED32: value.signedValue = (int32_t)fixed32; break;
+		case FieldDescriptor::TYPE_FIXED64: value.unsignedValue = fixed64; break;
+		case FieldDescriptor::TYPE_SFIXED64: value.signedValue = (int64_t)fixed64; break;
+		case FieldDescriptor::TYPE_FLOAT:
+		{
+			float f;
+			memcpy(&f, &fixed32, sizeof(f));
+			value.floatingValue = f;
+			break;
+		}
+		case FieldDescriptor::TYPE_DOUBLE: memcpy(&value.floatingValue, &fixed64, sizeof(value.floatingValue)); break;
+		default: break;
+		}
+		found = true;
+	}
+	return input.ConsumedEntireMessage() || input.CurrentPosition() == size;
+}
+
+template <typename T> bool GravityPredicate::compare(const T& a, const T& b, Operator op)
+{
+	switch (op)
+	{
+	case EQ: return a == b;
+	case NE: return !(a == b);
+	case LT: return a < b;
+	case LE: return !(b < a);
+	case GT: return b < a;
+	default: return !(a < b);
+	}
+}
+
+bool GravityPredicate::test(const uint8_t* data, int size, const Comparison& comparison) const
+{
+	Value value;
+	bool found = false;
+	if (!find(data, size, comparison, 0, value, found))
+		return false;
+	if (!found)
+		value = comparison.defaultValue;
+	else if (comparison.kind == FLOATING)
+	{
+		// Integer fields compared with fractions
+		switch (comparison.type)
+		{
+		case FieldDescriptor::TYPE_FLOAT:
+		case FieldDescriptor::TYPE_DOUBLE: break;
+		case FieldDescriptor::TYPE_UINT32:
+		case FieldDescriptor::TYPE_UINT64:
+		case FieldDescriptor::TYPE_FIXED32:
+		case FieldDescriptor::TYPE_FIXED64: value.floatingValue = (double)value.unsignedValue; break;
+		default: value.floatingValue = (double)value.signedValue; break;
+		}
+	}
+
+	switch (comparison.kind)
+	{
+	case SIGNED: return compare(value.signedValue, comparison.value.signedValue, comparison.op);
+	case UNSIGNED: return compare(value.unsignedValue, comparison.value.unsignedValue, comparison.op);
+	case FLOATING: return compare(value.floatingValue, comparison.value.floatingValue, comparison.op);
+	default: return compare(value.stringValue, comparison.value.stringValue, comparison.op);
+	}
+}
+
+bool GravityPredicate::matches(const void* data, size_t size) const
+{
+	if (size > (size_t)INT_MAX)
+		return false;
+	for (size_t i = 0; i < disjuncts.size(); i++)
+	{
+		bool holds = true;
+		for (size_t j = 0; holds && j < disjuncts[i].size(); j++)
+		{
+			holds = test(static_cast<const uint8_t*>(data), (int)size, disjuncts[i][j]);
+		}
+		if (holds)
+			return true;
+	}
+	return false;
+}
+
+} /* namespace gravity */
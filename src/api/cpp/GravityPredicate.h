@@ -0,0 +1,110 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityPredicate.h
+ *
+ */
+
+#ifndef GRAVITYPREDICATE_H_
+#define GRAVITYPREDICATE_H_
+
+#include "Utility.h"
+
+#include <google/protobuf/descriptor.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gravity
+{
+
+/**
+ * A test of the fields of data published as a protobuf message, used internally to filter the data products of a
+ * subscription by their content.  A predicate is comparisons of fields with values, joined with && and ||
+ * (&& binding tighter), e.g.
+ *
+ *     range < 10000 && kind == "track" || alarm == true
+ *
+ * Fields are named as in the message type, with nested messages' fields reached with '.' (e.g. position.x).  Only
+ * singular fields of scalar, string and enum types can be compared, using ==, !=, <, <=, > and >=.  Values are
+ * numbers, true or false, strings in double quotes (with \" and \\ escapes) and names of enum values.  A field that
+ * isn't set has its default value.
+ *
+ * A predicate is compiled against the message type once, and then tested against serialized data without parsing
+ * it: only the fields compared are decoded.
+ */
+class GravityPredicate
+{
+private:
+	typedef enum Operator { EQ, NE, LT, LE, GT, GE } Operator;
+	typedef enum Kind { SIGNED, UNSIGNED, FLOATING, STRING } Kind;
+
+	typedef struct Value
+	{
+		int64_t signedValue;
+		uint64_t unsignedValue;
+		double floatingValue;
+		std::string stringValue;
+		Value() : signedValue(0), unsignedValue(0), floatingValue(0) {}
+	} Value;
+
+	typedef struct Comparison
+	{
+		std::vector<int> path; ///< field numbers from the top level message down to the field compared
+		google::protobuf::FieldDescriptor::Type type; ///< type of the field compared
+		Kind kind; ///< how the field and value are compared
+		Operator op;
+		Value value;
+		Value defaultValue; ///< of the field, when it isn't set
+	} Comparison;
+
+	std::vector< std::vector<Comparison> > disjuncts; ///< the predicate holds if all the comparisons of any of these do
+
+	GravityPredicate() {}
+	bool find(const uint8_t* data, int size, const Comparison& comparison, size_t depth, Value& value, bool& found) const;
+	template <typename T> static bool compare(const T& a, const T& b, Operator op);
+	bool test(const uint8_t* data, int size, const Comparison& comparison) const;
+public:
+	/**
+	 * Compile a predicate on the fields of a message type
+	 * \param text the predicate
+	 * \param type the message type
+	 * \param error set to why the predicate can't be compiled
+	 * \return the compiled predicate, or empty if it can't be compiled
+	 */
+	static std::shared_ptr<GravityPredicate> compile(const std::string& text, const google::protobuf::Descriptor* type, std::string& error);
+
+	/**
+	 * Compile a predicate on the fields of a message type known to this process (i.e. one compiled into it)
+	 * \param text the predicate
+	 * \param typeName full name of the message type, as given by a GravityDataProduct's getTypeName
+	 * \param error set to why the predicate can't be compiled
+	 * \return the compiled predicate, or empty if it can't be compiled
+	 */
+	static std::shared_ptr<GravityPredicate> compile(const std::string& text, const std::string& typeName, std::string& error);
+
+	/**
+	 * Test serialized data of the message type against the predicate
+	 * \return true if it holds (false if the data can't be decoded)
+	 */
+	bool matches(const void* data, size_t size) const;
+};
+
+} /* namespace gravity */
+#endif /* GRAVITYPREDICATE_H_ */
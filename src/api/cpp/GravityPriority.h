@@ -0,0 +1,51 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravityPriority.h
+ *
+ */
+
+#ifndef GRAVITYPRIORITY_H_
+#define GRAVITYPRIORITY_H_
+
+namespace gravity
+{
+
+/**
+ * Namespace to hold Gravity Priorities.
+ */
+namespace GravityPriorities
+{
+    /**
+     * Classes of traffic, most urgent first.  Data products of a higher priority are handed to the publishing thread
+     * over their own channel, and received and delivered to subscribers ahead of those of a lower priority, so that
+     * e.g. a small alarm isn't held up behind a burst of large images.
+     */
+    enum Types
+    {
+        REALTIME = 0, ///< Control and alarm traffic, handled as soon as it arrives
+        NORMAL = 1, ///< Everything else (the default)
+        BULK = 2 ///< Large or high volume data that can wait for the rest
+    };
+    static const unsigned int COUNT = 3; ///< Number of priorities
+}
+typedef GravityPriorities::Types GravityPriority;
+
+} /* namespace gravity */
+#endif /* GRAVITYPRIORITY_H_ */
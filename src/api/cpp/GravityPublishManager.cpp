@@ -28,6 +28,8 @@
 #include "CommUtil.h"
 #include "GravityMetricsUtil.h"
 #include "zmq.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <sstream>
 #include <algorithm>
 
@@ -35,17 +37,16 @@ namespace gravity
 {
 
 using namespace std;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
 
-bool sortCacheValues (const std::shared_ptr<CacheValue> &i, const std::shared_ptr<CacheValue> &j)
-{
-    return i->timestamp < j->timestamp;
-}
-
-GravityPublishManager::GravityPublishManager(void* context)
+GravityPublishManager::GravityPublishManager(void* context, unsigned int shard, const std::shared_ptr<CacheBudget>& cacheBudget)
 {
 	// This is the zmq context that is shared with the GravityNode. Must use
 	// a shared context to establish an inproc socket.
 	this->context = context;
+	this->shard = shard;
+	this->cacheBudget = cacheBudget;
 
     // Default to no metrics
     metricsEnabled = false;
@@ -58,27 +59,36 @@ GravityPublishManager::~GravityPublishManager() {}
 
 void GravityPublishManager::start()
 {
-	// Messages
-	zmq_msg_t event;
-
 	// Set up the inproc sockets to subscribe and unsubscribe to messages from
 	// the GravityNode
 	gravityNodeResponseSocket = zmq_socket(context, ZMQ_REP);
-	zmq_bind(gravityNodeResponseSocket, PUB_MGR_REQ_URL);
+	zmq_bind(gravityNodeResponseSocket, shardURL(PUB_MGR_REQ_URL, shard).c_str());
 
-	gravityNodeSubscribeSocket = zmq_socket(context, ZMQ_SUB);
-    zmq_connect(gravityNodeSubscribeSocket, PUB_MGR_PUB_URL);
+	// A channel for the publishes of each priority, which (unlike a subscription) never drops any; publications limit
+	// how many of theirs may wait in it (see enqueuePublish)
+	for (unsigned int priority = 0; priority < GravityPriorities::COUNT; priority++)
+	{
+		int hwm = 0;
+		gravityNodeSubscribeSockets[priority] = zmq_socket(context, ZMQ_PULL);
+		zmq_setsockopt(gravityNodeSubscribeSockets[priority], ZMQ_RCVHWM, &hwm, sizeof(hwm));
+		zmq_connect(gravityNodeSubscribeSockets[priority], channelURL(shard, static_cast<GravityPriority>(priority)).c_str());
+	}
 	// Create the socket to receive heartbeat publish messages
-	zmq_bind(gravityNodeSubscribeSocket,PUB_MGR_HB_URL);
-    zmq_setsockopt(gravityNodeSubscribeSocket, ZMQ_SUBSCRIBE, NULL, 0);
+	if (shard == 0)
+	{
+		zmq_bind(gravityNodeSubscribeSockets[GravityPriorities::NORMAL],PUB_MGR_HB_URL);
+	}
 
-    // Setup socket to respond to metrics requests
+    // Setup socket to respond to metrics requests (each publish thread's metrics are collected separately)
     gravityMetricsSocket = zmq_socket(context, ZMQ_REP);
-    zmq_bind(gravityMetricsSocket, GRAVITY_PUB_METRICS_REQ);
+    zmq_bind(gravityMetricsSocket, shardURL(GRAVITY_PUB_METRICS_REQ, shard).c_str());
 
     // Setup socket to listen for metrics to be published
     metricsPublishSocket = zmq_socket(context, ZMQ_SUB);
-    zmq_connect(metricsPublishSocket, GRAVITY_METRICS_PUB);
+    if (shard == 0)
+    {
+        zmq_connect(metricsPublishSocket, GRAVITY_METRICS_PUB);
+    }
     zmq_setsockopt(metricsPublishSocket, ZMQ_SUBSCRIBE, NULL, 0);
 
 	// Configure polling on our sockets
@@ -89,12 +99,15 @@ void GravityPublishManager::start()
 	pollItemResponse.revents = 0;
 	pollItems.push_back(pollItemResponse);
 
-    zmq_pollitem_t pollItemSubscribe;
-    pollItemSubscribe.socket = gravityNodeSubscribeSocket;
-    pollItemSubscribe.events = ZMQ_POLLIN;
-    pollItemSubscribe.fd = 0;
-    pollItemSubscribe.revents = 0;
-    pollItems.push_back(pollItemSubscribe);
+    for (unsigned int priority = 0; priority < GravityPriorities::COUNT; priority++)
+    {
+        zmq_pollitem_t pollItemSubscribe;
+        pollItemSubscribe.socket = gravityNodeSubscribeSockets[priority];
+        pollItemSubscribe.events = ZMQ_POLLIN;
+        pollItemSubscribe.fd = 0;
+        pollItemSubscribe.revents = 0;
+        pollItems.push_back(pollItemSubscribe);
+    }
 
     // Poll the metrics request socket
     zmq_pollitem_t metricsRequestPollItem;
@@ -112,13 +125,17 @@ void GravityPublishManager::start()
     metricsPollItem.revents = 0;
     pollItems.push_back(metricsPollItem);
 
-	ready();
+	// The GravityNode starts any other publish threads once it has read its configuration, and doesn't wait for them
+	if (shard == 0)
+	{
+		ready();
+	}
 
 	// Process forever...
 	while (true)
 	{
-		// Start polling socket(s), blocking while we wait
-		int rc = zmq_poll(&pollItems[0], pollItems.size(), -1); // 0 --> return immediately, -1 --> blocks
+		// Start polling socket(s), blocking while we wait unless there are cached values to replay
+		int rc = zmq_poll(&pollItems[0], pollItems.size(), replays.empty() ? -1 : 0); // 0 --> return immediately, -1 --> blocks
 		if (rc == -1)
 		{
 			// Interrupted
@@ -145,44 +162,49 @@ void GravityPublishManager::start()
 			{
 				setHWM();
 			}
+			else if (command == "set_cache_limit")
+			{
+				setCacheLimit();
+			}
 			else
 			{
 				Log::warning("GravityPublishManager received unknown command '%s' from GravityNode", command.c_str());
 			}
 		}
 
-		if (pollItems[1].revents & ZMQ_POLLIN)
+		// Publishes from the gravity node: all the REALTIME ones waiting, and then NORMAL ones ahead of BULK ones, with
+		// any REALTIME ones that arrive in the meantime handled between each
+		bool killed = false;
+		for (unsigned int priority = 0; !killed && priority < GravityPriorities::COUNT; priority++)
 		{
-            // Get new GravityNode request
-            string command = readStringMessage(gravityNodeSubscribeSocket);
-            Log::trace("GravityPublishManager, pollItems[1], command = %s", command.c_str());
-
-			// message from gravity node should be either a publish or kill request
-			if (command == "publish")
-			{
-				publish(pollItems[1].socket);
-			}
-			else if (command == "kill")
-			{
-				break;
-			}
-			else
+			int slice = priority == GravityPriorities::REALTIME ? -1 : priority == GravityPriorities::NORMAL ? NORMAL_SLICE_SIZE : 1;
+			void* socket = gravityNodeSubscribeSockets[priority];
+			while (!killed && slice-- != 0 && readable(socket))
 			{
-                Log::critical("Received unknown publish command %s", command.c_str());
+				killed = !processPublishCommand(socket);
+				while (!killed && priority != GravityPriorities::REALTIME && readable(gravityNodeSubscribeSockets[GravityPriorities::REALTIME]))
+				{
+					killed = !processPublishCommand(gravityNodeSubscribeSockets[GravityPriorities::REALTIME]);
+				}
 			}
 		}
+		if (killed)
+		{
+			break;
+		}
 
-        if (pollItems[2].revents & ZMQ_POLLIN)
+        if (pollItems[METRICS_REQUEST_ITEM].revents & ZMQ_POLLIN)
         {
             // Received a command from the metrics control
-            void* socket = pollItems[2].socket;
+            void* socket = pollItems[METRICS_REQUEST_ITEM].socket;
             string command = readStringMessage(socket);
-            Log::trace("GravityPublishManager, pollItems[2], command = %s", command.c_str());
+            Log::trace("GravityPublishManager, metrics request, command = %s", command.c_str());
 
             if (command == "MetricsEnable")
             {
                 // Clear any metrics data
                 metricsData.reset();
+                collectPublicationMetrics(false);
 
                 // Enable metrics
                 metricsEnabled = true;
@@ -203,6 +225,7 @@ void GravityPublishManager::start()
                 // The GravityMetricsManager has request our metrics data
 
                 // Mark the collection as completed
+                collectPublicationMetrics(true);
                 metricsData.done();
 
                 // Respond with metrics
@@ -213,84 +236,150 @@ void GravityPublishManager::start()
             }
         }
 
-        if (pollItems[3].revents & ZMQ_POLLIN)
+        if (pollItems[METRICS_PUBLISH_ITEM].revents & ZMQ_POLLIN)
         {
-            string command = readStringMessage(pollItems[3].socket);
-            Log::trace("GravityPublishManager, pollItems[3], command = %s", command.c_str());
+            string command = readStringMessage(pollItems[METRICS_PUBLISH_ITEM].socket);
+            Log::trace("GravityPublishManager, metrics publish, command = %s", command.c_str());
             if (command == "publish")
             {
-                // This is an instruction to publish the attached metrics data
-                publish(pollItems[3].socket);
+                // This is an instruction to publish the attached metrics data, which every publish thread hears but
+                // only the one with the metrics data product publishes
+                void* socket = pollItems[METRICS_PUBLISH_ITEM].socket;
+                map<string,std::shared_ptr<PublishDetails> >::iterator iter = publishMapByID.find(readStringMessage(socket));
+                publish(socket, iter == publishMapByID.end() ? NULL : iter->second.get());
             }
         }
 
-		// Check for publish updates
-		for (unsigned int i = 4; i < pollItems.size(); i++)
+		// Check for subscription events
+		for (unsigned int i = PUBLICATION_ITEMS; i < pollItems.size(); i++)
 		{
 			if (pollItems[i].revents & ZMQ_POLLIN)
 			{
-				// Read whether it's a new subscription from socket
-				zmq_msg_init(&event);
-				zmq_recvmsg(pollItems[i].socket, &event, 0);
-				bool newsub = *((char*)zmq_msg_data(&event)) == 1;  //This message is coming from ZMQ.  The subscriber doesn't send messages on a subscribed socket.
-				zmq_msg_close(&event);
-
-				if (newsub)
-				{					
-				    std::shared_ptr<PublishDetails> pd = publishMapBySocket[pollItems[i].socket];
-				    // can't log here because the network logging uses this code - any logs here will result in an
-				    // infinite loop, or a deadlock.
-				    // This message can be useful though, so leaving it in, but commented out.
-//				    Log::debug("got a new subscriber for %s, resending %d values", pd->dataProductID.c_str(), pd->lastCachedValues.size());
-
-				    list<std::shared_ptr<CacheValue> > values;
-				    for (map<string,std::shared_ptr<CacheValue> >::iterator iter = pd->lastCachedValues.begin(); iter != pd->lastCachedValues.end(); iter++)
-				        values.push_back(iter->second);
-
-					
-				    // we shouldn't be doing this often, so just sort these when we need it.
-                    values.sort(sortCacheValues);
-				    for (list<std::shared_ptr<CacheValue> >::iterator iter = values.begin(); iter != values.end(); iter++)
+				if (pollItems[i].socket)
+				{
+					PublishDetails* publishDetails = publishMapBySocket[pollItems[i].socket].get();
+					if (processSubscriptionEvents(*publishDetails))
+					{
+						replays.insert(publishDetails);
+					}
+					continue;
+				}
+				map<PollFD,std::shared_ptr<PublishDetails> >::iterator iter = publishMapByFD.find(pollItems[i].fd);
+				if (iter != publishMapByFD.end())
+				{
+					PublishDetails& publishDetails = *iter->second;
+					publishDetails.lock.Lock();
+					if (processSubscriptionEvents(publishDetails))
 					{
-						//we have a new subscriber and are going to send it the last cached data product value. 
-						char* bytes = (*iter)->value;
-						int size = (*iter)->size;
-						//Deserialize cache bytes to a data product and mark cached
-						GravityDataProduct dataProduct(bytes, size);
-						dataProduct.setIsCachedDataproduct(true);
-						int newSize = dataProduct.getSize();
-						//Serialize back to send over socket
-						char* newBytes = new char[newSize];
-						dataProduct.serializeToArray(newBytes);		
-						// See comment above re the use of log statements in this section of code
-						//Log::trace("Publishing data product %s..., Which is cached? %s", dataProduct.getDataProductID().c_str(),dataProduct.isCachedDataproduct() ? "true" : "false");
-				        publish(pd->socket, (*iter)->filterText, newBytes, newSize);
-				        delete[] newBytes;
+						replays.insert(&publishDetails);
 					}
+					publishDetails.lock.Unlock();
 				}
 			}
 		}
+
+		// Send new subscribers some more of the cached values they missed
+		replayCachedValues();
 	}
 
 	// Clean up any pub sockets
 	for (map<void*,std::shared_ptr<PublishDetails> >::iterator iter = publishMapBySocket.begin(); iter != publishMapBySocket.end(); iter++)
 	{
-	    std::shared_ptr<PublishDetails> pubDetails = publishMapBySocket[iter->second->socket];
-		zmq_close(pubDetails->pollItem.socket);
-        for (map<string,std::shared_ptr<CacheValue> >::iterator valIter = pubDetails->lastCachedValues.begin(); valIter != pubDetails->lastCachedValues.end(); valIter++)
-            delete [] valIter->second->value;
-        pubDetails->lastCachedValues.clear();
+	    std::shared_ptr<PublishDetails> pubDetails = iter->second;
+	    pubDetails->lock.Lock();
+		zmq_close(pubDetails->socket);
+		pubDetails->socket = NULL;
+        clearCachedValues(*pubDetails);
+	    pubDetails->lock.Unlock();
 	}
 
+	replays.clear();
 	publishMapBySocket.clear();
+	publishMapByFD.clear();
 	publishMapByID.clear();
+	publishMapByHandle.clear();
 
     zmq_close(gravityNodeResponseSocket);
-	zmq_close(gravityNodeSubscribeSocket);
+	for (unsigned int priority = 0; priority < GravityPriorities::COUNT; priority++)
+	{
+		zmq_close(gravityNodeSubscribeSockets[priority]);
+	}
     zmq_close(gravityMetricsSocket);
     zmq_close(metricsPublishSocket);
 }
 
+bool GravityPublishManager::processPublishCommand(void* socket)
+{
+    // Get new GravityNode request
+    string command = readStringMessage(socket);
+    Log::trace("GravityPublishManager, publish channel, command = %s", command.c_str());
+
+    // message from gravity node should be either a publish or kill request
+    if (command == "publishHandle")
+    {
+        publishByHandle(socket);
+    }
+    else if (command == "publish")
+    {
+        publish(socket);
+    }
+    else if (command == "publishBatch")
+    {
+        publishBatch(socket);
+    }
+    else if (command == "replay")
+    {
+        // A direct publication has new subscribers
+        uint32_t handle = readUint32Message(socket);
+        if (handle < publishMapByHandle.size() && publishMapByHandle[handle])
+        {
+            replays.insert(publishMapByHandle[handle].get());
+        }
+    }
+    else if (command == "kill")
+    {
+        return false;
+    }
+    else
+    {
+        Log::critical("Received unknown publish command %s", command.c_str());
+    }
+    return true;
+}
+
+bool GravityPublishManager::readable(void* socket)
+{
+    int events = 0;
+    size_t eventsSize = sizeof(events);
+    return zmq_getsockopt(socket, ZMQ_EVENTS, &events, &eventsSize) == 0 && (events & ZMQ_POLLIN) != 0;
+}
+
+std::string GravityPublishManager::channelURL(unsigned int shard, GravityPriority priority)
+{
+    // The NORMAL channel is the one publish threads had before there were priorities
+    string url = shardURL(PUB_MGR_PUB_URL, shard);
+    if (priority == GravityPriorities::REALTIME)
+    {
+        url += "_realtime";
+    }
+    else if (priority == GravityPriorities::BULK)
+    {
+        url += "_bulk";
+    }
+    return url;
+}
+
+std::string GravityPublishManager::shardURL(const std::string& url, unsigned int shard)
+{
+    if (shard == 0)
+    {
+        return url;
+    }
+    stringstream ss;
+    ss << url << "_" << shard;
+    return ss.str();
+}
+
 void GravityPublishManager::ready()
 {
 	// Create the request socket
@@ -311,9 +400,36 @@ void GravityPublishManager::registerDataProduct()
 	// Read the data product id for this request
 	string dataProductID = readStringMessage(gravityNodeResponseSocket);
 
+	// Read the handle the GravityNode uses to publish it
+	uint32_t handle = readUint32Message(gravityNodeResponseSocket);
+
 	//Read flag to cache last sent data product or not
 	bool cacheLastValue = readIntMessage(gravityNodeResponseSocket);
 
+	// Read the size of the chunks to send large data in
+	uint64_t chunkSize = readUint64Message(gravityNodeResponseSocket);
+
+	// Read flag to have the GravityNode publish directly
+	bool direct = readIntMessage(gravityNodeResponseSocket);
+
+	// Read the number of values to cache for each filter and how long for
+	uint32_t historyDepth = readUint32Message(gravityNodeResponseSocket);
+	uint64_t historyMaxAge = readUint64Message(gravityNodeResponseSocket);
+
+	// Read the number of data products kept to send again, if the publication is reliable
+	uint32_t retransmitDepth = readUint32Message(gravityNodeResponseSocket);
+
+	// Read how long data products are wanted for
+	uint64_t timeToLive = readUint64Message(gravityNodeResponseSocket);
+
+	// Read flag to have the GravityNode drop publishes that no subscription wants
+	bool elide = readIntMessage(gravityNodeResponseSocket);
+
+	// Read how far behind subscribers may fall, and what's done about those that stay slow
+	uint32_t maxSubscriberLag = readUint32Message(gravityNodeResponseSocket);
+	GravitySlowSubscriberPolicy slowSubscriberPolicy = static_cast<GravitySlowSubscriberPolicy>(readIntMessage(gravityNodeResponseSocket));
+	uint32_t slowSubscriberTimeout = readUint32Message(gravityNodeResponseSocket);
+
 	// Read the publish transport type
 	string transportType = readStringMessage(gravityNodeResponseSocket);
 
@@ -335,6 +451,10 @@ void GravityPublishManager::registerDataProduct()
     }
     int verbose = 1;
     zmq_setsockopt(pubSocket, ZMQ_XPUB_VERBOSE, &verbose, sizeof(verbose));
+#ifdef ZMQ_XPUB_VERBOSER
+    // Every unsubscription too, not just the last from a filter, so that subscribers can be counted
+    zmq_setsockopt(pubSocket, ZMQ_XPUB_VERBOSER, &verbose, sizeof(verbose));
+#endif
 
 	// Set high water mark
 	zmq_setsockopt(pubSocket, ZMQ_SNDHWM, &publishHWM, sizeof(publishHWM));
@@ -369,26 +489,73 @@ void GravityPublishManager::registerDataProduct()
         }
     }
 
-    sendStringMessage(gravityNodeResponseSocket, connectionURL, ZMQ_DONTWAIT);
-
-	// Create poll item for response to this request
+	// Create poll item for response to this request. The socket of a direct publication is also used by the
+	// publishing thread, so only its file descriptor is polled, and the socket is used with its lock held.
 	zmq_pollitem_t pollItem;
 	pollItem.socket = pubSocket;
 	pollItem.events = ZMQ_POLLIN;
 	pollItem.fd = 0;
 	pollItem.revents = 0;
+	if (direct)
+	{
+		size_t fdSize = sizeof(pollItem.fd);
+		zmq_getsockopt(pubSocket, ZMQ_FD, &pollItem.fd, &fdSize);
+		pollItem.socket = NULL;
+	}
 	pollItems.push_back(pollItem);
 
     // Track dataProductID->socket mapping
 	std::shared_ptr<PublishDetails> publishDetails = std::shared_ptr<PublishDetails>(new PublishDetails);
     publishDetails->url = connectionURL;
     publishDetails->dataProductID = dataProductID;
+    publishDetails->handle = handle;
     publishDetails->socket = pubSocket;
 	publishDetails->pollItem = pollItem;
 	publishDetails->cacheLastValue = cacheLastValue;
+    publishDetails->chunkSize = chunkSize;
+    publishDetails->historyDepth = historyDepth;
+    publishDetails->historyMaxAge = historyMaxAge;
+    publishDetails->retransmitDepth = retransmitDepth;
+    publishDetails->timeToLive = timeToLive;
+    publishDetails->maxSubscriberLag = maxSubscriberLag;
+    publishDetails->slowSubscriberPolicy = slowSubscriberPolicy;
+    publishDetails->slowSubscriberTimeout = (uint64_t) slowSubscriberTimeout * 1000000;
+    publishDetails->cacheBudget = cacheBudget;
+    publishDetails->direct = direct;
+    publishDetails->messageCount = 0;
+    publishDetails->byteCount = 0;
+    publishDetails->retransmitCount = 0;
+    publishDetails->expiredCount = 0;
+    publishDetails->slowSubscriberCount = 0;
+    publishDetails->subscriberDropCount = 0;
+    publishDetails->subscriberLag = 0;
+    publishDetails->handoffDropCount = 0;
+    publishDetails->handoffBlockedTime = 0;
+    publishDetails->cacheSequence = 0;
+    publishDetails->replaying = false;
+    publishDetails->audience.reset(new PublicationAudience());
+    publishDetails->audience->elide = elide;
+    publishDetails->audience->keepElided = elide && cacheLastValue;
+
+    // Reply with the URL, a reference to the publication's audience and, for a direct publication, a reference to it
+    // for the GravityNode to take
+    sendStringMessage(gravityNodeResponseSocket, connectionURL, ZMQ_SNDMORE);
+    std::shared_ptr<PublicationAudience>* audience = new std::shared_ptr<PublicationAudience>(publishDetails->audience);
+    sendUint64Message(gravityNodeResponseSocket, reinterpret_cast<uintptr_t>(audience), ZMQ_SNDMORE);
+    std::shared_ptr<PublishDetails>* reference = direct ? new std::shared_ptr<PublishDetails>(publishDetails) : NULL;
+    sendUint64Message(gravityNodeResponseSocket, reinterpret_cast<uintptr_t>(reference), ZMQ_DONTWAIT);
 
     publishMapByID[dataProductID] = publishDetails;
     publishMapBySocket[pubSocket] = publishDetails;
+    if (direct)
+    {
+        publishMapByFD[pollItem.fd] = publishDetails;
+    }
+    if (handle >= publishMapByHandle.size())
+    {
+        publishMapByHandle.resize(handle + 1);
+    }
+    publishMapByHandle[handle] = publishDetails;
 }
 
 void GravityPublishManager::unregisterDataProduct()
@@ -406,22 +573,33 @@ void GravityPublishManager::unregisterDataProduct()
 	if (publishMapByID.count(dataProductID))
 	{
 	    std::shared_ptr<PublishDetails> publishDetails = publishMapByID[dataProductID];
-		void* socket = publishDetails->pollItem.socket;
+		void* socket = publishDetails->socket;
 		publishMapBySocket.erase(socket);
+		if (publishDetails->direct)
+		{
+			publishMapByFD.erase(publishDetails->pollItem.fd);
+		}
 		publishMapByID.erase(dataProductID);
+		publishMapByHandle[publishDetails->handle].reset();
+		replays.erase(publishDetails.get());
+
+		// The publishing thread may still hold a direct publication, which it finds closed from now on
+		publishDetails->lock.Lock();
 		zmq_unbind(socket, publishDetails->url.c_str());
 		zmq_close(socket);
+		publishDetails->socket = NULL;
 
 		// delete any cached values.
-        for (map<string,std::shared_ptr<CacheValue> >::iterator iter = publishDetails->lastCachedValues.begin(); iter != publishDetails->lastCachedValues.end(); iter++)
-		    delete [] iter->second->value;
-        publishDetails->lastCachedValues.clear();
+        clearCachedValues(*publishDetails);
+        publishDetails->replaying = false;
+        publishDetails->held.clear();
+		publishDetails->lock.Unlock();
 
 		// Remove from poll items
 		vector<zmq_pollitem_t>::iterator iter = pollItems.begin();
 		while (iter != pollItems.end())
 		{
-			if (iter->socket == socket)
+			if (iter->socket == publishDetails->pollItem.socket && iter->fd == publishDetails->pollItem.fd)
 			{
 				iter = pollItems.erase(iter);
 			}
@@ -442,78 +620,1201 @@ void GravityPublishManager::setHWM()
 	sendStringMessage(gravityNodeResponseSocket, "ACK", ZMQ_DONTWAIT);
 }
 
+void GravityPublishManager::setCacheLimit()
+{
+	// Read the limit on bytes cached for late subscribers
+	uint64_t limit = readUint64Message(gravityNodeResponseSocket);
+	cacheBudget->lock.Lock();
+	cacheBudget->limit = limit;
+	cacheBudget->lock.Unlock();
+
+	// Send ACK
+	sendStringMessage(gravityNodeResponseSocket, "ACK", ZMQ_DONTWAIT);
+}
+
 void GravityPublishManager::publish(void* requestSocket)
 {
-    // Read the filter text
     string dataProductId = readStringMessage(requestSocket);
+    map<string,std::shared_ptr<PublishDetails> >::iterator iter = publishMapByID.find(dataProductId);
+    if (iter == publishMapByID.end())
+    {
+        Log::critical("Unable to process publish for unknown data product %s", dataProductId.c_str());
+    }
+    publish(requestSocket, iter == publishMapByID.end() ? NULL : iter->second.get());
+}
+
+void GravityPublishManager::publishByHandle(void* requestSocket)
+{
+    uint32_t handle = readUint32Message(requestSocket);
+    PublishDetails* publishDetails = handle < publishMapByHandle.size() ? publishMapByHandle[handle].get() : NULL;
+    if (!publishDetails)
+    {
+        Log::critical("Unable to process publish for unknown publication handle %u", handle);
+    }
+    publish(requestSocket, publishDetails);
+}
+
+void GravityPublishManager::publish(void* requestSocket, PublishDetails* publishDetails)
+{
+    // Read the timestamp and filter text
     uint64_t timestamp = readUint64Message(requestSocket);
     string filterText    = readStringMessage(requestSocket);
 
-    // Read the data product
-    zmq_msg_t msg;
-    zmq_msg_init(&msg);
-    zmq_recvmsg(requestSocket, &msg, -1);
-    size_t gdbSize = zmq_msg_size(&msg);
-    // make a copy to hold for new subscribers below
-    char *bytes = new char[gdbSize];
-    memcpy(bytes, zmq_msg_data(&msg), gdbSize);
-    zmq_msg_close(&msg);
+    // Read the data product envelope and data. These are held (not copied) for late subscribers.
+    std::shared_ptr<zmq_msg_t> envelope = readSharedMessage(requestSocket, 0);
+    std::shared_ptr<zmq_msg_t> data = readSharedMessage(requestSocket, 0);
 
-	
-    std::shared_ptr<PublishDetails> publishDetails = publishMapByID[dataProductId];
-    if (!publishDetails)
+    if (!publishDetails || !dequeuePublish(*publishDetails->audience) || expired(*publishDetails, timestamp, getCurrentTime()))
     {
-        Log::critical("Unable to process publish for unknown data product %s", dataProductId.c_str());
         return;
     }
+    if (publishDetails->direct)
+    {
+        bool replay = false;
+        publishDirect(*publishDetails, filterText, timestamp, envelope, data, replay);
+        if (replay)
+        {
+            replays.insert(publishDetails);
+        }
+        return;
+    }
+
+    if (publishAndCache(*publishDetails, filterText, timestamp, envelope, data))
+    {
+        replays.insert(publishDetails);
+    }
+
+    if (metricsEnabled)
+    {
+        metricsData.incrementMessageCount(publishDetails->dataProductID, 1);
+        metricsData.incrementByteCount(publishDetails->dataProductID, zmq_msg_size(envelope.get()) + zmq_msg_size(data.get()));
+    }
+}
+
+void GravityPublishManager::publishBatch(void* requestSocket)
+{
+    uint32_t count = readUint32Message(requestSocket);
+
+    // Metrics are collected for each run of the same data product rather than for each one
+    PublishDetails* metricsDetails = NULL;
+    int metricsCount = 0;
+    uint64_t metricsBytes = 0;
+    uint64_t currentTime = getCurrentTime();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // Header is the handle, timestamp and filter text
+        zmq_msg_t header;
+        zmq_msg_init(&header);
+        zmq_recvmsg(requestSocket, &header, 0);
+        const char* bytes = static_cast<const char*>(zmq_msg_data(&header));
+        size_t size = zmq_msg_size(&header);
+        uint32_t handle = INVALID_PUBLICATION_HANDLE;
+        uint64_t timestamp = 0;
+        string filterText;
+        if (size >= sizeof(uint32_t) + sizeof(uint64_t))
+        {
+            memcpy(&handle, bytes, sizeof(uint32_t));
+            memcpy(&timestamp, bytes + sizeof(uint32_t), sizeof(uint64_t));
+            filterText.assign(bytes + sizeof(uint32_t) + sizeof(uint64_t), size - sizeof(uint32_t) - sizeof(uint64_t));
+        }
+        zmq_msg_close(&header);
+
+        std::shared_ptr<zmq_msg_t> envelope = readSharedMessage(requestSocket, 0);
+        std::shared_ptr<zmq_msg_t> data = readSharedMessage(requestSocket, 0);
+
+        PublishDetails* publishDetails = handle < publishMapByHandle.size() ? publishMapByHandle[handle].get() : NULL;
+        if (!publishDetails)
+        {
+            Log::critical("Unable to process publish for unknown publication handle %u", handle);
+            continue;
+        }
+        if (!dequeuePublish(*publishDetails->audience) || expired(*publishDetails, timestamp, currentTime))
+        {
+            continue;
+        }
+        if (publishDetails->direct)
+        {
+            bool replay = false;
+            publishDirect(*publishDetails, filterText, timestamp, envelope, data, replay);
+            if (replay)
+            {
+                replays.insert(publishDetails);
+            }
+            continue;
+        }
+        if (publishAndCache(*publishDetails, filterText, timestamp, envelope, data))
+        {
+            replays.insert(publishDetails);
+        }
+
+        if (metricsEnabled)
+        {
+            if (publishDetails != metricsDetails && metricsDetails)
+            {
+                metricsData.incrementMessageCount(metricsDetails->dataProductID, metricsCount);
+                metricsData.incrementByteCount(metricsDetails->dataProductID, metricsBytes);
+                metricsCount = 0;
+                metricsBytes = 0;
+            }
+            metricsDetails = publishDetails;
+            metricsCount++;
+            metricsBytes += zmq_msg_size(envelope.get()) + zmq_msg_size(data.get());
+        }
+    }
+    if (metricsDetails)
+    {
+        metricsData.incrementMessageCount(metricsDetails->dataProductID, metricsCount);
+        metricsData.incrementByteCount(metricsDetails->dataProductID, metricsBytes);
+    }
+}
 
-    // delete any old data and ...
-    if (publishDetails->lastCachedValues.count(filterText) > 0) {
-        delete [] publishDetails->lastCachedValues[filterText]->value;
+void GravityPublishManager::collectPublicationMetrics(bool keep)
+{
+    // Direct publications count their own publishes, and publications count their retransmits, expired data products and
+    // what their subscribers report
+    for (map<void*,std::shared_ptr<PublishDetails> >::iterator iter = publishMapBySocket.begin(); iter != publishMapBySocket.end(); iter++)
+    {
+        PublishDetails& publishDetails = *iter->second;
+        publishDetails.lock.Lock();
+        if (keep && publishDetails.messageCount > 0)
+        {
+            metricsData.incrementMessageCount(publishDetails.dataProductID, publishDetails.messageCount);
+            metricsData.incrementByteCount(publishDetails.dataProductID, publishDetails.byteCount);
+        }
+        if (keep && publishDetails.retransmitCount > 0)
+        {
+            metricsData.incrementRetransmitCount(publishDetails.dataProductID, publishDetails.retransmitCount);
+        }
+        publishDetails.messageCount = 0;
+        publishDetails.byteCount = 0;
+        if (keep && publishDetails.expiredCount > 0)
+        {
+            metricsData.incrementExpiredCount(publishDetails.dataProductID, publishDetails.expiredCount);
+        }
+        if (keep && publishDetails.slowSubscriberCount > 0)
+        {
+            metricsData.incrementSlowSubscriberCount(publishDetails.dataProductID, publishDetails.slowSubscriberCount);
+        }
+        if (keep && publishDetails.subscriberDropCount > 0)
+        {
+            metricsData.incrementSubscriberDropCount(publishDetails.dataProductID, publishDetails.subscriberDropCount);
+        }
+        if (keep && publishDetails.subscriberLag > 0)
+        {
+            metricsData.updateMaxSubscriberLag(publishDetails.dataProductID, publishDetails.subscriberLag);
+        }
+        publishDetails.retransmitCount = 0;
+        publishDetails.expiredCount = 0;
+        publishDetails.slowSubscriberCount = 0;
+        publishDetails.subscriberDropCount = 0;
+        publishDetails.subscriberLag = 0;
+        publishDetails.lock.Unlock();
+
+        // Publishes are dropped, and wait for room in the channel, before the publish thread sees them
+        PublicationAudience& audience = *publishDetails.audience;
+        audience.lock.Lock();
+        uint64_t handoffDropCount = audience.handoffDropCount;
+        uint64_t handoffBlockedTime = audience.handoffBlockedTime;
+        audience.lock.Unlock();
+        if (keep && handoffDropCount > publishDetails.handoffDropCount)
+        {
+            metricsData.incrementHandoffDropCount(publishDetails.dataProductID, handoffDropCount - publishDetails.handoffDropCount);
+        }
+        if (keep && handoffBlockedTime > publishDetails.handoffBlockedTime)
+        {
+            metricsData.incrementHandoffBlockedTime(publishDetails.dataProductID, handoffBlockedTime - publishDetails.handoffBlockedTime);
+        }
+        publishDetails.handoffDropCount = handoffDropCount;
+        publishDetails.handoffBlockedTime = handoffBlockedTime;
+    }
+}
+
+bool GravityPublishManager::publishDirect(PublishDetails& publishDetails, const string& filterText, uint64_t timestamp,
+                                          const std::shared_ptr<zmq_msg_t>& envelope, const std::shared_ptr<zmq_msg_t>& data, bool& replay)
+{
+    publishDetails.lock.Lock();
+    if (!publishDetails.socket)
+    {
+        publishDetails.lock.Unlock();
+        return false;
+    }
+    replay = publishAndCache(publishDetails, filterText, timestamp, envelope, data);
+    publishDetails.messageCount++;
+    publishDetails.byteCount += zmq_msg_size(envelope.get()) + zmq_msg_size(data.get());
+
+    // Sending may have taken in subscription events that the GravityPublishManager won't be woken for, so handle them now
+    replay = processSubscriptionEvents(publishDetails) || replay;
+    publishDetails.lock.Unlock();
+    return true;
+}
+
+bool GravityPublishManager::publishAndCache(PublishDetails& publishDetails, const string& filterText, uint64_t timestamp,
+                                            const std::shared_ptr<zmq_msg_t>& dataProductEnvelope, const std::shared_ptr<zmq_msg_t>& data)
+{
+    // Pick up any subscribers that have arrived since the socket was last polled
+    bool replay = false;
+    if (publishDetails.subscriptions.empty() && publishDetails.v2Subscriptions.empty() && publishDetails.streams.empty())
+    {
+        replay = processSubscriptionEvents(publishDetails);
+    }
+
+    std::shared_ptr<zmq_msg_t> envelope = keepValue(publishDetails, filterText, timestamp, dataProductEnvelope, data);
+
+    // New subscribers drop data products older than the last one they received, so while cached values are being
+    // replayed to them this one is held back until the slice of them it follows has been sent (see replayCachedValues)
+    if (publishDetails.replaying)
+    {
+        publishDetails.held.push_back(HeldValue());
+        HeldValue& held = publishDetails.held.back();
+        held.filterText = filterText;
+        held.envelope = envelope;
+        held.data = data;
+        held.key = CacheKey(timestamp, publishDetails.cacheSequence - 1); // as it was just cached (see keepValue)
+        return replay;
+    }
+
+    publish(publishDetails, filterText, envelope, data, NULL, false);
+    return replay;
+}
+
+std::shared_ptr<zmq_msg_t> GravityPublishManager::keepValue(PublishDetails& publishDetails, const string& filterText, uint64_t timestamp,
+                                                            const std::shared_ptr<zmq_msg_t>& dataProductEnvelope,
+                                                            const std::shared_ptr<zmq_msg_t>& data)
+{
+    // A reliable publication numbers the data products of each filter text, as does one that monitors its subscribers
+    // (for them to count those they miss), and a publication with a time to live tells subscribers when they expire.
+    // Fields that appear later take precedence, so these are appended to the envelope.
+    std::shared_ptr<zmq_msg_t> envelope = dataProductEnvelope;
+    bool monitored = publishDetails.maxSubscriberLag > 0;
+    bool unreliable = monitored && publishDetails.retransmitDepth == 0;
+    uint64_t sequenceNumber = publishDetails.retransmitDepth > 0 || monitored ? ++publishDetails.sequenceNumbers[filterText] : 0;
+    if (sequenceNumber > 0 || publishDetails.timeToLive > 0)
+    {
+        size_t size = zmq_msg_size(dataProductEnvelope.get());
+        size_t fieldsSize = 0;
+        if (sequenceNumber > 0)
+        {
+            fieldsSize += WireFormatLite::TagSize(GravityDataProductPB::kSequenceNumberFieldNumber, WireFormatLite::TYPE_UINT64) +
+                          WireFormatLite::UInt64Size(sequenceNumber);
+        }
+        if (publishDetails.timeToLive > 0)
+        {
+            fieldsSize += WireFormatLite::TagSize(GravityDataProductPB::kTimeToLiveFieldNumber, WireFormatLite::TYPE_UINT64) +
+                          WireFormatLite::UInt64Size(publishDetails.timeToLive);
+        }
+        if (monitored)
+        {
+            fieldsSize += WireFormatLite::TagSize(GravityDataProductPB::kMonitoredFieldNumber, WireFormatLite::TYPE_BOOL) +
+                          WireFormatLite::kBoolSize;
+        }
+        if (unreliable)
+        {
+            fieldsSize += WireFormatLite::TagSize(GravityDataProductPB::kUnreliableFieldNumber, WireFormatLite::TYPE_BOOL) +
+                          WireFormatLite::kBoolSize;
+        }
+        zmq_msg_t msg;
+        zmq_msg_init_size(&msg, size + fieldsSize);
+        memcpy(zmq_msg_data(&msg), zmq_msg_data(dataProductEnvelope.get()), size);
+        uint8_t* target = (uint8_t*)zmq_msg_data(&msg) + size;
+        if (sequenceNumber > 0)
+        {
+            target = WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kSequenceNumberFieldNumber, sequenceNumber, target);
+        }
+        if (publishDetails.timeToLive > 0)
+        {
+            target = WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kTimeToLiveFieldNumber, publishDetails.timeToLive, target);
+        }
+        if (monitored)
+        {
+            target = WireFormatLite::WriteBoolToArray(GravityDataProductPB::kMonitoredFieldNumber, true, target);
+        }
+        if (unreliable)
+        {
+            WireFormatLite::WriteBoolToArray(GravityDataProductPB::kUnreliableFieldNumber, true, target);
+        }
+        envelope = moveSharedMessage(&msg);
+    }
+
+    // A reliable publication keeps the last data products of each filter text to send again to subscribers that miss any
+    if (publishDetails.retransmitDepth > 0)
+    {
+        std::deque<RetransmitValue>& retransmits = publishDetails.retransmits[filterText];
+        retransmits.push_back(RetransmitValue());
+        retransmits.back().sequenceNumber = sequenceNumber;
+        retransmits.back().envelope = envelope;
+        retransmits.back().data = data;
+        if (retransmits.size() > publishDetails.retransmitDepth)
+        {
+            retransmits.pop_front();
+        }
     }
 
 	//cache new data unless publisher specified not to
-	if(publishDetails->cacheLastValue){
-		Log::trace("Cache last data product value for %s", dataProductId.c_str());
+	if(publishDetails.cacheLastValue){
+		Log::trace("Cache last data product value for %s", publishDetails.dataProductID.c_str());
 		// ... save new data for late subscribers
-		std::shared_ptr<CacheValue> val = std::shared_ptr<CacheValue>(new CacheValue);
-		val->filterText = filterText;
-		val->value = bytes;
-		val->size = gdbSize;
-		val->timestamp = timestamp;
-		publishDetails->lastCachedValues[filterText] = val;
-	
+		cacheValue(publishDetails, filterText, timestamp, envelope, data);
 	}else{
 		Log::trace("We are not caching data products");
 	}
-    publish(publishDetails->socket, filterText, bytes, gdbSize);
+    return envelope;
+}
 
-    if (!publishDetails->cacheLastValue){
-        delete [] bytes;
+void GravityPublishManager::cacheValue(PublishDetails& publishDetails, const string& filterText, uint64_t timestamp,
+                                       const std::shared_ptr<zmq_msg_t>& envelope, const std::shared_ptr<zmq_msg_t>& data)
+{
+    std::shared_ptr<CacheValue> val = std::shared_ptr<CacheValue>(new CacheValue);
+    val->filterText = filterText;
+    val->envelope = envelope;
+    val->data = data;
+    val->timestamp = timestamp;
+    val->cachedTime = getCurrentTime();
+    val->size = zmq_msg_size(envelope.get()) + zmq_msg_size(data.get());
+    val->publishDetails = &publishDetails;
+
+    CacheBudget& cacheBudget = *publishDetails.cacheBudget;
+    cacheBudget.lock.Lock();
+
+    // Keep the cached values in the order they're replayed, and in order of use
+    val->key = CacheKey(timestamp, publishDetails.cacheSequence++);
+    publishDetails.cacheOrder.insert(publishDetails.cacheOrder.end(), make_pair(val->key, val));
+    val->lruPosition = cacheBudget.lru.insert(cacheBudget.lru.end(), val);
+    cacheBudget.size += val->size;
+
+    // Drop the values of this filter that are beyond the history kept
+    std::deque<std::shared_ptr<CacheValue> >& history = publishDetails.lastCachedValues[filterText];
+    history.push_back(val);
+    while ((publishDetails.historyDepth > 0 && history.size() > publishDetails.historyDepth) ||
+           (publishDetails.historyMaxAge > 0 && history.front()->cachedTime + publishDetails.historyMaxAge < val->cachedTime))
+    {
+        removeCachedValue(cacheBudget, history.front());
     }
 
-    if (metricsEnabled)
+    // and the values of any filter that have expired (in replay order, which is mostly the order they were cached in)
+    while (publishDetails.historyMaxAge > 0 &&
+           publishDetails.cacheOrder.begin()->second->cachedTime + publishDetails.historyMaxAge < val->cachedTime)
+    {
+        removeCachedValue(cacheBudget, publishDetails.cacheOrder.begin()->second);
+    }
+
+    // Drop the least recently used values of any publication while over the limit
+    while (cacheBudget.limit > 0 && cacheBudget.size > cacheBudget.limit)
+    {
+        removeCachedValue(cacheBudget, cacheBudget.lru.front());
+    }
+    cacheBudget.lock.Unlock();
+}
+
+void GravityPublishManager::removeCachedValue(CacheBudget& cacheBudget, std::shared_ptr<CacheValue> value)
+{
+    // Called with the CacheBudget lock held
+    PublishDetails& publishDetails = *value->publishDetails;
+    publishDetails.cacheOrder.erase(value->key);
+    cacheBudget.lru.erase(value->lruPosition);
+    cacheBudget.size -= value->size;
+
+    map<string,std::deque<std::shared_ptr<CacheValue> > >::iterator iter = publishDetails.lastCachedValues.find(value->filterText);
+    std::deque<std::shared_ptr<CacheValue> >& history = iter->second;
+    history.erase(std::find(history.begin(), history.end(), value));
+    if (history.empty())
+    {
+        publishDetails.lastCachedValues.erase(iter);
+    }
+}
+
+void GravityPublishManager::clearCachedValues(PublishDetails& publishDetails)
+{
+    CacheBudget& cacheBudget = *publishDetails.cacheBudget;
+    cacheBudget.lock.Lock();
+    for (map<CacheKey,std::shared_ptr<CacheValue> >::iterator iter = publishDetails.cacheOrder.begin(); iter != publishDetails.cacheOrder.end(); iter++)
     {
-        metricsData.incrementMessageCount(dataProductId, 1);
-        metricsData.incrementByteCount(dataProductId, gdbSize);
+        cacheBudget.lru.erase(iter->second->lruPosition);
+        cacheBudget.size -= iter->second->size;
     }
+    publishDetails.cacheOrder.clear();
+    publishDetails.lastCachedValues.clear();
+    cacheBudget.lock.Unlock();
 }
 
-void GravityPublishManager::publish(void* socket, const string &filterText, const void *bytes, int size)
+bool GravityPublishManager::processSubscriptionEvents(PublishDetails& publishDetails)
 {
+    const string& prefix = wireFormatV2Prefix();
+    bool replay = false, counted = false, lagged = false;
+    zmq_msg_t event;
+    while (true)
+    {
+        zmq_msg_init(&event);
+        if (zmq_recvmsg(publishDetails.socket, &event, ZMQ_DONTWAIT) == -1)
+        {
+            zmq_msg_close(&event);
+            break;
+        }
 
-    // Create message & send filter text
-    sendStringMessage(socket, filterText, ZMQ_SNDMORE);
+        // This message is coming from ZMQ: 1 (subscribe) or 0 (unsubscribe) followed by the subscription filter.
+        // The subscriber doesn't send messages on a subscribed socket.
+        const char* bytes = (const char*)zmq_msg_data(&event);
+        size_t size = zmq_msg_size(&event);
+        if (size == 0)
+        {
+            zmq_msg_close(&event);
+            continue;
+        }
+        bool newsub = bytes[0] == 1;
+        string filter(bytes + 1, size - 1);
+        zmq_msg_close(&event);
+
+        // A subscriber asking for data products of a reliable publication it missed (which it stops asking for once
+        // they've arrived) subscribes to the topic they're sent again with
+        uint64_t first, last;
+        string filterText;
+        if (parseRetransmitTopic(filter, first, last, filterText))
+        {
+            if (newsub)
+            {
+                retransmit(publishDetails, filter, first, last, filterText);
+            }
+            continue;
+        }
 
-    zmq_msg_t data;
-    zmq_msg_init_size(&data, size);
-    memcpy(zmq_msg_data(&data), bytes, size);
+        // A subscriber to a publication that monitors its subscribers reports how far behind it is by subscribing to a
+        // topic saying so, in place of its last report
+        uint64_t lag, dropped, report;
+        string subscriberID;
+        if (parseLagReportTopic(filter, lag, dropped, report, subscriberID))
+        {
+            if (publishDetails.maxSubscriberLag > 0)
+            {
+                lagged = monitorSubscriber(publishDetails, filter, subscriberID, lag, dropped, newsub) || lagged;
+            }
+            continue;
+        }
+
+        // Subscribers that understand wire format version 2 prefix their filter, and those that want data products at a
+        // limited rate (from version 3 publishers) or matching a predicate (from version 4 publishers) say which
+        uint64_t interval = 0;
+        string predicate, topic(filter);
+        bool stream = parseRateLimitedTopic(topic, interval, filter) || parsePredicateTopic(topic, interval, predicate, filter);
+        bool v2 = !stream && filter.compare(0, prefix.length(), prefix) == 0;
+        if (v2)
+        {
+            filter.erase(0, prefix.length());
+        }
+        string streamTopic = stream ? topic.substr(0, topic.length() - filter.length()) : string();
+        counted = true;
+        if (!countSubscription(publishDetails, topic, filter, newsub))
+        {
+            continue;
+        }
+        if (stream && publishDetails.streams.count(streamTopic) == 0)
+        {
+            PublishStream& publishStream = publishDetails.streams[streamTopic];
+            publishStream.interval = interval;
+            publishStream.predicate = predicate;
+        }
+        set<string>& subscriptions = stream ? publishDetails.streams[streamTopic].filters :
+                                     v2 ? publishDetails.v2Subscriptions : publishDetails.subscriptions;
+        if (!newsub)
+        {
+            subscriptions.erase(filter);
+            if (stream && subscriptions.empty())
+            {
+                publishDetails.streams.erase(streamTopic);
+            }
+            continue;
+        }
+        subscriptions.insert(filter);
+        if (publishDetails.audience->keepElided)
+        {
+            cacheElidedValues(publishDetails, filter);
+        }
+
+        // can't log here because the network logging uses this code - any logs here will result in an
+        // infinite loop, or a deadlock.
+        // This message can be useful though, so leaving it in, but commented out.
+//        Log::debug("got a new subscriber for %s, resending %d values", publishDetails.dataProductID.c_str(), publishDetails.lastCachedValues.size());
+
+        // We have a new subscriber and are going to send it the last cached data product values, marked as cached, in
+        // slices between other work. Values published from now on, or held back by a replay already under way, are
+        // published to it anyway. That replay starts again from the beginning for the new subscriber (the others ignore
+        // values they already have).
+        publishDetails.cacheBudget->lock.Lock();
+        map<CacheKey,std::shared_ptr<CacheValue> >::iterator end = publishDetails.held.empty() ? publishDetails.cacheOrder.end() :
+                                                                   publishDetails.cacheOrder.lower_bound(publishDetails.held.front().key);
+        if (end != publishDetails.cacheOrder.begin())
+        {
+            replay = replay || !publishDetails.replaying;
+            publishDetails.replaying = true;
+            publishDetails.replayNext = publishDetails.cacheOrder.begin()->first;
+            publishDetails.replayLast = (--end)->first;
+        }
+        publishDetails.cacheBudget->lock.Unlock();
+    }
+    return replay || counted || lagged;
+}
+
+bool GravityPublishManager::countSubscription(PublishDetails& publishDetails, const string& topic, const string& filter, bool newsub)
+{
+    // Every subscription and unsubscription is seen (see registerDataProduct), so a topic is only dropped once the last
+    // subscriber to it has gone.  Without ZMQ_XPUB_VERBOSER only the last unsubscription is seen.
+    map<string,uint32_t>::iterator iter = publishDetails.topicCounts.find(topic);
+    uint32_t previous = iter == publishDetails.topicCounts.end() ? 0 : iter->second;
+    uint32_t count = newsub ? previous + 1 : 0;
+#ifdef ZMQ_XPUB_VERBOSER
+    if (!newsub && previous > 1)
+    {
+        count = previous - 1;
+    }
+#endif
+    if (count > 0)
+    {
+        publishDetails.topicCounts[topic] = count;
+    }
+    else if (iter != publishDetails.topicCounts.end())
+    {
+        publishDetails.topicCounts.erase(iter);
+    }
+
+    PublicationAudience& audience = *publishDetails.audience;
+    audience.lock.Lock();
+    audience.subscriberCount = audience.subscriberCount - previous + count;
+    uint32_t& filterCount = audience.filters[filter];
+    filterCount = filterCount - previous + count;
+    if (filterCount == 0)
+    {
+        audience.filters.erase(filter);
+    }
+    audience.changed = true;
+    audience.lock.Unlock();
+    return newsub || count == 0;
+}
+
+void GravityPublishManager::cacheElidedValues(PublishDetails& publishDetails, const string& filter)
+{
+    // The values elided while no subscription wanted them are cached now that one does, so that the new subscriber is
+    // sent them with the rest of the cached values
+    PublicationAudience& audience = *publishDetails.audience;
+    std::vector<std::pair<string,ElidedValue> > values;
+    audience.lock.Lock();
+    map<string,ElidedValue>::iterator iter = audience.elided.lower_bound(filter);
+    while (iter != audience.elided.end() && iter->first.compare(0, filter.length(), filter) == 0)
+    {
+        values.push_back(*iter);
+        audience.elided.erase(iter++);
+    }
+    audience.lock.Unlock();
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        ElidedValue& value = values[i].second;
+        if (!value.envelope)
+        {
+            audience.prepare(audience, value);
+        }
+        keepValue(publishDetails, values[i].first, value.timestamp, value.envelope, value.data);
+    }
+}
+
+void GravityPublishManager::notifySubscriberCount(PublishDetails& publishDetails)
+{
+    PublicationAudience& audience = *publishDetails.audience;
+    audience.lock.Lock();
+    bool changed = audience.changed;
+    uint32_t count = audience.subscriberCount;
+    audience.changed = false;
+    audience.lock.Unlock();
+    if (!changed)
+    {
+        return;
+    }
+
+    audience.listenerLock.Lock();
+    if (audience.listener)
+    {
+        audience.listener->subscriberCountChanged(publishDetails.dataProductID, count);
+    }
+    audience.listenerLock.Unlock();
+}
+
+bool GravityPublishManager::monitorSubscriber(PublishDetails& publishDetails, const string& topic, const string& subscriberID,
+                                              uint64_t lag, uint64_t dropped, bool newsub)
+{
+    // A subscriber has gone once the topic of its latest report is unsubscribed from, rather than replaced by a later one
+    map<string,SubscriberLag>::iterator iter = publishDetails.subscriberLags.find(subscriberID);
+    if (!newsub)
+    {
+        if (iter != publishDetails.subscriberLags.end() && iter->second.topic == topic)
+        {
+            publishDetails.subscriberLags.erase(iter);
+        }
+        return false;
+    }
+
+    SubscriberLag& subscriber = publishDetails.subscriberLags[subscriberID];
+    uint64_t newlyDropped = dropped > subscriber.dropped ? dropped - subscriber.dropped : 0;
+    subscriber.topic = topic;
+    subscriber.lag = lag;
+    subscriber.dropped = dropped;
+    publishDetails.subscriberDropCount += newlyDropped;
+    publishDetails.subscriberLag = std::max(publishDetails.subscriberLag, lag);
+
+    SlowSubscriberEvent event;
+    event.subscriberID = subscriberID;
+    event.lag = (uint32_t) std::min<uint64_t>(lag, 0xFFFFFFFF);
+    event.dropped = dropped;
+    uint64_t currTime = getCurrentTime();
+    if (lag <= publishDetails.maxSubscriberLag && newlyDropped == 0)
+    {
+        if (subscriber.slowSince == 0)
+        {
+            return false;
+        }
+        subscriber.slowSince = 0;
+        event.event = GravitySlowSubscriberEvents::RECOVERED;
+        publishDetails.slowSubscriberEvents.push_back(event);
+        return true;
+    }
+    bool lagged = false;
+    if (subscriber.slowSince == 0)
+    {
+        subscriber.slowSince = currTime;
+        publishDetails.slowSubscriberCount++;
+        event.event = GravitySlowSubscriberEvents::SLOW;
+        publishDetails.slowSubscriberEvents.push_back(event);
+        lagged = true;
+    }
+    if (publishDetails.slowSubscriberPolicy == GravitySlowSubscriberPolicies::DROP ||
+        currTime - subscriber.slowSince < publishDetails.slowSubscriberTimeout)
+    {
+        return lagged;
+    }
+
+    // Tell the subscriber what to do on the topic of its report, which only it is subscribed to.  It's told again with
+    // each report while it's slow, in case it's too far behind to have received it.
+    bool disconnect = publishDetails.slowSubscriberPolicy == GravitySlowSubscriberPolicies::DISCONNECT;
+    string interval;
+    if (!disconnect)
+    {
+        ostringstream ss;
+        ss << (uint64_t) publishDetails.maxSubscriberLag * 1000;
+        interval = ss.str();
+    }
+    sendStringMessage(publishDetails.socket, topic, ZMQ_SNDMORE);
+    sendStringMessage(publishDetails.socket, interval, ZMQ_DONTWAIT);
+    if (subscriber.handled)
+    {
+        return lagged;
+    }
+    subscriber.handled = true;
+    event.event = disconnect ? GravitySlowSubscriberEvents::DISCONNECTED : GravitySlowSubscriberEvents::CONFLATED;
+    publishDetails.slowSubscriberEvents.push_back(event);
+    return true;
+}
+
+void GravityPublishManager::notifySlowSubscribers(PublishDetails& publishDetails, const std::vector<SlowSubscriberEvent>& events)
+{
+    if (events.empty())
+    {
+        return;
+    }
+    PublicationAudience& audience = *publishDetails.audience;
+    audience.listenerLock.Lock();
+    for (size_t i = 0; i < events.size() && audience.slowSubscriberListener; i++)
+    {
+        audience.slowSubscriberListener->subscriberLagged(publishDetails.dataProductID, events[i].subscriberID, events[i].event,
+                                                          events[i].lag, events[i].dropped);
+    }
+    audience.listenerLock.Unlock();
+}
+
+uint32_t GravityPublishManager::subscriberCount(PublicationAudience& audience, const string& filterText)
+{
+    uint32_t count = 0;
+    audience.lock.Lock();
+    for (map<string,uint32_t>::const_iterator iter = audience.filters.begin(); iter != audience.filters.end(); iter++)
+    {
+        if (filterText.compare(0, iter->first.length(), iter->first) == 0)
+        {
+            count += iter->second;
+        }
+    }
+    audience.lock.Unlock();
+    return count;
+}
+
+bool GravityPublishManager::elide(PublicationAudience& audience, const string& filterText, uint64_t timestamp, const string& typeName,
+                                  zmq_msg_t* envelope, zmq_msg_t* data)
+{
+    audience.lock.Lock();
+    for (map<string,uint32_t>::const_iterator iter = audience.filters.begin(); iter != audience.filters.end(); iter++)
+    {
+        if (filterText.compare(0, iter->first.length(), iter->first) == 0)
+        {
+            audience.lock.Unlock();
+            return false;
+        }
+    }
+
+    // Only the last value of each filter text is kept, replacing the one before
+    bool keep = audience.keepElided;
+    if (keep)
+    {
+        ElidedValue& value = audience.elided[filterText];
+        value.timestamp = timestamp;
+        value.typeName = typeName;
+        value.envelope = envelope ? moveSharedMessage(envelope) : std::shared_ptr<zmq_msg_t>();
+        value.data = moveSharedMessage(data);
+    }
+    audience.lock.Unlock();
+
+    if (!keep)
+    {
+        if (envelope)
+        {
+            zmq_msg_close(envelope);
+        }
+        zmq_msg_close(data);
+    }
+    return true;
+}
+
+bool GravityPublishManager::enqueuePublish(PublicationAudience& audience)
+{
+    if (!audience.handoffSlots || audience.handoffSlots->TryLock(0))
+    {
+        return true;
+    }
+
+    bool enqueued = false;
+    uint64_t blockedTime = 0;
+    if (audience.handoffPolicy == GravityHandoffPolicies::BLOCK)
+    {
+        uint64_t start = getCurrentTime();
+        if (audience.handoffTimeout == 0)
+        {
+            audience.handoffSlots->Lock();
+            enqueued = true;
+        }
+        else
+        {
+            enqueued = audience.handoffSlots->TryLock(audience.handoffTimeout);
+        }
+        blockedTime = getCurrentTime() - start;
+    }
+
+    audience.lock.Lock();
+    if (audience.handoffPolicy == GravityHandoffPolicies::DROP_OLDEST && audience.superseded < audience.handoffLimit)
+    {
+        // The oldest publish waiting with a slot gives it to this one, and is dropped once the publish thread reads it
+        audience.superseded++;
+        enqueued = true;
+    }
+    audience.handoffBlockedTime += blockedTime;
+    if (!enqueued || audience.handoffPolicy == GravityHandoffPolicies::DROP_OLDEST)
+    {
+        audience.handoffDropCount++;
+    }
+    audience.lock.Unlock();
+    return enqueued;
+}
+
+bool GravityPublishManager::dequeuePublish(PublicationAudience& audience)
+{
+    if (!audience.handoffSlots)
+    {
+        return true;
+    }
+    audience.lock.Lock();
+    bool superseded = audience.superseded > 0;
+    if (superseded)
+    {
+        audience.superseded--;
+    }
+    audience.lock.Unlock();
+    if (!superseded)
+    {
+        audience.handoffSlots->Unlock();
+    }
+    return !superseded;
+}
+
+void GravityPublishManager::retransmit(PublishDetails& publishDetails, const string& topic, uint64_t first, uint64_t last,
+                                       const string& filterText)
+{
+    map<string,std::deque<RetransmitValue> >::const_iterator iter = publishDetails.retransmits.find(filterText);
+    if (iter == publishDetails.retransmits.end())
+    {
+        return;
+    }
+
+    // Those still kept are sent in order, so the subscriber knows any before the first it receives are gone (and if
+    // none are kept, the oldest that is).  They're sent whole rather than in chunks, so as not to get mixed up with the
+    // chunks of data products being published.
+    const std::deque<RetransmitValue>& retransmits = iter->second;
+    uint64_t oldest = retransmits.front().sequenceNumber;
+    last = std::max(last, oldest);
+    for (uint64_t sequenceNumber = std::max(first, oldest); sequenceNumber <= last && sequenceNumber - oldest < retransmits.size(); sequenceNumber++)
+    {
+        const RetransmitValue& value = retransmits[sequenceNumber - oldest];
+        publishToTopic(publishDetails, topic, value.envelope, value.data, true, NULL);
+        publishDetails.retransmitCount++;
+    }
+}
+
+void GravityPublishManager::replayCachedValues()
+{
+    set<PublishDetails*>::iterator iter = replays.begin();
+    while (iter != replays.end())
+    {
+        PublishDetails& publishDetails = **iter;
+        if (publishDetails.direct)
+        {
+            publishDetails.lock.Lock();
+        }
+        bool replaying = publishDetails.socket && replayCachedValues(publishDetails);
+        std::vector<SlowSubscriberEvent> events;
+        events.swap(publishDetails.slowSubscriberEvents);
+        if (publishDetails.direct)
+        {
+            publishDetails.lock.Unlock();
+        }
+        notifySubscriberCount(publishDetails);
+        notifySlowSubscribers(publishDetails, events);
+
+        if (replaying)
+        {
+            iter++;
+        }
+        else
+        {
+            replays.erase(iter++);
+        }
+    }
+}
+
+bool GravityPublishManager::replayCachedValues(PublishDetails& publishDetails)
+{
+    if (!publishDetails.replaying)
+    {
+        return false;
+    }
+
+    // Take the next slice of cached values, dropping those that have expired, and send them once the cached values
+    // have been let go of
+    CacheBudget& cacheBudget = *publishDetails.cacheBudget;
+    vector<std::shared_ptr<CacheValue> > values;
+    cacheBudget.lock.Lock();
+    uint64_t currentTime = getCurrentTime();
+    uint64_t expiry = publishDetails.historyMaxAge > 0 ? currentTime - publishDetails.historyMaxAge : 0;
+    map<CacheKey,std::shared_ptr<CacheValue> >::iterator iter = publishDetails.cacheOrder.lower_bound(publishDetails.replayNext);
+    while (values.size() < static_cast<size_t>(REPLAY_SLICE_SIZE) && iter != publishDetails.cacheOrder.end() && iter->first <= publishDetails.replayLast)
+    {
+        std::shared_ptr<CacheValue> value = (iter++)->second;
+        if (value->cachedTime < expiry || expired(publishDetails, value->timestamp, currentTime))
+        {
+            removeCachedValue(cacheBudget, value);
+            continue;
+        }
+
+        // The cached flag is applied to a value the first time it's replayed, and the messages reused after that
+        if (!value->cachedEnvelope)
+        {
+            // Fields that appear later take precedence, so the cached flag can be appended to the envelope
+            size_t size = zmq_msg_size(value->envelope.get());
+            zmq_msg_t msg;
+            zmq_msg_init_size(&msg, size + 2);
+            memcpy(zmq_msg_data(&msg), zmq_msg_data(value->envelope.get()), size);
+            WireFormatLite::WriteBoolToArray(GravityDataProductPB::kIsCachedDataproductFieldNumber, true, (uint8_t*)zmq_msg_data(&msg) + size);
+            value->cachedEnvelope = moveSharedMessage(&msg);
+            value->size += size + 2;
+            cacheBudget.size += size + 2;
+        }
+        cacheBudget.lru.splice(cacheBudget.lru.end(), cacheBudget.lru, value->lruPosition);
+        values.push_back(value);
+    }
+
+    publishDetails.replaying = iter != publishDetails.cacheOrder.end() && iter->first <= publishDetails.replayLast;
+    if (publishDetails.replaying)
+    {
+        publishDetails.replayNext = iter->first;
+    }
+    cacheBudget.lock.Unlock();
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        CacheValue& value = *values[i];
+        publish(publishDetails, value.filterText, value.cachedEnvelope, value.data, &value.cachedFrame, true);
+    }
+
+    // then the values held back from the new subscribers that this slice has caught up with
+    while (!publishDetails.held.empty() && (!publishDetails.replaying || publishDetails.held.front().key < publishDetails.replayNext))
+    {
+        HeldValue& value = publishDetails.held.front();
+        publish(publishDetails, value.filterText, value.envelope, value.data, NULL, false);
+        publishDetails.held.pop_front();
+    }
+    return publishDetails.replaying;
+}
+
+bool GravityPublishManager::expired(PublishDetails& publishDetails, uint64_t timestamp, uint64_t currentTime)
+{
+    // Checked with the timestamp the data product was handed over with, so without looking at its envelope
+    if (publishDetails.timeToLive == 0 || currentTime <= timestamp + publishDetails.timeToLive)
+    {
+        return false;
+    }
+    publishDetails.expiredCount++;
+    return true;
+}
+
+void GravityPublishManager::publish(PublishDetails& publishDetails, const string &filterText, const std::shared_ptr<zmq_msg_t>& envelopeMessage,
+                                    const std::shared_ptr<zmq_msg_t>& dataMessage, std::shared_ptr<zmq_msg_t>* singleFrame, bool cached)
+{
+    const string& prefix = wireFormatV2Prefix();
+    void* socket = publishDetails.socket;
+
+    // Version 1 subscribers whose filter is a prefix of a version 2 topic (e.g. the empty filter) receive whatever is
+    // sent to that topic, so the topics sent to are kept to send them the plain frame only if none of those reached them.
+    // Only when other version 1 subscribers need the plain frame as well does such a subscriber get the same single frame
+    // twice, which it drops like any resend with the same timestamp and data.
+    vector<string> topics;
+    bool v2 = false;
+    for (set<string>::const_iterator iter = publishDetails.v2Subscriptions.begin(); !v2 && iter != publishDetails.v2Subscriptions.end(); iter++)
+    {
+        v2 = filterText.compare(0, iter->length(), *iter) == 0;
+    }
+    if (v2)
+    {
+        topics.push_back(prefix + filterText);
+        publishToTopic(publishDetails, topics.back(), envelopeMessage, dataMessage, reachesVersion1(publishDetails, topics.back()), singleFrame);
+    }
+
+    if (!publishDetails.streams.empty())
+    {
+        publishStreams(publishDetails, filterText, envelopeMessage, dataMessage, singleFrame, cached, topics);
+    }
+
+    bool v1 = false;
+    for (set<string>::const_iterator iter = publishDetails.subscriptions.begin(); !v1 && iter != publishDetails.subscriptions.end(); iter++)
+    {
+        if (filterText.compare(0, iter->length(), *iter) == 0)
+        {
+            v1 = true;
+            for (size_t i = 0; v1 && i < topics.size(); i++)
+            {
+                v1 = topics[i].compare(0, iter->length(), *iter) != 0;
+            }
+        }
+    }
+    if (v1)
+    {
+        sendStringMessage(socket, filterText, ZMQ_SNDMORE);
+        publishSingleFrame(socket, envelopeMessage.get(), dataMessage.get(), singleFrame);
+    }
+}
+
+bool GravityPublishManager::reachesVersion1(const PublishDetails& publishDetails, const string& topic)
+{
+    for (set<string>::const_iterator filter = publishDetails.subscriptions.begin(); filter != publishDetails.subscriptions.end(); filter++)
+    {
+        if (topic.compare(0, filter->length(), *filter) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GravityPublishManager::publishToTopic(const PublishDetails& publishDetails, const string& topic, const std::shared_ptr<zmq_msg_t>& envelopeMessage,
+                                           const std::shared_ptr<zmq_msg_t>& dataMessage, bool singleFrameOnly, std::shared_ptr<zmq_msg_t>* singleFrame)
+{
+    zmq_msg_t* envelope = envelopeMessage.get();
+    zmq_msg_t* data = dataMessage.get();
+    void* socket = publishDetails.socket;
+
+    if (!singleFrameOnly && publishDetails.chunkSize > 0 && zmq_msg_size(data) > publishDetails.chunkSize)
+    {
+        publishChunks(publishDetails, topic, envelope, dataMessage);
+        return;
+    }
+
+    sendStringMessage(socket, topic, ZMQ_SNDMORE);
+    if (singleFrameOnly)
+    {
+        publishSingleFrame(socket, envelope, data, singleFrame);
+    }
+    else
+    {
+        // Separate envelope and data frames, sent without copying either
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        zmq_msg_copy(&msg, envelope);
+        zmq_sendmsg(socket, &msg, ZMQ_SNDMORE);
+        zmq_msg_close(&msg);
+
+        zmq_msg_init(&msg);
+        zmq_msg_copy(&msg, data);
+        zmq_sendmsg(socket, &msg, ZMQ_DONTWAIT);
+        zmq_msg_close(&msg);
+    }
+}
+
+void GravityPublishManager::publishStreams(PublishDetails& publishDetails, const string &filterText, const std::shared_ptr<zmq_msg_t>& envelope,
+                                           const std::shared_ptr<zmq_msg_t>& data, std::shared_ptr<zmq_msg_t>* singleFrame, bool cached,
+                                           vector<string>& topics)
+{
+    // Each stream with a limited rate gets a data product with a given filter text once the interval since the last has
+    // passed, and those with a predicate only get the data products that match it.  Cached values are replayed to new
+    // subscribers regardless of the rate.
+    uint64_t now = 0;
+    for (map<string,PublishStream>::iterator iter = publishDetails.streams.begin(); iter != publishDetails.streams.end(); iter++)
+    {
+        PublishStream& stream = iter->second;
+        bool match = false;
+        for (set<string>::const_iterator filter = stream.filters.begin(); !match && filter != stream.filters.end(); filter++)
+        {
+            match = filterText.compare(0, filter->length(), *filter) == 0;
+        }
+        if (!match || (!stream.predicate.empty() && !matches(stream, envelope.get(), data.get())))
+        {
+            continue;
+        }
+
+        if (!cached && stream.interval > 0)
+        {
+            if (now == 0)
+            {
+                now = getCurrentTime();
+            }
+            uint64_t& lastSent = stream.lastSent[filterText];
+            if (lastSent != 0 && now >= lastSent && now - lastSent < stream.interval)
+            {
+                continue;
+            }
+            lastSent = now;
+        }
+
+        // Version 1 subscribers with a filter that's a prefix of the topic receive this too
+        topics.push_back(iter->first + filterText);
+        publishToTopic(publishDetails, topics.back(), envelope, data, reachesVersion1(publishDetails, topics.back()), singleFrame);
+    }
+}
+
+bool GravityPublishManager::matches(PublishStream& stream, zmq_msg_t* envelope, zmq_msg_t* data)
+{
+    // The envelope is small, so parse it for the type and compression of the data
+    GravityDataProductPB envelopePB;
+    if (!envelopePB.ParseFromArray(zmq_msg_data(envelope), (int)zmq_msg_size(envelope)))
+    {
+        return true;
+    }
+
+    // Compressed data, and data of a type this process doesn't know, is left for subscribers to test
+    if (envelopePB.compression() != 0 || envelopePB.type_name().empty())
+    {
+        return true;
+    }
+    map<string,std::shared_ptr<GravityPredicate> >::iterator iter = stream.predicates.find(envelopePB.type_name());
+    if (iter == stream.predicates.end())
+    {
+        string error;
+        std::shared_ptr<GravityPredicate> predicate;
+        if (google::protobuf::DescriptorPool::generated_pool()->FindMessageTypeByName(envelopePB.type_name()) != NULL)
+        {
+            predicate = GravityPredicate::compile(stream.predicate, envelopePB.type_name(), error);
+            if (!predicate)
+            {
+                // Never matches this type
+                stream.invalidTypes.insert(envelopePB.type_name());
+            }
+        }
+        iter = stream.predicates.insert(std::make_pair(envelopePB.type_name(), predicate)).first;
+    }
+    if (!iter->second)
+    {
+        return stream.invalidTypes.count(iter->first) == 0;
+    }
+    return iter->second->matches(zmq_msg_data(data), zmq_msg_size(data));
+}
+
+void GravityPublishManager::publishSingleFrame(void* socket, zmq_msg_t* envelope, zmq_msg_t* data, std::shared_ptr<zmq_msg_t>* singleFrame)
+{
+    // Reuse the frame made the last time this was published
+    zmq_msg_t msg;
+    if (singleFrame && *singleFrame)
+    {
+        zmq_msg_init(&msg);
+        zmq_msg_copy(&msg, singleFrame->get());
+        zmq_sendmsg(socket, &msg, ZMQ_DONTWAIT);
+        zmq_msg_close(&msg);
+        return;
+    }
+
+    // A serialized data product is its envelope followed by the data field
+    size_t envelopeSize = zmq_msg_size(envelope);
+    size_t dataSize = zmq_msg_size(data);
+    size_t size = envelopeSize + 1 + CodedOutputStream::VarintSize64(dataSize) + dataSize;
+
+    zmq_msg_init_size(&msg, size);
+    uint8_t* target = (uint8_t*)zmq_msg_data(&msg);
+    memcpy(target, zmq_msg_data(envelope), envelopeSize);
+    target += envelopeSize;
+    target = WireFormatLite::WriteTagToArray(GravityDataProductPB::kDataFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, target);
+    target = CodedOutputStream::WriteVarint64ToArray(dataSize, target);
+    memcpy(target, zmq_msg_data(data), dataSize);
+
+    // Keep the frame to publish again if asked to
+    if (singleFrame)
+    {
+        *singleFrame = moveSharedMessage(&msg);
+        zmq_msg_init(&msg);
+        zmq_msg_copy(&msg, singleFrame->get());
+    }
 
     // Publish data
-    zmq_sendmsg(socket, &data, ZMQ_DONTWAIT);
+    zmq_sendmsg(socket, &msg, ZMQ_DONTWAIT);
 
     // Clean up
-    zmq_msg_close(&data);
+    zmq_msg_close(&msg);
+}
+static void releaseChunk(void* data, void* hint)
+{
+    // Each chunk holds a reference to the message it is part of
+    delete static_cast<std::shared_ptr<zmq_msg_t>*>(hint);
+}
 
+void GravityPublishManager::publishChunks(const PublishDetails& publishDetails, const string& topic, zmq_msg_t* envelope,
+                                          const std::shared_ptr<zmq_msg_t>& data)
+{
+    // Every chunk is a complete message: the topic, the envelope marked with where the chunk lies in the whole, and
+    // the chunk itself, which references the data rather than copying it.
+    void* socket = publishDetails.socket;
+    const char* bytes = static_cast<const char*>(zmq_msg_data(data.get()));
+    uint64_t totalSize = zmq_msg_size(data.get());
+    size_t envelopeSize = zmq_msg_size(envelope);
+    for (uint64_t offset = 0; offset < totalSize; offset += publishDetails.chunkSize)
+    {
+        uint64_t chunkSize = std::min(publishDetails.chunkSize, totalSize - offset);
+
+        sendStringMessage(socket, topic, ZMQ_SNDMORE);
+
+        zmq_msg_t msg;
+        zmq_msg_init_size(&msg, envelopeSize +
+                          WireFormatLite::TagSize(GravityDataProductPB::kChunkOffsetFieldNumber, WireFormatLite::TYPE_UINT64) +
+                          WireFormatLite::UInt64Size(offset) +
+                          WireFormatLite::TagSize(GravityDataProductPB::kTotalSizeFieldNumber, WireFormatLite::TYPE_UINT64) +
+                          WireFormatLite::UInt64Size(totalSize));
+        uint8_t* target = static_cast<uint8_t*>(zmq_msg_data(&msg));
+        memcpy(target, zmq_msg_data(envelope), envelopeSize);
+        target += envelopeSize;
+        target = WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kChunkOffsetFieldNumber, offset, target);
+        WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kTotalSizeFieldNumber, totalSize, target);
+        zmq_sendmsg(socket, &msg, ZMQ_SNDMORE);
+        zmq_msg_close(&msg);
+
+        zmq_msg_init_data(&msg, const_cast<char*>(bytes + offset), chunkSize, releaseChunk, new std::shared_ptr<zmq_msg_t>(data));
+        zmq_sendmsg(socket, &msg, ZMQ_DONTWAIT);
+        zmq_msg_close(&msg);
+    }
 }
+
 } /* namespace gravity */
@@ -28,6 +28,13 @@
 
 #include "Utility.h"
 #include "GravityMetrics.h"
+#include "GravitySemaphore.h"
+#include "GravityPredicate.h"
+#include "GravityPriority.h"
+#include "GravityHandoffPolicy.h"
+#include "GravityCompression.h"
+#include "GravitySubscriberCountListener.h"
+#include "GravitySlowSubscriberListener.h"
 
 #ifdef __GNUC__
 #include <memory>
@@ -36,7 +43,10 @@
 #endif
 #include <zmq.h>
 #include <vector>
+#include <deque>
+#include <list>
 #include <map>
+#include <set>
 #include <string>
 
 #define PUB_MGR_REQ_URL "inproc://gravity_publish_manager_request"
@@ -46,56 +56,270 @@
 namespace gravity
 {
 
+/**
+ * Position of a cached value in the order cached values are sent to new subscribers: the data product's timestamp,
+ * then the order it was cached in.
+ */
+typedef std::pair<uint64_t,uint64_t> CacheKey;
+
+struct PublishDetails;
+
 typedef struct CacheValue
 {
     std::string filterText;
-    char *value;
-    int size;
+    std::shared_ptr<zmq_msg_t> envelope;
+    std::shared_ptr<zmq_msg_t> data;
     uint64_t timestamp;
+    CacheKey key;
+    std::shared_ptr<zmq_msg_t> cachedEnvelope; ///< envelope marked as cached, made the first time the value is replayed
+    std::shared_ptr<zmq_msg_t> cachedFrame; ///< single frame form (see publishSingleFrame) made from cachedEnvelope when needed
+    uint64_t cachedTime; ///< when the value was cached
+    uint64_t size; ///< bytes counted against the CacheBudget
+    PublishDetails* publishDetails; ///< publication the value is cached for
+    std::list<std::shared_ptr<CacheValue> >::iterator lruPosition; ///< position in CacheBudget::lru
 } CacheValue;
 
+/**
+ * Limit on the bytes cached for late subscribers across all of a GravityNode's publications, kept to by dropping the
+ * least recently used (cached or replayed) values.
+ */
+typedef struct CacheBudget
+{
+    Semaphore lock; ///< guards this and the cached values of every publication
+    uint64_t limit; ///< 0 for no limit
+    uint64_t size;
+    std::list<std::shared_ptr<CacheValue> > lru; ///< every cached value, least recently used first
+} CacheBudget;
+
+/**
+ * Data products sent to subscribers that asked for them at a limited rate or matching a predicate (see rateLimitedTopic
+ * and predicateTopic), with the topic the stream was subscribed to ahead of the filter text.
+ */
+typedef struct PublishStream
+{
+    uint64_t interval; ///< fewest microseconds between data products with the same filter text (0 for every one)
+    std::string predicate; ///< the data products must match (empty for all of them)
+    std::set<std::string> filters; ///< subscribed to
+    std::map<std::string,uint64_t> lastSent; ///< when a data product with each filter text was last sent
+    std::map<std::string,std::shared_ptr<GravityPredicate> > predicates; ///< predicate compiled for each type name published (empty if it can't be)
+    std::set<std::string> invalidTypes; ///< type names the predicate doesn't fit, whose data products are never sent
+    PublishStream() : interval(0) {}
+} PublishStream;
+
+/// A data product of a reliable publication, kept to send again to subscribers that missed it
+typedef struct RetransmitValue
+{
+    uint64_t sequenceNumber;
+    std::shared_ptr<zmq_msg_t> envelope; ///< stamped with the sequence number
+    std::shared_ptr<zmq_msg_t> data;
+} RetransmitValue;
+
+/// A data product published while older cached values were being replayed, held back until they have been sent
+typedef struct HeldValue
+{
+    std::string filterText;
+    std::shared_ptr<zmq_msg_t> envelope;
+    std::shared_ptr<zmq_msg_t> data;
+    CacheKey key; ///< position among the cached values
+} HeldValue;
+
+/// A data product of a publication elided for want of subscribers, kept to cache once there are some
+typedef struct ElidedValue
+{
+    uint64_t timestamp;
+    std::string typeName; ///< of protobuf data
+    std::shared_ptr<zmq_msg_t> envelope; ///< empty until the value is prepared (see PublicationAudience::prepare)
+    std::shared_ptr<zmq_msg_t> data; ///< uncompressed until the value is prepared
+} ElidedValue;
+
+/**
+ * The subscriptions to a publication, counted by its GravityPublishManager as they come and go, and shared with the
+ * GravityNode (see GravityNode::getSubscriberCount).
+ */
+typedef struct PublicationAudience
+{
+    Semaphore lock; ///< guards this, but for the listener
+    uint32_t subscriberCount; ///< subscriptions to the publication, with any filter
+    std::map<std::string,uint32_t> filters; ///< subscriptions with each filter
+    bool changed; ///< the subscriptions have changed since the listener was last told
+    bool elide; ///< the GravityNode drops publishes that no subscription wants (see GravityPublicationOptions::elideWithoutSubscribers)
+    bool keepElided; ///< the last value elided with each filter text is kept, to cache once a subscription wants it
+    std::map<std::string,ElidedValue> elided; ///< last value elided with each filter text
+    std::string envelope; ///< serialized fields of the data product that are the same for every publish
+    GravityCompressionPolicy compression;
+    void (*prepare)(const PublicationAudience& audience, ElidedValue& value); ///< make the envelope of an elided value
+    Semaphore listenerLock; ///< held to tell the listeners of a change, and to change the listeners
+    GravitySubscriberCountListener* listener;
+    GravitySlowSubscriberListener* slowSubscriberListener;
+    std::shared_ptr<Semaphore> handoffSlots; ///< one for each publish that may wait to be published (empty for no limit, see enqueuePublish)
+    uint32_t handoffLimit;
+    GravityHandoffPolicy handoffPolicy;
+    uint32_t handoffTimeout; ///< milliseconds a publish waits for a slot (0 for as long as it takes)
+    uint32_t superseded; ///< oldest publishes waiting to be published that are to be dropped, having given their slots to later ones
+    uint64_t handoffDropCount; ///< publishes dropped rather than published since the publication was registered
+    uint64_t handoffBlockedTime; ///< microseconds publishes have waited for a slot since the publication was registered
+    PublicationAudience() : subscriberCount(0), changed(false), elide(false), keepElided(false), prepare(NULL), listener(NULL),
+                            slowSubscriberListener(NULL), handoffLimit(0), handoffPolicy(GravityHandoffPolicies::BLOCK),
+                            handoffTimeout(0), superseded(0), handoffDropCount(0), handoffBlockedTime(0) {}
+} PublicationAudience;
+
+/// A subscriber to a publication that monitors its subscribers, as of its latest report (see lagReportTopic)
+typedef struct SubscriberLag
+{
+    std::string topic; ///< of the latest report, which the subscriber is told what to do on if it stays slow
+    uint64_t lag; ///< milliseconds reported
+    uint64_t dropped; ///< data products reported missing since the subscriber subscribed
+    uint64_t slowSince; ///< when the subscriber became slow (0 while it isn't)
+    bool handled; ///< the slow subscriber policy has been applied to it
+    SubscriberLag() : lag(0), dropped(0), slowSince(0), handled(false) {}
+} SubscriberLag;
+
+/// Something that happened to a slow subscriber, to tell the GravitySlowSubscriberListener of
+typedef struct SlowSubscriberEvent
+{
+    std::string subscriberID;
+    GravitySlowSubscriberEvent event;
+    uint32_t lag;
+    uint64_t dropped;
+} SlowSubscriberEvent;
+
 typedef struct PublishDetails
 {
     std::string url;
     std::string dataProductID;
+    uint32_t handle; ///< PublicationHandle assigned by the GravityNode
 	bool cacheLastValue;
-	std::map<std::string,std::shared_ptr<CacheValue> > lastCachedValues;
+    uint64_t chunkSize; ///< data larger than this is sent to version 2 subscribers in chunks (0 never chunks)
+    uint32_t historyDepth; ///< values cached for each filter text (0 for any number)
+    uint64_t historyMaxAge; ///< microseconds a value is cached for (0 for no limit)
+    std::shared_ptr<CacheBudget> cacheBudget;
+	std::map<std::string,std::deque<std::shared_ptr<CacheValue> > > lastCachedValues; ///< cached values of each filter text, oldest first
+    std::map<CacheKey,std::shared_ptr<CacheValue> > cacheOrder; ///< lastCachedValues in the order they are replayed
+    uint64_t cacheSequence; ///< number of values cached so far
+    bool replaying; ///< true while lastCachedValues are being replayed to new subscribers
+    CacheKey replayNext; ///< next cached value to replay
+    CacheKey replayLast; ///< last cached value to replay (those cached later are published to the new subscribers)
+    std::deque<HeldValue> held; ///< published during the replay, oldest first, each sent once the replay has passed it
+    std::set<std::string> subscriptions; ///< filters subscribed to with wire format version 1
+    std::set<std::string> v2Subscriptions; ///< filters (without prefix) subscribed to with wire format version 2
+    std::map<std::string,PublishStream> streams; ///< streams subscribed to at a limited rate or with a predicate, by the topic ahead of the filters
+    std::map<std::string,uint32_t> topicCounts; ///< subscriptions to each topic (filter as subscribed to), but for retransmits
+    std::shared_ptr<PublicationAudience> audience;
+    uint32_t retransmitDepth; ///< data products kept for each filter text to send again to subscribers that miss them (0 if not reliable)
+    std::map<std::string,uint64_t> sequenceNumbers; ///< of the last data product published with each filter text, if reliable
+    std::map<std::string,std::deque<RetransmitValue> > retransmits; ///< last data products published with each filter text, oldest first
+    uint64_t timeToLive; ///< microseconds after their timestamp that data products are dropped rather than sent (0 for no limit)
+    uint32_t maxSubscriberLag; ///< milliseconds a subscriber may fall behind (0 if subscribers aren't monitored)
+    GravitySlowSubscriberPolicy slowSubscriberPolicy;
+    uint64_t slowSubscriberTimeout; ///< microseconds a subscriber may stay slow before the policy is applied
+    std::map<std::string,SubscriberLag> subscriberLags; ///< subscribers that have reported, by subscriber ID
+    std::vector<SlowSubscriberEvent> slowSubscriberEvents; ///< to tell the listener of
     zmq_pollitem_t pollItem;
     void* socket;
+    bool direct; ///< published to from the publishing thread rather than by the GravityPublishManager (see publishDirect)
+    Semaphore lock; ///< guards the socket, subscriptions and replay of a direct publication
+    uint64_t messageCount; ///< messages published directly since metrics were last collected
+    uint64_t byteCount; ///< bytes published directly since metrics were last collected
+    uint64_t retransmitCount; ///< data products sent again since metrics were last collected
+    uint64_t expiredCount; ///< data products dropped for outliving timeToLive since metrics were last collected
+    uint64_t slowSubscriberCount; ///< subscribers found slow since metrics were last collected
+    uint64_t subscriberDropCount; ///< data products subscribers reported missing since metrics were last collected
+    uint64_t subscriberLag; ///< most milliseconds a subscriber reported since metrics were last collected
+    uint64_t handoffDropCount; ///< of the audience, when metrics were last collected
+    uint64_t handoffBlockedTime; ///< of the audience, when metrics were last collected
 } PublishDetails;
 
 /**
  * The GravityPublishManager is a component used internally by the GravityNode to allow
- * late subscribers to receive the most recent value that they missed.
+ * late subscribers to receive the most recent values that they missed.
  */
 class GravityPublishManager
 {
 private:
 	void* context;
+    unsigned int shard;
     void* gravityMetricsSocket;
     void* metricsPublishSocket;
 	void* gravityNodeResponseSocket;
-    void* gravityNodeSubscribeSocket;
+    void* gravityNodeSubscribeSockets[GravityPriorities::COUNT]; ///< channel for the publishes of each priority
     std::map<void*,std::shared_ptr<PublishDetails> > publishMapBySocket;
     std::map<std::string,std::shared_ptr<PublishDetails> > publishMapByID;
+    std::vector<std::shared_ptr<PublishDetails> > publishMapByHandle;
+#ifdef _WIN32
+    typedef SOCKET PollFD;
+#else
+    typedef int PollFD;
+#endif
+    std::map<PollFD,std::shared_ptr<PublishDetails> > publishMapByFD; ///< direct publications, by the fd polled for their subscription events
     std::vector<zmq_pollitem_t> pollItems;
+    std::set<PublishDetails*> replays; ///< publications replaying cached values to new subscribers, or with subscriptions to tell of
+
+    static const int REPLAY_SLICE_SIZE = 64; ///< cached values to replay between polls of the sockets
+    static const int NORMAL_SLICE_SIZE = 16; ///< NORMAL publishes handled for each BULK one, when both are waiting
+
+    /// Indexes of pollItems: the request socket, the channel of each priority, the metrics sockets then the publications
+    static const unsigned int METRICS_REQUEST_ITEM = 1 + GravityPriorities::COUNT;
+    static const unsigned int METRICS_PUBLISH_ITEM = METRICS_REQUEST_ITEM + 1;
+    static const unsigned int PUBLICATION_ITEMS = METRICS_PUBLISH_ITEM + 1;
 
 	void setHWM();
+	void setCacheLimit();
 	void ready();
 	void registerDataProduct();
 	void unregisterDataProduct();
 	void publish(void* requestSocket);
-    void publish(void* socket, const std::string &filterText, const void *data, int size);
+	void publishByHandle(void* requestSocket);
+	void publish(void* requestSocket, PublishDetails* publishDetails);
+	void publishBatch(void* requestSocket);
+	bool processPublishCommand(void* socket);
+	static bool readable(void* socket);
+    void collectPublicationMetrics(bool keep);
+    void replayCachedValues();
+    static bool publishAndCache(PublishDetails& publishDetails, const std::string& filterText, uint64_t timestamp,
+                                const std::shared_ptr<zmq_msg_t>& envelope, const std::shared_ptr<zmq_msg_t>& data);
+    static std::shared_ptr<zmq_msg_t> keepValue(PublishDetails& publishDetails, const std::string& filterText, uint64_t timestamp,
+                                                const std::shared_ptr<zmq_msg_t>& envelope, const std::shared_ptr<zmq_msg_t>& data);
+    static void publish(PublishDetails& publishDetails, const std::string &filterText, const std::shared_ptr<zmq_msg_t>& envelope,
+                        const std::shared_ptr<zmq_msg_t>& data, std::shared_ptr<zmq_msg_t>* singleFrame, bool cached);
+    static void publishToTopic(const PublishDetails& publishDetails, const std::string& topic, const std::shared_ptr<zmq_msg_t>& envelope,
+                               const std::shared_ptr<zmq_msg_t>& data, bool singleFrameOnly, std::shared_ptr<zmq_msg_t>* singleFrame);
+    static void publishStreams(PublishDetails& publishDetails, const std::string &filterText, const std::shared_ptr<zmq_msg_t>& envelope,
+                               const std::shared_ptr<zmq_msg_t>& data, std::shared_ptr<zmq_msg_t>* singleFrame, bool cached,
+                               std::vector<std::string>& topics);
+    static bool reachesVersion1(const PublishDetails& publishDetails, const std::string& topic);
+    static bool matches(PublishStream& stream, zmq_msg_t* envelope, zmq_msg_t* data);
+    static void publishSingleFrame(void* socket, zmq_msg_t* envelope, zmq_msg_t* data, std::shared_ptr<zmq_msg_t>* singleFrame);
+    static void publishChunks(const PublishDetails& publishDetails, const std::string& topic, zmq_msg_t* envelope,
+                              const std::shared_ptr<zmq_msg_t>& data);
+    static void cacheValue(PublishDetails& publishDetails, const std::string& filterText, uint64_t timestamp,
+                           const std::shared_ptr<zmq_msg_t>& envelope, const std::shared_ptr<zmq_msg_t>& data);
+    static void removeCachedValue(CacheBudget& cacheBudget, std::shared_ptr<CacheValue> value);
+    static void clearCachedValues(PublishDetails& publishDetails);
+    static bool processSubscriptionEvents(PublishDetails& publishDetails);
+    static bool countSubscription(PublishDetails& publishDetails, const std::string& topic, const std::string& filter, bool newsub);
+    static void cacheElidedValues(PublishDetails& publishDetails, const std::string& filter);
+    static void notifySubscriberCount(PublishDetails& publishDetails);
+    static bool monitorSubscriber(PublishDetails& publishDetails, const std::string& topic, const std::string& subscriberID,
+                                  uint64_t lag, uint64_t dropped, bool newsub);
+    static void notifySlowSubscribers(PublishDetails& publishDetails, const std::vector<SlowSubscriberEvent>& events);
+    static void retransmit(PublishDetails& publishDetails, const std::string& topic, uint64_t first, uint64_t last,
+                           const std::string& filterText);
+    static bool replayCachedValues(PublishDetails& publishDetails);
+    static bool expired(PublishDetails& publishDetails, uint64_t timestamp, uint64_t currentTime);
 
 	int publishHWM;
+    std::shared_ptr<CacheBudget> cacheBudget;
     bool metricsEnabled;
     GravityMetrics metricsData;
 public:
 	/**
 	 * Constructor GravityPublishManager
 	 * \param context The zmq context in which the inproc socket will be established with the GravityNode
+	 * \param shard Which of the GravityNode's publish threads this is.  The first (0) also publishes the GravityNode's
+	 *        heartbeat and metrics, and signals its readiness to the GravityNode.
+	 * \param cacheBudget Limit on cached values, shared by all the GravityNode's publish threads
 	 */
-	GravityPublishManager(void* context);
+	GravityPublishManager(void* context, unsigned int shard, const std::shared_ptr<CacheBudget>& cacheBudget);
 
 	/**
 	 * Default destructor
@@ -107,6 +331,68 @@ public:
 	 * Should be executed from GravityNode in its own thread with a shared zmq context.
 	 */
 	void start();
+
+	/**
+	 * The URL of one of the inproc sockets of the given publish thread (the URL itself for the first)
+	 */
+	static std::string shardURL(const std::string& url, unsigned int shard);
+
+	/**
+	 * The URL of the channel that a publish thread receives publishes of a priority over
+	 */
+	static std::string channelURL(unsigned int shard, GravityPriority priority);
+
+	/**
+	 * Publish a data product of a direct publication from the calling thread, straight to its socket.  The
+	 * GravityPublishManager only handles the publication's subscription events (and sends its cached values to new
+	 * subscribers), taking the publication's lock to do so, the same as this.
+	 * \param publishDetails direct publication, handed to the GravityNode when it was registered
+	 * \param filterText text filter associated with the publish
+	 * \param timestamp time the data was created
+	 * \param envelope serialized data product envelope
+	 * \param data the data product's data
+	 * \param replay set to true if new subscribers turned up, and the GravityPublishManager must be sent a "replay"
+	 *        request (with the publication's handle) to send them the publication's cached values
+	 * \return false if the publication has been unregistered
+	 */
+	static bool publishDirect(PublishDetails& publishDetails, const std::string& filterText, uint64_t timestamp,
+	                          const std::shared_ptr<zmq_msg_t>& envelope, const std::shared_ptr<zmq_msg_t>& data, bool& replay);
+
+	/**
+	 * Number of subscriptions to a publication that receive the data products published with the given filter text.
+	 * Takes the audience's lock.
+	 */
+	static uint32_t subscriberCount(PublicationAudience& audience, const std::string& filterText);
+
+	/**
+	 * Drop a publish of a publication that elides them if no subscription wants it, keeping it to cache once one does
+	 * if the publication keeps elided values.
+	 * \param audience of the publication
+	 * \param filterText text filter associated with the publish
+	 * \param timestamp time the data was created
+	 * \param typeName type of protobuf data (empty for other data)
+	 * \param envelope serialized data product envelope, or NULL to make it from the rest only if it's cached
+	 * \param data the data product's data (uncompressed if there's no envelope)
+	 * \return true if the publish was dropped, closing the messages.  Otherwise they're left to be published.
+	 */
+	static bool elide(PublicationAudience& audience, const std::string& filterText, uint64_t timestamp, const std::string& typeName,
+	                  zmq_msg_t* envelope, zmq_msg_t* data);
+
+	/**
+	 * Take a slot for a publish of a publication to wait in the channel to its publish thread, as the publication's
+	 * handoff policy says when they're all taken: waiting for one, superseding the oldest publish waiting without one
+	 * (at most as many as there are slots), or neither.  Publishes dropped, and the time spent waiting, are counted.
+	 * \param audience of the publication
+	 * \return false if the publish is to be dropped instead
+	 */
+	static bool enqueuePublish(PublicationAudience& audience);
+
+	/**
+	 * Give back the slot of a publish of a publication read from the channel to its publish thread.
+	 * \param audience of the publication
+	 * \return false if the publish was superseded, so is to be dropped rather than published
+	 */
+	static bool dequeuePublish(PublicationAudience& audience);
 };
 
 } /* namespace gravity */
@@ -47,9 +47,8 @@ GravityRequestManager::~GravityRequestManager() {}
 void GravityRequestManager::start()
 {
 	// Set up the inproc socket to subscribe to request messages from the GravityNode
-	gravityNodeSocket = zmq_socket(context, ZMQ_SUB);
+	gravityNodeSocket = zmq_socket(context, ZMQ_PULL);
 	zmq_connect(gravityNodeSocket, "inproc://gravity_request_manager");
-	zmq_setsockopt(gravityNodeSocket, ZMQ_SUBSCRIBE, NULL, 0);
 
 	gravityResponseSocket = zmq_socket(context, ZMQ_REP);
 	zmq_connect(gravityResponseSocket, "inproc://gravity_request_rep");
@@ -34,6 +34,10 @@ public:
 	GRAVITY_API Semaphore(int count);
 	GRAVITY_API void Lock();
 	GRAVITY_API void Unlock();
+	/**
+	 * Lock if it can be within the given number of milliseconds (0 not to wait at all); false if it can't
+	 */
+	GRAVITY_API bool TryLock(int timeoutMilliseconds);
 	GRAVITY_API ~Semaphore();
 private:
 	sem_t semaphore;
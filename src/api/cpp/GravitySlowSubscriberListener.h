@@ -0,0 +1,90 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravitySlowSubscriberListener.h
+ *
+ */
+
+#ifndef GRAVITYSLOWSUBSCRIBERLISTENER_H_
+#define GRAVITYSLOWSUBSCRIBERLISTENER_H_
+
+#include <string>
+#include <stdint.h>
+#include "Utility.h"
+
+namespace gravity
+{
+
+/**
+ * Namespace to hold what a publisher does about its slow subscribers (see GravityPublicationOptions::maxSubscriberLag).
+ */
+namespace GravitySlowSubscriberPolicies
+{
+    enum Types
+    {
+        DROP = 0, ///< Keep sending it everything, dropping what doesn't fit within the high water marks (the default)
+        DISCONNECT = 1, ///< Have it unsubscribe from the publisher
+        CONFLATE = 2 ///< Have it subscribe at a limited rate instead, for at most one data product with each filter text per maxSubscriberLag
+    };
+}
+typedef GravitySlowSubscriberPolicies::Types GravitySlowSubscriberPolicy;
+
+/**
+ * Namespace to hold what can happen to a slow subscriber.
+ */
+namespace GravitySlowSubscriberEvents
+{
+    enum Types
+    {
+        SLOW = 0, ///< The subscriber has fallen too far behind, or missed data products
+        RECOVERED = 1, ///< The subscriber has caught up again
+        DISCONNECTED = 2, ///< The subscriber stayed slow, so has been told to unsubscribe
+        CONFLATED = 3 ///< The subscriber stayed slow, so has been told to subscribe at a limited rate
+    };
+}
+typedef GravitySlowSubscriberEvents::Types GravitySlowSubscriberEvent;
+
+/**
+ * Interface specification for an object that will respond to the subscribers of a data product that a GravityNode
+ * publishes falling behind (see GravityNode::registerSlowSubscriberListener).
+ */
+class GravitySlowSubscriberListener
+{
+public:
+	/**
+	 * Called when a subscriber becomes slow, recovers or has the publication's slow subscriber policy applied to it.
+	 * Called from the thread that publishes the data product, so it should return promptly.  It may publish, but
+	 * mustn't register or unregister a listener.
+	 * \param dataProductID ID of the data product
+	 * \param subscriberID identifies the subscriber: its component ID, IP address and a number for its socket
+	 * \param event what happened
+	 * \param lag most milliseconds a data product reached the subscriber after its timestamp, in its latest report
+	 * \param dropped data products the subscriber has missed since it subscribed
+	 */
+	GRAVITY_API virtual void subscriberLagged(const std::string& dataProductID, const std::string& subscriberID,
+	                                          GravitySlowSubscriberEvent event, uint32_t lag, uint64_t dropped) = 0;
+
+	/**
+	 * Default destructor
+	 */
+	GRAVITY_API virtual ~GravitySlowSubscriberListener() { };
+};
+
+} /* namespace gravity */
+#endif //GRAVITYSLOWSUBSCRIBERLISTENER_H_
@@ -24,6 +24,7 @@
  */
 
 #include "GravitySubscriber.h"
+#include "GravityLogger.h"
 
 #include <memory>
 
@@ -32,6 +33,18 @@ namespace gravity {
 GravitySubscriber::~GravitySubscriber() {}
 //TODO: REMOVE IMPLEMENTATION
 void GravitySubscriber::subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) {}
+
+void GravitySubscriber::dataChunkReceived(const std::shared_ptr<GravityDataProduct>& chunk, uint64_t offset, uint64_t totalSize) {}
+
+bool GravitySubscriber::reassembleChunks() const
+{
+    return true;
+}
+
+void GravitySubscriber::unparsedData(const GravityDataProduct& dataProduct, const std::string& typeName)
+{
+    Log::warning("Unable to parse data of %s as %s", dataProduct.getDataProductID().c_str(), typeName.c_str());
+}
 }
 
 
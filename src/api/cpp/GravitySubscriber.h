@@ -27,6 +27,7 @@
 #define GRAVITYSUBSCRIBER_H_
 
 #include "GravityDataProduct.h"
+#include <vector>
 
 namespace gravity
 {
@@ -47,6 +48,79 @@ public:
      * \param dataProducts the data products that fill the registered subscription
      */
     GRAVITY_API virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) = 0;
+
+    /**
+     * Called on implementing object with each chunk of a data product that was published in chunks, in order, as the
+     * chunks arrive.  The chunk has the data product's envelope (ID, timestamp, etc.) and the data from offset to
+     * offset + chunk->getDataSize64() (compressed, if the publisher compresses the data).  If a chunk is lost the rest of
+     * that data product is skipped, so a chunk at offset 0 always starts a new data product.
+     * \param chunk data product holding the chunk
+     * \param offset offset of the chunk's data within the whole data
+     * \param totalSize size of the whole data
+     */
+    GRAVITY_API virtual void dataChunkReceived(const std::shared_ptr<GravityDataProduct>& chunk, uint64_t offset, uint64_t totalSize);
+
+    /**
+     * Whether data products published in chunks should be reassembled for subscriptionFilled.  Subscribers that process
+     * data with dataChunkReceived can return false, so that large data products are not held in memory for them.
+     * \return true (the default) to receive reassembled data products
+     */
+    GRAVITY_API virtual bool reassembleChunks() const;
+
+protected:
+    /**
+     * Report a data product whose data could not be parsed as the expected type
+     */
+    GRAVITY_API static void unparsedData(const GravityDataProduct& dataProduct, const std::string& typeName);
+};
+
+/**
+ * Subscriber that receives the data of its data products already parsed as protobuf messages of type T.
+ * The data of a data product is parsed once and shared by every TypedSubscriber of it.
+ */
+template<typename T>
+class TypedSubscriber : public GravitySubscriber
+{
+public:
+    /**
+     * Default destructor
+     */
+    virtual ~TypedSubscriber() {}
+
+    /**
+     * Called on implementing object when a registered subscription is filled with 1 or more GravityDataProducts
+     * \param data the parsed data of each data product
+     * \param dataProducts the data products that fill the registered subscription (in the same order as data)
+     */
+    virtual void typedSubscriptionFilled(const std::vector< std::shared_ptr<const T> >& data,
+                                         const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) = 0;
+
+    /**
+     * Parses the data of the data products and passes it on to typedSubscriptionFilled.  Data products whose
+     * data can't be parsed as a T are dropped.
+     */
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        std::vector< std::shared_ptr<const T> > data;
+        std::vector< std::shared_ptr<GravityDataProduct> > parsedDataProducts;
+        data.reserve(dataProducts.size());
+        parsedDataProducts.reserve(dataProducts.size());
+        for (size_t i = 0; i < dataProducts.size(); i++)
+        {
+            std::shared_ptr<const T> parsed = dataProducts[i]->getParsedData<T>();
+            if (!parsed)
+            {
+                unparsedData(*dataProducts[i], T::descriptor()->full_name());
+                continue;
+            }
+            data.push_back(parsed);
+            parsedDataProducts.push_back(dataProducts[i]);
+        }
+        if (!data.empty())
+        {
+            typedSubscriptionFilled(data, parsedDataProducts);
+        }
+    }
 };
 
 } /* namespace gravity */
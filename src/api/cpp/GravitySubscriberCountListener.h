@@ -0,0 +1,57 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravitySubscriberCountListener.h
+ *
+ */
+
+#ifndef GRAVITYSUBSCRIBERCOUNTLISTENER_H_
+#define GRAVITYSUBSCRIBERCOUNTLISTENER_H_
+
+#include <string>
+#include <stdint.h>
+#include "Utility.h"
+
+namespace gravity
+{
+
+/**
+ * Interface specification for an object that will respond to subscribers coming and going from a data product that
+ * a GravityNode publishes (see GravityNode::registerSubscriberCountListener).
+ */
+class GravitySubscriberCountListener
+{
+public:
+	/**
+	 * Called when a subscription to the data product is added or removed.  Called from the thread that publishes the
+	 * data product, so it should return promptly.  It may publish and ask for subscriber counts, but mustn't
+	 * register or unregister a listener.
+	 * \param dataProductID ID of the data product
+	 * \param subscriberCount number of subscriptions to it now (see GravityNode::getSubscriberCount)
+	 */
+	GRAVITY_API virtual void subscriberCountChanged(const std::string& dataProductID, uint32_t subscriberCount) = 0;
+
+	/**
+	 * Default destructor
+	 */
+	GRAVITY_API virtual ~GravitySubscriberCountListener() { };
+};
+
+} /* namespace gravity */
+#endif //GRAVITYSUBSCRIBERCOUNTLISTENER_H_
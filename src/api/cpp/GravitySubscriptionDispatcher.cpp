@@ -0,0 +1,372 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravitySubscriptionDispatcher.cpp
+ *
+ */
+
+#include "GravitySubscriptionDispatcher.h"
+#include "GravityLogger.h"
+#include "Utility.h"
+#include <algorithm>
+
+namespace gravity
+{
+
+using namespace std;
+
+GravitySubscriptionDispatcher::GravitySubscriptionDispatcher() : runnable(0)
+{
+	queueLimit = 0;
+	strandPerProduct = false;
+	stopping = false;
+}
+
+GravitySubscriptionDispatcher::~GravitySubscriptionDispatcher()
+{
+	stop();
+}
+
+void GravitySubscriptionDispatcher::start(unsigned int threads, unsigned int queueLimit, bool strandPerProduct)
+{
+	lock.Lock();
+	this->queueLimit = queueLimit;
+	this->strandPerProduct = strandPerProduct;
+	stopping = false;
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread(&GravitySubscriptionDispatcher::work, this));
+	}
+	lock.Unlock();
+}
+
+void GravitySubscriptionDispatcher::stop()
+{
+	lock.Lock();
+	stopping = true;
+	vector<std::thread> stopped;
+	stopped.swap(workers);
+	lock.Unlock();
+
+	// Wake every worker so it sees it's stopping
+	for (size_t i = 0; i < stopped.size(); i++)
+	{
+		runnable.Unlock();
+	}
+	for (size_t i = 0; i < stopped.size(); i++)
+	{
+		stopped[i].join();
+	}
+
+	lock.Lock();
+	strands.clear();
+	for (unsigned int i = 0; i < GravityPriorities::COUNT; i++)
+	{
+		runQueues[i].clear();
+	}
+	lock.Unlock();
+}
+
+std::shared_ptr<GravitySubscriptionDispatcher::Strand>& GravitySubscriptionDispatcher::strand(GravitySubscriber* subscriber,
+                                                                                              const string& dataProductID)
+{
+	StrandKey key(subscriber, strandPerProduct ? dataProductID : string());
+	std::shared_ptr<Strand>& strand = strands[key];
+	if (!strand)
+	{
+		strand.reset(new Strand());
+		strand->key = key;
+		strand->scheduled = false;
+		strand->running = false;
+		strand->runPriority = 0;
+		strand->overflowing = false;
+	}
+	return strand;
+}
+
+GravitySubscriptionDispatcher::Delivery& GravitySubscriptionDispatcher::enqueue(Strand& strand, const string& dataProductID,
+                                                                                GravityPriority priority)
+{
+	deque<Delivery>& queue = strand.queue;
+
+	// Drop the oldest of the least urgent deliveries rather than let a stalled subscriber hold up the
+	// GravitySubscriptionManager
+	if (queueLimit > 0 && queue.size() >= queueLimit)
+	{
+		if (!strand.overflowing)
+		{
+			Log::warning("Subscriber to %s has %u deliveries queued, dropping the oldest", dataProductID.c_str(), queueLimit);
+			strand.overflowing = true;
+		}
+		deque<Delivery>::iterator oldest = queue.begin();
+		while (oldest->priority != queue.back().priority)
+			++oldest;
+		queue.erase(oldest);
+	}
+
+	// After the deliveries of the same or a more urgent priority
+	deque<Delivery>::iterator position = queue.end();
+	while (position != queue.begin() && (position - 1)->priority > priority)
+		--position;
+	position = queue.insert(position, Delivery());
+	position->dataProductID = dataProductID;
+	position->priority = priority;
+	return *position;
+}
+
+void GravitySubscriptionDispatcher::schedule(const std::shared_ptr<Strand>& strand)
+{
+	unsigned int priority = strand->queue.front().priority;
+	if (!strand->scheduled)
+	{
+		strand->scheduled = true;
+		strand->runPriority = priority;
+		runQueues[priority].push_back(strand);
+		runnable.Unlock();
+	}
+	else if (!strand->running && priority < strand->runPriority)
+	{
+		// Move it up to the run queue of its now most urgent delivery
+		deque<std::shared_ptr<Strand> >& runQueue = runQueues[strand->runPriority];
+		runQueue.erase(std::find(runQueue.begin(), runQueue.end(), strand));
+		strand->runPriority = priority;
+		runQueues[priority].push_back(strand);
+	}
+}
+
+void GravitySubscriptionDispatcher::dispatch(GravitySubscriber* subscriber, const string& dataProductID,
+                                             const vector< std::shared_ptr<GravityDataProduct> >& dataProducts,
+                                             GravityPriority priority, uint64_t timeToLive)
+{
+	lock.Lock();
+	if (workers.empty())
+	{
+		lock.Unlock();
+		subscriber->subscriptionFilled(dataProducts);
+		return;
+	}
+
+	std::shared_ptr<Strand>& strand = this->strand(subscriber, dataProductID);
+	Delivery& delivery = enqueue(*strand, dataProductID, priority);
+	delivery.dataProducts = dataProducts;
+	delivery.conflate = false;
+	delivery.timeToLive = timeToLive;
+
+	schedule(strand);
+	lock.Unlock();
+}
+
+void GravitySubscriptionDispatcher::dispatchLatest(GravitySubscriber* subscriber, const string& dataProductID, const string& filter,
+                                                   const vector< std::shared_ptr<GravityDataProduct> >& dataProducts,
+                                                   GravityPriority priority, uint64_t timeToLive)
+{
+	if (dataProducts.empty())
+	{
+		return;
+	}
+	vector< std::shared_ptr<GravityDataProduct> > latest(1, dataProducts.back());
+
+	lock.Lock();
+	uint64_t& conflated = conflatedCounts[std::make_pair(subscriber, dataProductID)];
+	conflated += dataProducts.size() - 1;
+	if (workers.empty())
+	{
+		lock.Unlock();
+		subscriber->subscriptionFilled(latest);
+		return;
+	}
+
+	// The subscription has at most one delivery queued, which the latest data product takes the place of
+	std::shared_ptr<Strand>& strand = this->strand(subscriber, dataProductID);
+	for (deque<Delivery>::iterator delivery = strand->queue.begin(); delivery != strand->queue.end(); ++delivery)
+	{
+		if (delivery->conflate && delivery->dataProductID == dataProductID && delivery->filter == filter)
+		{
+			conflated += delivery->dataProducts.size();
+			delivery->dataProducts.swap(latest);
+			delivery->timeToLive = timeToLive;
+			lock.Unlock();
+			return;
+		}
+	}
+
+	Delivery& delivery = enqueue(*strand, dataProductID, priority);
+	delivery.dataProducts.swap(latest);
+	delivery.conflate = true;
+	delivery.filter = filter;
+	delivery.timeToLive = timeToLive;
+
+	schedule(strand);
+	lock.Unlock();
+}
+
+void GravitySubscriptionDispatcher::cancel(GravitySubscriber* subscriber, const string& dataProductID)
+{
+	lock.Lock();
+	for (map<StrandKey, std::shared_ptr<Strand> >::iterator iter = strands.lower_bound(StrandKey(subscriber, string()));
+	     iter != strands.end() && iter->first.first == subscriber; ++iter)
+	{
+		deque<Delivery>& queue = iter->second->queue;
+		for (deque<Delivery>::iterator delivery = queue.begin(); delivery != queue.end();)
+		{
+			delivery = delivery->dataProductID == dataProductID ? queue.erase(delivery) : delivery + 1;
+		}
+	}
+	conflatedCounts.erase(std::make_pair(subscriber, dataProductID));
+	expiredCounts.erase(std::make_pair(subscriber, dataProductID));
+	lock.Unlock();
+}
+
+void GravitySubscriptionDispatcher::countExpired(GravitySubscriber* subscriber, const string& dataProductID, uint64_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	lock.Lock();
+	expiredCounts[std::make_pair(subscriber, dataProductID)] += count;
+	lock.Unlock();
+}
+
+size_t GravitySubscriptionDispatcher::queueDepth(const GravitySubscriber* subscriber, const string& dataProductID)
+{
+	size_t depth = 0;
+	lock.Lock();
+	GravitySubscriber* key = const_cast<GravitySubscriber*>(subscriber);
+	for (map<StrandKey, std::shared_ptr<Strand> >::const_iterator iter = strands.lower_bound(StrandKey(key, string()));
+	     iter != strands.end() && iter->first.first == key; ++iter)
+	{
+		const deque<Delivery>& queue = iter->second->queue;
+		for (deque<Delivery>::const_iterator delivery = queue.begin(); delivery != queue.end(); ++delivery)
+		{
+			if (dataProductID.empty() || delivery->dataProductID == dataProductID)
+			{
+				depth++;
+			}
+		}
+	}
+	lock.Unlock();
+	return depth;
+}
+
+// Total of the counts kept for a subscriber, of one data product or all of them
+static uint64_t subscriberCount(const map<std::pair<GravitySubscriber*, string>, uint64_t>& counts, const GravitySubscriber* subscriber,
+                                const string& dataProductID)
+{
+	uint64_t count = 0;
+	GravitySubscriber* key = const_cast<GravitySubscriber*>(subscriber);
+	for (map<std::pair<GravitySubscriber*, string>, uint64_t>::const_iterator iter = counts.lower_bound(std::make_pair(key, string()));
+	     iter != counts.end() && iter->first.first == key; ++iter)
+	{
+		if (dataProductID.empty() || iter->first.second == dataProductID)
+		{
+			count += iter->second;
+		}
+	}
+	return count;
+}
+
+uint64_t GravitySubscriptionDispatcher::conflatedCount(const GravitySubscriber* subscriber, const string& dataProductID)
+{
+	lock.Lock();
+	uint64_t count = subscriberCount(conflatedCounts, subscriber, dataProductID);
+	lock.Unlock();
+	return count;
+}
+
+uint64_t GravitySubscriptionDispatcher::expiredCount(const GravitySubscriber* subscriber, const string& dataProductID)
+{
+	lock.Lock();
+	uint64_t count = subscriberCount(expiredCounts, subscriber, dataProductID);
+	lock.Unlock();
+	return count;
+}
+
+void GravitySubscriptionDispatcher::work()
+{
+	while (true)
+	{
+		runnable.Lock();
+		lock.Lock();
+		if (stopping)
+		{
+			lock.Unlock();
+			break;
+		}
+		unsigned int priority = 0;
+		while (runQueues[priority].empty())
+			priority++;
+		std::shared_ptr<Strand> strand = runQueues[priority].front();
+		runQueues[priority].pop_front();
+		if (strand->queue.empty())
+		{
+			// Its deliveries were cancelled
+			strand->scheduled = false;
+			strands.erase(strand->key);
+			lock.Unlock();
+			continue;
+		}
+		Delivery delivery;
+		delivery.dataProductID = strand->queue.front().dataProductID;
+		delivery.dataProducts.swap(strand->queue.front().dataProducts);
+		delivery.timeToLive = strand->queue.front().timeToLive;
+		strand->queue.pop_front();
+		strand->running = true;
+		lock.Unlock();
+
+		// Drop the data products that outlived their time to live while queued, without parsing them
+		uint64_t currTime = getCurrentTime();
+		size_t live = 0;
+		for (size_t i = 0; i < delivery.dataProducts.size(); i++)
+		{
+			if (!delivery.dataProducts[i]->isExpired(currTime, delivery.timeToLive))
+				delivery.dataProducts[live++] = delivery.dataProducts[i];
+		}
+		uint64_t expired = delivery.dataProducts.size() - live;
+		delivery.dataProducts.resize(live);
+
+		// Only this worker delivers to the strand until it's scheduled again
+		if (!delivery.dataProducts.empty())
+		{
+			strand->key.first->subscriptionFilled(delivery.dataProducts);
+		}
+
+		lock.Lock();
+		if (expired > 0)
+		{
+			expiredCounts[std::make_pair(strand->key.first, delivery.dataProductID)] += expired;
+		}
+		strand->running = false;
+		if (strand->queue.empty())
+		{
+			strand->scheduled = false;
+			strand->overflowing = false;
+			strands.erase(strand->key);
+		}
+		else
+		{
+			strand->runPriority = strand->queue.front().priority;
+			runQueues[strand->runPriority].push_back(strand);
+			runnable.Unlock();
+		}
+		lock.Unlock();
+	}
+}
+
+} /* namespace gravity */
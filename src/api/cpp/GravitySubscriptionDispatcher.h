@@ -0,0 +1,165 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * GravitySubscriptionDispatcher.h
+ *
+ */
+
+#ifndef GRAVITYSUBSCRIPTIONDISPATCHER_H_
+#define GRAVITYSUBSCRIPTIONDISPATCHER_H_
+
+#include "GravitySubscriber.h"
+#include "GravitySemaphore.h"
+#include "GravityPriority.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace gravity
+{
+
+/**
+ * The GravitySubscriptionDispatcher is a component used internally by the GravityNode to deliver data products to its
+ * subscribers.  By default subscribers are called from the GravitySubscriptionManager's thread.  Once started with
+ * worker threads, each subscriber (or each subscriber and data product) is a strand: its deliveries are queued and
+ * made in order by one worker at a time, while other strands are delivered to in parallel.  A strand that falls
+ * behind by more than the queue limit loses its oldest deliveries rather than holding up the others.
+ *
+ * Deliveries have the priority of their subscription.  A strand's deliveries are made most urgent first (in order
+ * within each priority), and workers run the strands with the most urgent deliveries first.
+ */
+class GravitySubscriptionDispatcher
+{
+private:
+	typedef struct Delivery
+	{
+		std::string dataProductID;
+		std::vector< std::shared_ptr<GravityDataProduct> > dataProducts;
+		bool conflate; ///< replaced by a later delivery of the latest data product for the same filter
+		std::string filter;
+		GravityPriority priority;
+		uint64_t timeToLive; ///< microseconds after their timestamp the subscriber wants the data products (0 for no limit)
+	} Delivery;
+
+	typedef std::pair<GravitySubscriber*, std::string> StrandKey;
+
+	typedef struct Strand
+	{
+		StrandKey key;
+		std::deque<Delivery> queue;
+		bool scheduled; ///< queued to run, or being run by a worker
+		bool running; ///< being run by a worker
+		unsigned int runPriority; ///< run queue the strand is in, while scheduled and not running
+		bool overflowing; ///< deliveries dropped since the queue was last empty
+	} Strand;
+
+	Semaphore lock; ///< guards everything below
+	Semaphore runnable; ///< counts the strands in runQueues (and wakes workers to stop)
+	std::map<StrandKey, std::shared_ptr<Strand> > strands;
+	std::deque<std::shared_ptr<Strand> > runQueues[GravityPriorities::COUNT]; ///< strands to run, by the priority of their most urgent delivery
+	std::map<std::pair<GravitySubscriber*, std::string>, uint64_t> conflatedCounts; ///< per subscriber and data product
+	std::map<std::pair<GravitySubscriber*, std::string>, uint64_t> expiredCounts; ///< per subscriber and data product
+	std::vector<std::thread> workers;
+	unsigned int queueLimit; ///< most deliveries queued for a strand (0 for no limit)
+	bool strandPerProduct;
+	bool stopping;
+
+	std::shared_ptr<Strand>& strand(GravitySubscriber* subscriber, const std::string& dataProductID);
+	Delivery& enqueue(Strand& strand, const std::string& dataProductID, GravityPriority priority);
+	void schedule(const std::shared_ptr<Strand>& strand);
+	void work();
+public:
+	/**
+	 * Constructor GravitySubscriptionDispatcher, delivering from the calling thread until started
+	 */
+	GravitySubscriptionDispatcher();
+
+	/**
+	 * Destructor, stops the worker threads
+	 */
+	virtual ~GravitySubscriptionDispatcher();
+
+	/**
+	 * Start delivering from a pool of worker threads
+	 * \param threads number of worker threads (0 keeps delivering from the calling thread)
+	 * \param queueLimit most deliveries queued for a strand before its oldest are dropped (0 for no limit)
+	 * \param strandPerProduct true to order deliveries per subscriber and data product rather than per subscriber
+	 */
+	void start(unsigned int threads, unsigned int queueLimit, bool strandPerProduct);
+
+	/**
+	 * Stop the worker threads, once they finish any deliveries they're making.  Queued deliveries are dropped.
+	 */
+	void stop();
+
+	/**
+	 * Deliver data products to a subscriber, after any earlier deliveries on its strand of the same or a more urgent
+	 * priority.  Those that outlive their time to live (or the subscriber's) while queued are dropped.
+	 */
+	void dispatch(GravitySubscriber* subscriber, const std::string& dataProductID,
+	              const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts,
+	              GravityPriority priority = GravityPriorities::NORMAL, uint64_t timeToLive = 0);
+
+	/**
+	 * Deliver only the latest of some data products to a subscriber, replacing any delivery of an earlier one (with the
+	 * same data product ID and filter) still queued for it.  The data products not delivered are counted as conflated.
+	 */
+	void dispatchLatest(GravitySubscriber* subscriber, const std::string& dataProductID, const std::string& filter,
+	                    const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts,
+	                    GravityPriority priority = GravityPriorities::NORMAL, uint64_t timeToLive = 0);
+
+	/**
+	 * Count data products dropped rather than delivered to a subscriber for outliving their time to live
+	 */
+	void countExpired(GravitySubscriber* subscriber, const std::string& dataProductID, uint64_t count);
+
+	/**
+	 * Drop the deliveries of a data product queued for a subscriber, and its conflated and expired counts (when it
+	 * unsubscribes)
+	 */
+	void cancel(GravitySubscriber* subscriber, const std::string& dataProductID);
+
+	/**
+	 * Number of deliveries queued for a subscriber
+	 * \param subscriber the subscriber
+	 * \param dataProductID only count deliveries of this data product (empty for all)
+	 */
+	size_t queueDepth(const GravitySubscriber* subscriber, const std::string& dataProductID);
+
+	/**
+	 * Number of data products conflated for a subscriber by dispatchLatest
+	 * \param subscriber the subscriber
+	 * \param dataProductID only count data products with this ID (empty for all)
+	 */
+	uint64_t conflatedCount(const GravitySubscriber* subscriber, const std::string& dataProductID);
+
+	/**
+	 * Number of data products not delivered to a subscriber for outliving their time to live
+	 * \param subscriber the subscriber
+	 * \param dataProductID only count data products with this ID (empty for all)
+	 */
+	uint64_t expiredCount(const GravitySubscriber* subscriber, const std::string& dataProductID);
+};
+
+} /* namespace gravity */
+#endif /* GRAVITYSUBSCRIPTIONDISPATCHER_H_ */
@@ -27,16 +27,22 @@
 #include "GravityLogger.h"
 #include "CommUtil.h"
 #include "GravityMetricsUtil.h"
+#include "Utility.h"
 #include "protobuf/ComponentDataLookupResponsePB.pb.h"
 #include "protobuf/ServiceDirectoryUnregistrationPB.pb.h"
 
+#include <google/protobuf/wire_format_lite.h>
 #include <memory>
+#include <new>
 #include <algorithm>
+#include <sstream>
+#include <cstdlib>
 
 namespace gravity
 {
 
 using namespace std;
+using google::protobuf::internal::WireFormatLite;
 
 bool sortCacheValues (const std::shared_ptr<GravityDataProduct> &i, const std::shared_ptr<GravityDataProduct> &j)
 {
@@ -44,17 +50,22 @@ bool sortCacheValues (const std::shared_ptr<GravityDataProduct> &i, const std::s
 }
 
 
-GravitySubscriptionManager::GravitySubscriptionManager(void* context)
+GravitySubscriptionManager::GravitySubscriptionManager(void* context, const std::shared_ptr<GravitySubscriptionDispatcher>& dispatcher)
 {
 	// This is the zmq context that is shared with the GravityNode. Must use
 	// a shared context to establish an inproc socket.
 	this->context = context;
+	this->dispatcher = dispatcher;
 
     // Default to no metrics
     metricsEnabled = false;
 
 	// Default high water mark
 	subscribeHWM = 1000;
+
+	// Default limit on reassembling chunked data products
+	reassemblyLimit = 1024 * 1024 * 1024;
+	reassemblyBytes = 0;
 }
 
 GravitySubscriptionManager::~GravitySubscriptionManager() {}
@@ -65,29 +76,18 @@ void GravitySubscriptionManager::start()
 
     // Set up the inproc socket to subscribe to subscribe and unsubscribe messages from
 	// the GravityNode
-	gravityNodeSocket = zmq_socket(context, ZMQ_SUB);
+	gravityNodeSocket = zmq_socket(context, ZMQ_PULL);
 	zmq_connect(gravityNodeSocket, "inproc://gravity_subscription_manager");
-	zmq_setsockopt(gravityNodeSocket, ZMQ_SUBSCRIBE, NULL, 0);
 
     // Setup socket to reponsd to metrics requests
     gravityMetricsSocket = zmq_socket(context, ZMQ_REP);
     zmq_bind(gravityMetricsSocket, GRAVITY_SUB_METRICS_REQ);
 
 	// Poll the gravity node
-	zmq_pollitem_t pollItem;
-	pollItem.socket = gravityNodeSocket;
-	pollItem.events = ZMQ_POLLIN;
-	pollItem.fd = 0;
-	pollItem.revents = 0;
-	pollItems.push_back(pollItem);
+	addSocket(gravityNodeSocket, GRAVITY_NODE);
 
     // Poll the metrics request socket
-    zmq_pollitem_t metricsRequestPollItem;
-    metricsRequestPollItem.socket = gravityMetricsSocket;
-    metricsRequestPollItem.events = ZMQ_POLLIN;
-    metricsRequestPollItem.fd = 0;
-    metricsRequestPollItem.revents = 0;
-    pollItems.push_back(metricsRequestPollItem);
+    addSocket(gravityMetricsSocket, METRICS);
 
 	void* configureSocket=zmq_socket(context,ZMQ_SUB);
 	zmq_connect(configureSocket,"inproc://gravity_subscription_manager_configure");
@@ -133,10 +133,14 @@ void GravitySubscriptionManager::start()
 	zmq_close(configureSocket);
 
 	// Process forever...
+	vector<unsigned int> readySlots;
 	while (true)
 	{
 		calculateTimeout();
-		int rc = zmq_poll(&pollItems[0], pollItems.size(), pollTimeout); // 0 --> return immediately, -1 --> blocks
+		// Wake up in time to ask again for data products of reliable publications that haven't been received again
+		int retransmitTimeout = checkRetransmitRequests();
+		bool retransmitWakeup = retransmitTimeout >= 0 && (pollTimeout < 0 || retransmitTimeout < pollTimeout);
+		int rc = poller.wait(retransmitWakeup ? retransmitTimeout : pollTimeout, readySlots); // 0 --> return immediately, -1 --> blocks
 		if (rc == -1)
 		{
 		    Log::debug("Interrupted, exiting (rc = %d)", rc);
@@ -147,7 +151,7 @@ void GravitySubscriptionManager::start()
 		// If timeout occured
 		if(rc == 0)
 		{
-			if (currTimeoutMonitor != NULL)
+			if (currTimeoutMonitor != NULL && !retransmitWakeup)
 			{				
 				//calculate time since last subscription
 				uint64_t currTime =  getCurrentTime()/1000;
@@ -160,8 +164,15 @@ void GravitySubscriptionManager::start()
 			continue;
 		}
 
+		bool gravityNodeReady = false, metricsReady = false;
+		for (size_t i = 0; i < readySlots.size(); i++)
+		{
+			gravityNodeReady |= socketSlots[readySlots[i]].type == GRAVITY_NODE;
+			metricsReady |= socketSlots[readySlots[i]].type == METRICS;
+		}
+
 		// Process new subscription requests from the gravity node
-		if (pollItems[0].revents & ZMQ_POLLIN)
+		if (gravityNodeReady)
 		{
 			// Get new GravityNode request
 			string command = readStringMessage(gravityNodeSocket);
@@ -186,6 +197,10 @@ void GravitySubscriptionManager::start()
 			{
 				setHWM();
 			}
+			else if (command == "set_reassembly_limit")
+			{
+				reassemblyLimit = readUint64Message(gravityNodeSocket);
+			}
 			else if (command == "set_monitor")
 			{
 				setTimeoutMonitor();
@@ -204,10 +219,10 @@ void GravitySubscriptionManager::start()
 			}
 		}
 
-        if (pollItems[1].revents & ZMQ_POLLIN)
+        if (metricsReady)
         {
             // Received a command from the metrics control
-            void* socket = pollItems[1].socket;
+            void* socket = gravityMetricsSocket;
             string command = readStringMessage(socket);
 
             if (command == "MetricsEnable")
@@ -244,226 +259,22 @@ void GravitySubscriptionManager::start()
             }
         }
 
-		// Check for subscription updates
-		for (unsigned int index = 2; index < pollItems.size(); index++)
+		// Receive on the sockets ready, most urgent first, skipping any closed handling a request before them
+		for (size_t i = 0; i < readySlots.size() * GravityPriorities::COUNT; i++)
 		{
-			string url = "<PUBLISHER UPDATES>";
-			if (subscriptionSocketMap.find(pollItems[index].socket) != subscriptionSocketMap.end())
+			unsigned int slot = readySlots[i % readySlots.size()];
+			if (poller.socket(slot) == NULL || socketSlots[slot].priority != i / readySlots.size())
 			{
-				url = subscriptionSocketMap[pollItems[index].socket]->socketToUrlMap[pollItems[index].socket];
+				continue;
 			}
-	        Log::trace("Checking poll item: index = %d, size = %d, url=%s", index, pollItems.size(), url.c_str());
-			if (pollItems[index].revents & ZMQ_POLLIN)
+			if (socketSlots[slot].type == PUBLISHER)
 			{
-			    // if it's a regular subscription poll item
-			    if (subscriptionSocketMap.count(pollItems[index].socket) > 0)
-			    {
-                    // Deliver to subscriber(s)
-			        std::shared_ptr<SubscriptionDetails> subDetails = subscriptionSocketMap[pollItems[index].socket];
-
-                    vector< std::shared_ptr<GravityDataProduct> > dataProducts;
-                    while (true)
-                    {
-                        string filterText;
-                        std::shared_ptr<GravityDataProduct> dataProduct;
-                        if (readSubscription(pollItems[index].socket, filterText, dataProduct) < 0)
-                            break;
-
-						// Verify publisher
-						if (socketVerificationMap[pollItems[index].socket] != dataProduct->getRegistrationTime())
-						{
-							// Published data does not match publisher
-							Log::critical("Received data product (%s) from publisher different from registered with ServiceDirectory [%u != %u].",
-											dataProduct->getDataProductID().c_str(), socketVerificationMap[pollItems[index].socket], 
-											dataProduct->getRegistrationTime());								
-							
-							// Notify Service Directory of stale entry
-							notifyServiceDirectoryOfStaleEntry(subDetails->dataProductID, subDetails->domain, url, socketVerificationMap[pollItems[index].socket]);
-
-							// Unsubscribe
-							//unsubscribeFromPollItem(pollItems[index], filterText);
-
-							// Add this socket to the to be deleted list
-							deleteList.push_back(std::make_pair(subDetails, pollItems[index].socket));
-
-							break;
-						}
-
-                        std::shared_ptr<GravityDataProduct> lastCachedValue = lastCachedValueMap[pollItems[index].socket];
-
-                        // if it's been relayed, it will come in on a different socket than the original.  Look at all cached values
-                        // to try to filter out duplicates.
-                        // This is just to handle the transition when the Relay is first inserted - after that, normal subscribers
-                        // will only be subscribed to the relay (if one exists).
-                        bool cachedRelay = false;
-                        if (!lastCachedValue && dataProduct->isRelayedDataproduct())
-                        {
-                            for (map<void*, std::shared_ptr<GravityDataProduct> >::const_iterator mapIter = lastCachedValueMap.begin();
-                                    mapIter != lastCachedValueMap.end(); mapIter++)
-                            {
-                                if (mapIter->second &&
-                                        mapIter->second->getGravityTimestamp() == dataProduct->getGravityTimestamp() &&
-                                        mapIter->second->getComponentId() == dataProduct->getComponentId() &&
-                                        *(mapIter->second) == *dataProduct) // only compares product id and data
-                                {
-                                    cachedRelay = true;
-                                    break;
-                                }
-                            }
-                        }
-
-                        // This may be a resend of previous value if a new subscriber was added, so make sure this is new data
-                        if (!cachedRelay &&
-                              (!lastCachedValue ||
-                               lastCachedValue->getGravityTimestamp() < dataProduct->getGravityTimestamp() ||
-                               // or if timestamps are the same, but GDP's are different
-                               (lastCachedValue->getGravityTimestamp() == dataProduct->getGravityTimestamp() && !(*lastCachedValue == *dataProduct))))
-                        {
-
-							// Grab current time now for stamping received_timestamp on received data products
-							dataProduct->setReceivedTimestamp(getCurrentTime());
-																												
-							if(dataProduct->isCachedDataproduct() && subDetails->receiveCachedDataProducts == false){
-								// if it's cached and we're not receiving cached, do nothing
-								Log::trace("Ignoring cached data product");
-							}
-							else
-							{														
-								// Add data product to vector to be provided to the subscriber								
-								Log::trace(dataProduct->isCachedDataproduct() ? "Accepting cached data product" : "Accepting new data product");
-								dataProducts.push_back(dataProduct);
-							}
-								// Save most recent value so we can provide it to new subscribers, and to perform check above.
-								lastCachedValueMap[pollItems[index].socket] = dataProduct;
-							
-                        }
-                    }                
-
-                    // Loop through all subscribers and deliver the messages
-					if(dataProducts.size() != 0)
-					{
-						Log::trace("received %d gdp's, about to send to %d subscribers", dataProducts.size(), subDetails->subscribers.size());
-
-						for (set<GravitySubscriber*>::iterator iter = subDetails->subscribers.begin(); iter != subDetails->subscribers.end(); iter++)
-						{
-							(*iter)->subscriptionFilled(dataProducts);
-						}
-						uint64_t currTime = getCurrentTime()/1000;
-						for (set<std::shared_ptr<TimeoutMonitor> >::iterator iter = subDetails->monitors.begin(); iter != subDetails->monitors.end(); iter++)
-						{						
-							(*iter)->lastReceived = (int64_t) currTime;
-							(*iter)->endTime = currTime + (*iter)->timeout;
-						}
-
-                        if (metricsEnabled)
-                        {
-                            collectMetrics(dataProducts);
-                        }
-					}
-                }
-			    else // it's a publisher update list from the SD
-			    {
-			        std::shared_ptr<GravityDataProduct> dataProduct;
-                    string dataProductID;
-                    readSubscription(pollItems[index].socket, dataProductID, dataProduct);
-                    if (dataProductID.empty())
-                    {
-                        Log::warning("Received an apparently empty update list from ServiceDirectory");
-                        continue;
-                    }
-                    ComponentDataLookupResponsePB update;
-                    dataProduct->populateMessage(update);
-					string domain = update.domain_id();
-                    Log::trace("Found update to publishers list for data product %s (domain:%s)", dataProductID.c_str(), domain.c_str());
-
-					// Create the domain/data key for tracking subscriptions
-					DomainDataKey key(domain, dataProductID);
-					Log::trace("subscriptionMap.count(key) = %d", subscriptionMap.count(key));
-
-					list<PublisherInfoPB> allPublishers, trimmedPublishers;
-                    for (int i = 0; i < update.publishers_size(); i++)
-                    {
-                    	allPublishers.push_back(update.publishers(i));
-                    }
-					trimPublishers(allPublishers, trimmedPublishers);
-
-                    if (subscriptionMap.count(key) != 0)
-                    {
-						// Loop over our existing subscriptions (filters) for domain/data of the updated publisher list
-                        for (map<string, std::shared_ptr<SubscriptionDetails> >::iterator iter = subscriptionMap[key].begin();
-                             iter != subscriptionMap[key].end();
-                             iter++)
-                        {
-							// Details of the existing subscription
-							string filter = iter->first;
-							std::shared_ptr<SubscriptionDetails> subDetails = iter->second;
-
-							// Loop over publishers list provided by SD
-                            for (list<PublisherInfoPB>::const_iterator trimmedIter = trimmedPublishers.begin();
-                            		trimmedIter != trimmedPublishers.end(); trimmedIter++)
-                            {
-                                // If we don't already have this publisher url, add it OR if it is an updated publisher url based on a new registration timestamp
-								if (subDetails->pollItemMap.count(trimmedIter->url()) == 0 ||
-									socketVerificationMap[subDetails->pollItemMap[trimmedIter->url()].socket] != trimmedIter->registration_time())
-                                {                                    
-									if (socketVerificationMap[subDetails->pollItemMap[trimmedIter->url()].socket] != trimmedIter->registration_time())
-									{
-										Log::trace("Updated url: %s", trimmedIter->url().c_str());
-										// This is an updated publisher location. Remove the old one.
-										deleteList.push_back(std::make_pair(subDetails, subDetails->pollItemMap[trimmedIter->url()].socket));
-									}
-									else
-									{
-										Log::trace("New url: %s", trimmedIter->url().c_str());
-									}
-
-                                    zmq_pollitem_t pollItem;
-                                    void *subSocket = setupSubscription(trimmedIter->url(), filter, pollItem);
-
-                                    // Track by socket for quick lookup as data arrives
-									subscriptionSocketMap[subSocket] = subDetails;
-
-                                    // Add url & poll item to subscription details
-									subDetails->pollItemMap[trimmedIter->url()] = pollItem;
-
-									// Add lookup from socket to url
-									subDetails->socketToUrlMap[subSocket] = trimmedIter->url();									
-                                }								
-                                else
-                                {
-                                    Log::trace("Skipping. Already have this publisher url: %s", trimmedIter->url().c_str());
-                                }
-
-								// Insert/Update map to manage publisher verification
-								socketVerificationMap[iter->second->pollItemMap[trimmedIter->url()].socket] = trimmedIter->registration_time();
-                            }
-
-                            // loop through the existing urls/sockets to see if any have disappeared.
-							map<string, zmq_pollitem_t>::iterator socketIter = subDetails->pollItemMap.begin();
-							while (socketIter != subDetails->pollItemMap.end())
-                            {
-                                bool found = false;
-                                // there doesn't seem to be a good way to check containment in a protobuf set...
-                                for (list<PublisherInfoPB>::const_iterator trimmedIter = trimmedPublishers.begin();
-                                		trimmedIter != trimmedPublishers.end(); trimmedIter++)
-                                {
-                                    if (socketIter->first == trimmedIter->url())
-                                    {
-                                        found = true;
-                                        break;
-                                    }
-                                }
-
-                                if (!found) 
-								{
-                                    Log::debug("url %s is gone, adding to delete list", socketIter->first.c_str());
-									deleteList.push_back(std::make_pair(iter->second, socketIter->second.socket));
-                                } 								
-								++socketIter;
-                            }
-                        }
-                    }
-			    }
+				// Deliver to subscriber(s)
+				receiveData(slot, deleteList);
+			}
+			else if (socketSlots[slot].type == PUBLISHER_UPDATES)
+			{
+				receivePublisherUpdate(slot, deleteList);
 			}
 		}
 
@@ -473,34 +284,19 @@ void GravitySubscriptionManager::start()
 			std::shared_ptr<SubscriptionDetails> subDetails = iter->first;
 			void* socket = iter->second;
 			string url = subDetails->socketToUrlMap[socket];
-			subscriptionSocketMap.erase(socket);
-			socketVerificationMap.erase(socket);
-			lastCachedValueMap.erase(socket);
-			
-			// Unsubscribe
+
+			// Unsubscribe, closing the socket if no other subscription shares it
 			Log::trace("Unsubscribing: %s:%s:%s @ %s", subDetails->domain.c_str(), subDetails->dataProductID.c_str(), 
 														subDetails->filter.c_str(), url.c_str());
-			zmq_setsockopt(socket, ZMQ_UNSUBSCRIBE, subDetails->filter.c_str(), subDetails->filter.length());			
-			
-			// Close the socket
-			zmq_close(socket);
+			detachSubscription(subDetails, socket);
 
 			// If the socket for this url hasn't been updated, remove it
-			if (subDetails->pollItemMap[url].socket == socket)
+			map<string, zmq_pollitem_t>::iterator pollItemIter = subDetails->pollItemMap.find(url);
+			if (pollItemIter != subDetails->pollItemMap.end() && pollItemIter->second.socket == socket)
 			{
-				subDetails->pollItemMap.erase(url);
+				subDetails->pollItemMap.erase(pollItemIter);
 			}
 			subDetails->socketToUrlMap.erase(socket);
-			
-			for (vector<zmq_pollitem_t>::iterator pollIter = pollItems.begin(); pollIter != pollItems.end(); ++pollIter)
-			{
-				if (socket == pollIter->socket)
-				{
-					pollItems.erase(pollIter);
-					Log::debug("delete socket from pollitems, size is now %d", pollItems.size());
-					break;
-				}
-			}
 
 			// Check if we're out of subscriptions for this domain/data/filter
 			/*
@@ -536,22 +332,18 @@ void GravitySubscriptionManager::start()
 	}
 
 	// Clean up all our open sockets
-	for (map<DomainDataKey, map<std::string, std::shared_ptr<SubscriptionDetails> > >::iterator iter = subscriptionMap.begin();
-	     iter != subscriptionMap.end(); iter++)
+	for (size_t slot = 0; slot < socketSlots.size(); slot++)
 	{
-	    for (map<std::string, std::shared_ptr<SubscriptionDetails> >::iterator detIter = iter->second.begin(); detIter != iter->second.end(); detIter++)
+	    if (socketSlots[slot].type != GRAVITY_NODE && socketSlots[slot].type != METRICS && socketSlots[slot].socket != NULL)
 	    {
-	        for (std::map<std::string, zmq_pollitem_t>::iterator piIter = detIter->second->pollItemMap.begin(); piIter != detIter->second->pollItemMap.end(); piIter++)
-	        {
-	            zmq_close(piIter->second.socket);
-	        }
-	        zmq_close(detIter->second->publisherUpdatePollItem.socket);
+	        closeSocket(slot);
 	    }
 	}
 
 	subscriptionMap.clear();
-	subscriptionSocketMap.clear();
-	socketVerificationMap.clear();
+	monitoredSubscriptions.clear();
+	publisherSlotMap.clear();
+	publisherUpdateSlotMap.clear();
 	zmq_close(gravityNodeSocket);
     zmq_close(gravityMetricsSocket);
 }
@@ -570,10 +362,11 @@ void GravitySubscriptionManager::ready()
 	zmq_close(initSocket);
 }
 
-int GravitySubscriptionManager::readSubscription(void *socket, string &filterText, std::shared_ptr<GravityDataProduct> &dataProduct)
+int GravitySubscriptionManager::readSubscription(void *socket, string &filterText, string &stream, std::shared_ptr<GravityDataProduct> &dataProduct,
+                                                 std::shared_ptr<google::protobuf::Arena> arena)
 {
     // Messages
-    zmq_msg_t filter, message;
+    zmq_msg_t filter;
 
     int ret = 0;
 
@@ -585,25 +378,95 @@ int GravitySubscriptionManager::readSubscription(void *socket, string &filterTex
         zmq_msg_close(&filter);
         return ret;
     }
-    int size = zmq_msg_size(&filter);
-    char* s = (char*)malloc(size+1);
-    memcpy(s, zmq_msg_data(&filter), size);
-    s[size] = 0;
-    filterText = string(s, size);
-    free(s);
+    filterText.assign((const char*)zmq_msg_data(&filter), zmq_msg_size(&filter));
     zmq_msg_close(&filter);
+    const string& prefix = wireFormatV2Prefix();
+    stream.clear();
+    if (filterText.compare(0, prefix.length(), prefix) == 0)
+    {
+        filterText.erase(0, prefix.length());
+    }
+    else
+    {
+        string topic(filterText), predicate, subscriberID;
+        uint64_t interval, first, last, lag, dropped, report;
+        if (parseRateLimitedTopic(topic, interval, filterText) || parsePredicateTopic(topic, interval, predicate, filterText) ||
+            parseRetransmitTopic(topic, first, last, filterText))
+        {
+            stream.assign(topic, 0, topic.length() - filterText.length());
+        }
+        else if (parseLagReportTopic(topic, lag, dropped, report, subscriberID))
+        {
+            // A publisher that monitors its subscribers answers a slow one on the topic of its report, with what it's
+            // to do rather than a data product (which is left empty).  The topic goes in the stream, and the reply in
+            // the filter text.
+            stream = topic;
+            filterText = readStringMessage(socket);
+            while (hasMoreFrames(socket))
+            {
+                readSharedMessage(socket, 0);
+            }
+            dataProduct.reset();
+            return ret;
+        }
+    }
 
-    zmq_msg_init(&message);
-    zmq_recvmsg(socket, &message, 0);
-    // Create new GravityDataProduct from the incoming message
-    dataProduct = std::shared_ptr<GravityDataProduct>(new GravityDataProduct(zmq_msg_data(&message), zmq_msg_size(&message)));
-    // Clean up message
-    zmq_msg_close(&message);
+    // Wrap the incoming message in a GravityDataProduct without copying or parsing it. The message
+    // is closed once the last data product referencing it is released. Publishers using wire format
+    // version 2 send the data in a frame of its own.
+    std::shared_ptr<zmq_msg_t> message = readSharedMessage(socket, 0);
+    if (hasMoreFrames(socket))
+    {
+        std::shared_ptr<zmq_msg_t> data = readSharedMessage(socket, 0);
+        dataProduct = std::shared_ptr<GravityDataProduct>(
+                new GravityDataProduct(message, zmq_msg_data(message.get()), zmq_msg_size(message.get()),
+                                       data, zmq_msg_data(data.get()), zmq_msg_size(data.get()), arena));
+
+        // Discard anything we don't understand
+        while (hasMoreFrames(socket))
+        {
+            readSharedMessage(socket, 0);
+        }
+    }
+    else
+    {
+        dataProduct = std::shared_ptr<GravityDataProduct>(
+                new GravityDataProduct(message, zmq_msg_data(message.get()), zmq_msg_size(message.get()), arena));
+    }
 
     return ret;
 }
 
-void *GravitySubscriptionManager::setupSubscription(const string &url, const string &filter, zmq_pollitem_t &pollItem)
+// Topic to subscribe to a publisher with.  Publishers that understand wire format version 2 recognize such subscribers
+// by a prefix, those that understand version 3 send data products at a limited rate on request, and those that
+// understand version 4 only send those matching a predicate on request (which subscribers test again themselves, for
+// the publishers that don't).  The stream is set to the topic ahead of the filter text of the data products sent.
+static string subscriptionTopic(const string& filter, uint64_t minInterval, const string& predicate, uint32_t wireFormatVersion,
+                                string& stream)
+{
+    string topic;
+    if (wireFormatVersion >= 4 && !predicate.empty())
+        topic = predicateTopic(minInterval, predicate, filter);
+    else if (wireFormatVersion >= 3 && minInterval > 0)
+        topic = rateLimitedTopic(minInterval, filter);
+    else
+    {
+        stream.clear();
+        return wireFormatVersion >= 2 ? wireFormatV2Prefix() + filter : filter;
+    }
+    stream.assign(topic, 0, topic.length() - filter.length());
+    return topic;
+}
+
+// Fewest microseconds between data products to ask a publisher for: as few as the subscribers want, but no fewer than
+// the publisher had the socket ask for, for being slow (see receiveLagReply)
+static uint64_t askedInterval(uint64_t minInterval, uint64_t conflatedInterval)
+{
+    return minInterval == 0 ? conflatedInterval : std::max(minInterval, conflatedInterval);
+}
+
+unsigned int GravitySubscriptionManager::setupSubscription(const string &url, const string &topic, uint32_t wireFormatVersion,
+                                                           SocketType type)
 {
 	Log::trace("Setting up subscription for %s", url.c_str());
     // Create the socket
@@ -615,39 +478,917 @@ void *GravitySubscriptionManager::setupSubscription(const string &url, const str
 	Log::trace("Configured hwm");
 
     // Configure filter
-    zmq_setsockopt(subSocket, ZMQ_SUBSCRIBE, filter.c_str(), filter.length());
+    zmq_setsockopt(subSocket, ZMQ_SUBSCRIBE, topic.c_str(), topic.length());
 	Log::trace("Configured filter");
 
 	// Connect to publisher
     zmq_connect(subSocket, url.c_str());
 	Log::trace("connected to publisher");
 
-    // set up the poll item for this subscription
+    // Poll it
+    unsigned int slot = addSocket(subSocket, type);
+    socketSlots[slot].url = url;
+    socketSlots[slot].wireFormatVersion = wireFormatVersion;
+	Log::trace("Added to poller");
+
+    return slot;
+}
+
+unsigned int GravitySubscriptionManager::addSocket(void* socket, SocketType type)
+{
+    unsigned int slot = poller.add(socket);
+    if (slot >= socketSlots.size())
+    {
+        socketSlots.resize(slot + 1);
+    }
+    socketSlots[slot] = SocketSlot();
+    socketSlots[slot].socket = socket;
+    socketSlots[slot].type = type;
+    socketSlotMap[socket] = slot;
+    return slot;
+}
+
+void GravitySubscriptionManager::closeSocket(unsigned int slot)
+{
+    void* socket = socketSlots[slot].socket;
+    poller.remove(slot);
+    socketSlotMap.erase(socket);
+    retransmitSlots.erase(slot);
+    socketSlots[slot] = SocketSlot();
+    zmq_close(socket);
+}
+
+void GravitySubscriptionManager::receiveData(unsigned int slot, vector<pair<std::shared_ptr<SubscriptionDetails>, void*> >& deleteList)
+{
+    SocketSlot& publisherSocket = socketSlots[slot];
+    void* socket = publisherSocket.socket;
+    vector<PublisherSubscription>& subscriptions = publisherSocket.subscriptions;
+
+    // Data products for each of the subscriptions sharing the socket
+    vector< vector< std::shared_ptr<GravityDataProduct> > > dataProducts(subscriptions.size());
+    // Reassembled data products aren't delivered to subscribers that only want the chunks
+    set< std::shared_ptr<GravityDataProduct> > reassembled;
+    // Data products received again aren't delivered to subscribers that only want the latest
+    set< std::shared_ptr<GravityDataProduct> > retransmitted;
+    // Any data products from this batch that need to be parsed are allocated from a shared arena
+    std::shared_ptr<google::protobuf::Arena> arena(new google::protobuf::Arena());
+    // Sockets that aren't REALTIME are read a slice at a time, so that more urgent ones are read in between
+    int slice = publisherSocket.priority == GravityPriorities::REALTIME ? -1 :
+                publisherSocket.priority == GravityPriorities::NORMAL ? NORMAL_RECEIVE_SLICE_SIZE : BULK_RECEIVE_SLICE_SIZE;
+    // Data products dropped for outliving the publisher's time to live
+    int expired = 0;
+    // Whether the publisher has had the socket unsubscribe for being slow
+    bool disconnected = false;
+    while (true)
+    {
+        if (slice-- == 0)
+        {
+            poller.touch(slot);
+            break;
+        }
+        string filterText, stream;
+        std::shared_ptr<GravityDataProduct> received;
+        if (readSubscription(socket, filterText, stream, received, arena) < 0)
+            break;
+
+        // The publisher may have answered a report that the socket is slow
+        if (!received)
+        {
+            disconnected = receiveLagReply(slot, stream, filterText, deleteList);
+            if (disconnected)
+                break;
+            continue;
+        }
+
+        // Verify publisher
+        if (publisherSocket.registrationTime != received->getRegistrationTime())
+        {
+            // Published data does not match publisher
+            Log::critical("Received data product (%s) from publisher different from registered with ServiceDirectory [%u != %u].",
+                          received->getDataProductID().c_str(), publisherSocket.registrationTime, received->getRegistrationTime());
+
+            // Notify Service Directory of stale entry
+            notifyServiceDirectoryOfStaleEntry(subscriptions[0].details->dataProductID, subscriptions[0].details->domain, publisherSocket.url,
+                                               publisherSocket.registrationTime);
+
+            // Add this socket to the to be deleted list for each subscription sharing it
+            for (size_t i = 0; i < subscriptions.size(); i++)
+            {
+                deleteList.push_back(std::make_pair(subscriptions[i].details, socket));
+            }
+            break;
+        }
+
+        // Data products of a reliable publication are numbered, so that any missed can be asked for again.  Those
+        // received again go to the subscriptions that missed them, late, whatever was received since.
+        uint64_t sequenceNumber = received->getSequenceNumber();
+        uint64_t currTime = getCurrentTime();
+        if (sequenceNumber > 0 && !stream.empty() && receiveRetransmit(slot, filterText, stream + filterText, sequenceNumber))
+        {
+            if (received->isExpired(currTime))
+            {
+                expired++;
+                continue;
+            }
+            if (!received->decompress(reassemblyLimit))
+                continue;
+            received->setReceivedTimestamp(currTime);
+            for (size_t i = 0; i < subscriptions.size(); i++)
+            {
+                if (subscriptions[i].stream.empty() && filterText.compare(0, subscriptions[i].details->filter.length(), subscriptions[i].details->filter) == 0)
+                    dataProducts[i].push_back(received);
+            }
+            retransmitted.insert(received);
+            continue;
+        }
+        if (sequenceNumber > 0 && stream.empty() && !received->isCachedDataproduct())
+        {
+            checkSequenceNumber(slot, filterText, sequenceNumber, received->isReliable());
+        }
+
+        // A publisher that monitors its subscribers is told how late its data products arrive (see reportLag)
+        if (received->isMonitored() && !received->isCachedDataproduct())
+        {
+            uint64_t timestamp = received->getGravityTimestamp();
+            LagReport& lagReport = publisherSocket.lagReport;
+            lagReport.lag = std::max(lagReport.lag, currTime > timestamp ? currTime - timestamp : 0);
+            if (!publisherSocket.monitored)
+            {
+                publisherSocket.monitored = true;
+                lagReport.due = currTime + LAG_REPORT_INTERVAL * 1000;
+            }
+        }
+
+        // Those that have outlived the publisher's time to live (queued behind others at either end) are dropped
+        // without parsing them
+        if (received->isExpired(currTime))
+        {
+            expired++;
+            continue;
+        }
+
+        // Demultiplex to the subscriptions whose filter the data product's filter text starts with, as the socket did
+        // for each of them (for the stream they subscribed to)
+        DataFingerprint fingerprint;
+        const GravityDataProduct* fingerprinted = NULL;
+        for (size_t i = 0; i < subscriptions.size(); i++)
+        {
+            PublisherSubscription& subscription = subscriptions[i];
+            SubscriptionDetails& subDetails = *subscription.details;
+            if (subscription.stream != stream || filterText.compare(0, subDetails.filter.length(), subDetails.filter) != 0)
+                continue;
+            SocketSubscription key(socket, &subDetails);
+            std::shared_ptr<GravityDataProduct> dataProduct = received;
+
+            // Data published in chunks is passed on as it's reassembled
+            uint64_t chunkOffset, chunkTotalSize;
+            if (dataProduct->getChunkInfo(chunkOffset, chunkTotalSize))
+            {
+                dataProduct = receiveChunk(key, subDetails, dataProduct);
+                if (!dataProduct)
+                    continue;
+                reassembled.insert(dataProduct);
+            }
+
+            // Decompress once here rather than once per subscriber
+            if (!dataProduct->decompress(reassemblyLimit))
+            {
+                Log::warning("Unable to decompress data of %s, dropping it", dataProduct->getDataProductID().c_str());
+                continue;
+            }
+
+            // Fingerprinted once for every subscription (unless reassembled for each)
+            if (fingerprinted != dataProduct.get())
+            {
+                fingerprint = DataFingerprint(*dataProduct);
+                fingerprinted = dataProduct.get();
+            }
+
+            // if it's been relayed, it will come in on a different socket than the original.  Look for the data product
+            // among the last received on every socket to try to filter out duplicates.
+            // This is just to handle the transition when the Relay is first inserted - after that, normal subscribers
+            // will only be subscribed to the relay (if one exists).
+            bool cachedRelay = !subscription.received && dataProduct->isRelayedDataproduct() &&
+                               fingerprintIndex.count(fingerprint.key) > 0;
+
+            // This may be a resend of previous value if a new subscriber was added, so make sure this is new data
+            if (!cachedRelay && !isResend(subscription, fingerprint))
+            {
+                // Grab current time now for stamping received_timestamp on received data products
+                dataProduct->setReceivedTimestamp(getCurrentTime());
+
+                if (dataProduct->isCachedDataproduct() && subDetails.receiveCachedDataProducts == false)
+                {
+                    // if it's cached and we're not receiving cached, do nothing
+                    Log::trace("Ignoring cached data product");
+                }
+                else
+                {
+                    // Add data product to vector to be provided to the subscriber
+                    Log::trace(dataProduct->isCachedDataproduct() ? "Accepting cached data product" : "Accepting new data product");
+                    dataProducts[i].push_back(dataProduct);
+                }
+                // Save most recent value so we can provide it to new subscribers, and to perform check above.
+                setLastReceived(subscription, fingerprint, dataProduct);
+            }
+        }
+    }
+
+    if (publisherSocket.monitored && !disconnected && getCurrentTime() >= publisherSocket.lagReport.due)
+    {
+        reportLag(slot);
+    }
+
+    for (size_t i = 0; i < subscriptions.size(); i++)
+    {
+        // Loop through all subscribers and deliver the messages
+        if (dataProducts[i].empty())
+            continue;
+        SubscriptionDetails& subDetails = *subscriptions[i].details;
+        Log::trace("received %d gdp's, about to send to %d subscribers", dataProducts[i].size(), subDetails.subscribers.size());
+
+        vector< std::shared_ptr<GravityDataProduct> > unchunkedDataProducts;
+        for (set<GravitySubscriber*>::const_iterator iter = subDetails.subscribers.begin(); iter != subDetails.subscribers.end(); iter++)
+        {
+            const vector< std::shared_ptr<GravityDataProduct> >* subscriberDataProducts = &dataProducts[i];
+            if (!reassembled.empty() && !(*iter)->reassembleChunks())
+            {
+                if (unchunkedDataProducts.empty())
+                {
+                    for (size_t j = 0; j < dataProducts[i].size(); j++)
+                    {
+                        if (reassembled.count(dataProducts[i][j]) == 0)
+                            unchunkedDataProducts.push_back(dataProducts[i][j]);
+                    }
+                }
+                subscriberDataProducts = &unchunkedDataProducts;
+            }
+
+            // Subscribers with a predicate only get the data products that match it
+            vector< std::shared_ptr<GravityDataProduct> > matchingDataProducts;
+            map<GravitySubscriber*, string>::const_iterator predicate = subDetails.predicates.find(*iter);
+            if (predicate != subDetails.predicates.end() && !predicate->second.empty())
+            {
+                for (size_t j = 0; j < subscriberDataProducts->size(); j++)
+                {
+                    if (matchesPredicate(subDetails, *iter, *(*subscriberDataProducts)[j]))
+                        matchingDataProducts.push_back((*subscriberDataProducts)[j]);
+                }
+                subscriberDataProducts = &matchingDataProducts;
+            }
+
+            // Subscribers with a time to live only get the data products that haven't outlived it
+            vector< std::shared_ptr<GravityDataProduct> > liveDataProducts;
+            uint64_t timeToLive = subDetails.timeToLives[*iter];
+            if (timeToLive > 0)
+            {
+                uint64_t currTime = getCurrentTime();
+                for (size_t j = 0; j < subscriberDataProducts->size(); j++)
+                {
+                    if (!(*subscriberDataProducts)[j]->isExpired(currTime, timeToLive))
+                        liveDataProducts.push_back((*subscriberDataProducts)[j]);
+                }
+                dispatcher->countExpired(*iter, subDetails.dataProductID, subscriberDataProducts->size() - liveDataProducts.size());
+                subscriberDataProducts = &liveDataProducts;
+            }
+            if (subscriberDataProducts->empty())
+                continue;
+
+            GravityPriority priority = subDetails.priorities[*iter];
+            if (subDetails.conflatingSubscribers.count(*iter) > 0)
+            {
+                vector< std::shared_ptr<GravityDataProduct> > latestDataProducts;
+                if (!retransmitted.empty())
+                {
+                    for (size_t j = 0; j < subscriberDataProducts->size(); j++)
+                    {
+                        if (retransmitted.count((*subscriberDataProducts)[j]) == 0)
+                            latestDataProducts.push_back((*subscriberDataProducts)[j]);
+                    }
+                    subscriberDataProducts = &latestDataProducts;
+                }
+                if (!subscriberDataProducts->empty())
+                    dispatcher->dispatchLatest(*iter, subDetails.dataProductID, subDetails.filter, *subscriberDataProducts, priority, timeToLive);
+            }
+            else
+                dispatcher->dispatch(*iter, subDetails.dataProductID, *subscriberDataProducts, priority, timeToLive);
+        }
+        uint64_t currTime = getCurrentTime()/1000;
+        for (set<std::shared_ptr<TimeoutMonitor> >::const_iterator iter = subDetails.monitors.begin(); iter != subDetails.monitors.end(); iter++)
+        {
+            (*iter)->lastReceived = (int64_t) currTime;
+            (*iter)->endTime = currTime + (*iter)->timeout;
+        }
+
+        if (metricsEnabled)
+        {
+            collectMetrics(dataProducts[i]);
+        }
+    }
+
+    if (metricsEnabled && expired > 0)
+    {
+        metricsData.incrementExpiredCount(subscriptions[0].details->dataProductID, expired);
+    }
+}
+
+void GravitySubscriptionManager::receivePublisherUpdate(unsigned int slot, vector<pair<std::shared_ptr<SubscriptionDetails>, void*> >& deleteList)
+{
+    std::shared_ptr<GravityDataProduct> dataProduct;
+    string dataProductID, stream;
+    readSubscription(socketSlots[slot].socket, dataProductID, stream, dataProduct, std::shared_ptr<google::protobuf::Arena>());
+    if (dataProductID.empty())
+    {
+        Log::warning("Received an apparently empty update list from ServiceDirectory");
+        return;
+    }
+    ComponentDataLookupResponsePB update;
+    dataProduct->populateMessage(update);
+	string domain = update.domain_id();
+    Log::trace("Found update to publishers list for data product %s (domain:%s)", dataProductID.c_str(), domain.c_str());
+
+	// Create the domain/data key for tracking subscriptions
+	DomainDataKey key(domain, dataProductID);
+	Log::trace("subscriptionMap.count(key) = %d", subscriptionMap.count(key));
+
+	list<PublisherInfoPB> allPublishers, trimmedPublishers;
+    for (int i = 0; i < update.publishers_size(); i++)
+    {
+    	allPublishers.push_back(update.publishers(i));
+    }
+	trimPublishers(allPublishers, trimmedPublishers);
+
+    if (subscriptionMap.count(key) != 0)
+    {
+		// Loop over our existing subscriptions (filters) for domain/data of the updated publisher list
+        for (map<string, std::shared_ptr<SubscriptionDetails> >::iterator iter = subscriptionMap[key].begin();
+             iter != subscriptionMap[key].end();
+             iter++)
+        {
+			// Details of the existing subscription
+			string filter = iter->first;
+			std::shared_ptr<SubscriptionDetails> subDetails = iter->second;
+
+			// Loop over publishers list provided by SD
+            for (list<PublisherInfoPB>::const_iterator trimmedIter = trimmedPublishers.begin();
+            		trimmedIter != trimmedPublishers.end(); trimmedIter++)
+            {
+                // If we don't already have this publisher url, add it OR if it is an updated publisher url based on a new registration timestamp
+				map<string, zmq_pollitem_t>::const_iterator pollItemIter = subDetails->pollItemMap.find(trimmedIter->url());
+				if (pollItemIter == subDetails->pollItemMap.end() ||
+					socketSlots[socketSlotMap[pollItemIter->second.socket]].registrationTime != trimmedIter->registration_time())
+                {                                    
+					if (pollItemIter != subDetails->pollItemMap.end())
+					{
+						Log::trace("Updated url: %s", trimmedIter->url().c_str());
+						// This is an updated publisher location. Remove the old one.
+						deleteList.push_back(std::make_pair(subDetails, pollItemIter->second.socket));
+					}
+					else
+					{
+						Log::trace("New url: %s", trimmedIter->url().c_str());
+					}
+
+                    // Subscribe on the publisher's socket, shared with other subscriptions to it
+                    attachSubscription(subDetails, trimmedIter->url(), trimmedIter->wire_format_version(),
+                                       trimmedIter->registration_time());
+                }								
+                else
+                {
+                    Log::trace("Skipping. Already have this publisher url: %s", trimmedIter->url().c_str());
+                }
+            }
+
+            // loop through the existing urls/sockets to see if any have disappeared.
+			map<string, zmq_pollitem_t>::iterator socketIter = subDetails->pollItemMap.begin();
+			while (socketIter != subDetails->pollItemMap.end())
+            {
+                bool found = false;
+                // there doesn't seem to be a good way to check containment in a protobuf set...
+                for (list<PublisherInfoPB>::const_iterator trimmedIter = trimmedPublishers.begin();
+                		trimmedIter != trimmedPublishers.end(); trimmedIter++)
+                {
+                    if (socketIter->first == trimmedIter->url())
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (!found) 
+				{
+                    Log::debug("url %s is gone, adding to delete list", socketIter->first.c_str());
+					deleteList.push_back(std::make_pair(iter->second, socketIter->second.socket));
+                } 								
+				++socketIter;
+            }
+        }
+    }
+}
+
+void* GravitySubscriptionManager::attachSubscription(const std::shared_ptr<SubscriptionDetails>& subDetails, const string& url,
+                                                     uint32_t wireFormatVersion, uint32_t registrationTime)
+{
+    // Subscriptions to the same publisher share its socket, each subscribing to it with their own filter
+    unsigned int slot;
+    map<string, unsigned int>::const_iterator iter = publisherSlotMap.find(url);
+    string topic, stream;
+    if (iter != publisherSlotMap.end() && socketSlots[iter->second].registrationTime == registrationTime)
+    {
+        slot = iter->second;
+        topic = subscriptionTopic(subDetails->filter, askedInterval(subDetails->minInterval, socketSlots[slot].conflatedInterval),
+                                  subDetails->predicate, socketSlots[slot].wireFormatVersion, stream);
+        if (!subscribedTo(slot, topic))
+        {
+            zmq_setsockopt(socketSlots[slot].socket, ZMQ_SUBSCRIBE, topic.c_str(), topic.length());
+        }
+        poller.touch(slot);
+
+        // Data products with filter texts not received before may now arrive (and those no longer wanted stop), so
+        // start over checking their sequence numbers rather than mistake the difference for missed data products
+        socketSlots[slot].sequenceNumbers.clear();
+    }
+    else
+    {
+        // A publisher registered again at the same url gets a new socket. The old one is closed once the
+        // subscriptions sharing it have moved off it.
+        topic = subscriptionTopic(subDetails->filter, subDetails->minInterval, subDetails->predicate, wireFormatVersion, stream);
+        slot = setupSubscription(url, topic, wireFormatVersion, PUBLISHER);
+        publisherSlotMap[url] = slot;
+        socketSlots[slot].registrationTime = registrationTime;
+    }
+    socketSlots[slot].subscriptions.push_back(PublisherSubscription());
+    socketSlots[slot].subscriptions.back().details = subDetails;
+    socketSlots[slot].subscriptions.back().topic = topic;
+    socketSlots[slot].subscriptions.back().stream = stream;
+    updatePriority(slot);
+    void* subSocket = socketSlots[slot].socket;
+
+    zmq_pollitem_t& pollItem = subDetails->pollItemMap[url];
     pollItem.socket = subSocket;
     pollItem.events = ZMQ_POLLIN;
     pollItem.fd = 0;
     pollItem.revents = 0;
-    pollItems.push_back(pollItem);
-	Log::trace("Added to pollItem");
-
+    subDetails->socketToUrlMap[subSocket] = url;
     return subSocket;
 }
 
-void GravitySubscriptionManager::removePollItem(zmq_pollitem_t &pollItem)
+void GravitySubscriptionManager::detachSubscription(const std::shared_ptr<SubscriptionDetails>& subDetails, void* socket)
 {
-    // Remove from poll items
-    vector<zmq_pollitem_t>::iterator pollIter = pollItems.begin();
-    while (pollIter != pollItems.end())
+    map<void*, unsigned int>::iterator iter = socketSlotMap.find(socket);
+    if (iter == socketSlotMap.end())
+        return;
+    unsigned int slot = iter->second;
+    vector<PublisherSubscription>& subscriptions = socketSlots[slot].subscriptions;
+    vector<PublisherSubscription>::iterator position = subscriptions.begin();
+    while (position != subscriptions.end() && position->details != subDetails)
+        position++;
+    if (position == subscriptions.end())
+        return;
+
+    // Clear cached values
+    clearLastReceived(*position);
+    SocketSubscription key(socket, subDetails.get());
+    abandonChunks(key);
+    chunkedDataProducts.erase(key);
+
+    // Unsubscribe, unless another subscription sharing the socket has the same topic
+    string topic = position->topic;
+    subscriptions.erase(position);
+    if (!subscribedTo(slot, topic))
     {
-        if (pollIter->socket == pollItem.socket)
+        zmq_setsockopt(socket, ZMQ_UNSUBSCRIBE, topic.c_str(), topic.length());
+    }
+    if (!subscriptions.empty())
+    {
+        socketSlots[slot].sequenceNumbers.clear();
+        updatePriority(slot);
+        poller.touch(slot);
+        return;
+    }
+
+    // Close the socket once the last subscription sharing it is gone
+    map<string, unsigned int>::iterator urlIter = publisherSlotMap.find(socketSlots[slot].url);
+    if (urlIter != publisherSlotMap.end() && urlIter->second == slot)
+    {
+        publisherSlotMap.erase(urlIter);
+    }
+    closeSocket(slot);
+    Log::debug("closed socket to publisher, %d sockets polled", socketSlotMap.size());
+}
+
+bool GravitySubscriptionManager::subscribedTo(unsigned int slot, const string& topic)
+{
+    // Each topic is subscribed to once for all the subscriptions sharing a socket, so that publishers see one
+    // subscription for each subscribing socket (see GravityNode::getSubscriberCount)
+    const vector<PublisherSubscription>& subscriptions = socketSlots[slot].subscriptions;
+    for (size_t i = 0; i < subscriptions.size(); i++)
+    {
+        if (subscriptions[i].topic == topic)
+            return true;
+    }
+    return false;
+}
+
+GravitySubscriptionManager::DataFingerprint::DataFingerprint(const GravityDataProduct& dataProduct)
+{
+    timestamp = dataProduct.getGravityTimestamp();
+    string componentID = dataProduct.getComponentId();
+    const string& dataProductID = dataProduct.getDataProductID();
+    key = hash64(dataProduct.getDataPointer(), dataProduct.getDataSize64(),
+                 hash64(&timestamp, sizeof(timestamp), hash64(componentID.data(), componentID.size(),
+                                                              hash64(dataProductID.data(), dataProductID.size()))));
+}
+
+bool GravitySubscriptionManager::isResend(const PublisherSubscription& subscription, const DataFingerprint& fingerprint)
+{
+    if (!subscription.received || subscription.lastReceived.timestamp < fingerprint.timestamp)
+    {
+        return false;
+    }
+    return subscription.lastReceived.timestamp > fingerprint.timestamp || subscription.lastReceived.key == fingerprint.key;
+}
+
+void GravitySubscriptionManager::setLastReceived(PublisherSubscription& subscription, const DataFingerprint& fingerprint,
+                                                 const std::shared_ptr<GravityDataProduct>& dataProduct)
+{
+    clearLastReceived(subscription);
+    subscription.received = true;
+    subscription.lastReceived = fingerprint;
+    subscription.lastCachedValue = dataProduct;
+    fingerprintIndex[fingerprint.key]++;
+}
+
+void GravitySubscriptionManager::clearLastReceived(PublisherSubscription& subscription)
+{
+    if (!subscription.received)
+        return;
+    unordered_map<uint64_t, unsigned int>::iterator iter = fingerprintIndex.find(subscription.lastReceived.key);
+    if (iter != fingerprintIndex.end() && --iter->second == 0)
+    {
+        fingerprintIndex.erase(iter);
+    }
+    subscription.received = false;
+    subscription.lastCachedValue.reset();
+}
+
+void GravitySubscriptionManager::checkSequenceNumber(unsigned int slot, const string& filterText, uint64_t sequenceNumber, bool reliable)
+{
+    SocketSlot& publisherSocket = socketSlots[slot];
+    uint64_t& lastSequenceNumber = publisherSocket.sequenceNumbers[filterText];
+    uint64_t first = lastSequenceNumber + 1, last = sequenceNumber - 1;
+    bool gap = lastSequenceNumber > 0 && sequenceNumber > first;
+    if (sequenceNumber > lastSequenceNumber)
+    {
+        // Chunks of a data product all have its sequence number
+        lastSequenceNumber = sequenceNumber;
+    }
+    if (!gap)
+        return;
+
+    // Those missed are reported to a publisher that monitors its subscribers, which only a reliable publication sends
+    // again.  Keep track of the most recent of them, to ask for again.
+    const string& dataProductID = publisherSocket.subscriptions[0].details->dataProductID;
+    Log::debug("Missed data products %llu-%llu of %s (%s)", (unsigned long long) first, (unsigned long long) last,
+               dataProductID.c_str(), filterText.c_str());
+    uint64_t missed = last - first + 1;
+    publisherSocket.lagReport.dropped += missed;
+    if (!reliable)
+    {
+        if (metricsEnabled)
+        {
+            metricsData.incrementGapCount(dataProductID, (int) missed);
+            metricsData.incrementLostCount(dataProductID, (int) missed);
+        }
+        return;
+    }
+    if (missed > MAX_RETRANSMIT_REQUEST)
+    {
+        first = last - MAX_RETRANSMIT_REQUEST + 1;
+    }
+    RetransmitRequest& request = publisherSocket.retransmitRequests[filterText];
+    for (uint64_t i = first; i <= last; i++)
+    {
+        request.missing.insert(i);
+    }
+    uint64_t lost = missed - (last - first + 1);
+    while (request.missing.size() > MAX_RETRANSMIT_REQUEST)
+    {
+        request.missing.erase(request.missing.begin());
+        lost++;
+    }
+    if (lost > 0)
+    {
+        Log::warning("Missed too many data products of %s (%s) to ask for all of them again, %llu lost", dataProductID.c_str(),
+                     filterText.c_str(), (unsigned long long) lost);
+    }
+    if (metricsEnabled)
+    {
+        metricsData.incrementGapCount(dataProductID, (int) missed);
+        metricsData.incrementLostCount(dataProductID, (int) lost);
+    }
+
+    if (request.topic.empty())
+    {
+        requestRetransmit(slot, filterText);
+    }
+}
+
+bool GravitySubscriptionManager::receiveRetransmit(unsigned int slot, const string& filterText, const string& topic, uint64_t sequenceNumber)
+{
+    SocketSlot& publisherSocket = socketSlots[slot];
+    map<string, RetransmitRequest>::iterator iter = publisherSocket.retransmitRequests.find(filterText);
+    if (iter == publisherSocket.retransmitRequests.end() || iter->second.topic != topic)
+    {
+        // Sent again for another subscriber
+        return false;
+    }
+
+    // The window is sent in order, starting with the oldest the publisher still has (which it sends even if it's after
+    // the window), so any before the first received are gone
+    RetransmitRequest& request = iter->second;
+    if (!request.received)
+    {
+        loseRetransmits(slot, filterText, request, sequenceNumber - 1);
+        request.received = true;
+    }
+    bool missing = request.missing.erase(sequenceNumber) > 0;
+    if (missing && metricsEnabled)
+    {
+        metricsData.incrementRetransmitCount(publisherSocket.subscriptions[0].details->dataProductID, 1);
+    }
+
+    // Ask for the next window once this one has been received
+    if (request.missing.empty() || *request.missing.begin() > request.last)
+    {
+        request.attempts = 0;
+        requestRetransmit(slot, filterText);
+    }
+    return missing;
+}
+
+void GravitySubscriptionManager::requestRetransmit(unsigned int slot, const string& filterText)
+{
+    SocketSlot& publisherSocket = socketSlots[slot];
+    RetransmitRequest& request = publisherSocket.retransmitRequests[filterText];
+    if (!request.topic.empty())
+    {
+        zmq_setsockopt(publisherSocket.socket, ZMQ_UNSUBSCRIBE, request.topic.c_str(), request.topic.length());
+    }
+    if (request.missing.empty())
+    {
+        publisherSocket.retransmitRequests.erase(filterText);
+        if (publisherSocket.retransmitRequests.empty())
+        {
+            retransmitSlots.erase(slot);
+        }
+        return;
+    }
+
+    // Ask for a window at a time, so that the publisher doesn't send them all at once only for most to be dropped at
+    // the high water marks
+    request.first = *request.missing.begin();
+    request.last = std::min(request.first + RETRANSMIT_WINDOW - 1, *request.missing.rbegin());
+    request.topic = retransmitTopic(request.first, request.last, filterText);
+    zmq_setsockopt(publisherSocket.socket, ZMQ_SUBSCRIBE, request.topic.c_str(), request.topic.length());
+    request.deadline = getCurrentTime() + RETRANSMIT_TIMEOUT * 1000;
+    request.attempts++;
+    request.received = false;
+    retransmitSlots.insert(slot);
+}
+
+void GravitySubscriptionManager::loseRetransmits(unsigned int slot, const string& filterText, RetransmitRequest& request, uint64_t last)
+{
+    set<uint64_t>::iterator end = request.missing.upper_bound(last);
+    size_t lost = std::distance(request.missing.begin(), end);
+    if (lost == 0)
+        return;
+    request.missing.erase(request.missing.begin(), end);
+
+    const string& dataProductID = socketSlots[slot].subscriptions[0].details->dataProductID;
+    Log::warning("%u data products of %s (%s) missed couldn't be received again", (unsigned int) lost, dataProductID.c_str(),
+                 filterText.c_str());
+    if (metricsEnabled)
+    {
+        metricsData.incrementLostCount(dataProductID, (int) lost);
+    }
+}
+
+int GravitySubscriptionManager::checkRetransmitRequests()
+{
+    if (retransmitSlots.empty())
+        return -1;
+
+    // Ask again for windows that haven't been received in time, or give up on them
+    uint64_t currTime = getCurrentTime();
+    uint64_t nextDeadline = 0;
+    set<unsigned int> slots(retransmitSlots);
+    for (set<unsigned int>::iterator slotIter = slots.begin(); slotIter != slots.end(); slotIter++)
+    {
+        map<string, RetransmitRequest>& requests = socketSlots[*slotIter].retransmitRequests;
+        vector<string> expired;
+        for (map<string, RetransmitRequest>::iterator iter = requests.begin(); iter != requests.end(); iter++)
         {
-            pollIter = pollItems.erase(pollIter);
+            if (iter->second.deadline <= currTime)
+                expired.push_back(iter->first);
         }
-        else
+        for (size_t i = 0; i < expired.size(); i++)
         {
-            pollIter++;
+            RetransmitRequest& request = requests[expired[i]];
+            if (request.attempts >= RETRANSMIT_ATTEMPTS)
+            {
+                loseRetransmits(*slotIter, expired[i], request, request.last);
+                request.attempts = 0;
+            }
+            requestRetransmit(*slotIter, expired[i]);
         }
+        for (map<string, RetransmitRequest>::iterator iter = requests.begin(); iter != requests.end(); iter++)
+        {
+            if (nextDeadline == 0 || iter->second.deadline < nextDeadline)
+                nextDeadline = iter->second.deadline;
+        }
+    }
+    return nextDeadline == 0 ? -1 : (int) ((nextDeadline - currTime + 999) / 1000);
+}
+
+void GravitySubscriptionManager::reportLag(unsigned int slot)
+{
+    // The report replaces the last, so that the publisher can tell when the socket has gone (by the topic of its latest
+    // report being unsubscribed from), and answer on the topic of the latest
+    SocketSlot& publisherSocket = socketSlots[slot];
+    LagReport& lagReport = publisherSocket.lagReport;
+    if (lagReport.subscriberID.empty())
+    {
+        ostringstream subscriberID;
+        subscriberID << componentID << '@' << ipAddress << '/' << getCurrentTime() << '.' << slot;
+        lagReport.subscriberID = subscriberID.str();
     }
+    string topic = lagReportTopic((lagReport.lag + 999) / 1000, lagReport.dropped, ++lagReport.count, lagReport.subscriberID);
+    zmq_setsockopt(publisherSocket.socket, ZMQ_SUBSCRIBE, topic.c_str(), topic.length());
+    if (!lagReport.topic.empty())
+    {
+        zmq_setsockopt(publisherSocket.socket, ZMQ_UNSUBSCRIBE, lagReport.topic.c_str(), lagReport.topic.length());
+    }
+    lagReport.topic = topic;
+    lagReport.lag = 0;
+    lagReport.due = getCurrentTime() + LAG_REPORT_INTERVAL * 1000;
+}
+
+bool GravitySubscriptionManager::receiveLagReply(unsigned int slot, const string& topic, const string& reply,
+                                                 vector<pair<std::shared_ptr<SubscriptionDetails>, void*> >& deleteList)
+{
+    SocketSlot& publisherSocket = socketSlots[slot];
+    if (topic != publisherSocket.lagReport.topic)
+    {
+        return false;
+    }
+    vector<PublisherSubscription>& subscriptions = publisherSocket.subscriptions;
+    const string& dataProductID = subscriptions[0].details->dataProductID;
+
+    // An empty reply has the socket unsubscribe, as if the publisher were stale
+    if (reply.empty())
+    {
+        Log::warning("Publisher of %s at %s dropped this subscriber for being slow", dataProductID.c_str(), publisherSocket.url.c_str());
+        for (size_t i = 0; i < subscriptions.size(); i++)
+        {
+            deleteList.push_back(std::make_pair(subscriptions[i].details, publisherSocket.socket));
+        }
+        return true;
+    }
+
+    // Otherwise it's the fewest microseconds between data products to ask for, which the subscriptions move to (for the
+    // rest of the socket's life)
+    uint64_t interval = strtoull(reply.c_str(), NULL, 10);
+    if (interval <= publisherSocket.conflatedInterval)
+    {
+        return false;
+    }
+    Log::warning("Publisher of %s at %s conflated this subscriber to one data product every %llu us for being slow",
+                 dataProductID.c_str(), publisherSocket.url.c_str(), (unsigned long long) interval);
+    publisherSocket.conflatedInterval = interval;
+    for (size_t i = 0; i < subscriptions.size(); i++)
+    {
+        updateTopic(slot, subscriptions[i]);
+    }
+    return false;
+}
+
+std::shared_ptr<GravityDataProduct> GravitySubscriptionManager::receiveChunk(const SocketSubscription& key, const SubscriptionDetails& subDetails,
+                                                                            const std::shared_ptr<GravityDataProduct>& chunk)
+{
+    uint64_t offset, totalSize;
+    chunk->getChunkInfo(offset, totalSize);
+    uint64_t size = chunk->getDataSize64();
+    ChunkedDataProduct& chunked = chunkedDataProducts[key];
+
+    if (offset == 0)
+    {
+        if (chunked.active)
+        {
+            Log::warning("Dropping incomplete %s received in chunks", chunked.first->getDataProductID().c_str());
+            abandonChunks(key);
+        }
+
+        // Late subscribers cause the last value to be resent, so skip it if it was already received
+        if (chunk->isCachedDataproduct() &&
+                (!subDetails.receiveCachedDataProducts || chunk->getGravityTimestamp() <= chunked.lastTimestamp))
+        {
+            return std::shared_ptr<GravityDataProduct>();
+        }
+
+        bool reassemble = false;
+        for (set<GravitySubscriber*>::const_iterator iter = subDetails.subscribers.begin(); iter != subDetails.subscribers.end(); iter++)
+        {
+            reassemble = reassemble || (*iter)->reassembleChunks();
+        }
+        if (reassemble)
+        {
+            chunked.data = reserveReassembly(totalSize, reassemblyLimit, reassemblyBytes);
+            if (!chunked.data)
+            {
+                Log::warning("Can't reassemble %s (%llu bytes) within ChunkReassemblyLimitMB, dropping it",
+                             chunk->getDataProductID().c_str(), (unsigned long long)totalSize);
+            }
+        }
+
+        chunked.first = chunk;
+        chunked.totalSize = totalSize;
+        chunked.received = 0;
+        chunked.lastTimestamp = chunk->getGravityTimestamp();
+        chunked.active = true;
+    }
+
+    if (!chunked.active)
+    {
+        // The rest of a data product that is being skipped
+        return std::shared_ptr<GravityDataProduct>();
+    }
+    if (offset != chunked.received || totalSize != chunked.totalSize || size > totalSize - offset)
+    {
+        Log::warning("Lost a chunk of %s, dropping it", chunked.first->getDataProductID().c_str());
+        abandonChunks(key);
+        return std::shared_ptr<GravityDataProduct>();
+    }
+
+    for (set<GravitySubscriber*>::const_iterator iter = subDetails.subscribers.begin(); iter != subDetails.subscribers.end(); iter++)
+    {
+        (*iter)->dataChunkReceived(chunk, offset, totalSize);
+    }
+    if (chunked.data)
+    {
+        memcpy(chunked.data.get() + offset, chunk->getDataPointer(), size);
+    }
+    chunked.received += size;
+    if (chunked.received < totalSize)
+    {
+        return std::shared_ptr<GravityDataProduct>();
+    }
+
+    // Complete. The reassembled data product has the envelope of the first chunk, marked as no longer a chunk.
+    std::shared_ptr<GravityDataProduct> dataProduct;
+    if (chunked.data)
+    {
+        std::shared_ptr<string> envelope(new string());
+        chunked.first->serializeEnvelope(*envelope);
+        uint8_t field[16];
+        uint8_t* end = WireFormatLite::WriteUInt64ToArray(GravityDataProductPB::kTotalSizeFieldNumber, 0, field);
+        envelope->append((const char*)field, end - field);
+        dataProduct.reset(new GravityDataProduct(envelope, envelope->data(), envelope->size(),
+                                                 chunked.data, chunked.data.get(), totalSize,
+                                                 std::shared_ptr<google::protobuf::Arena>()));
+    }
+    abandonChunks(key);
+    return dataProduct;
+}
+
+std::shared_ptr<char> GravitySubscriptionManager::reserveReassembly(uint64_t totalSize, uint64_t limit, uint64_t& reassemblyBytes)
+{
+    std::shared_ptr<char> data;
+    if (reassemblyBytes > limit || totalSize > limit - reassemblyBytes || static_cast<size_t>(totalSize) != totalSize)
+    {
+        return data;
+    }
+    data.reset(new (std::nothrow) char[totalSize], std::default_delete<char[]>());
+    if (data)
+    {
+        reassemblyBytes += totalSize;
+    }
+    return data;
+}
+
+void GravitySubscriptionManager::abandonChunks(const SocketSubscription& key)
+{
+    map<SocketSubscription, ChunkedDataProduct>::iterator iter = chunkedDataProducts.find(key);
+    if (iter == chunkedDataProducts.end())
+        return;
+    ChunkedDataProduct& chunked = iter->second;
+    if (chunked.data)
+    {
+        reassemblyBytes -= chunked.totalSize;
+        chunked.data.reset();
+    }
+    chunked.first.reset();
+    chunked.active = false;
 }
 
 void GravitySubscriptionManager::setHWM()
@@ -656,6 +1397,48 @@ void GravitySubscriptionManager::setHWM()
 	subscribeHWM = readIntMessage(gravityNodeSocket);
 }
 
+void GravitySubscriptionManager::subscribePublisherUpdates(SubscriptionDetails& subDetails, const string& url)
+{
+	subDetails.publisherUpdateUrl = url;
+	map<string, unsigned int>::iterator iter = publisherUpdateSlotMap.find(url);
+	if (iter == publisherUpdateSlotMap.end())
+	{
+		unsigned int slot = setupSubscription(url, subDetails.dataProductID, 1, PUBLISHER_UPDATES);
+		socketSlots[slot].users = 1;
+		publisherUpdateSlotMap[url] = slot;
+		return;
+	}
+
+	// Share the socket already subscribed to this url, adding the data product to its subscriptions
+	SocketSlot& socketSlot = socketSlots[iter->second];
+	zmq_setsockopt(socketSlot.socket, ZMQ_SUBSCRIBE, subDetails.dataProductID.c_str(), subDetails.dataProductID.length());
+	socketSlot.users++;
+	poller.touch(iter->second);
+}
+
+void GravitySubscriptionManager::unsubscribePublisherUpdates(SubscriptionDetails& subDetails)
+{
+	map<string, unsigned int>::iterator iter = publisherUpdateSlotMap.find(subDetails.publisherUpdateUrl);
+	if (subDetails.publisherUpdateUrl.empty() || iter == publisherUpdateSlotMap.end())
+	{
+		// Only monitored, never subscribed to updates
+		return;
+	}
+
+	SocketSlot& socketSlot = socketSlots[iter->second];
+	zmq_setsockopt(socketSlot.socket, ZMQ_UNSUBSCRIBE, subDetails.dataProductID.c_str(), subDetails.dataProductID.length());
+	if (--socketSlot.users == 0)
+	{
+		closeSocket(iter->second);
+		publisherUpdateSlotMap.erase(iter);
+	}
+	else
+	{
+		poller.touch(iter->second);
+	}
+	subDetails.publisherUpdateUrl.clear();
+}
+
 void GravitySubscriptionManager::addSubscription()
 {
 	Log::trace("Adding subscription");
@@ -666,6 +1449,12 @@ void GravitySubscriptionManager::addSubscription()
 	bool receiveLastCachedValue = readIntMessage(gravityNodeSocket);
 	Log::trace("receiveLastCachedValue = '%d'", receiveLastCachedValue);
 
+	bool conflate = readIntMessage(gravityNodeSocket);
+	uint64_t minInterval = readUint64Message(gravityNodeSocket);
+	string predicate = readStringMessage(gravityNodeSocket);
+	GravityPriority priority = static_cast<GravityPriority>(readIntMessage(gravityNodeSocket));
+	uint64_t timeToLive = readUint64Message(gravityNodeSocket);
+
 	// Read all the publisher infos
 	uint32_t numPubInfoPBs = readUint32Message(gravityNodeSocket);
 	list<PublisherInfoPB> pubInfoPBs;
@@ -730,14 +1519,22 @@ void GravitySubscriptionManager::addSubscription()
 		subDetails->domain = domain;
         subDetails->filter = filter;
 		subDetails->receiveCachedDataProducts = receiveLastCachedValue;
+		subDetails->priority = GravityPriorities::NORMAL;
 
-		zmq_pollitem_t pollItem;
-		setupSubscription(publisherUpdateUrl, dataProductID, pollItem);
-		subDetails->publisherUpdatePollItem = pollItem;
+		subscribePublisherUpdates(*subDetails, publisherUpdateUrl);
 
 	    subscriptionMap[key][filter] = subDetails;
 	}
 
+	// Subscribe to publishers at the rate this subscriber wants, if it wants more than the others, and for the data
+	// products matching its predicate as well
+	subDetails->minIntervals[subscriber] = minInterval;
+	subDetails->predicates[subscriber] = predicate;
+	updateTopic(*subDetails);
+	subDetails->priorities[subscriber] = priority;
+	updatePriority(*subDetails);
+	subDetails->timeToLives[subscriber] = timeToLive;
+
 	list<PublisherInfoPB> trimmedPublishers;
 	trimPublishers(pubInfoPBs, trimmedPublishers);
 	for (list<PublisherInfoPB>::iterator iter = trimmedPublishers.begin(); iter != trimmedPublishers.end(); iter++)
@@ -746,20 +1543,7 @@ void GravitySubscriptionManager::addSubscription()
 		if (iter->has_url() && subDetails->pollItemMap.count(iter->url()) == 0)
 		{
 			Log::trace("Subscribe to new url");
-			zmq_pollitem_t pollItem;
-			void *subSocket = setupSubscription(iter->url(), filter, pollItem);
-
-			// Create subscription details
-			subDetails->pollItemMap[iter->url()] = pollItem;
-
-			// Add lookup from socket to URL
-			subDetails->socketToUrlMap[subSocket] = iter->url();
-
-			// and by socket for quick lookup as data arrives
-			subscriptionSocketMap[subSocket] = subDetails;
-
-			// Map to manage publisher verification
-			socketVerificationMap[subSocket] = iter->registration_time();
+			attachSubscription(subDetails, iter->url(), iter->wire_format_version(), iter->registration_time());
 		}
 	}
 	
@@ -773,6 +1557,11 @@ void GravitySubscriptionManager::addSubscription()
 		}
 	}
 
+    if (conflate)
+        subDetails->conflatingSubscribers.insert(subscriber);
+    else
+        subDetails->conflatingSubscribers.erase(subscriber);
+
     // Add new subscriber if it isn't already in the list
     if (subDetails->subscribers.find(subscriber) == subDetails->subscribers.end())
     {
@@ -787,16 +1576,24 @@ void GravitySubscriptionManager::addSubscription()
 			vector<std::shared_ptr<GravityDataProduct> > dataProducts;
 			for (map<string, zmq_pollitem_t>::iterator iter = subDetails->pollItemMap.begin(); iter != subDetails->pollItemMap.end(); iter++)
 			{
-				if (lastCachedValueMap[iter->second.socket])
+				const vector<PublisherSubscription>& subscriptions = socketSlots[socketSlotMap[iter->second.socket]].subscriptions;
+				for (size_t i = 0; i < subscriptions.size(); i++)
 				{
-					dataProducts.push_back(lastCachedValueMap[iter->second.socket]);
+					if (subscriptions[i].details == subDetails && subscriptions[i].lastCachedValue &&
+					    matchesPredicate(*subDetails, subscriber, *subscriptions[i].lastCachedValue))
+					{
+						dataProducts.push_back(subscriptions[i].lastCachedValue);
+					}
 				}
 			}
 			if (dataProducts.size() > 0)
 			{
 				Log::debug("sending data (%s) to late subscriber", dataProductID.c_str());
 				sort(dataProducts.begin(), dataProducts.end(), sortCacheValues);
-				subscriber->subscriptionFilled(dataProducts);
+				if (conflate)
+					dispatcher->dispatchLatest(subscriber, dataProductID, filter, dataProducts, priority);
+				else
+					dispatcher->dispatch(subscriber, dataProductID, dataProducts, priority);
 			}			
 		}else
 		{
@@ -850,6 +1647,25 @@ void GravitySubscriptionManager::removeSubscription()
 			{
 				Log::trace("Found and removed subscriber");
 				subDetails->subscribers.erase(iter);
+				subDetails->conflatingSubscribers.erase(subscriber);
+				subDetails->minIntervals.erase(subscriber);
+				subDetails->predicates.erase(subscriber);
+				updateTopic(*subDetails);
+				subDetails->priorities.erase(subscriber);
+				updatePriority(*subDetails);
+				subDetails->timeToLives.erase(subscriber);
+
+				// Drop its queued deliveries, unless it's still subscribed with another filter
+				bool subscribed = false;
+				for (map<string, std::shared_ptr<SubscriptionDetails> >::const_iterator filterIter = subscriptionMap[key].begin();
+				     filterIter != subscriptionMap[key].end(); ++filterIter)
+				{
+					subscribed = subscribed || filterIter->second->subscribers.count(subscriber) > 0;
+				}
+				if (!subscribed)
+				{
+					dispatcher->cancel(subscriber, dataProductID);
+				}
 				break;
 			}
 			else
@@ -877,21 +1693,16 @@ void GravitySubscriptionManager::removeSubscription()
 				// If we no longer have subscriptions for this domain/dataProductID combo, then stop
 				// subscribing for updates from the SD on this as well				
 				Log::trace("Removing subscription to RegisteredPublishers");
-				removePollItem(subDetails->publisherUpdatePollItem);
-				zmq_setsockopt(subDetails->publisherUpdatePollItem.socket, ZMQ_UNSUBSCRIBE, dataProductID.c_str(), dataProductID.length());
-				zmq_close(subDetails->publisherUpdatePollItem.socket);
+				unsubscribePublisherUpdates(*subDetails);
 			}
 
 			for (map<string, zmq_pollitem_t>::iterator iter = subDetails->pollItemMap.begin(); iter != subDetails->pollItemMap.end(); iter++)
 			{
-				unsubscribeFromPollItem(iter->second, filter);
-
-				// Remove from poll items
-				removePollItem(iter->second);
-
-				// Clear cached values
-				lastCachedValueMap.erase(iter->second.socket);
-			}				
+				// Unsubscribe, closing the socket if no other subscription shares it
+				detachSubscription(subDetails, iter->second.socket);
+			}
+			subDetails->pollItemMap.clear();
+			subDetails->socketToUrlMap.clear();
 		}
 	}
 }
@@ -923,6 +1734,7 @@ void GravitySubscriptionManager::setTimeoutMonitor()
 	else
 	{
 		subDetails.reset(new SubscriptionDetails());
+		subDetails->priority = GravityPriorities::NORMAL;
 		subDetails->dataProductID = dataProductID;
 		subDetails->domain = domain;
 		subDetails->filter = filter;
@@ -955,6 +1767,7 @@ void GravitySubscriptionManager::setTimeoutMonitor()
 	tm->lastReceived=-1l;		
 		
 	subDetails->monitors.insert(tm);
+	monitoredSubscriptions.insert(subDetails);
 
 }
 
@@ -991,6 +1804,10 @@ void GravitySubscriptionManager::clearTimeoutMonitor()
 					pollTimeout=-1;
 				}
 				subDetails->monitors.erase(iter);
+				if (subDetails->monitors.empty())
+				{
+					monitoredSubscriptions.erase(subDetails);
+				}
 				break;
 			}
 			
@@ -1008,78 +1825,183 @@ void GravitySubscriptionManager::clearTimeoutMonitor()
 			}
 			// If we no longer have subscriptions for this domain/dataProductID combo, then stop
 			// subscribing for updates from the SD on this as well
-			removePollItem(subDetails->publisherUpdatePollItem);
-			zmq_setsockopt(subDetails->publisherUpdatePollItem.socket, ZMQ_UNSUBSCRIBE, dataProductID.c_str(), dataProductID.length());
-			zmq_close(subDetails->publisherUpdatePollItem.socket);
+			unsubscribePublisherUpdates(*subDetails);
 		}
 	}
 }
 
-void GravitySubscriptionManager::unsubscribeFromPollItem(zmq_pollitem_t pollItem, string filterText)
+void GravitySubscriptionManager::updateTopic(SubscriptionDetails& subDetails)
+{
+	// The publishers are asked for the most data products any of the subscribers want: at the highest rate, matching
+	// any of their predicates
+	uint64_t minInterval = 0;
+	for (map<GravitySubscriber*, uint64_t>::const_iterator iter = subDetails.minIntervals.begin(); iter != subDetails.minIntervals.end(); iter++)
+	{
+		if (iter->second == 0)
+		{
+			minInterval = 0;
+			break;
+		}
+		minInterval = minInterval == 0 ? iter->second : std::min(minInterval, iter->second);
+	}
+	set<string> predicates;
+	for (map<GravitySubscriber*, string>::const_iterator iter = subDetails.predicates.begin(); iter != subDetails.predicates.end(); iter++)
+	{
+		if (iter->second.empty())
+		{
+			predicates.clear();
+			break;
+		}
+		predicates.insert(iter->second);
+	}
+	string predicate;
+	for (set<string>::const_iterator iter = predicates.begin(); iter != predicates.end(); iter++)
+	{
+		predicate += (predicate.empty() ? "" : " || ") + *iter;
+	}
+	if (minInterval == subDetails.minInterval && predicate == subDetails.predicate)
+		return;
+	subDetails.minInterval = minInterval;
+	subDetails.predicate = predicate;
+
+	// Move the subscriptions to publishers over to the new topic (those that can send at a limited rate or test the
+	// predicate)
+	for (map<string, zmq_pollitem_t>::iterator iter = subDetails.pollItemMap.begin(); iter != subDetails.pollItemMap.end(); iter++)
+	{
+		unsigned int slot = socketSlotMap[iter->second.socket];
+		vector<PublisherSubscription>& subscriptions = socketSlots[slot].subscriptions;
+		for (size_t i = 0; i < subscriptions.size(); i++)
+		{
+			if (subscriptions[i].details.get() == &subDetails)
+				updateTopic(slot, subscriptions[i]);
+		}
+	}
+}
+
+void GravitySubscriptionManager::updateTopic(unsigned int slot, PublisherSubscription& subscription)
+{
+	const SubscriptionDetails& subDetails = *subscription.details;
+	SocketSlot& publisherSocket = socketSlots[slot];
+	string stream;
+	string topic = subscriptionTopic(subDetails.filter, askedInterval(subDetails.minInterval, publisherSocket.conflatedInterval),
+	                                 subDetails.predicate, publisherSocket.wireFormatVersion, stream);
+	if (topic == subscription.topic)
+		return;
+	if (!subscribedTo(slot, topic))
+	{
+		zmq_setsockopt(publisherSocket.socket, ZMQ_SUBSCRIBE, topic.c_str(), topic.length());
+	}
+	string previous = subscription.topic;
+	subscription.topic = topic;
+	subscription.stream = stream;
+	if (!subscribedTo(slot, previous))
+	{
+		zmq_setsockopt(publisherSocket.socket, ZMQ_UNSUBSCRIBE, previous.c_str(), previous.length());
+	}
+	poller.touch(slot);
+}
+
+void GravitySubscriptionManager::updatePriority(SubscriptionDetails& subDetails)
 {
-	// Clean-up/Subscribe from this subscription
-	subscriptionSocketMap.erase(pollItem.socket);
-	socketVerificationMap.erase(pollItem.socket);
+	GravityPriority priority = GravityPriorities::NORMAL;
+	for (map<GravitySubscriber*, GravityPriority>::const_iterator iter = subDetails.priorities.begin(); iter != subDetails.priorities.end(); iter++)
+	{
+		priority = iter == subDetails.priorities.begin() ? iter->second : std::min(priority, iter->second);
+	}
+	if (priority == subDetails.priority)
+		return;
+	subDetails.priority = priority;
 
-	// Unsubscribe
-	zmq_setsockopt(pollItem.socket, ZMQ_UNSUBSCRIBE, filterText.c_str(), filterText.length());
+	for (map<string, zmq_pollitem_t>::iterator iter = subDetails.pollItemMap.begin(); iter != subDetails.pollItemMap.end(); iter++)
+	{
+		updatePriority(socketSlotMap[iter->second.socket]);
+	}
+}
 
-	// Close the socket
-	zmq_close(pollItem.socket);
+void GravitySubscriptionManager::updatePriority(unsigned int slot)
+{
+	// A socket shared by subscriptions of different priorities is read with the most urgent
+	const vector<PublisherSubscription>& subscriptions = socketSlots[slot].subscriptions;
+	GravityPriority priority = GravityPriorities::NORMAL;
+	for (size_t i = 0; i < subscriptions.size(); i++)
+	{
+		priority = i == 0 ? subscriptions[i].details->priority : std::min(priority, subscriptions[i].details->priority);
+	}
+	socketSlots[slot].priority = priority;
 }
-	
+
+bool GravitySubscriptionManager::matchesPredicate(SubscriptionDetails& subDetails, GravitySubscriber* subscriber, const GravityDataProduct& dataProduct)
+{
+	map<GravitySubscriber*, string>::const_iterator iter = subDetails.predicates.find(subscriber);
+	if (iter == subDetails.predicates.end() || iter->second.empty())
+		return true;
+
+	// Chunks passed on as they are can't be tested
+	uint64_t chunkOffset, chunkTotalSize;
+	if (dataProduct.getChunkInfo(chunkOffset, chunkTotalSize))
+		return true;
+
+	// Compiled once for each type of data received
+	string typeName = dataProduct.getTypeName();
+	string key = iter->second + '\0' + typeName;
+	map<string, std::shared_ptr<GravityPredicate> >::iterator compiled = subDetails.compiledPredicates.find(key);
+	if (compiled == subDetails.compiledPredicates.end())
+	{
+		string error;
+		compiled = subDetails.compiledPredicates.insert(make_pair(key, GravityPredicate::compile(iter->second, typeName, error))).first;
+		if (!compiled->second)
+			Log::warning("Predicate '%s' on %s can't be tested against %s: %s, dropping them", iter->second.c_str(),
+			             subDetails.dataProductID.c_str(), typeName.empty() ? "untyped data" : typeName.c_str(), error.c_str());
+	}
+	return compiled->second && compiled->second->matches(dataProduct.getDataPointer(), dataProduct.getDataSize64());
+}
+
 void GravitySubscriptionManager::calculateTimeout()
 {
 	int minTime = -1;
 	currTimeoutMonitor.reset();
 	currMonitorDetails.reset();
-	map<DomainDataKey, map<std::string, std::shared_ptr<SubscriptionDetails> > >::iterator dpIter = subscriptionMap.begin();
-	//go through all domain-dataproduct keys
-	while (dpIter != subscriptionMap.end())
+	//go through the subscriptions with monitors
+	for (set<std::shared_ptr<SubscriptionDetails> >::iterator monitoredIter = monitoredSubscriptions.begin();
+	     monitoredIter != monitoredSubscriptions.end(); monitoredIter++)
 	{
-		map<string, std::shared_ptr<SubscriptionDetails> >::iterator filterIter = dpIter->second.begin();
-		while(filterIter != dpIter->second.end())
+	    std::shared_ptr<SubscriptionDetails> subDetails = *monitoredIter;
+		for(set<std::shared_ptr<TimeoutMonitor> >::iterator monitorIter = subDetails->monitors.begin(); monitorIter != subDetails->monitors.end(); monitorIter++)
 		{
-		    std::shared_ptr<SubscriptionDetails> subDetails = filterIter->second;
-			for(set<std::shared_ptr<TimeoutMonitor> >::iterator monitorIter = subDetails->monitors.begin(); monitorIter != subDetails->monitors.end(); monitorIter++)
+			// check if this is an active subscription with a valid timeout
+			if(subDetails->subscribers.size() > 0 && (*monitorIter)->timeout>=0)
 			{
-				// check if this is an active subscription with a valid timeout
-				if(subDetails->subscribers.size() > 0 && (*monitorIter)->timeout>=0)
-				{
 
-					uint64_t currTime = getCurrentTime()/1000;
-					// calculate how much time is left until this monitor times out
-					int64_t timeRemaining =(*monitorIter)->endTime-currTime;
-
-					//a subscription timed out during processing
-					if(timeRemaining <= 0)
-					{						
-						int timeSinceLast = (*monitorIter)->lastReceived>0?(int)(currTime-(*monitorIter)->lastReceived):-1l;
-						//make call to monitor
-						(*monitorIter)->monitor->subscriptionTimeout(subDetails->dataProductID,timeSinceLast,
-								subDetails->filter,subDetails->domain);
-						//reset next timeout
-						(*monitorIter)->endTime = (*monitorIter)->endTime + (*monitorIter)->timeout;
-						
-						Log::trace("Subscription Timeout (%s)",subDetails->dataProductID.c_str());	
-
-						if((*monitorIter)->timeout < minTime || minTime == -1)
-						{
-							minTime = (int) (*monitorIter)->timeout;
-						}
-					}
-					else if(timeRemaining < (int64_t) minTime || minTime == -1)
+				uint64_t currTime = getCurrentTime()/1000;
+				// calculate how much time is left until this monitor times out
+				int64_t timeRemaining =(*monitorIter)->endTime-currTime;
+
+				//a subscription timed out during processing
+				if(timeRemaining <= 0)
+				{						
+					int timeSinceLast = (*monitorIter)->lastReceived>0?(int)(currTime-(*monitorIter)->lastReceived):-1l;
+					//make call to monitor
+					(*monitorIter)->monitor->subscriptionTimeout(subDetails->dataProductID,timeSinceLast,
+							subDetails->filter,subDetails->domain);
+					//reset next timeout
+					(*monitorIter)->endTime = (*monitorIter)->endTime + (*monitorIter)->timeout;
+					
+					Log::trace("Subscription Timeout (%s)",subDetails->dataProductID.c_str());	
+
+					if((*monitorIter)->timeout < minTime || minTime == -1)
 					{
-						//set current timeout details
-						minTime = (int) timeRemaining;
-						currTimeoutMonitor = *monitorIter;
-						currMonitorDetails = subDetails;					
+						minTime = (int) (*monitorIter)->timeout;
 					}
 				}
+				else if(timeRemaining < (int64_t) minTime || minTime == -1)
+				{
+					//set current timeout details
+					minTime = (int) timeRemaining;
+					currTimeoutMonitor = *monitorIter;
+					currMonitorDetails = subDetails;					
+				}
 			}
-			filterIter++;
-		}		
-		dpIter++;
+		}
 	}	
 	pollTimeout=minTime;
 }
@@ -29,6 +29,7 @@
 #include <zmq.h>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <set>
 #ifndef __GNUC__
 #include <memory>
@@ -39,6 +40,10 @@
 #include <list>
 #include "GravitySubscriber.h"
 #include "GravitySubscriptionMonitor.h"
+#include "GravitySubscriptionDispatcher.h"
+#include "GravityPoller.h"
+#include "GravityPredicate.h"
+#include "GravityPriority.h"
 #include "GravityMetrics.h"
 #include "DomainDataKey.h"
 #include "protobuf/ComponentDataLookupResponsePB.pb.h"
@@ -67,22 +72,128 @@ private:
         std::string dataProductID;
         std::string filter;
 		bool receiveCachedDataProducts;
-        std::map<std::string, zmq_pollitem_t> pollItemMap;
+        std::map<std::string, zmq_pollitem_t> pollItemMap; ///< socket subscribed to each publisher url (shared with other subscriptions)
 		std::map<void*, std::string> socketToUrlMap;
         std::set<GravitySubscriber*> subscribers;
+        std::set<GravitySubscriber*> conflatingSubscribers; ///< subscribers only delivered the latest data product
+		std::map<GravitySubscriber*, uint64_t> minIntervals; ///< fewest microseconds between data products each subscriber asked for
+		uint64_t minInterval; ///< fewest microseconds between data products asked of publishers (0 for every one)
+		std::map<GravitySubscriber*, std::string> predicates; ///< predicate each subscriber asked for (empty for every data product)
+		std::string predicate; ///< predicate asked of publishers, which holds if any of the subscribers' does
+		std::map<std::string, std::shared_ptr<GravityPredicate> > compiledPredicates; ///< by predicate, '\0' and type name (empty if it can't be compiled)
+		std::map<GravitySubscriber*, GravityPriority> priorities; ///< priority each subscriber asked for
+		GravityPriority priority; ///< most urgent of the subscribers' priorities
+		std::map<GravitySubscriber*, uint64_t> timeToLives; ///< microseconds after their timestamp each subscriber wants data products (0 for no limit)
 		std::set<std::shared_ptr<TimeoutMonitor> > monitors;
-		zmq_pollitem_t publisherUpdatePollItem;
+		std::string publisherUpdateUrl; ///< url subscribed to for publisher updates (with a socket shared with other subscriptions)
 	} SubscriptionDetails;
 
+	typedef struct ChunkedDataProduct
+	{
+		std::shared_ptr<GravityDataProduct> first; ///< first chunk, whose envelope the reassembled data product gets
+		std::shared_ptr<char> data; ///< data reassembled so far (empty if no subscriber wants it reassembled)
+		uint64_t totalSize;
+		uint64_t received; ///< bytes received so far, i.e. the offset of the next chunk
+		uint64_t lastTimestamp; ///< timestamp of the last data product received in chunks, to skip resends of it
+		bool active;
+		ChunkedDataProduct() : totalSize(0), received(0), lastTimestamp(0), active(false) {}
+	} ChunkedDataProduct;
+
+	/// Tells data products apart without keeping them: the timestamp, and a hash of the ID, component ID, timestamp and data
+	typedef struct DataFingerprint
+	{
+		uint64_t timestamp;
+		uint64_t key; ///< hash of the ID, component ID, timestamp and data
+		DataFingerprint() : timestamp(0), key(0) {}
+		DataFingerprint(const GravityDataProduct& dataProduct);
+	} DataFingerprint;
+
+	/// A subscription's use of a publisher's socket
+	typedef struct PublisherSubscription
+	{
+		std::shared_ptr<SubscriptionDetails> details;
+		std::string topic; ///< subscribed to on the socket
+		std::string stream; ///< topic ahead of the filter text of the data products the topic asks for (empty for every one)
+		bool received; ///< whether a data product has been received
+		DataFingerprint lastReceived; ///< of the most recent data product received, to drop resends of it
+		std::shared_ptr<GravityDataProduct> lastCachedValue; ///< the most recent data product received, for subscribers that join later
+		PublisherSubscription() : received(false) {}
+	} PublisherSubscription;
+
+	typedef enum SocketType
+	{
+		GRAVITY_NODE, ///< requests from the GravityNode
+		METRICS, ///< requests from the GravityMetricsManager
+		PUBLISHER, ///< data published
+		PUBLISHER_UPDATES ///< publisher updates from the ServiceDirectory
+	} SocketType;
+
+	/**
+	 * Data products of a reliable publication missed with one filter text, asked for again a window at a time by
+	 * subscribing to the topic the publisher sends them with
+	 */
+	typedef struct RetransmitRequest
+	{
+		std::set<uint64_t> missing; ///< sequence numbers not received yet
+		std::string topic; ///< subscribed to for the window asked for
+		uint64_t first, last; ///< sequence numbers of the window asked for
+		uint64_t deadline; ///< microseconds by which the window should have been received, before asking again
+		int attempts; ///< times the window has been asked for
+		bool received; ///< whether any of the window has been received since it was last asked for
+		RetransmitRequest() : first(0), last(0), deadline(0), attempts(0), received(false) {}
+	} RetransmitRequest;
+
+	/// How far behind the subscriptions sharing a socket are, reported to a publisher that monitors its subscribers
+	typedef struct LagReport
+	{
+		std::string subscriberID; ///< identifies the socket to the publisher (empty until the first report)
+		std::string topic; ///< subscribed to for the latest report, which the publisher answers on if the socket stays slow
+		uint64_t lag; ///< most microseconds a data product was received after its timestamp since the latest report
+		uint64_t dropped; ///< data products found missing since subscribing
+		uint64_t count; ///< reports made
+		uint64_t due; ///< microseconds by which to report again
+		LagReport() : lag(0), dropped(0), count(0), due(0) {}
+	} LagReport;
+
+	typedef struct SocketSlot
+	{
+		void* socket; ///< NULL if the slot is free
+		SocketType type;
+		std::string url;
+		uint32_t wireFormatVersion;
+		uint32_t registrationTime; ///< of the publisher, to verify the data received
+		unsigned int users; ///< subscriptions to publisher updates sharing the socket
+		std::vector<PublisherSubscription> subscriptions; ///< subscriptions sharing a publisher's socket, each with its own filter
+		GravityPriority priority; ///< most urgent of the subscriptions' priorities, which the socket is read with
+		std::map<std::string, uint64_t> sequenceNumbers; ///< of the last data product received with each filter text from a reliable publication
+		std::map<std::string, RetransmitRequest> retransmitRequests; ///< by filter text
+		bool monitored; ///< the publisher monitors its subscribers, so is sent lagReport
+		LagReport lagReport;
+		uint64_t conflatedInterval; ///< fewest microseconds between data products the publisher had the socket ask for (0 for every one)
+		SocketSlot() : socket(NULL), type(PUBLISHER), wireFormatVersion(1), registrationTime(0), users(0), priority(GravityPriorities::NORMAL),
+		               monitored(false), conflatedInterval(0) {}
+	} SocketSlot;
+
+	/// A subscription's use of a publisher socket
+	typedef std::pair<void*, const SubscriptionDetails*> SocketSubscription;
+
 	void* context;
+	std::shared_ptr<GravitySubscriptionDispatcher> dispatcher;
 	void* gravityNodeSocket;
     void* gravityMetricsSocket;
 	std::map<DomainDataKey, std::map<std::string, std::shared_ptr<SubscriptionDetails> > > subscriptionMap;
-    std::map<void*,std::shared_ptr<SubscriptionDetails> > subscriptionSocketMap;
-	std::map<void*,uint32_t> socketVerificationMap;
+	std::set<std::shared_ptr<SubscriptionDetails> > monitoredSubscriptions; ///< subscriptions with timeout monitors
+	GravityPoller poller;
+	std::vector<SocketSlot> socketSlots; ///< everything about each socket polled, indexed by its poller slot
+	std::map<void*,unsigned int> socketSlotMap; ///< poller slot of each socket
+    std::map<std::string,unsigned int> publisherSlotMap; ///< slot of the socket currently subscribed to each publisher url
+	std::map<std::string,unsigned int> publisherUpdateSlotMap; ///< slot of the socket subscribed to publisher updates from each url
 	//std::map<DomainDataKey, std::map<std::string, zmq_pollitem_t> > publisherUpdateMap;
-    std::map<void*,std::shared_ptr<GravityDataProduct> > lastCachedValueMap;
-	std::vector<zmq_pollitem_t> pollItems;
+    std::unordered_map<uint64_t,unsigned int> fingerprintIndex; ///< number of subscriptions to publishers whose last data product received has each fingerprint key
+    std::map<SocketSubscription,ChunkedDataProduct> chunkedDataProducts; ///< data products being received in chunks
+    uint64_t reassemblyLimit; ///< most bytes of chunked data products to reassemble at once, or for one to decompress to
+    uint64_t reassemblyBytes; ///< bytes of chunked data products being reassembled
+    std::set<unsigned int> retransmitSlots; ///< slots of the sockets with retransmit requests outstanding
 
 	// Info for this node - not subscription specific
 	std::string domain;
@@ -93,19 +204,56 @@ private:
 	std::string serviceDirectoryUrl;
 
 	void setHWM();
+	std::shared_ptr<GravityDataProduct> receiveChunk(const SocketSubscription& key, const SubscriptionDetails& subDetails,
+	                                                 const std::shared_ptr<GravityDataProduct>& chunk);
+	void abandonChunks(const SocketSubscription& key);
+	void setLastReceived(PublisherSubscription& subscription, const DataFingerprint& fingerprint,
+	                     const std::shared_ptr<GravityDataProduct>& dataProduct);
+	void clearLastReceived(PublisherSubscription& subscription);
+	bool isResend(const PublisherSubscription& subscription, const DataFingerprint& fingerprint);
+	void checkSequenceNumber(unsigned int slot, const std::string& filterText, uint64_t sequenceNumber, bool reliable);
+	bool receiveRetransmit(unsigned int slot, const std::string& filterText, const std::string& topic, uint64_t sequenceNumber);
+	void requestRetransmit(unsigned int slot, const std::string& filterText);
+	void loseRetransmits(unsigned int slot, const std::string& filterText, RetransmitRequest& request, uint64_t last);
+	int checkRetransmitRequests();
+	void reportLag(unsigned int slot);
+	bool receiveLagReply(unsigned int slot, const std::string& topic, const std::string& reply,
+	                     std::vector<std::pair<std::shared_ptr<SubscriptionDetails>, void*> >& deleteList);
+	void receiveData(unsigned int slot, std::vector<std::pair<std::shared_ptr<SubscriptionDetails>, void*> >& deleteList);
+	void receivePublisherUpdate(unsigned int slot, std::vector<std::pair<std::shared_ptr<SubscriptionDetails>, void*> >& deleteList);
+	void* attachSubscription(const std::shared_ptr<SubscriptionDetails>& subDetails, const std::string& url,
+	                         uint32_t wireFormatVersion, uint32_t registrationTime);
+	void detachSubscription(const std::shared_ptr<SubscriptionDetails>& subDetails, void* socket);
+	bool subscribedTo(unsigned int slot, const std::string& topic);
+	void subscribePublisherUpdates(SubscriptionDetails& subDetails, const std::string& url);
+	void unsubscribePublisherUpdates(SubscriptionDetails& subDetails);
 	void addSubscription();
 	void removeSubscription();
-	int readSubscription(void *socket, std::string &filterText, std::shared_ptr<GravityDataProduct> &dataProduct);
-	void *setupSubscription(const std::string &url, const std::string &filter, zmq_pollitem_t &pollItem);
-	void removePollItem(zmq_pollitem_t &pollItem);
+	int readSubscription(void *socket, std::string &filterText, std::string &stream, std::shared_ptr<GravityDataProduct> &dataProduct,
+	                     std::shared_ptr<google::protobuf::Arena> arena);
+	unsigned int setupSubscription(const std::string &url, const std::string &topic, uint32_t wireFormatVersion, SocketType type);
+	void updateTopic(SubscriptionDetails& subDetails);
+	void updateTopic(unsigned int slot, PublisherSubscription& subscription);
+	void updatePriority(SubscriptionDetails& subDetails);
+	void updatePriority(unsigned int slot);
+	bool matchesPredicate(SubscriptionDetails& subDetails, GravitySubscriber* subscriber, const GravityDataProduct& dataProduct);
+	unsigned int addSocket(void* socket, SocketType type);
+	void closeSocket(unsigned int slot);
 	void ready();
 	void setTimeoutMonitor();
 	void clearTimeoutMonitor();
 	void calculateTimeout();
 	void trimPublishers(const std::list<gravity::PublisherInfoPB>& fullList, std::list<gravity::PublisherInfoPB>& trimmedList);
-	void unsubscribeFromPollItem(zmq_pollitem_t pollItem, std::string filterText);
 	void notifyServiceDirectoryOfStaleEntry(std::string dataProductId, std::string domain, std::string url, uint32_t regTime);
 
+	static const int NORMAL_RECEIVE_SLICE_SIZE = 64; ///< data products to read from a NORMAL socket before reading others
+	static const int BULK_RECEIVE_SLICE_SIZE = 1; ///< data products to read from a BULK socket before reading others
+	static const size_t MAX_RETRANSMIT_REQUEST = 4096; ///< most data products of a reliable publication missing at once
+	static const uint64_t RETRANSMIT_WINDOW = 64; ///< most data products of a reliable publication asked for again at once
+	static const int RETRANSMIT_TIMEOUT = 250; ///< milliseconds to wait for data products asked for again, before asking again
+	static const int RETRANSMIT_ATTEMPTS = 3; ///< times to ask for data products again, before counting them lost
+	static const int LAG_REPORT_INTERVAL = 1000; ///< milliseconds between reports to a publisher that monitors its subscribers
+
 	int pollTimeout;
 	std::shared_ptr<TimeoutMonitor> currTimeoutMonitor;
 	std::shared_ptr<SubscriptionDetails> currMonitorDetails;
@@ -119,8 +267,9 @@ public:
 	/**
 	 * Constructor GravitySubscriptionManager
 	 * \param context The zmq context in which the inproc socket will be established with the GravityNode
+	 * \param dispatcher Delivers the data products received to the subscribers
 	 */
-	GravitySubscriptionManager(void* context);
+	GravitySubscriptionManager(void* context, const std::shared_ptr<GravitySubscriptionDispatcher>& dispatcher);
 
 	/**
 	 * Default destructor
@@ -133,6 +282,16 @@ public:
 	 * its own thread with a shared zmq context.
 	 */
 	void start();
+
+	/**
+	 * Make room to reassemble a data product received in chunks, if it fits within the limit on bytes reassembled at
+	 * once.
+	 * \param totalSize bytes of the whole data product
+	 * \param limit most bytes to reassemble at once (see ChunkReassemblyLimitMB)
+	 * \param reassemblyBytes bytes already being reassembled, which then count the room made
+	 * \return the room made, or empty if it doesn't fit (or can't be allocated)
+	 */
+	static std::shared_ptr<char> reserveReassembly(uint64_t totalSize, uint64_t limit, uint64_t& reassemblyBytes);
 };
 
 } /* namespace gravity */
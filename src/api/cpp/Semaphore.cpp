@@ -19,6 +19,8 @@
 #include "GravitySemaphore.h"
 #include <zmq.h>
 #include <sstream>
+#include <time.h>
+#include <errno.h>
 
 using namespace std;
 
@@ -43,6 +45,26 @@ void Semaphore::Unlock()
 	sem_post(&semaphore);
 }
 
+bool Semaphore::TryLock(int timeoutMilliseconds)
+{
+	if (timeoutMilliseconds <= 0)
+	{
+		return sem_trywait(&semaphore) == 0;
+	}
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeoutMilliseconds / 1000;
+	deadline.tv_nsec += (long)(timeoutMilliseconds % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	int ret;
+	while ((ret = sem_timedwait(&semaphore, &deadline)) != 0 && errno == EINTR);
+	return ret == 0;
+}
+
 Semaphore::~Semaphore()
 {
 	sem_destroy(&semaphore);
@@ -18,6 +18,7 @@
 
 #include <string>
 #include <sstream>
+#include <cstring>
 
 #include "Utility.h"
 
@@ -236,4 +237,98 @@ GRAVITY_API unsigned int sleep(int milliseconds)
 #endif
 }
 
+// XXH64 primes
+static const uint64_t PRIME64_1 = 11400714785074694791ULL;
+static const uint64_t PRIME64_2 = 14029467366897019727ULL;
+static const uint64_t PRIME64_3 = 1609587929392839161ULL;
+static const uint64_t PRIME64_4 = 9650029242287828579ULL;
+static const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	return rotl64(acc, 31) * PRIME64_1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+{
+	acc ^= hashRound(0, value);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+GRAVITY_API uint64_t hash64(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	uint64_t hash;
+
+	if (size >= 32)
+	{
+		// Four independent lanes of 8 bytes, so the multiplies of each 32 byte stripe overlap
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+		const unsigned char* limit = end - 32;
+		do
+		{
+			v1 = hashRound(v1, read64(p));
+			v2 = hashRound(v2, read64(p + 8));
+			v3 = hashRound(v3, read64(p + 16));
+			v4 = hashRound(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else
+	{
+		hash = seed + PRIME64_5;
+	}
+	hash += (uint64_t) size;
+
+	// The remaining (up to 31) bytes
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= hashRound(0, read64(p));
+		hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (p + 4 <= end)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		hash ^= (uint64_t) value * PRIME64_1;
+		hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++)
+	{
+		hash ^= (*p) * PRIME64_5;
+		hash = rotl64(hash, 11) * PRIME64_1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
 }
@@ -81,6 +81,14 @@ GRAVITY_API uint64_t getCurrentTime();
 
 GRAVITY_API unsigned int sleep(int milliseconds);
 
+/**
+ * Fast (non-cryptographic) 64 bit hash of a block of memory, using the XXH64 algorithm
+ * \param data start of the block
+ * \param size bytes in the block
+ * \param seed hash differently with a different seed, e.g. the hash of a preceding block
+ */
+GRAVITY_API uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
+
 }
 
 #endif //GRAVITY_UTILITY_H__
@@ -83,7 +83,10 @@ namespace gravity {
         INTERRUPTED = -9,
         NO_SERVICE_PROVIDER = -10,
         NO_PORTS_AVAILABLE = -11,
-		INVALID_PARAMETER = -12
+		INVALID_PARAMETER = -12,
+		NOT_INITIALIZED = -13,
+		QUEUE_FULL = -14,
+		QUEUE_TIMEOUT = -15
     };
 
     enum GravityTransportType {
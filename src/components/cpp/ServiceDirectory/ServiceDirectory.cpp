@@ -723,6 +723,7 @@ void ServiceDirectory::handleRegister(const GravityDataProduct& request, Gravity
 					if (registration.has_is_relay()) infoPB.set_isrelay(registration.is_relay());
 					if (registration.has_component_id()) infoPB.set_componentid(registration.component_id());
 					if (registration.has_ip_address()) infoPB.set_ipaddress(registration.ip_address());
+					if (registration.has_wire_format_version()) infoPB.set_wire_format_version(registration.wire_format_version());
 					infoPB.set_registration_time(regTimeSecs);
 
 					dpMap[registration.id()].push_back(infoPB);
@@ -732,6 +733,7 @@ void ServiceDirectory::handleRegister(const GravityDataProduct& request, Gravity
 					if (registration.has_is_relay()) iter->set_isrelay(registration.is_relay());
 					if (registration.has_component_id()) iter->set_componentid(registration.component_id());
 					if (registration.has_ip_address()) iter->set_ipaddress(registration.ip_address());
+					if (registration.has_wire_format_version()) iter->set_wire_format_version(registration.wire_format_version());
 					iter->set_registration_time(regTimeSecs);
 				}				
 				
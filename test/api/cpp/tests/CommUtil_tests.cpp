@@ -230,6 +230,31 @@ TEST_CASE("tests for sending/reading ZMQ messages") {
         CHECK(gdp.getSize() == bytes);
       }
     } 
+
+    GIVEN("a GravityDataProduct sent as separate envelope and data frames") {
+		  GravityDataProduct gdp(dataProductID);
+      std::string data = "string of data";
+      gdp.setData((const void*) data.c_str(), data.size());
+      gdp.setTimestamp(42);
+      int bytes = sendGravityDataProductFrames(clientSocket, gdp, ZMQ_DONTWAIT);
+      THEN("the data frame holds only the data and the envelope everything else") {
+        CHECK((int)data.size() == bytes);
+        std::shared_ptr<zmq_msg_t> envelope = readSharedMessage(serviceSocket, ZMQ_DONTWAIT);
+        REQUIRE(envelope);
+        CHECK(hasMoreFrames(serviceSocket));
+        std::shared_ptr<zmq_msg_t> payload = readSharedMessage(serviceSocket, ZMQ_DONTWAIT);
+        REQUIRE(payload);
+        CHECK(!hasMoreFrames(serviceSocket));
+        CHECK(std::string((char*)zmq_msg_data(payload.get()), zmq_msg_size(payload.get())) == data);
+
+        GravityDataProduct received((char*)zmq_msg_data(envelope.get()), zmq_msg_size(envelope.get()));
+        CHECK(received.getDataProductID() == dataProductID);
+        CHECK(received.getGravityTimestamp() == 42);
+        CHECK(received.getDataSize() == 0);
+        // the original data product is left untouched
+        CHECK(gdp.getDataSize() == (int)data.size());
+      }
+    }
   }
 
   SUBCASE("tests for sending protobufs") {
@@ -264,3 +289,121 @@ TEST_CASE("tests for sending/reading ZMQ messages") {
   zmq_close(clientSocket);
   zmq_close(serviceSocket);
 }
+
+TEST_CASE("Rate limited topics") {
+  uint64_t interval = 0;
+  std::string filter;
+
+  SUBCASE("a topic splits back into its interval and filter") {
+    std::string topic = rateLimitedTopic(200000, "tracks:1");
+    CHECK(topic.compare(0, 1, std::string("\0", 1)) == 0);
+    CHECK(parseRateLimitedTopic(topic, interval, filter));
+    CHECK(interval == 200000);
+    CHECK(filter == "tracks:1");
+
+    CHECK(parseRateLimitedTopic(rateLimitedTopic(5, ""), interval, filter));
+    CHECK(interval == 5);
+    CHECK(filter.empty());
+  }
+
+  SUBCASE("other topics aren't rate limited") {
+    CHECK_FALSE(parseRateLimitedTopic("", interval, filter));
+    CHECK_FALSE(parseRateLimitedTopic("tracks", interval, filter));
+    CHECK_FALSE(parseRateLimitedTopic(wireFormatV2Prefix() + "tracks", interval, filter));
+    std::string prefix = rateLimitedTopic(1, "").substr(0, 3);
+    CHECK_FALSE(parseRateLimitedTopic(prefix, interval, filter));
+    CHECK_FALSE(parseRateLimitedTopic(prefix + ":tracks", interval, filter));
+    CHECK_FALSE(parseRateLimitedTopic(prefix + "12", interval, filter));
+  }
+}
+
+TEST_CASE("Predicate topics") {
+  uint64_t interval = 0;
+  std::string predicate, filter;
+
+  SUBCASE("a topic splits back into its interval, predicate and filter") {
+    std::string topic = predicateTopic(200000, "count > 5 && name == \"a:b\"", "tracks:1");
+    CHECK(topic.compare(0, 1, std::string("\0", 1)) == 0);
+    CHECK(parsePredicateTopic(topic, interval, predicate, filter));
+    CHECK(interval == 200000);
+    CHECK(predicate == "count > 5 && name == \"a:b\"");
+    CHECK(filter == "tracks:1");
+
+    CHECK(parsePredicateTopic(predicateTopic(0, "count == 1", ""), interval, predicate, filter));
+    CHECK(interval == 0);
+    CHECK(predicate == "count == 1");
+    CHECK(filter.empty());
+  }
+
+  SUBCASE("other topics don't have a predicate") {
+    CHECK_FALSE(parsePredicateTopic("", interval, predicate, filter));
+    CHECK_FALSE(parsePredicateTopic("tracks", interval, predicate, filter));
+    CHECK_FALSE(parsePredicateTopic(rateLimitedTopic(5, "tracks"), interval, predicate, filter));
+    CHECK_FALSE(parseRateLimitedTopic(predicateTopic(5, "count == 1", "tracks"), interval, filter));
+    std::string prefix = predicateTopic(1, "", "").substr(0, 3);
+    CHECK_FALSE(parsePredicateTopic(prefix + "12:count == 1", interval, predicate, filter));
+    CHECK_FALSE(parsePredicateTopic(prefix + ":count == 1" + std::string("\0", 1), interval, predicate, filter));
+  }
+}
+
+TEST_CASE("Retransmit topics") {
+  uint64_t first = 0, last = 0;
+  std::string filter;
+
+  SUBCASE("a topic splits back into its sequence numbers and filter text") {
+    std::string topic = retransmitTopic(17, 4112, "tracks:1");
+    CHECK(topic.compare(0, 1, std::string("\0", 1)) == 0);
+    CHECK(parseRetransmitTopic(topic, first, last, filter));
+    CHECK(first == 17);
+    CHECK(last == 4112);
+    CHECK(filter == "tracks:1");
+
+    CHECK(parseRetransmitTopic(retransmitTopic(3, 3, ""), first, last, filter));
+    CHECK(first == 3);
+    CHECK(last == 3);
+    CHECK(filter.empty());
+  }
+
+  SUBCASE("other topics aren't retransmits") {
+    CHECK_FALSE(parseRetransmitTopic("", first, last, filter));
+    CHECK_FALSE(parseRetransmitTopic("tracks", first, last, filter));
+    CHECK_FALSE(parseRetransmitTopic(rateLimitedTopic(5, "tracks"), first, last, filter));
+    CHECK_FALSE(parseRateLimitedTopic(retransmitTopic(1, 5, "tracks"), first, filter));
+    std::string prefix = retransmitTopic(1, 1, "").substr(0, 3);
+    CHECK_FALSE(parseRetransmitTopic(prefix + "12:tracks", first, last, filter));
+    CHECK_FALSE(parseRetransmitTopic(prefix + "-12:tracks", first, last, filter));
+    CHECK_FALSE(parseRetransmitTopic(prefix + "1-:tracks", first, last, filter));
+  }
+}
+
+TEST_CASE("Lag report topics") {
+  uint64_t lag = 0, dropped = 0, report = 0;
+  std::string subscriberID;
+
+  SUBCASE("round trip") {
+    std::string topic = lagReportTopic(250, 12, 3, "Tracker@10.0.0.1/1700000000.4");
+    CHECK(topic.compare(0, 1, std::string("\0", 1)) == 0);
+    CHECK(parseLagReportTopic(topic, lag, dropped, report, subscriberID));
+    CHECK(lag == 250);
+    CHECK(dropped == 12);
+    CHECK(report == 3);
+    CHECK(subscriberID == "Tracker@10.0.0.1/1700000000.4");
+
+    CHECK(parseLagReportTopic(lagReportTopic(0, 0, 1, "a:b"), lag, dropped, report, subscriberID));
+    CHECK(lag == 0);
+    CHECK(dropped == 0);
+    CHECK(subscriberID == "a:b");
+  }
+
+  SUBCASE("other topics aren't lag reports") {
+    CHECK_FALSE(parseLagReportTopic("", lag, dropped, report, subscriberID));
+    CHECK_FALSE(parseLagReportTopic(retransmitTopic(1, 5, "tracks"), lag, dropped, report, subscriberID));
+    uint64_t first, last;
+    std::string filter;
+    CHECK_FALSE(parseRetransmitTopic(lagReportTopic(1, 5, 1, "tracks"), first, last, filter));
+    std::string prefix = lagReportTopic(1, 1, 1, "").substr(0, 3);
+    CHECK_FALSE(parseLagReportTopic(prefix + "1-2:id", lag, dropped, report, subscriberID));
+    CHECK_FALSE(parseLagReportTopic(prefix + "1-2-3", lag, dropped, report, subscriberID));
+    CHECK_FALSE(parseLagReportTopic(prefix + "1--3:id", lag, dropped, report, subscriberID));
+  }
+}
@@ -1,4 +1,7 @@
 #include "GravityDataProduct.h"
+#include "GravityCompression.h"
+#include "GravitySubscriber.h"
+#include "protobuf/ServiceDirectoryRegistrationPB.pb.h"
 #include "../doctest.h"
 
 #include <string>
@@ -70,3 +73,390 @@ TEST_CASE("Tests without the mocking framework") {
   }
 }
 
+
+// Exposes the constructor used on the subscription receive path
+class WrappedDataProduct : public GravityDataProduct {
+public:
+  WrappedDataProduct(std::shared_ptr<const void> buffer, int size, std::shared_ptr<google::protobuf::Arena> arena)
+    : GravityDataProduct(buffer, buffer.get(), size, arena) {}
+  WrappedDataProduct(std::shared_ptr<const void> envelope, int envelopeSize, std::shared_ptr<const void> data, int dataSize)
+    : GravityDataProduct(envelope, envelope.get(), envelopeSize, data, data.get(), dataSize, std::shared_ptr<google::protobuf::Arena>()) {}
+  using GravityDataProduct::serializeEnvelope;
+  using GravityDataProduct::decompress;
+  using GravityDataProduct::getChunkInfo;
+};
+
+TEST_CASE("Wrapped (received) GravityDataProducts") {
+
+  GravityDataProduct gdp("testProductID");
+  gdp.setData((void*)"Hello World", 11);
+  gdp.setTimestamp(1234);
+  gdp.setRegistrationTime(56);
+  gdp.setComponentId("component");
+  gdp.setDomain("domain");
+  gdp.setIsRelayedDataproduct(true);
+
+  std::shared_ptr<char> bytes(new char[gdp.getSize()], std::default_delete<char[]>());
+  gdp.serializeToArray(bytes.get());
+  std::shared_ptr<google::protobuf::Arena> arena(new google::protobuf::Arena());
+  WrappedDataProduct wrapped(bytes, gdp.getSize(), arena);
+
+  SUBCASE("Envelope fields and data are read from the serialized bytes") {
+    CHECK(wrapped.getDataProductID() == "testProductID");
+    CHECK(wrapped.getGravityTimestamp() == 1234);
+    CHECK(wrapped.getRegistrationTime() == 56);
+    CHECK(wrapped.getComponentId() == "component");
+    CHECK(wrapped.getDomain() == "domain");
+    CHECK(wrapped.isRelayedDataproduct());
+    CHECK(!wrapped.isCachedDataproduct());
+    CHECK(wrapped.getDataSize() == 11);
+    CHECK(wrapped.getDataPointer() > bytes.get());
+    CHECK(wrapped.getDataPointer() < bytes.get() + gdp.getSize());
+    CHECK(memcmp(wrapped.getDataPointer(), "Hello World", 11) == 0);
+    CHECK(wrapped == gdp);
+  }
+
+  SUBCASE("Received timestamp is kept through re-serialization") {
+    wrapped.setReceivedTimestamp(999);
+    CHECK(wrapped.getReceivedTimestamp() == 999);
+    std::vector<char> copy(wrapped.getSize());
+    CHECK(wrapped.serializeToArray(&copy[0]));
+    GravityDataProduct parsed(&copy[0], copy.size());
+    CHECK(parsed.getReceivedTimestamp() == 999);
+    CHECK(parsed.getGravityTimestamp() == 1234);
+    CHECK(parsed == gdp);
+  }
+
+  SUBCASE("Modifying a wrapped data product parses it") {
+    wrapped.setReceivedTimestamp(999);
+    wrapped.setIsCachedDataproduct(true);
+    CHECK(wrapped.isCachedDataproduct());
+    CHECK(wrapped.getReceivedTimestamp() == 999);
+    CHECK(wrapped.getComponentId() == "component");
+    CHECK(wrapped == gdp);
+  }
+}
+
+TEST_CASE("Wrapped GravityDataProducts with separate envelope and data") {
+
+  GravityDataProduct gdp("testProductID");
+  gdp.setData((void*)"Hello World", 11);
+  gdp.setTimestamp(1234);
+
+  std::shared_ptr<char> data(new char[11], std::default_delete<char[]>());
+  memcpy(data.get(), "Hello World", 11);
+  // the envelope is everything but the data
+  GravityDataProduct envelopeOnly("testProductID");
+  envelopeOnly.setTimestamp(1234);
+  std::string envelopeBytes(envelopeOnly.getSize(), '\0');
+  envelopeOnly.serializeToArray(&envelopeBytes[0]);
+  std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+  memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+  WrappedDataProduct wrapped(envelope, envelopeBytes.size(), data, 11);
+
+  SUBCASE("Data is read from its own buffer") {
+    CHECK(wrapped.getDataPointer() == data.get());
+    CHECK(wrapped.getGravityTimestamp() == 1234);
+    CHECK(wrapped == gdp);
+  }
+
+  SUBCASE("Flags are applied to the envelope only") {
+    wrapped.setIsCachedDataproduct(true);
+    CHECK(wrapped.isCachedDataproduct());
+    CHECK(wrapped.getDataPointer() == data.get());
+    std::string cachedEnvelope;
+    wrapped.serializeEnvelope(cachedEnvelope);
+    CHECK(cachedEnvelope.size() == envelopeBytes.size() + 2);
+
+    std::vector<char> copy(wrapped.getSize());
+    CHECK(wrapped.serializeToArray(&copy[0]));
+    GravityDataProduct parsed(&copy[0], copy.size());
+    CHECK(parsed.isCachedDataproduct());
+    CHECK(parsed.getGravityTimestamp() == 1234);
+    CHECK(parsed == gdp);
+  }
+}
+
+TEST_CASE("Compressed GravityDataProducts") {
+
+  GravityCompressionPolicy policy(GravityCompressionTypes::LZ4);
+  if (!isCompressionSupported(policy.type))
+    return;
+
+  std::string text(1000, 'x');
+  size_t bound = compressBound(policy.type, text.size());
+  std::shared_ptr<char> data(new char[bound], std::default_delete<char[]>());
+  size_t compressedSize = compressData(policy, text.data(), text.size(), data.get(), bound);
+  REQUIRE(compressedSize > 0);
+  REQUIRE(compressedSize < text.size());
+
+  GravityDataProductPB envelopePB;
+  envelopePB.set_dataproductid("testProductID");
+  envelopePB.set_timestamp(1234);
+  envelopePB.set_compression(policy.type);
+  envelopePB.set_uncompressed_size(text.size());
+  std::string envelopeBytes = envelopePB.SerializeAsString();
+  std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+  memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+  WrappedDataProduct wrapped(envelope, envelopeBytes.size(), data, compressedSize);
+
+  SUBCASE("Data is decompressed once") {
+    CHECK(wrapped.getDataSize() == (int)compressedSize);
+    CHECK(wrapped.decompress());
+    CHECK(wrapped.getDataSize() == (int)text.size());
+    CHECK(std::string((const char*)wrapped.getDataPointer(), wrapped.getDataSize()) == text);
+    CHECK(wrapped.decompress());
+    CHECK(wrapped.getDataSize() == (int)text.size());
+    CHECK(wrapped.getGravityTimestamp() == 1234);
+  }
+
+  SUBCASE("Decompressed data products re-serialize uncompressed") {
+    CHECK(wrapped.decompress());
+    std::vector<char> copy(wrapped.getSize());
+    CHECK(wrapped.serializeToArray(&copy[0]));
+    GravityDataProduct parsed(&copy[0], copy.size());
+    CHECK(parsed.getDataSize() == (int)text.size());
+    CHECK(std::string((const char*)parsed.getDataPointer(), parsed.getDataSize()) == text);
+  }
+
+  SUBCASE("Corrupt data is not decompressed") {
+    WrappedDataProduct truncated(envelope, envelopeBytes.size(), data, compressedSize / 2);
+    CHECK(!truncated.decompress());
+  }
+
+  SUBCASE("Data claiming to decompress past the limit is not decompressed") {
+    CHECK(!wrapped.decompress(text.size() - 1));
+    CHECK(wrapped.getDataSize() == (int)compressedSize);
+
+    envelopePB.set_uncompressed_size(1ULL << 62);
+    std::string hostileBytes = envelopePB.SerializeAsString();
+    std::shared_ptr<char> hostile(new char[hostileBytes.size()], std::default_delete<char[]>());
+    memcpy(hostile.get(), hostileBytes.data(), hostileBytes.size());
+    WrappedDataProduct oversized(hostile, hostileBytes.size(), data, compressedSize);
+    CHECK(!oversized.decompress());
+  }
+}
+
+TEST_CASE("Chunked GravityDataProducts") {
+
+  GravityDataProductPB envelopePB;
+  envelopePB.set_dataproductid("testProductID");
+  envelopePB.set_timestamp(1234);
+  envelopePB.set_chunk_offset(6);
+  envelopePB.set_total_size(11);
+  std::string envelopeBytes = envelopePB.SerializeAsString();
+  std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+  memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+  std::shared_ptr<char> data(new char[5], std::default_delete<char[]>());
+  memcpy(data.get(), "World", 5);
+  WrappedDataProduct chunk(envelope, envelopeBytes.size(), data, 5);
+
+  SUBCASE("Chunk info is read from the envelope") {
+    uint64_t offset = 0, totalSize = 0;
+    CHECK(chunk.getChunkInfo(offset, totalSize));
+    CHECK(offset == 6);
+    CHECK(totalSize == 11);
+    CHECK(chunk.getDataSize64() == 5);
+    CHECK(chunk.getGravityTimestamp() == 1234);
+  }
+
+  SUBCASE("Data products that aren't chunks have no chunk info") {
+    GravityDataProduct gdp("testProductID");
+    gdp.setData64("Hello World", 11);
+    CHECK(gdp.getDataSize64() == 11);
+    CHECK(gdp.getDataSize() == 11);
+    std::shared_ptr<char> bytes(new char[gdp.getSize()], std::default_delete<char[]>());
+    gdp.serializeToArray(bytes.get());
+    WrappedDataProduct wrapped(bytes, gdp.getSize(), std::shared_ptr<google::protobuf::Arena>());
+    uint64_t offset = 0, totalSize = 0;
+    CHECK(!wrapped.getChunkInfo(offset, totalSize));
+    CHECK(wrapped.getDataSize64() == 11);
+  }
+}
+
+TEST_CASE("Sequence numbers of reliable publications") {
+
+  GravityDataProductPB envelopePB;
+  envelopePB.set_dataproductid("testProductID");
+  envelopePB.set_timestamp(1234);
+  envelopePB.set_sequence_number(42);
+  std::string envelopeBytes = envelopePB.SerializeAsString();
+  std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+  memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+  std::shared_ptr<char> data(new char[5], std::default_delete<char[]>());
+  memcpy(data.get(), "Hello", 5);
+
+  SUBCASE("The sequence number is read from the envelope") {
+    WrappedDataProduct wrapped(envelope, envelopeBytes.size(), data, 5);
+    CHECK(wrapped.getSequenceNumber() == 42);
+    CHECK(wrapped.getGravityTimestamp() == 1234);
+  }
+
+  SUBCASE("Data products that aren't numbered have sequence number 0") {
+    GravityDataProduct gdp("testProductID");
+    gdp.setData("Hello", 5);
+    CHECK(gdp.getSequenceNumber() == 0);
+  }
+}
+
+TEST_CASE("Data products of publications that monitor their subscribers") {
+
+  GravityDataProductPB envelopePB;
+  envelopePB.set_dataproductid("testProductID");
+  envelopePB.set_timestamp(1234);
+  envelopePB.set_sequence_number(7);
+  std::shared_ptr<char> data(new char[5], std::default_delete<char[]>());
+  memcpy(data.get(), "Hello", 5);
+
+  SUBCASE("Numbered data products are reliable unless marked otherwise") {
+    std::string envelopeBytes = envelopePB.SerializeAsString();
+    std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+    memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+    WrappedDataProduct wrapped(envelope, envelopeBytes.size(), data, 5);
+    CHECK(wrapped.isReliable());
+    CHECK_FALSE(wrapped.isMonitored());
+  }
+
+  SUBCASE("Monitored publications number their data products without being reliable") {
+    envelopePB.set_monitored(true);
+    envelopePB.set_unreliable(true);
+    std::string envelopeBytes = envelopePB.SerializeAsString();
+    std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+    memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+    WrappedDataProduct wrapped(envelope, envelopeBytes.size(), data, 5);
+    CHECK(wrapped.isMonitored());
+    CHECK_FALSE(wrapped.isReliable());
+    CHECK(wrapped.getSequenceNumber() == 7);
+  }
+
+  SUBCASE("Data products that aren't numbered aren't reliable") {
+    GravityDataProduct gdp("testProductID");
+    gdp.setData("Hello", 5);
+    CHECK_FALSE(gdp.isReliable());
+    CHECK_FALSE(gdp.isMonitored());
+  }
+}
+
+TEST_CASE("Time to live") {
+
+  GravityDataProductPB envelopePB;
+  envelopePB.set_dataproductid("testProductID");
+  envelopePB.set_timestamp(1000000);
+  envelopePB.set_time_to_live(500);
+  std::string envelopeBytes = envelopePB.SerializeAsString();
+  std::shared_ptr<char> envelope(new char[envelopeBytes.size()], std::default_delete<char[]>());
+  memcpy(envelope.get(), envelopeBytes.data(), envelopeBytes.size());
+  std::shared_ptr<char> data(new char[5], std::default_delete<char[]>());
+  memcpy(data.get(), "Hello", 5);
+  WrappedDataProduct wrapped(envelope, envelopeBytes.size(), data, 5);
+
+  SUBCASE("The publisher's time to live is read from the envelope") {
+    CHECK(wrapped.getTimeToLive() == 500);
+    CHECK_FALSE(wrapped.isExpired(1000500));
+    CHECK(wrapped.isExpired(1000501));
+  }
+
+  SUBCASE("The shorter of the publisher's and the subscriber's time to live applies") {
+    CHECK(wrapped.isExpired(1000200, 100));
+    CHECK_FALSE(wrapped.isExpired(1000200, 1000));
+    CHECK(wrapped.isExpired(1000600, 1000));
+  }
+
+  SUBCASE("Data products without a time to live don't expire") {
+    GravityDataProduct gdp("testProductID");
+    gdp.setTimestamp(1000000);
+    CHECK(gdp.getTimeToLive() == 0);
+    CHECK_FALSE(gdp.isExpired(2000000000));
+    CHECK(gdp.isExpired(2000000000, 1000));
+  }
+}
+
+TEST_CASE("GravityDataProducts with owned data") {
+
+  GravityDataProduct expected("testProductID");
+  expected.setData((void*)"Hello World", 11);
+
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[11]);
+  memcpy(buffer.get(), "Hello World", 11);
+  const uint8_t* bufferPtr = buffer.get();
+  GravityDataProduct gdp("testProductID");
+  gdp.setData(std::move(buffer), 11);
+  gdp.setTimestamp(1234);
+
+  SUBCASE("Data is not copied") {
+    CHECK((const uint8_t*)gdp.getDataPointer() == bufferPtr);
+    CHECK(gdp.getDataSize() == 11);
+    CHECK(gdp == expected);
+    GravityDataProduct copy = gdp;
+    CHECK((const uint8_t*)copy.getDataPointer() == bufferPtr);
+  }
+
+  SUBCASE("Owned data is serialized with the rest of the data product") {
+    std::vector<char> bytes(gdp.getSize());
+    CHECK(gdp.serializeToArray(&bytes[0]));
+    GravityDataProduct parsed(&bytes[0], bytes.size());
+    CHECK(parsed == expected);
+    CHECK(parsed.getGravityTimestamp() == 1234);
+  }
+
+  SUBCASE("Vectors are moved in") {
+    std::vector<uint8_t> data(11);
+    memcpy(data.data(), "Hello World", 11);
+    const uint8_t* dataPtr = data.data();
+    gdp.setData(std::move(data));
+    CHECK((const uint8_t*)gdp.getDataPointer() == dataPtr);
+    CHECK(gdp == expected);
+  }
+
+  SUBCASE("Setting data replaces owned data") {
+    gdp.setData((void*)"Goodbye", 7);
+    CHECK(gdp.getDataSize() == 7);
+    CHECK(memcmp(gdp.getDataPointer(), "Goodbye", 7) == 0);
+  }
+}
+
+class RegistrationSubscriber : public TypedSubscriber<ServiceDirectoryRegistrationPB> {
+public:
+  std::vector< std::shared_ptr<const ServiceDirectoryRegistrationPB> > received;
+  void typedSubscriptionFilled(const std::vector< std::shared_ptr<const ServiceDirectoryRegistrationPB> >& data,
+                               const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) {
+    received.insert(received.end(), data.begin(), data.end());
+  }
+};
+
+TEST_CASE("Parsed data is shared by typed subscribers") {
+
+  ServiceDirectoryRegistrationPB registration;
+  registration.set_id("registration");
+  registration.set_timestamp(10);
+
+  GravityDataProduct gdp("testProductID");
+  gdp.setData(registration);
+  CHECK(gdp.getTypeName() == registration.GetTypeName());
+
+  std::shared_ptr<char> bytes(new char[gdp.getSize()], std::default_delete<char[]>());
+  gdp.serializeToArray(bytes.get());
+  std::vector< std::shared_ptr<GravityDataProduct> > dataProducts;
+  dataProducts.push_back(std::shared_ptr<GravityDataProduct>(
+      new WrappedDataProduct(bytes, gdp.getSize(), std::shared_ptr<google::protobuf::Arena>())));
+
+  RegistrationSubscriber first, second;
+  first.subscriptionFilled(dataProducts);
+  // reading the data product doesn't lose the parsed data
+  CHECK(dataProducts[0]->getTypeName() == registration.GetTypeName());
+  second.subscriptionFilled(dataProducts);
+
+  REQUIRE(first.received.size() == 1);
+  REQUIRE(second.received.size() == 1);
+  CHECK(first.received[0] == second.received[0]);
+  CHECK(first.received[0]->id() == "registration");
+  CHECK(first.received[0]->timestamp() == 10);
+
+  SUBCASE("Modified data products are parsed again") {
+    dataProducts[0]->setData((void*)"", 0);
+    std::shared_ptr<const ServiceDirectoryRegistrationPB> parsed = dataProducts[0]->getParsedData<ServiceDirectoryRegistrationPB>();
+    REQUIRE(parsed);
+    CHECK(parsed != first.received[0]);
+    CHECK(!parsed->has_id());
+  }
+}
@@ -1,4 +1,6 @@
 #include "GravityNode.h"
+#include "GravityPublishManager.h"
+#include "GravitySubscriptionManager.h"
 #include "Utility.h"
 #include "../doctest.h"
 
@@ -163,7 +165,7 @@ TEST_CASE("Tests without the mocking framework") {
   SUBCASE("Testing uninitalization GravideNode")
   {
     class TestStub : public GravitySubscriber, public GravityRequestor, public GravityServiceProvider,
-                     public GravityHeartbeatListener, public GravitySubscriptionMonitor
+                     public GravityHeartbeatListener, public GravitySubscriptionMonitor, public GravitySubscriberCountListener
     {
     public:
       GRAVITY_API virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) {}
@@ -175,6 +177,7 @@ TEST_CASE("Tests without the mocking framework") {
       GRAVITY_API virtual void ReceivedHeartbeat(std::string componentID, int64_t& interval_in_microseconds) {}
       GRAVITY_API virtual void MissedHeartbeat(std::string componentID, int64_t microsecond_to_last_heartbeat, int64_t& interval_in_microseconds) {}
       GRAVITY_API virtual void subscriptionTimeout(std::string dataProductID, int milliSecondsSinceLast, std::string filter, std::string domain) {}
+      GRAVITY_API virtual void subscriberCountChanged(const std::string& dataProductID, uint32_t subscriberCount) {}
       virtual ~TestStub() {}
     };
 
@@ -222,6 +225,14 @@ TEST_CASE("Tests without the mocking framework") {
         CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
         ret = gn.registerDataProduct("", GravityTransportType::TCP, true);
         CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
+        PublicationHandle handle = 0;
+        ret = gn.registerDataProduct("", GravityTransportType::TCP, true, GravityCompressionPolicy(GravityCompressionTypes::LZ4), handle);
+        CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
+        CHECK(handle == INVALID_PUBLICATION_HANDLE);
+        handle = 0;
+        ret = gn.registerDataProduct("", GravityTransportType::TCP, true, GravityPublicationOptions(), handle);
+        CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
+        CHECK(handle == INVALID_PUBLICATION_HANDLE);
         ret = gn.unregisterDataProduct("");
         CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
 
@@ -235,6 +246,13 @@ TEST_CASE("Tests without the mocking framework") {
         ret = gn.unregisterHeartbeatListener("", "");
         CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
 
+        ret = gn.registerSubscriberCountListener("", TestStub());
+        CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
+        ret = gn.unregisterSubscriberCountListener("");
+        CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
+        CHECK_FALSE(gn.hasSubscribers(""));
+        CHECK(gn.getSubscriberCount("", "") == 0);
+
         ret = gn.registerRelay("", TestStub(), true, GravityTransportType::TCP);
         CHECK(ret == GravityReturnCodes::NOT_INITIALIZED);
         ret = gn.registerRelay("", TestStub(), true, GravityTransportType::TCP, true);
@@ -262,3 +280,139 @@ TEST_CASE("Tests without the mocking framework") {
     }
   }
 }
+
+TEST_CASE("Subscriber counts and publish elision") {
+
+  PublicationAudience audience;
+  audience.filters[""] = 1;
+  audience.filters["track"] = 2;
+  audience.filters["track/air"] = 1;
+  audience.subscriberCount = 4;
+
+  SUBCASE("Subscriptions with a filter that the filter text starts with are counted") {
+    CHECK(GravityPublishManager::subscriberCount(audience, "") == 1);
+    CHECK(GravityPublishManager::subscriberCount(audience, "track/sea") == 3);
+    CHECK(GravityPublishManager::subscriberCount(audience, "track/air/1") == 4);
+    CHECK(GravityPublishManager::subscriberCount(audience, "status") == 1);
+  }
+
+  audience.filters.erase("");
+  audience.subscriberCount = 3;
+  audience.elide = true;
+
+  SUBCASE("Publishes that a subscription wants aren't elided") {
+    zmq_msg_t data;
+    zmq_msg_init_size(&data, 4);
+    CHECK_FALSE(GravityPublishManager::elide(audience, "track/sea", 100, "", NULL, &data));
+    CHECK(zmq_msg_size(&data) == 4);
+    zmq_msg_close(&data);
+  }
+
+  SUBCASE("Publishes that no subscription wants are dropped") {
+    zmq_msg_t data;
+    zmq_msg_init_size(&data, 4);
+    CHECK(GravityPublishManager::elide(audience, "status", 100, "", NULL, &data));
+    CHECK(audience.elided.empty());
+  }
+
+  SUBCASE("The last value elided with each filter text is kept") {
+    audience.keepElided = true;
+    for (int i = 0; i < 3; i++) {
+      zmq_msg_t data;
+      zmq_msg_init_size(&data, sizeof(i));
+      memcpy(zmq_msg_data(&data), &i, sizeof(i));
+      CHECK(GravityPublishManager::elide(audience, i < 2 ? "status" : "health", 100 + i, "", NULL, &data));
+    }
+    REQUIRE(audience.elided.size() == 2);
+    ElidedValue& value = audience.elided["status"];
+    CHECK(value.timestamp == 101);
+    CHECK_FALSE(value.envelope);
+    CHECK(*static_cast<int*>(zmq_msg_data(value.data.get())) == 1);
+    CHECK(audience.elided["health"].timestamp == 102);
+  }
+}
+
+TEST_CASE("Bounded handoff of publishes to the publish thread") {
+
+  PublicationAudience audience;
+  audience.handoffSlots.reset(new Semaphore(2));
+  audience.handoffLimit = 2;
+
+  SUBCASE("Publishes beyond the limit are refused") {
+    audience.handoffPolicy = GravityHandoffPolicies::REJECT;
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK_FALSE(GravityPublishManager::enqueuePublish(audience));
+    CHECK(audience.handoffDropCount == 1);
+
+    CHECK(GravityPublishManager::dequeuePublish(audience));
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK(audience.handoffDropCount == 1);
+  }
+
+  SUBCASE("Publishes beyond the limit supersede the oldest waiting") {
+    audience.handoffPolicy = GravityHandoffPolicies::DROP_OLDEST;
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK(audience.handoffDropCount == 1);
+
+    CHECK_FALSE(GravityPublishManager::dequeuePublish(audience));
+    CHECK(GravityPublishManager::dequeuePublish(audience));
+    CHECK(GravityPublishManager::dequeuePublish(audience));
+    CHECK(audience.handoffSlots->TryLock(0));
+    CHECK(audience.handoffSlots->TryLock(0));
+    CHECK_FALSE(audience.handoffSlots->TryLock(0));
+  }
+
+  SUBCASE("Publishes beyond the limit wait for room until the timeout") {
+    audience.handoffPolicy = GravityHandoffPolicies::BLOCK;
+    audience.handoffTimeout = 10;
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK(GravityPublishManager::enqueuePublish(audience));
+    CHECK_FALSE(GravityPublishManager::enqueuePublish(audience));
+    CHECK(audience.handoffDropCount == 1);
+    CHECK(audience.handoffBlockedTime >= 10000);
+  }
+
+  SUBCASE("Publications without a limit never wait") {
+    PublicationAudience unlimited;
+    for (int i = 0; i < 3; i++) {
+      CHECK(GravityPublishManager::enqueuePublish(unlimited));
+    }
+    CHECK(GravityPublishManager::dequeuePublish(unlimited));
+    CHECK(unlimited.handoffDropCount == 0);
+  }
+
+  GravityNode gravityNode;
+  CHECK("QUEUE_FULL" == gravityNode.getCodeString(GravityReturnCodes::QUEUE_FULL));
+  CHECK("QUEUE_TIMEOUT" == gravityNode.getCodeString(GravityReturnCodes::QUEUE_TIMEOUT));
+}
+
+TEST_CASE("Reassembly of data products received in chunks within ChunkReassemblyLimitMB") {
+
+  uint64_t reassemblyBytes = 0;
+
+  SUBCASE("Data products are reassembled at once while they fit within the limit") {
+    std::shared_ptr<char> first = GravitySubscriptionManager::reserveReassembly(60, 100, reassemblyBytes);
+    CHECK(first);
+    CHECK(reassemblyBytes == 60);
+    CHECK_FALSE(GravitySubscriptionManager::reserveReassembly(50, 100, reassemblyBytes));
+    CHECK(reassemblyBytes == 60);
+    CHECK(GravitySubscriptionManager::reserveReassembly(40, 100, reassemblyBytes));
+    CHECK(reassemblyBytes == 100);
+    CHECK_FALSE(GravitySubscriptionManager::reserveReassembly(1, 100, reassemblyBytes));
+  }
+
+  SUBCASE("A data product larger than the limit is never reassembled") {
+    CHECK_FALSE(GravitySubscriptionManager::reserveReassembly(101, 100, reassemblyBytes));
+    CHECK_FALSE(GravitySubscriptionManager::reserveReassembly(UINT64_MAX, UINT64_MAX, reassemblyBytes));
+    CHECK(reassemblyBytes == 0);
+  }
+
+  SUBCASE("Bytes past a lowered limit leave no room") {
+    reassemblyBytes = 200;
+    CHECK_FALSE(GravitySubscriptionManager::reserveReassembly(1, 100, reassemblyBytes));
+    CHECK(reassemblyBytes == 200);
+  }
+}
@@ -0,0 +1,109 @@
+#include "GravityPredicate.h"
+#include "../doctest.h"
+#include "protobuf/GravityDataProductPB.pb.h"
+#include "BasicCounterDataProduct.pb.h"
+
+#include <string>
+
+using namespace gravity;
+
+static bool matches(const std::string& text, const google::protobuf::Message& message)
+{
+  std::string error;
+  std::shared_ptr<GravityPredicate> predicate = GravityPredicate::compile(text, message.GetDescriptor(), error);
+  REQUIRE_MESSAGE(predicate, error);
+  std::string data = message.SerializeAsString();
+  return predicate->matches(data.data(), data.size());
+}
+
+static bool compiles(const std::string& text, const google::protobuf::Descriptor* type)
+{
+  std::string error;
+  std::shared_ptr<GravityPredicate> predicate = GravityPredicate::compile(text, type, error);
+  CHECK(error.empty() == (bool)predicate);
+  return (bool)predicate;
+}
+
+TEST_CASE("Predicates on the content of data products") {
+  GravityDataProductPB message;
+  message.set_timestamp(1000);
+  message.set_dataproductid("tracks");
+  message.set_is_cached_dataproduct(true);
+  message.set_data("payload");
+
+  SUBCASE("integer fields") {
+    CHECK(matches("timestamp == 1000", message));
+    CHECK(matches("timestamp >= 1000", message));
+    CHECK(matches("timestamp < 1001", message));
+    CHECK_FALSE(matches("timestamp > 1000", message));
+    CHECK_FALSE(matches("timestamp != 1000", message));
+    CHECK(matches("timestamp < 1000.5", message));
+    CHECK(matches("timestamp > -1", message));
+
+    BasicCounterDataProductPB counter;
+    counter.set_count(-7);
+    CHECK(matches("count == -7", counter));
+    CHECK(matches("count < -6.5", counter));
+    CHECK_FALSE(matches("count > 0", counter));
+  }
+
+  SUBCASE("string and bool fields") {
+    CHECK(matches("dataProductID == \"tracks\"", message));
+    CHECK(matches("dataProductID > \"track\"", message));
+    CHECK_FALSE(matches("dataProductID == \"track\"", message));
+    CHECK(matches("data == \"payload\"", message));
+    CHECK(matches("is_cached_dataproduct == true", message));
+    CHECK_FALSE(matches("is_cached_dataproduct == false", message));
+  }
+
+  SUBCASE("unset fields have their default") {
+    CHECK(matches("componentID == \"\"", message));
+    CHECK(matches("is_relayed_dataproduct == false", message));
+    CHECK(matches("compression == 0", message));
+  }
+
+  SUBCASE("&& binds tighter than ||") {
+    CHECK(matches("timestamp == 1 && dataProductID == \"x\" || timestamp == 1000", message));
+    CHECK_FALSE(matches("timestamp == 1000 && dataProductID == \"x\" || timestamp == 1", message));
+    CHECK(matches("timestamp == 1000 && dataProductID == \"tracks\" && is_cached_dataproduct == true", message));
+  }
+
+  SUBCASE("the last occurrence of a field counts") {
+    GravityDataProductPB later;
+    later.set_timestamp(2000);
+    std::string data = message.SerializeAsString() + later.SerializeAsString();
+    std::string error;
+    std::shared_ptr<GravityPredicate> predicate = GravityPredicate::compile("timestamp == 2000", message.GetDescriptor(), error);
+    REQUIRE(predicate);
+    CHECK(predicate->matches(data.data(), data.size()));
+  }
+
+  SUBCASE("malformed data doesn't match") {
+    std::string error;
+    std::shared_ptr<GravityPredicate> predicate = GravityPredicate::compile("componentID == \"\"", message.GetDescriptor(), error);
+    REQUIRE(predicate);
+    std::string data = message.SerializeAsString();
+    CHECK_FALSE(predicate->matches(data.data(), data.size() - 1));
+  }
+
+  SUBCASE("predicates that don't fit the type don't compile") {
+    const google::protobuf::Descriptor* type = message.GetDescriptor();
+    CHECK(compiles("timestamp == 1", type));
+    CHECK_FALSE(compiles("", type));
+    CHECK_FALSE(compiles("no_such_field == 1", type));
+    CHECK_FALSE(compiles("timestamp == \"1\"", type));
+    CHECK_FALSE(compiles("timestamp = 1", type));
+    CHECK_FALSE(compiles("timestamp == 1 &&", type));
+    CHECK_FALSE(compiles("timestamp == 1 timestamp == 2", type));
+    CHECK_FALSE(compiles("dataProductID == tracks", type));
+    CHECK_FALSE(compiles("dataProductID == \"tracks", type));
+    CHECK_FALSE(compiles("is_cached_dataproduct == 2", type));
+  }
+
+  SUBCASE("types are found by name") {
+    std::string error;
+    CHECK(GravityPredicate::compile("count == 1", "BasicCounterDataProductPB", error));
+    CHECK_FALSE(GravityPredicate::compile("count == 1", "NoSuchType", error));
+    CHECK_FALSE(error.empty());
+  }
+}
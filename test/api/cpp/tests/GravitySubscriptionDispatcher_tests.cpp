@@ -0,0 +1,267 @@
+#include "GravitySubscriptionDispatcher.h"
+#include "GravityDataProduct.h"
+#include "GravitySemaphore.h"
+#include "Utility.h"
+#include "../doctest.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gravity;
+
+class RecordingSubscriber : public GravitySubscriber
+{
+public:
+  std::vector<int> received;
+  std::thread::id thread;
+  std::atomic<int> calls;
+  Semaphore* gate;
+  std::vector<int>* log; ///< shared with other subscribers, to see the order they're called in
+
+  RecordingSubscriber(Semaphore* gate = NULL, std::vector<int>* log = NULL) : calls(0), gate(gate), log(log) {}
+
+  virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+  {
+    if (gate)
+    {
+      gate->Lock();
+    }
+    thread = std::this_thread::get_id();
+    for (size_t i = 0; i < dataProducts.size(); i++)
+    {
+      int value;
+      dataProducts[i]->getData(&value, sizeof(value));
+      received.push_back(value);
+      if (log)
+      {
+        log->push_back(value);
+      }
+    }
+    calls++;
+  }
+};
+
+static std::vector< std::shared_ptr<GravityDataProduct> > makeDelivery(const std::string& dataProductID, int value)
+{
+  std::shared_ptr<GravityDataProduct> dataProduct(new GravityDataProduct(dataProductID));
+  dataProduct->setData(&value, sizeof(value));
+  return std::vector< std::shared_ptr<GravityDataProduct> >(1, dataProduct);
+}
+
+static void waitForCalls(RecordingSubscriber& subscriber, int calls)
+{
+  for (int i = 0; i < 500 && subscriber.calls < calls; i++)
+  {
+    gravity::sleep(10);
+  }
+}
+
+TEST_CASE("Dispatching data products to subscribers") {
+
+  SUBCASE("Subscribers are called from the dispatching thread until workers are started")
+  {
+    GravitySubscriptionDispatcher dispatcher;
+    RecordingSubscriber subscriber;
+    dispatcher.dispatch(&subscriber, "A", makeDelivery("A", 1));
+    CHECK(subscriber.calls == 1);
+    CHECK(subscriber.thread == std::this_thread::get_id());
+    CHECK(dispatcher.queueDepth(&subscriber, "") == 0);
+  }
+
+  SUBCASE("A stalled subscriber doesn't hold up the others, and keeps its deliveries in order")
+  {
+    GravitySubscriptionDispatcher dispatcher;
+    dispatcher.start(2, 3, false);
+
+    Semaphore gate(0);
+    RecordingSubscriber stalled(&gate);
+    RecordingSubscriber other;
+    dispatcher.dispatch(&stalled, "B", makeDelivery("B", 0));
+    for (int i = 0; i < 100 && dispatcher.queueDepth(&stalled, "") > 0; i++)
+    {
+      gravity::sleep(10);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+      dispatcher.dispatch(&other, "A", makeDelivery("A", i));
+      waitForCalls(other, i + 1);
+    }
+    CHECK(other.calls == 5);
+    for (int i = 1; i < 5; i++)
+    {
+      dispatcher.dispatch(&stalled, i % 2 ? "A" : "B", makeDelivery("A", i));
+    }
+    CHECK(other.thread != std::this_thread::get_id());
+
+    // The first delivery is being made, the next is dropped to keep within the limit of 3 queued
+    CHECK(stalled.calls == 0);
+    CHECK(dispatcher.queueDepth(&stalled, "") == 3);
+    CHECK(dispatcher.queueDepth(&stalled, "A") == 1);
+
+    for (int i = 0; i < 4; i++)
+    {
+      gate.Unlock();
+    }
+    waitForCalls(stalled, 4);
+    std::vector<int> expected;
+    expected.push_back(0);
+    expected.push_back(2);
+    expected.push_back(3);
+    expected.push_back(4);
+    CHECK(stalled.received == expected);
+    CHECK(other.received.size() == 5);
+    CHECK(dispatcher.queueDepth(&stalled, "") == 0);
+  }
+
+  SUBCASE("Cancelling drops a subscriber's queued deliveries of a data product")
+  {
+    GravitySubscriptionDispatcher dispatcher;
+    dispatcher.start(1, 0, true);
+
+    Semaphore gate(0);
+    RecordingSubscriber subscriber(&gate);
+    for (int i = 0; i < 4; i++)
+    {
+      dispatcher.dispatch(&subscriber, "A", makeDelivery("A", i));
+    }
+    dispatcher.dispatch(&subscriber, "B", makeDelivery("B", 10));
+    gravity::sleep(50);
+    CHECK(dispatcher.queueDepth(&subscriber, "A") == 3);
+
+    dispatcher.cancel(&subscriber, "A");
+    CHECK(dispatcher.queueDepth(&subscriber, "A") == 0);
+    CHECK(dispatcher.queueDepth(&subscriber, "") == 1);
+
+    gate.Unlock();
+    gate.Unlock();
+    waitForCalls(subscriber, 2);
+    CHECK(subscriber.calls == 2);
+    CHECK(subscriber.received.size() == 2);
+    dispatcher.stop();
+  }
+
+  SUBCASE("Conflating keeps only the latest data product queued for each filter")
+  {
+    GravitySubscriptionDispatcher dispatcher;
+    RecordingSubscriber direct;
+    std::vector< std::shared_ptr<GravityDataProduct> > batch = makeDelivery("A", 1);
+    batch.push_back(makeDelivery("A", 2)[0]);
+    batch.push_back(makeDelivery("A", 3)[0]);
+    dispatcher.dispatchLatest(&direct, "A", "", batch);
+    CHECK(direct.received == std::vector<int>(1, 3));
+    CHECK(dispatcher.conflatedCount(&direct, "A") == 2);
+
+    dispatcher.start(1, 0, false);
+    Semaphore gate(0);
+    RecordingSubscriber subscriber(&gate);
+    dispatcher.dispatch(&subscriber, "A", makeDelivery("A", 0));
+    gravity::sleep(50);
+    for (int i = 1; i <= 5; i++)
+    {
+      dispatcher.dispatchLatest(&subscriber, "A", "x", makeDelivery("A", i));
+      dispatcher.dispatchLatest(&subscriber, "A", "y", makeDelivery("A", 10 + i));
+    }
+    dispatcher.dispatch(&subscriber, "A", makeDelivery("A", 20));
+    CHECK(dispatcher.queueDepth(&subscriber, "A") == 3);
+    CHECK(dispatcher.conflatedCount(&subscriber, "A") == 8);
+    CHECK(dispatcher.conflatedCount(&subscriber, "B") == 0);
+
+    for (int i = 0; i < 4; i++)
+    {
+      gate.Unlock();
+    }
+    waitForCalls(subscriber, 4);
+    std::vector<int> expected;
+    expected.push_back(0);
+    expected.push_back(5);
+    expected.push_back(15);
+    expected.push_back(20);
+    CHECK(subscriber.received == expected);
+
+    dispatcher.cancel(&subscriber, "A");
+    CHECK(dispatcher.conflatedCount(&subscriber, "") == 0);
+    dispatcher.stop();
+  }
+
+  SUBCASE("More urgent deliveries are made first")
+  {
+    GravitySubscriptionDispatcher dispatcher;
+    dispatcher.start(1, 0, false);
+
+    Semaphore gate(0);
+    std::vector<int> log;
+    RecordingSubscriber subscriber(&gate, &log), bulk(NULL, &log), alarm(NULL, &log);
+    dispatcher.dispatch(&subscriber, "A", makeDelivery("A", 0));
+    gravity::sleep(50);
+
+    // The worker is busy, so these queue up
+    dispatcher.dispatch(&subscriber, "B", makeDelivery("B", 1), GravityPriorities::BULK);
+    dispatcher.dispatch(&bulk, "B", makeDelivery("B", 100), GravityPriorities::BULK);
+    dispatcher.dispatch(&alarm, "C", makeDelivery("C", 200), GravityPriorities::REALTIME);
+    dispatcher.dispatch(&subscriber, "A", makeDelivery("A", 2));
+    dispatcher.dispatch(&subscriber, "C", makeDelivery("C", 3), GravityPriorities::REALTIME);
+    CHECK(dispatcher.queueDepth(&subscriber, "") == 3);
+
+    for (int i = 0; i < 4; i++)
+    {
+      gate.Unlock();
+    }
+    waitForCalls(subscriber, 4);
+    waitForCalls(bulk, 1);
+    std::vector<int> expected;
+    expected.push_back(0);
+    expected.push_back(200);
+    expected.push_back(3);
+    expected.push_back(2);
+    expected.push_back(100);
+    expected.push_back(1);
+    CHECK(log == expected);
+    dispatcher.stop();
+  }
+
+  SUBCASE("Data products that outlive their time to live while queued are dropped")
+  {
+    GravitySubscriptionDispatcher dispatcher;
+    dispatcher.start(1, 0, false);
+
+    Semaphore gate(0);
+    RecordingSubscriber subscriber(&gate);
+    dispatcher.dispatch(&subscriber, "A", makeDelivery("A", 0));
+    gravity::sleep(50);
+
+    // Queued behind the stalled delivery, the first outlives the subscriber's time to live and the second its own
+    std::vector< std::shared_ptr<GravityDataProduct> > stale = makeDelivery("A", 1);
+    stale[0]->setTimestamp(getCurrentTime());
+    dispatcher.dispatch(&subscriber, "A", stale, GravityPriorities::NORMAL, 20000);
+    GravityDataProductPB expiringPB;
+    expiringPB.set_dataproductid("A");
+    expiringPB.set_timestamp(getCurrentTime());
+    expiringPB.set_time_to_live(20000);
+    int value = 2;
+    expiringPB.set_data(&value, sizeof(value));
+    std::shared_ptr<GravityDataProduct> expiring(new GravityDataProduct(expiringPB.SerializeAsString().data(), expiringPB.ByteSize()));
+    dispatcher.dispatch(&subscriber, "A", std::vector< std::shared_ptr<GravityDataProduct> >(1, expiring));
+    std::vector< std::shared_ptr<GravityDataProduct> > fresh = makeDelivery("A", 3);
+    fresh[0]->setTimestamp(getCurrentTime());
+    dispatcher.dispatch(&subscriber, "A", fresh, GravityPriorities::NORMAL, 5000000);
+    gravity::sleep(50);
+
+    for (int i = 0; i < 4; i++)
+    {
+      gate.Unlock();
+    }
+    waitForCalls(subscriber, 2);
+    gravity::sleep(50);
+    std::vector<int> expected;
+    expected.push_back(0);
+    expected.push_back(3);
+    CHECK(subscriber.received == expected);
+    CHECK(dispatcher.expiredCount(&subscriber, "A") == 2);
+    CHECK(dispatcher.expiredCount(&subscriber, "B") == 0);
+    dispatcher.cancel(&subscriber, "A");
+    CHECK(dispatcher.expiredCount(&subscriber, "") == 0);
+    dispatcher.stop();
+  }
+}
@@ -219,3 +219,30 @@ TEST_CASE("String helper tests") {
   }
 
 }
+
+TEST_CASE("Hash helper tests") {
+
+  GIVEN("short strings") {
+    THEN("return the XXH64 hashes") {
+      CHECK(hash64("", 0) == 0xEF46DB3751D8E999ULL);
+      CHECK(hash64("a", 1) == 0xD24EC4F1A98C6E5BULL);
+      CHECK(hash64("abc", 3) == 0x44BC2CF5AD770999ULL);
+    }
+  }
+
+  GIVEN("a block longer than a stripe") {
+    std::string block(1000, 'x');
+    uint64_t hash = hash64(block.data(), block.size());
+    THEN("any change to it changes the hash") {
+      CHECK(hash == hash64(block.data(), block.size()));
+      block[999] = 'y';
+      CHECK(hash != hash64(block.data(), block.size()));
+      block[999] = 'x';
+      block[3] = 'y';
+      CHECK(hash != hash64(block.data(), block.size()));
+      block[3] = 'x';
+      CHECK(hash != hash64(block.data(), block.size() - 1));
+      CHECK(hash != hash64(block.data(), block.size(), 1));
+    }
+  }
+}
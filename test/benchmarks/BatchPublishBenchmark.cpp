@@ -0,0 +1,137 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * BatchPublishBenchmark.cpp
+ *
+ * Measures publish throughput of small data products against batch size: the rate at which the publishing
+ * thread hands data products off, and the rate at which a subscriber receives them over TCP.
+ */
+
+#include <GravityNode.h>
+#include <GravityLogger.h>
+#include <Utility.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gravity;
+
+class CountingSubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    CountingSubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        count += dataProducts.size();
+    }
+};
+
+// batchSize 0 publishes each data product with publish(PublicationHandle, ...) rather than in a batch
+static void benchmarkBatch(GravityNode& publisher, PublicationHandle handle, CountingSubscriber& counter,
+                           const std::string& payload, int batchSize, int messages)
+{
+    std::vector<PublishItem> batch(batchSize, PublishItem(handle, payload.data(), payload.size()));
+    int step = batchSize > 0 ? batchSize : 1;
+    messages -= messages % step;
+    counter.count = 0;
+
+    uint64_t publishTime = 0;
+    uint64_t start = getCurrentTime();
+    for (int i = 0; i < messages; i += step)
+    {
+        // Keep fewer messages in flight than the high water marks so that none are dropped
+        while (i + step - counter.count > 500)
+        {
+            std::this_thread::yield();
+        }
+        uint64_t publishStart = getCurrentTime();
+        if (batchSize > 0)
+        {
+            publisher.publish(batch);
+        }
+        else
+        {
+            publisher.publish(handle, payload.data(), payload.size());
+        }
+        publishTime += getCurrentTime() - publishStart;
+    }
+    uint64_t timeout = getCurrentTime() + 30 * 1000000;
+    while (counter.count < messages && getCurrentTime() < timeout)
+    {
+        gravity::sleep(1);
+    }
+    uint64_t elapsed = getCurrentTime() - start;
+
+    char label[32];
+    if (batchSize > 0)
+        sprintf(label, "batch %4d", batchSize);
+    else
+        sprintf(label, "unbatched ");
+    printf("%s size %4zu: hand-off %9.0f msgs/s (%6.3f us/msg)  end-to-end %9.0f msgs/s  received %d/%d\n",
+           label, payload.size(), messages / (publishTime / 1e6), (double)publishTime / messages,
+           counter.count / (elapsed / 1e6), (int)counter.count, messages);
+}
+
+int main()
+{
+    GravityNode publisher;
+    GravityNode subscriber;
+    if (publisher.init("BatchPublishBenchmarkPublisher") != GravityReturnCodes::SUCCESS ||
+        subscriber.init("BatchPublishBenchmarkSubscriber") != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not initialize GravityNodes, is the ServiceDirectory running?\n");
+        return 1;
+    }
+
+    PublicationHandle handle;
+    if (publisher.registerDataProduct("BatchPublishBenchmark", GravityTransportTypes::TCP, false, handle) != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not register BatchPublishBenchmark\n");
+        return 1;
+    }
+    CountingSubscriber counter;
+    subscriber.subscribe("BatchPublishBenchmark", counter);
+    // Wait for the subscription to connect
+    std::string payload(64, 'x');
+    while (counter.count == 0)
+    {
+        publisher.publish(handle, payload.data(), payload.size());
+        gravity::sleep(10);
+    }
+    gravity::sleep(100);
+
+    const int batchSizes[] = {0, 1, 4, 16, 64, 256};
+    const size_t sizes[] = {16, 256};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        payload.assign(sizes[s], 'x');
+        for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++)
+        {
+            benchmarkBatch(publisher, handle, counter, payload, batchSizes[b], 200000);
+        }
+    }
+
+    subscriber.unsubscribe("BatchPublishBenchmark", counter);
+    publisher.unregisterDataProduct("BatchPublishBenchmark");
+    return 0;
+}
@@ -0,0 +1,201 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * CompressionBenchmark.cpp
+ *
+ * Measures the cost and benefit of compressing published data: codec throughput, ratio and CPU time
+ * for each payload size, then publish->subscribe throughput over TCP for each compression type.
+ */
+
+#include <GravityNode.h>
+#include <GravityCompression.h>
+#include <GravityLogger.h>
+#include <Utility.h>
+
+#include <atomic>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gravity;
+
+static const char* typeName(GravityCompressionType type)
+{
+    switch (type)
+    {
+    case GravityCompressionTypes::NONE: return "none";
+    case GravityCompressionTypes::LZ4: return "lz4";
+    case GravityCompressionTypes::ZSTD: return "zstd";
+    }
+    return "?";
+}
+
+// Telemetry-like payload: records of slowly changing values, so it compresses the way real data products do
+static std::string makePayload(size_t size)
+{
+    std::string payload;
+    char record[64];
+    for (int i = 0; payload.size() < size; i++)
+    {
+        int length = sprintf(record, "id=%06d;depth=%8.3f;heading=%6.2f;status=OK\n", i, 100.0 + i * 0.01, (i % 3600) / 10.0);
+        payload.append(record, length);
+    }
+    payload.resize(size);
+    return payload;
+}
+
+static void benchmarkCodec(const GravityCompressionPolicy& policy, const std::string& payload, int iterations)
+{
+    std::vector<char> compressed(compressBound(policy.type, payload.size()));
+    std::vector<char> decompressed(payload.size());
+    size_t compressedSize = 0;
+
+    std::clock_t cpuStart = std::clock();
+    uint64_t start = getCurrentTime();
+    for (int i = 0; i < iterations; i++)
+    {
+        compressedSize = compressData(policy, payload.data(), payload.size(), &compressed[0], compressed.size());
+    }
+    uint64_t compressTime = getCurrentTime() - start;
+    std::clock_t compressCpu = std::clock() - cpuStart;
+
+    cpuStart = std::clock();
+    start = getCurrentTime();
+    for (int i = 0; i < iterations && compressedSize > 0; i++)
+    {
+        decompressData(policy.type, &compressed[0], compressedSize, &decompressed[0], decompressed.size());
+    }
+    uint64_t decompressTime = getCurrentTime() - start;
+    std::clock_t decompressCpu = std::clock() - cpuStart;
+
+    double megabytes = (double)payload.size() * iterations / (1024 * 1024);
+    printf("codec %-5s size %7zu: ratio %5.2f  compress %8.1f MB/s (%6.2f us cpu/msg)  decompress %8.1f MB/s (%6.2f us cpu/msg)\n",
+           typeName(policy.type), payload.size(), compressedSize ? (double)payload.size() / compressedSize : 0.0,
+           megabytes / (compressTime / 1e6), 1e6 * compressCpu / CLOCKS_PER_SEC / iterations,
+           megabytes / (decompressTime / 1e6), 1e6 * decompressCpu / CLOCKS_PER_SEC / iterations);
+}
+
+class CountingSubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    CountingSubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        count += dataProducts.size();
+    }
+};
+
+static void benchmarkPubSub(GravityNode& publisher, GravityNode& subscriber, const GravityCompressionPolicy& policy,
+                            const std::string& payload, int messages)
+{
+    char dataProductID[64];
+    sprintf(dataProductID, "CompressionBenchmark_%s_%zu", typeName(policy.type), payload.size());
+
+    PublicationHandle handle;
+    if (publisher.registerDataProduct(dataProductID, GravityTransportTypes::TCP, false, policy, handle) != GravityReturnCodes::SUCCESS)
+    {
+        printf("pubsub %-5s: could not register %s\n", typeName(policy.type), dataProductID);
+        return;
+    }
+    CountingSubscriber counter;
+    subscriber.subscribe(dataProductID, counter);
+    // Wait for the subscription to connect
+    while (counter.count == 0)
+    {
+        publisher.publish(handle, payload.data(), payload.size());
+        gravity::sleep(10);
+    }
+    gravity::sleep(100);
+    counter.count = 0;
+
+    std::clock_t cpuStart = std::clock();
+    uint64_t start = getCurrentTime();
+    for (int i = 0; i < messages; i++)
+    {
+        // Keep fewer messages in flight than the high water marks so that none are dropped
+        while (i - counter.count > 500)
+        {
+            std::this_thread::yield();
+        }
+        publisher.publish(handle, payload.data(), payload.size());
+    }
+    uint64_t timeout = getCurrentTime() + 30 * 1000000;
+    while (counter.count < messages && getCurrentTime() < timeout)
+    {
+        gravity::sleep(1);
+    }
+    uint64_t elapsed = getCurrentTime() - start;
+    std::clock_t cpu = std::clock() - cpuStart;
+
+    printf("pubsub %-5s size %7zu: %8.0f msgs/s  %8.1f MB/s  %6.2f us cpu/msg  received %d/%d\n",
+           typeName(policy.type), payload.size(), counter.count / (elapsed / 1e6),
+           (double)payload.size() * counter.count / (1024 * 1024) / (elapsed / 1e6),
+           1e6 * cpu / CLOCKS_PER_SEC / messages, (int)counter.count, messages);
+
+    subscriber.unsubscribe(dataProductID, counter);
+    publisher.unregisterDataProduct(dataProductID);
+}
+
+int main()
+{
+    const GravityCompressionType types[] = {GravityCompressionTypes::NONE, GravityCompressionTypes::LZ4, GravityCompressionTypes::ZSTD};
+    const size_t sizes[] = {256, 4096, 65536, 1024 * 1024};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        std::string payload = makePayload(sizes[s]);
+        for (size_t t = 1; t < sizeof(types) / sizeof(types[0]); t++)
+        {
+            if (isCompressionSupported(types[t]))
+            {
+                benchmarkCodec(GravityCompressionPolicy(types[t]), payload, (int)(16 * 1024 * 1024 / sizes[s]) + 1);
+            }
+            else
+            {
+                printf("codec %-5s: not supported by this build\n", typeName(types[t]));
+            }
+        }
+    }
+
+    GravityNode publisher;
+    GravityNode subscriber;
+    if (publisher.init("CompressionBenchmarkPublisher") != GravityReturnCodes::SUCCESS ||
+        subscriber.init("CompressionBenchmarkSubscriber") != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not initialize GravityNodes, is the ServiceDirectory running?\n");
+        return 1;
+    }
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        std::string payload = makePayload(sizes[s]);
+        for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+        {
+            if (isCompressionSupported(types[t]))
+            {
+                benchmarkPubSub(publisher, subscriber, GravityCompressionPolicy(types[t]), payload,
+                                (int)(256 * 1024 * 1024 / sizes[s] < 50000 ? 256 * 1024 * 1024 / sizes[s] : 50000));
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * LatencyBenchmark.cpp
+ *
+ * Measures publish->receive latency (p50/p99) of small data products for each transport, publishing through the
+ * publish manager thread and publishing directly from the calling thread.  One data product is in flight at a time.
+ */
+
+#include <GravityNode.h>
+#include <GravityLogger.h>
+#include <Utility.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gravity;
+
+static int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class LatencySubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    std::vector<int64_t> latencies;
+    LatencySubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        int64_t received = now();
+        for (size_t i = 0; i < dataProducts.size(); i++)
+        {
+            int64_t sent;
+            memcpy(&sent, dataProducts[i]->getDataPointer(), sizeof(sent));
+            latencies.push_back(received - sent);
+        }
+        count += dataProducts.size();
+    }
+};
+
+static void benchmarkLatency(GravityNode& node, GravityTransportType transport, const char* transportName, bool direct, int messages)
+{
+    char dataProductID[64];
+    sprintf(dataProductID, "LatencyBenchmark_%s_%s", transportName, direct ? "direct" : "manager");
+
+    GravityPublicationOptions options;
+    options.directPublish = direct;
+    PublicationHandle handle;
+    if (node.registerDataProduct(dataProductID, transport, false, options, handle) != GravityReturnCodes::SUCCESS)
+    {
+        printf("%-5s %-7s: could not register %s\n", transportName, direct ? "direct" : "manager", dataProductID);
+        return;
+    }
+    LatencySubscriber subscriber;
+    node.subscribe(dataProductID, subscriber);
+
+    char payload[64] = {0};
+    // Wait for the subscription to connect
+    while (subscriber.count == 0)
+    {
+        node.publish(handle, payload, sizeof(payload));
+        gravity::sleep(10);
+    }
+    gravity::sleep(100);
+    subscriber.count = 0;
+    subscriber.latencies.clear();
+    subscriber.latencies.reserve(messages);
+
+    for (int i = 0; i < messages; i++)
+    {
+        int64_t sent = now();
+        memcpy(payload, &sent, sizeof(sent));
+        node.publish(handle, payload, sizeof(payload));
+        int64_t timeout = sent + 1000000000LL;
+        while (subscriber.count <= i && now() < timeout)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    std::vector<int64_t> latencies(subscriber.latencies);
+    std::sort(latencies.begin(), latencies.end());
+    if (latencies.empty())
+    {
+        printf("%-5s %-7s: nothing received\n", transportName, direct ? "direct" : "manager");
+    }
+    else
+    {
+        printf("%-5s %-7s: p50 %7.1f us  p99 %7.1f us  received %d/%d\n", transportName, direct ? "direct" : "manager",
+               latencies[latencies.size() / 2] / 1e3, latencies[latencies.size() * 99 / 100] / 1e3,
+               (int)latencies.size(), messages);
+    }
+
+    node.unsubscribe(dataProductID, subscriber);
+    node.unregisterDataProduct(dataProductID);
+}
+
+int main()
+{
+    // Inproc publications can only be subscribed to by the GravityNode that publishes them
+    GravityNode node;
+    if (node.init("LatencyBenchmark") != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not initialize GravityNode, is the ServiceDirectory running?\n");
+        return 1;
+    }
+
+    const GravityTransportType transports[] = {GravityTransportTypes::INPROC,
+#ifndef WIN32
+                                               GravityTransportTypes::IPC,
+#endif
+                                               GravityTransportTypes::TCP};
+    const char* names[] = {"inproc",
+#ifndef WIN32
+                           "ipc",
+#endif
+                           "tcp"};
+    for (size_t t = 0; t < sizeof(transports) / sizeof(transports[0]); t++)
+    {
+        benchmarkLatency(node, transports[t], names[t], false, 20000);
+        benchmarkLatency(node, transports[t], names[t], true, 20000);
+    }
+    return 0;
+}
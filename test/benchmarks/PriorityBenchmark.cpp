@@ -0,0 +1,189 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * PriorityBenchmark.cpp
+ *
+ * Measures publish->receive latency (p50/p99/max) of a small alarm data product over TCP, alone and while a bulk data
+ * product of large images is published as fast as possible to a subscriber that takes a while over each (called from
+ * the subscription manager thread, as it is by default).  Under load it's measured with both data products at the same
+ * (NORMAL) priority, then with the alarm REALTIME and the images BULK.
+ */
+
+#include <GravityNode.h>
+#include <GravityLogger.h>
+#include <Utility.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gravity;
+
+#define ALARMS 1000
+#define ALARM_INTERVAL_MS 5
+#define IMAGE_SIZE (512 * 1024)
+#define IMAGE_PROCESSING_MS 2
+
+static int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class AlarmSubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    std::vector<int64_t> latencies;
+    AlarmSubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        int64_t received = now();
+        for (size_t i = 0; i < dataProducts.size(); i++)
+        {
+            int64_t sent;
+            memcpy(&sent, dataProducts[i]->getDataPointer(), sizeof(sent));
+            latencies.push_back(received - sent);
+        }
+        count += dataProducts.size();
+    }
+};
+
+class ImageSubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    ImageSubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        // Stand in for the work of processing each image
+        std::this_thread::sleep_for(std::chrono::milliseconds(IMAGE_PROCESSING_MS * dataProducts.size()));
+        count += dataProducts.size();
+    }
+};
+
+static void publishImages(GravityNode* node, PublicationHandle handle, std::atomic<bool>* stop)
+{
+    std::vector<char> image(IMAGE_SIZE, 'x');
+    while (!*stop)
+    {
+        node->publish(handle, &image[0], image.size());
+    }
+}
+
+static void benchmarkPriority(GravityNode& node, const char* name, bool load, GravityPriority alarmPriority, GravityPriority imagePriority)
+{
+    std::string alarmID = std::string("PriorityBenchmark_alarm_") + name;
+    std::string imageID = std::string("PriorityBenchmark_images_") + name;
+
+    GravityPublicationOptions alarmOptions, imageOptions;
+    alarmOptions.priority = alarmPriority;
+    imageOptions.priority = imagePriority;
+    PublicationHandle alarmHandle, imageHandle;
+    if (node.registerDataProduct(alarmID, GravityTransportTypes::TCP, false, alarmOptions, alarmHandle) != GravityReturnCodes::SUCCESS ||
+        node.registerDataProduct(imageID, GravityTransportTypes::TCP, false, imageOptions, imageHandle) != GravityReturnCodes::SUCCESS)
+    {
+        printf("%-16s: could not register the data products\n", name);
+        return;
+    }
+    GravitySubscriptionOptions alarmSubscription, imageSubscription;
+    alarmSubscription.priority = alarmPriority;
+    imageSubscription.priority = imagePriority;
+    AlarmSubscriber alarms;
+    ImageSubscriber images;
+    node.subscribe(alarmID, alarms, "", "", false, alarmSubscription);
+    node.subscribe(imageID, images, "", "", false, imageSubscription);
+
+    char payload[64] = {0};
+    // Wait for the subscriptions to connect
+    while (alarms.count == 0)
+    {
+        node.publish(alarmHandle, payload, sizeof(payload));
+        gravity::sleep(10);
+    }
+    std::atomic<bool> stop(false);
+    std::thread imagePublisher;
+    if (load)
+    {
+        imagePublisher = std::thread(publishImages, &node, imageHandle, &stop);
+        while (images.count == 0)
+        {
+            gravity::sleep(10);
+        }
+    }
+    gravity::sleep(100);
+    alarms.count = 0;
+    alarms.latencies.clear();
+    alarms.latencies.reserve(ALARMS);
+
+    for (int i = 0; i < ALARMS; i++)
+    {
+        int64_t sent = now();
+        memcpy(payload, &sent, sizeof(sent));
+        node.publish(alarmHandle, payload, sizeof(payload));
+        std::this_thread::sleep_for(std::chrono::milliseconds(ALARM_INTERVAL_MS));
+    }
+    int64_t timeout = now() + 2000000000LL;
+    while (alarms.count < ALARMS && now() < timeout)
+    {
+        gravity::sleep(10);
+    }
+    stop = true;
+    if (load)
+    {
+        imagePublisher.join();
+    }
+
+    std::vector<int64_t> latencies(alarms.latencies.begin(), alarms.latencies.begin() + std::min<int>(alarms.count, ALARMS));
+    std::sort(latencies.begin(), latencies.end());
+    if (latencies.empty())
+    {
+        printf("%-16s: nothing received\n", name);
+    }
+    else
+    {
+        printf("%-16s: alarm p50 %8.1f us  p99 %8.1f us  max %8.1f us  received %d/%d  images %d\n", name,
+               latencies[latencies.size() / 2] / 1e3, latencies[latencies.size() * 99 / 100] / 1e3, latencies.back() / 1e3,
+               (int)latencies.size(), ALARMS, (int)images.count);
+    }
+
+    node.unsubscribe(alarmID, alarms);
+    node.unsubscribe(imageID, images);
+    node.unregisterDataProduct(alarmID);
+    node.unregisterDataProduct(imageID);
+}
+
+int main()
+{
+    GravityNode node;
+    if (node.init("PriorityBenchmark") != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not initialize GravityNode, is the ServiceDirectory running?\n");
+        return 1;
+    }
+
+    benchmarkPriority(node, "idle", false, GravityPriorities::NORMAL, GravityPriorities::NORMAL);
+    benchmarkPriority(node, "loaded", true, GravityPriorities::NORMAL, GravityPriorities::NORMAL);
+    benchmarkPriority(node, "loaded realtime", true, GravityPriorities::REALTIME, GravityPriorities::BULK);
+    return 0;
+}
@@ -0,0 +1,216 @@
+/** (C) Copyright 2013, Applied Physical Sciences Corp., A General Dynamics Company
+ **
+ ** Gravity is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU Lesser General Public License as published by
+ ** the Free Software Foundation; either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU Lesser General Public License for more details.
+ **
+ ** You should have received a copy of the GNU Lesser General Public
+ ** License along with this program;
+ ** If not, see <http://www.gnu.org/licenses/>.
+ **
+ */
+
+/*
+ * SubscriptionScalingBenchmark.cpp
+ *
+ * Measures the publish->receive latency and throughput of one hot data product as a subscriber's idle subscriptions
+ * grow, each to a publisher of its own (10000 by default, or the first argument).  Each idle subscription receives
+ * one data product when it connects, then nothing.
+ */
+
+#include <GravityNode.h>
+#include <GravityLogger.h>
+#include <Utility.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gravity;
+
+// Idle data products registered by each publishing node
+#define PUBLICATIONS_PER_NODE 1000
+
+static int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class HotSubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    std::vector<int64_t> latencies;
+    HotSubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        int64_t received = now();
+        for (size_t i = 0; i < dataProducts.size(); i++)
+        {
+            int64_t sent;
+            memcpy(&sent, dataProducts[i]->getDataPointer(), sizeof(sent));
+            latencies.push_back(received - sent);
+        }
+        count += dataProducts.size();
+    }
+};
+
+class IdleSubscriber : public GravitySubscriber
+{
+public:
+    std::atomic<int> count;
+    IdleSubscriber() : count(0) {}
+    virtual void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        count += dataProducts.size();
+    }
+};
+
+static void benchmarkHot(GravityNode& node, PublicationHandle handle, HotSubscriber& subscriber, int idle, int messages)
+{
+    char payload[64] = {0};
+
+    // Latency, one data product in flight at a time
+    subscriber.count = 0;
+    subscriber.latencies.clear();
+    subscriber.latencies.reserve(messages);
+    for (int i = 0; i < messages; i++)
+    {
+        int64_t sent = now();
+        memcpy(payload, &sent, sizeof(sent));
+        node.publish(handle, payload, sizeof(payload));
+        int64_t timeout = sent + 1000000000LL;
+        while (subscriber.count <= i && now() < timeout)
+        {
+            std::this_thread::yield();
+        }
+    }
+    std::vector<int64_t> latencies(subscriber.latencies);
+    std::sort(latencies.begin(), latencies.end());
+
+    // Throughput, a burst at a time so the subscriber's high water mark isn't hit
+    subscriber.count = 0;
+    int64_t start = now();
+    for (int i = 0; i < messages; i++)
+    {
+        memset(payload, 0, sizeof(payload));
+        node.publish(handle, payload, sizeof(payload));
+        if (i % 500 == 499)
+        {
+            int64_t timeout = now() + 1000000000LL;
+            while (subscriber.count <= i && now() < timeout)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+    int64_t timeout = now() + 1000000000LL;
+    while (subscriber.count < messages && now() < timeout)
+    {
+        std::this_thread::yield();
+    }
+    double seconds = (now() - start) / 1e9;
+
+    if (latencies.empty())
+    {
+        printf("%6d idle: nothing received\n", idle);
+    }
+    else
+    {
+        printf("%6d idle: p50 %7.1f us  p99 %7.1f us  %9.0f msg/s  received %d/%d\n", idle,
+               latencies[latencies.size() / 2] / 1e3, latencies[latencies.size() * 99 / 100] / 1e3,
+               subscriber.count / seconds, (int)subscriber.count, messages);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int idle = argc > 1 ? atoi(argv[1]) : 10000;
+
+    // Each idle subscription is a socket in the subscribing node and another in a publishing node, more than zmq
+    // allows by default (see MaxSockets in Gravity.ini), and a few file descriptors (see README.txt)
+    GravityNode subscriberNode;
+    if (subscriberNode.init("SubscriptionScalingBenchmark") != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not initialize GravityNode, is the ServiceDirectory running?\n");
+        return 1;
+    }
+
+    GravityNode hotNode;
+    hotNode.init("SubscriptionScalingBenchmarkHot");
+    PublicationHandle handle;
+    if (hotNode.registerDataProduct("SubscriptionScalingBenchmark_hot", GravityTransportTypes::TCP, false,
+                                    GravityPublicationOptions(), handle) != GravityReturnCodes::SUCCESS)
+    {
+        printf("Could not register the hot data product\n");
+        return 1;
+    }
+    HotSubscriber hotSubscriber;
+    subscriberNode.subscribe("SubscriptionScalingBenchmark_hot", hotSubscriber);
+    char payload[64] = {0};
+    // Wait for the subscription to connect
+    while (hotSubscriber.count == 0)
+    {
+        hotNode.publish(handle, payload, sizeof(payload));
+        gravity::sleep(10);
+    }
+    gravity::sleep(100);
+    benchmarkHot(hotNode, handle, hotSubscriber, 0, 20000);
+
+    // Publishers of the idle data products, each publishing once
+    std::vector< std::shared_ptr<GravityNode> > idleNodes;
+    IdleSubscriber idleSubscriber;
+    int64_t start = now();
+    for (int i = 0; i < idle; i++)
+    {
+        if (i % PUBLICATIONS_PER_NODE == 0)
+        {
+            char componentID[64];
+            sprintf(componentID, "SubscriptionScalingBenchmarkIdle%d", i / PUBLICATIONS_PER_NODE);
+            idleNodes.push_back(std::shared_ptr<GravityNode>(new GravityNode()));
+            idleNodes.back()->init(componentID);
+        }
+        char dataProductID[64];
+        sprintf(dataProductID, "SubscriptionScalingBenchmark_idle%d", i);
+#ifndef WIN32
+        GravityTransportType transport = GravityTransportTypes::IPC;
+#else
+        GravityTransportType transport = GravityTransportTypes::TCP;
+#endif
+        if (idleNodes.back()->registerDataProduct(dataProductID, transport) != GravityReturnCodes::SUCCESS)
+        {
+            printf("Could not register %s after %d idle data products\n", dataProductID, i);
+            idle = i;
+            break;
+        }
+        GravityDataProduct dataProduct(dataProductID);
+        dataProduct.setData(payload, sizeof(payload));
+        idleNodes.back()->publish(dataProduct);
+        subscriberNode.subscribe(dataProductID, idleSubscriber);
+    }
+
+    // Each idle subscription receives the data product published when it connects
+    int64_t timeout = now() + 60000000000LL;
+    while (idleSubscriber.count < idle && now() < timeout)
+    {
+        gravity::sleep(100);
+    }
+    printf("%d idle subscriptions connected in %.1f s\n", (int)idleSubscriber.count, (now() - start) / 1e9);
+    gravity::sleep(500);
+
+    benchmarkHot(hotNode, handle, hotSubscriber, idle, 20000);
+    return 0;
+}
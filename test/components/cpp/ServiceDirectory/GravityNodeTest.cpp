@@ -18,8 +18,19 @@
 
 #include "GravityNodeTest.h"
 #include "GravityTest.h"
+#include "protobuf/ServiceDirectoryMapPB.pb.h"
+#include "protobuf/GravityMetricsDataPB.pb.h"
+#include "protobuf/ServiceDirectoryBroadcastPB.pb.h"
 
+#include <zmq.h>
 #include <mutex>
+#include <map>
+#include <algorithm>
+#include <set>
+#include <cstring>
+#include <sstream>
+#include <functional>
+#include <thread>
 
 namespace {
   std::mutex mtx;
@@ -35,9 +46,166 @@ public:
     Subscriber() : count(0) {}
     ~Subscriber() {}
     int getCount() { return count; }
-    void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) { count++; }
+    void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts) { count += (int)dataProducts.size(); }
 };
 
+class CountListener : public GravitySubscriberCountListener
+{
+    uint32_t count;
+    int calls;
+public:
+    CountListener() : count(0), calls(0) {}
+    uint32_t getCount() { std::lock_guard<std::mutex> guard(mtx); return count; }
+    int getCalls() { std::lock_guard<std::mutex> guard(mtx); return calls; }
+    void subscriberCountChanged(const std::string& dataProductID, uint32_t subscriberCount)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        count = subscriberCount;
+        calls++;
+    }
+};
+
+class OrderedSubscriber : public GravitySubscriber
+{
+    std::map<std::string,int> next;
+    bool ordered;
+public:
+    OrderedSubscriber() : ordered(true) {}
+    int getCount(const std::string& dataProductID) { std::lock_guard<std::mutex> guard(mtx); return next[dataProductID]; }
+    bool isOrdered() { std::lock_guard<std::mutex> guard(mtx); return ordered; }
+    void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        for (size_t i = 0; i < dataProducts.size(); i++)
+        {
+            int value = -1;
+            dataProducts[i]->getData(&value, sizeof(int));
+            int& expected = next[dataProducts[i]->getDataProductID()];
+            ordered = ordered && value == expected;
+            expected++;
+        }
+    }
+};
+
+class KeepingSubscriber : public GravitySubscriber
+{
+    std::vector< std::shared_ptr<GravityDataProduct> > received;
+public:
+    std::vector< std::shared_ptr<GravityDataProduct> > getReceived() { std::lock_guard<std::mutex> guard(mtx); return received; }
+    void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        received.insert(received.end(), dataProducts.begin(), dataProducts.end());
+    }
+};
+
+class StallingSubscriber : public GravitySubscriber
+{
+    std::map<std::string,int> counts;
+    int stall;
+public:
+    StallingSubscriber() : stall(0) {}
+    void setStall(int milliseconds) { std::lock_guard<std::mutex> guard(mtx); stall = milliseconds; }
+    int getCount(const std::string& dataProductID) { std::lock_guard<std::mutex> guard(mtx); return counts[dataProductID]; }
+    void subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
+    {
+        int milliseconds;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            for (size_t i = 0; i < dataProducts.size(); i++)
+            {
+                counts[dataProducts[i]->getDataProductID()]++;
+            }
+            milliseconds = stall;
+        }
+        if (milliseconds > 0)
+        {
+            gravity::sleep(milliseconds);
+        }
+    }
+};
+
+class LagListener : public GravitySlowSubscriberListener
+{
+    std::vector<GravitySlowSubscriberEvent> events;
+public:
+    std::vector<GravitySlowSubscriberEvent> getEvents() { std::lock_guard<std::mutex> guard(mtx); return events; }
+    bool hasEvent(GravitySlowSubscriberEvent event)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        return std::find(events.begin(), events.end(), event) != events.end();
+    }
+    void subscriberLagged(const std::string& dataProductID, const std::string& subscriberID, GravitySlowSubscriberEvent event,
+                          uint32_t lag, uint64_t dropped)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        events.push_back(event);
+    }
+};
+
+static std::vector<int> receivedValues(KeepingSubscriber& subscriber, bool& allCached)
+{
+    std::vector< std::shared_ptr<GravityDataProduct> > received = subscriber.getReceived();
+    std::vector<int> values;
+    allCached = true;
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        int value = -1;
+        received[i]->getData(&value, sizeof(int));
+        values.push_back(value);
+        allCached = allCached && received[i]->isCachedDataproduct();
+    }
+    return values;
+}
+
+// Sums a subscription's counts over the metrics a node has published
+static void sumSubscriptionMetrics(KeepingSubscriber& metricsSubscriber, const std::string& dataProductID, uint32_t& gaps,
+                                   uint32_t& retransmits, uint32_t& lost)
+{
+    gaps = retransmits = lost = 0;
+    std::vector< std::shared_ptr<GravityDataProduct> > received = metricsSubscriber.getReceived();
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        GravityMetricsDataPB metricsData;
+        received[i]->populateMessage(metricsData);
+        for (int j = 0; j < metricsData.metrics_size(); j++)
+        {
+            const GravityMetricsPB& metrics = metricsData.metrics(j);
+            if (metrics.dataproductid() != dataProductID || metrics.messagetype() != GravityMetricsPB::SUBSCRIPTION)
+                continue;
+            for (int k = 0; k < metrics.numgaps_size(); k++)
+            {
+                gaps += metrics.numgaps(k);
+                retransmits += metrics.numretransmits(k);
+                lost += metrics.numlost(k);
+            }
+        }
+    }
+}
+
+static void publishValues(GravityNode* node, PublicationHandle handle, int count)
+{
+    for (int value = 0; value < count; value++)
+    {
+        GRAVITY_TEST_EQUALS(node->publish(handle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+    }
+}
+
+static void publishFilteredValues(GravityNode* node, PublicationHandle handle, int first, int count)
+{
+    // Each value with a filter text of its own, so that every one is cached
+    for (int value = first; value < first + count; value++)
+    {
+        std::ostringstream filter;
+        filter << value;
+        GRAVITY_TEST_EQUALS(node->publish(handle, &value, sizeof(int), filter.str()), GravityReturnCodes::SUCCESS);
+        if (value % 16 == 0)
+        {
+            sleep(1);
+        }
+    }
+}
+
 class GravitySyncTest : public GravitySubscriber
 {
     GravityNode gravityNode;
@@ -475,6 +643,1183 @@ void GravityNodeTest::testComponentID(void)
     GRAVITY_TEST_EQUALS(gn.getComponentID(), "TestCompId");
 }
 
+void GravityNodeTest::testLegacySubscriber(void)
+{
+	GravityNode node;
+	GravityReturnCode ret = node.init("TestLegacyNode");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	ret = node.registerDataProduct("LEGACY_TEST", GravityTransportTypes::TCP, false);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// Find the publisher's URL to connect a version 1 subscriber to
+	GravityDataProduct request("GetProviders");
+	std::shared_ptr<GravityDataProduct> response = node.request("DirectoryService", request, 1000);
+	GRAVITY_TEST(response);
+	ServiceDirectoryMapPB providers;
+	response->populateMessage(providers);
+	string url;
+	for (int i = 0; i < providers.data_provider_size(); i++)
+	{
+		if (providers.data_provider(i).product_id() == "LEGACY_TEST" && providers.data_provider(i).url_size() > 0)
+		{
+			url = providers.data_provider(i).url(0);
+		}
+	}
+	GRAVITY_TEST(!url.empty());
+
+	// A version 1 subscriber with the empty filter, which matches every topic sent to version 2 subscribers too
+	void* context = zmq_ctx_new();
+	void* legacySocket = zmq_socket(context, ZMQ_SUB);
+	zmq_setsockopt(legacySocket, ZMQ_SUBSCRIBE, "", 0);
+	zmq_connect(legacySocket, url.c_str());
+
+	// Alongside it, a version 2 subscriber to every data product, then one to a rate limited stream of them
+	Subscriber subscriber;
+	ret = node.subscribe("LEGACY_TEST", subscriber);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	sleep(100);
+	for (int i = 0; i < 10; i++)
+	{
+		if (i == 5)
+		{
+			node.unsubscribe("LEGACY_TEST", subscriber);
+			GravitySubscriptionOptions options;
+			options.maxRate = 1000;
+			ret = node.subscribe("LEGACY_TEST", subscriber, "", "", false, options);
+			GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+			sleep(100);
+		}
+		GravityDataProduct gdp("LEGACY_TEST");
+		gdp.setData(&i, sizeof(int));
+		ret = node.publish(gdp);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		sleep(10);
+	}
+	sleep(100);
+	GRAVITY_TEST_EQUALS(subscriber.getCount(), 10);
+
+	// Each data product reaches the version 1 subscriber once, as a topic and a single frame it can parse
+	int received = 0;
+	zmq_msg_t topic, frame;
+	zmq_msg_init(&topic);
+	while (zmq_msg_recv(&topic, legacySocket, ZMQ_DONTWAIT) >= 0)
+	{
+		GRAVITY_TEST(zmq_msg_more(&topic));
+		zmq_msg_init(&frame);
+		GRAVITY_TEST(zmq_msg_recv(&frame, legacySocket, 0) >= 0);
+		GRAVITY_TEST(!zmq_msg_more(&frame));
+		GravityDataProduct gdp(zmq_msg_data(&frame), (int)zmq_msg_size(&frame));
+		zmq_msg_close(&frame);
+		GRAVITY_TEST_EQUALS(gdp.getDataProductID(), "LEGACY_TEST");
+		int value = -1;
+		gdp.getData(&value, sizeof(int));
+		GRAVITY_TEST_EQUALS(value, received);
+		received++;
+	}
+	zmq_msg_close(&topic);
+	GRAVITY_TEST_EQUALS(received, 10);
+
+	zmq_close(legacySocket);
+	zmq_ctx_term(context);
+	node.unsubscribe("LEGACY_TEST", subscriber);
+}
+
+void GravityNodeTest::testPublishHandoff(void)
+{
+	GravityNode node;
+	GravityReturnCode ret = node.init("TestHandoffNode");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// Data sent in chunks this small keeps the publishing thread busy long enough for publishes to pile up
+	GravityPublicationOptions options;
+	options.chunkSize = 64;
+	options.handoffLimit = 2;
+	options.handoffPolicy = GravityHandoffPolicies::REJECT;
+	PublicationHandle rejectHandle, blockHandle;
+	ret = node.registerDataProduct("HANDOFF_REJECT", GravityTransportTypes::TCP, false, options, rejectHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	options.handoffPolicy = GravityHandoffPolicies::BLOCK;
+	options.handoffTimeout = 1;
+	ret = node.registerDataProduct("HANDOFF_BLOCK", GravityTransportTypes::TCP, false, options, blockHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	Subscriber rejectSubscriber, blockSubscriber;
+	node.subscribe("HANDOFF_REJECT", rejectSubscriber);
+	node.subscribe("HANDOFF_BLOCK", blockSubscriber);
+	sleep(100);
+
+	vector<char> data(1 << 20);
+	int full = 0, timedOut = 0;
+	for (int i = 0; i < 20; i++)
+	{
+		ret = node.publish(rejectHandle, &data[0], data.size());
+		if (ret == GravityReturnCodes::QUEUE_FULL)
+		{
+			full++;
+		}
+		else
+		{
+			GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		}
+
+		ret = node.publish(blockHandle, &data[0], data.size());
+		if (ret == GravityReturnCodes::QUEUE_TIMEOUT)
+		{
+			timedOut++;
+		}
+		else
+		{
+			GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		}
+	}
+
+	// Every publish that failed was counted as dropped, and the blocked ones as time spent waiting
+	GRAVITY_TEST(full > 0);
+	GRAVITY_TEST(timedOut > 0);
+	GRAVITY_TEST_EQUALS(node.getPublishDropCount("HANDOFF_REJECT"), (uint64_t)full);
+	GRAVITY_TEST_EQUALS(node.getPublishDropCount("HANDOFF_BLOCK"), (uint64_t)timedOut);
+	GRAVITY_TEST(node.getPublishBlockedTime("HANDOFF_BLOCK") >= (uint64_t)timedOut * 1000);
+
+	node.unsubscribe("HANDOFF_REJECT", rejectSubscriber);
+	node.unsubscribe("HANDOFF_BLOCK", blockSubscriber);
+}
+
+void GravityNodeTest::testSubscriberCount(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestCountPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	ret = pubNode.registerDataProduct("COUNT_TEST", GravityTransportTypes::TCP);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	CountListener listener;
+	ret = pubNode.registerSubscriberCountListener("COUNT_TEST", listener);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GRAVITY_TEST(!pubNode.hasSubscribers("COUNT_TEST"));
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST"), 0u);
+
+	// Subscriptions from another GravityNode, counted once for each filter
+	GravityNode subNode;
+	ret = subNode.init("TestCountSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	Subscriber allSubscriber, trackSubscriber, otherTrackSubscriber;
+	subNode.subscribe("COUNT_TEST", allSubscriber);
+	subNode.subscribe("COUNT_TEST", trackSubscriber, "track/air");
+	subNode.subscribe("COUNT_TEST", otherTrackSubscriber, "track/air");
+	sleep(500);
+
+	GRAVITY_TEST(pubNode.hasSubscribers("COUNT_TEST"));
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST"), 2u);
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST", "track/air/1"), 2u);
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST", "status"), 1u);
+	GRAVITY_TEST_EQUALS(listener.getCount(), 2u);
+	int calls = listener.getCalls();
+	GRAVITY_TEST(calls > 0);
+
+	// The filter is still subscribed to while any subscriber is left on it
+	subNode.unsubscribe("COUNT_TEST", otherTrackSubscriber, "track/air");
+	sleep(500);
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST"), 2u);
+	GRAVITY_TEST_EQUALS(listener.getCalls(), calls);
+
+	subNode.unsubscribe("COUNT_TEST", trackSubscriber, "track/air");
+	sleep(500);
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST"), 1u);
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST", "track/air/1"), 1u);
+	GRAVITY_TEST_EQUALS(listener.getCount(), 1u);
+
+	subNode.unsubscribe("COUNT_TEST", allSubscriber);
+	sleep(500);
+	GRAVITY_TEST(!pubNode.hasSubscribers("COUNT_TEST"));
+	GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount("COUNT_TEST"), 0u);
+	GRAVITY_TEST_EQUALS(listener.getCount(), 0u);
+
+	ret = pubNode.unregisterSubscriberCountListener("COUNT_TEST");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+}
+
+void GravityNodeTest::testPublishThreads(void)
+{
+	// Gravity.ini gives this component four publish threads, and an unlimited PublishHWM that each of them has to
+	// acknowledge before init returns
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestShardPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestShardSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// Pick two data products owned by each publish thread (see GravityNode::publishShard)
+	const unsigned int shards = 4;
+	vector<string> ids;
+	vector<int> owned(shards, 0);
+	for (int i = 0; ids.size() < 2 * shards; i++)
+	{
+		ostringstream id;
+		id << "SHARD_TEST_" << i;
+		unsigned int shard = std::hash<std::string>()(id.str()) % shards;
+		if (owned[shard] < 2)
+		{
+			owned[shard]++;
+			ids.push_back(id.str());
+		}
+	}
+
+	vector<PublicationHandle> handles(ids.size());
+	OrderedSubscriber subscriber;
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		ret = pubNode.registerDataProduct(ids[i], GravityTransportTypes::TCP, false, handles[i]);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		ret = subNode.subscribe(ids[i], subscriber);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	}
+	sleep(500);
+
+	// Publishes of every data product, interleaved, then one batch of them all
+	const int count = 1000;
+	for (int value = 0; value < count; value++)
+	{
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			ret = pubNode.publish(handles[i], &value, sizeof(int));
+			GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		}
+	}
+	vector<PublishItem> items;
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		items.push_back(PublishItem(handles[i], &count, sizeof(int)));
+	}
+	ret = pubNode.publish(items);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	sleep(1000);
+
+	// Each arrives in the order published
+	GRAVITY_TEST(subscriber.isOrdered());
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		GRAVITY_TEST_EQUALS(subscriber.getCount(ids[i]), count + 1);
+		GRAVITY_TEST_EQUALS(pubNode.getSubscriberCount(ids[i]), 1u);
+	}
+
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		subNode.unsubscribe(ids[i], subscriber);
+		ret = pubNode.unregisterDataProduct(ids[i]);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		ret = pubNode.unregisterDataProduct(ids[i]);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::REGISTRATION_CONFLICT);
+		int value = 0;
+		ret = pubNode.publish(handles[i], &value, sizeof(int));
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::NOT_REGISTERED);
+	}
+}
+
+void GravityNodeTest::testDirectPublish(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestDirectPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestDirectSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	GravityPublicationOptions options;
+	options.directPublish = true;
+	PublicationHandle handle1, handle2;
+	ret = pubNode.registerDataProduct("DIRECT_TEST_1", GravityTransportTypes::TCP, true, options, handle1);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.registerDataProduct("DIRECT_TEST_2", GravityTransportTypes::TCP, true, options, handle2);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	OrderedSubscriber subscriber;
+	subNode.subscribe("DIRECT_TEST_1", subscriber);
+	subNode.subscribe("DIRECT_TEST_2", subscriber);
+	sleep(500);
+
+	// Each data product published from its own thread, which sends it
+	const int count = 500;
+	std::thread publisher1(publishValues, &pubNode, handle1, count);
+	std::thread publisher2(publishValues, &pubNode, handle2, count);
+	publisher1.join();
+	publisher2.join();
+
+	// Then by data product and in a batch, which are sent directly too
+	int value = count;
+	GravityDataProduct gdp("DIRECT_TEST_1");
+	gdp.setData(&value, sizeof(int));
+	ret = pubNode.publish(gdp);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	vector<PublishItem> items;
+	int values[] = {count + 1, count + 2};
+	items.push_back(PublishItem(handle1, &values[0], sizeof(int)));
+	items.push_back(PublishItem(handle1, &values[1], sizeof(int)));
+	ret = pubNode.publish(items);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	sleep(500);
+
+	GRAVITY_TEST(subscriber.isOrdered());
+	GRAVITY_TEST_EQUALS(subscriber.getCount("DIRECT_TEST_1"), count + 3);
+	GRAVITY_TEST_EQUALS(subscriber.getCount("DIRECT_TEST_2"), count);
+
+	// The publish thread still sends the last value to subscribers that join late
+	Subscriber lateSubscriber;
+	subNode.subscribe("DIRECT_TEST_1", lateSubscriber);
+	sleep(500);
+	GRAVITY_TEST_EQUALS(lateSubscriber.getCount(), 1);
+
+	subNode.unsubscribe("DIRECT_TEST_1", subscriber);
+	subNode.unsubscribe("DIRECT_TEST_2", subscriber);
+	subNode.unsubscribe("DIRECT_TEST_1", lateSubscriber);
+	ret = pubNode.unregisterDataProduct("DIRECT_TEST_1");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.publish(handle1, &value, sizeof(int));
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::NOT_REGISTERED);
+}
+
+void GravityNodeTest::testSharedSubscriptionSocket(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestSharedPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestSharedSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	PublicationHandle handle;
+	ret = pubNode.registerDataProduct("SHARED_TEST", GravityTransportTypes::TCP, true, handle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	char data = 'x';
+	pubNode.publish(handle, &data, 1, "b1");
+	sleep(100);
+
+	// Subscriptions with several filters, some overlapping, all received over one socket to the publisher
+	Subscriber aSubscriber, a1Subscriber, bSubscriber, allSubscriber;
+	subNode.subscribe("SHARED_TEST", aSubscriber, "a");
+	subNode.subscribe("SHARED_TEST", a1Subscriber, "a1");
+	subNode.subscribe("SHARED_TEST", bSubscriber, "b");
+	subNode.subscribe("SHARED_TEST", allSubscriber, "");
+	sleep(500);
+
+	// Only the filters the cached value matches get it
+	GRAVITY_TEST_EQUALS(aSubscriber.getCount(), 0);
+	GRAVITY_TEST_EQUALS(a1Subscriber.getCount(), 0);
+	GRAVITY_TEST_EQUALS(bSubscriber.getCount(), 1);
+	GRAVITY_TEST_EQUALS(allSubscriber.getCount(), 1);
+
+	for (int i = 0; i < 10; i++)
+	{
+		pubNode.publish(handle, &data, 1, "a1");
+		pubNode.publish(handle, &data, 1, "a2");
+		pubNode.publish(handle, &data, 1, "b1");
+	}
+	sleep(500);
+
+	// Each data product reaches every subscription whose filter matches it, once
+	GRAVITY_TEST_EQUALS(aSubscriber.getCount(), 20);
+	GRAVITY_TEST_EQUALS(a1Subscriber.getCount(), 10);
+	GRAVITY_TEST_EQUALS(bSubscriber.getCount(), 11);
+	GRAVITY_TEST_EQUALS(allSubscriber.getCount(), 31);
+
+	// Removing filters from the socket leaves the others as they were
+	subNode.unsubscribe("SHARED_TEST", aSubscriber, "a");
+	subNode.unsubscribe("SHARED_TEST", allSubscriber, "");
+	sleep(300);
+	for (int i = 0; i < 10; i++)
+	{
+		pubNode.publish(handle, &data, 1, "a1");
+		pubNode.publish(handle, &data, 1, "a2");
+		pubNode.publish(handle, &data, 1, "b1");
+	}
+	sleep(500);
+	GRAVITY_TEST_EQUALS(aSubscriber.getCount(), 20);
+	GRAVITY_TEST_EQUALS(a1Subscriber.getCount(), 20);
+	GRAVITY_TEST_EQUALS(bSubscriber.getCount(), 21);
+	GRAVITY_TEST_EQUALS(allSubscriber.getCount(), 31);
+
+	// A filter added to the socket later still gets the cached value for it
+	Subscriber lateSubscriber;
+	subNode.subscribe("SHARED_TEST", lateSubscriber, "a2");
+	sleep(500);
+	GRAVITY_TEST_EQUALS(lateSubscriber.getCount(), 1);
+	GRAVITY_TEST_EQUALS(a1Subscriber.getCount(), 20);
+	GRAVITY_TEST_EQUALS(bSubscriber.getCount(), 21);
+
+	subNode.unsubscribe("SHARED_TEST", a1Subscriber, "a1");
+	subNode.unsubscribe("SHARED_TEST", bSubscriber, "b");
+	subNode.unsubscribe("SHARED_TEST", lateSubscriber, "a2");
+}
+
+void GravityNodeTest::testManySubscriptionSockets(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestPollPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestPollSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// A socket to the publisher of each data product for the subscription manager to wait on
+	const int products = 50;
+	vector<string> ids;
+	vector<PublicationHandle> handles(products);
+	OrderedSubscriber subscriber;
+	for (int i = 0; i < products; i++)
+	{
+		ostringstream id;
+		id << "POLL_TEST_" << i;
+		ids.push_back(id.str());
+		ret = pubNode.registerDataProduct(ids[i], GravityTransportTypes::TCP, false, handles[i]);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		ret = subNode.subscribe(ids[i], subscriber);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	}
+	sleep(1000);
+
+	// Bursts on every socket at once, each more than is read from a socket at a time
+	const int count = 200;
+	for (int value = 0; value < count; value++)
+	{
+		for (int i = 0; i < products; i++)
+		{
+			ret = pubNode.publish(handles[i], &value, sizeof(int));
+			GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		}
+	}
+	sleep(1000);
+	GRAVITY_TEST(subscriber.isOrdered());
+	for (int i = 0; i < products; i++)
+	{
+		GRAVITY_TEST_EQUALS(subscriber.getCount(ids[i]), count);
+	}
+
+	// After the sockets have gone quiet, a single data product on one of them is still noticed
+	int value = count;
+	ret = pubNode.publish(handles[products - 1], &value, sizeof(int));
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	sleep(200);
+	GRAVITY_TEST_EQUALS(subscriber.getCount(ids[products - 1]), count + 1);
+	GRAVITY_TEST_EQUALS(subscriber.getCount(ids[0]), count);
+
+	for (int i = 0; i < products; i++)
+	{
+		subNode.unsubscribe(ids[i], subscriber);
+	}
+}
+
+void GravityNodeTest::testRateLimitedSubscription(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestRatePublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode fullNode;
+	ret = fullNode.init("TestRateFullSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode limitedNode;
+	ret = limitedNode.init("TestRateLimitedSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	PublicationHandle handle;
+	ret = pubNode.registerDataProduct("RATE_TEST", GravityTransportTypes::TCP, false, handle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	Subscriber fullSubscriber, limitedSubscriber, limitedASubscriber;
+	fullNode.subscribe("RATE_TEST", fullSubscriber);
+	GravitySubscriptionOptions options;
+	options.maxRate = 10;
+	limitedNode.subscribe("RATE_TEST", limitedSubscriber, "", "", true, options);
+	options.maxRate = 5;
+	fullNode.subscribe("RATE_TEST", limitedASubscriber, "a", "", true, options);
+	sleep(500);
+
+	// Two filter texts, each published at 100 per second for two seconds
+	const int count = 400;
+	char data = 'x';
+	uint64_t start = getCurrentTime();
+	for (int i = 0; i < count; i++)
+	{
+		ret = pubNode.publish(handle, &data, 1, i % 2 ? "a" : "b");
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+		sleep(5);
+	}
+	uint64_t intervals = (getCurrentTime() - start) / 100000;
+	sleep(300);
+
+	// The unlimited subscriber gets every one, the others at most one per interval with each filter text
+	GRAVITY_TEST_EQUALS(fullSubscriber.getCount(), count);
+	GRAVITY_TEST(limitedSubscriber.getCount() <= 2 * (int)(intervals + 1));
+	GRAVITY_TEST(limitedSubscriber.getCount() >= 2 * 15);
+	GRAVITY_TEST(limitedASubscriber.getCount() <= (int)(intervals / 2 + 1));
+	GRAVITY_TEST(limitedASubscriber.getCount() >= 7);
+
+	fullNode.unsubscribe("RATE_TEST", fullSubscriber);
+	limitedNode.unsubscribe("RATE_TEST", limitedSubscriber);
+	fullNode.unsubscribe("RATE_TEST", limitedASubscriber, "a");
+}
+
+void GravityNodeTest::testPublishByHandle(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestHandlePublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestHandleSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	PublicationHandle handle = INVALID_PUBLICATION_HANDLE, otherHandle = INVALID_PUBLICATION_HANDLE;
+	ret = pubNode.registerDataProduct("HANDLE_TEST", GravityTransportTypes::TCP, false, handle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.registerDataProduct("HANDLE_TEST_2", GravityTransportTypes::TCP, false, otherHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GRAVITY_TEST(handle != INVALID_PUBLICATION_HANDLE);
+	GRAVITY_TEST(otherHandle != INVALID_PUBLICATION_HANDLE);
+	GRAVITY_TEST(handle != otherHandle);
+
+	KeepingSubscriber subscriber, filteredSubscriber;
+	subNode.subscribe("HANDLE_TEST", subscriber);
+	subNode.subscribe("HANDLE_TEST", filteredSubscriber, "keep");
+	sleep(500);
+
+	// A protobuf message with a timestamp, and raw bytes without one
+	ServiceDirectoryMapPB message;
+	message.set_domain("by handle");
+	ret = pubNode.publish(handle, message, "keep", 12345);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.publish(handle, "raw", 3, "drop");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	sleep(500);
+
+	// Both arrive as data products of the registration, with the filter text applied
+	std::vector< std::shared_ptr<GravityDataProduct> > received = subscriber.getReceived();
+	GRAVITY_TEST_EQUALS(received.size(), 2u);
+	GRAVITY_TEST_EQUALS(filteredSubscriber.getReceived().size(), 1u);
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		GRAVITY_TEST_EQUALS(received[i]->getDataProductID(), "HANDLE_TEST");
+		GRAVITY_TEST_EQUALS(received[i]->getComponentId(), "TestHandlePublisher");
+		GRAVITY_TEST_EQUALS(received[i]->getDomain(), pubNode.getDomain());
+		GRAVITY_TEST(received[i]->getRegistrationTime() > 0);
+	}
+	GRAVITY_TEST_EQUALS(received[0]->getGravityTimestamp(), 12345u);
+	GRAVITY_TEST_EQUALS(received[0]->getTypeName(), message.GetTypeName());
+	ServiceDirectoryMapPB receivedMessage;
+	received[0]->populateMessage(receivedMessage);
+	GRAVITY_TEST_EQUALS(receivedMessage.domain(), "by handle");
+	GRAVITY_TEST(received[1]->getGravityTimestamp() > 12345u);
+	GRAVITY_TEST_EQUALS(string(received[1]->getDataPointer(), received[1]->getDataSize()), "raw");
+
+	// A handle stops working when its data product is unregistered, and is the same when it's registered again
+	ret = pubNode.unregisterDataProduct("HANDLE_TEST");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.publish(handle, "raw", 3);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::NOT_REGISTERED);
+	PublicationHandle newHandle = INVALID_PUBLICATION_HANDLE;
+	ret = pubNode.registerDataProduct("HANDLE_TEST", GravityTransportTypes::TCP, false, newHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GRAVITY_TEST_EQUALS(newHandle, handle);
+	ret = pubNode.publish(handle, "raw", 3);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	ret = pubNode.publish(INVALID_PUBLICATION_HANDLE, "raw", 3);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::NOT_REGISTERED);
+
+	subNode.unsubscribe("HANDLE_TEST", subscriber);
+	subNode.unsubscribe("HANDLE_TEST", filteredSubscriber, "keep");
+}
+
+void GravityNodeTest::testBatchPublish(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestBatchPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestBatchSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	PublicationHandle handle1, handle2;
+	ret = pubNode.registerDataProduct("BATCH_TEST_1", GravityTransportTypes::TCP, false, handle1);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.registerDataProduct("BATCH_TEST_2", GravityTransportTypes::TCP, false, handle2);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	KeepingSubscriber subscriber, filteredSubscriber;
+	subNode.subscribe("BATCH_TEST_1", subscriber);
+	subNode.subscribe("BATCH_TEST_2", subscriber);
+	subNode.subscribe("BATCH_TEST_1", filteredSubscriber, "odd");
+	sleep(500);
+
+	// A batch of both data products, some with a timestamp, and the rest published in the same microsecond
+	const int count = 100;
+	int values[count];
+	vector<PublishItem> items;
+	for (int i = 0; i < count; i++)
+	{
+		values[i] = i;
+		items.push_back(PublishItem(i % 4 == 3 ? handle2 : handle1, &values[i], sizeof(int), i % 2 ? "odd" : "even",
+		                            i == 0 ? 1000 : 0));
+	}
+	ret = pubNode.publish(items);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	sleep(500);
+
+	// Every one arrives, in the order given, with its own filter text and a timestamp no resend could be mistaken for
+	std::vector< std::shared_ptr<GravityDataProduct> > received = subscriber.getReceived();
+	GRAVITY_TEST_EQUALS(received.size(), (size_t)count);
+	vector<int> next(2, 0);
+	uint64_t lastTimestamp = 0;
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		int value = -1;
+		received[i]->getData(&value, sizeof(int));
+		bool second = received[i]->getDataProductID() == "BATCH_TEST_2";
+		GRAVITY_TEST(second == (value % 4 == 3));
+		GRAVITY_TEST(value >= next[second]);
+		next[second] = value + 1;
+		if (!second)
+		{
+			GRAVITY_TEST(received[i]->getGravityTimestamp() > lastTimestamp);
+			lastTimestamp = received[i]->getGravityTimestamp();
+		}
+	}
+	GRAVITY_TEST_EQUALS(received[0]->getGravityTimestamp(), 1000u);
+	GRAVITY_TEST_EQUALS(filteredSubscriber.getReceived().size(), (size_t)(count / 2 - count / 4));
+
+	// Items that can't be published fail the batch, but the rest are still published
+	items.clear();
+	items.push_back(PublishItem(handle1, &values[0], sizeof(int)));
+	items.push_back(PublishItem(INVALID_PUBLICATION_HANDLE, &values[1], sizeof(int)));
+	items.push_back(PublishItem(handle2, &values[2], sizeof(int)));
+	ret = pubNode.publish(items);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::NOT_REGISTERED);
+	items[1] = PublishItem(handle1, NULL, sizeof(int));
+	ret = pubNode.publish(items);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::INVALID_PARAMETER);
+	sleep(500);
+	GRAVITY_TEST_EQUALS(subscriber.getReceived().size(), (size_t)count + 4);
+
+	subNode.unsubscribe("BATCH_TEST_1", subscriber);
+	subNode.unsubscribe("BATCH_TEST_2", subscriber);
+	subNode.unsubscribe("BATCH_TEST_1", filteredSubscriber, "odd");
+}
+
+void GravityNodeTest::testCacheReplay(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestReplayPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestReplaySubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	PublicationHandle handle;
+	ret = pubNode.registerDataProduct("REPLAY_TEST", GravityTransportTypes::TCP, true, handle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// Several times the cached values replayed at once (64), and more published while the late subscriber joins, but
+	// not so many at once that they're dropped at a high water mark
+	const int cached = 320, count = 1000;
+	publishFilteredValues(&pubNode, handle, 0, cached);
+	std::thread publisher(publishFilteredValues, &pubNode, handle, cached, count - cached);
+	KeepingSubscriber subscriber;
+	ret = subNode.subscribe("REPLAY_TEST", subscriber);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	publisher.join();
+	sleep(1000);
+
+	// Every value arrives in the order published: those cached before it joined marked as cached, then the rest
+	std::vector< std::shared_ptr<GravityDataProduct> > received = subscriber.getReceived();
+	GRAVITY_TEST_EQUALS(received.size(), (size_t)count);
+	bool live = false;
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		int value = -1;
+		received[i]->getData(&value, sizeof(int));
+		GRAVITY_TEST_EQUALS(value, (int)i);
+		live = live || !received[i]->isCachedDataproduct();
+		GRAVITY_TEST(live != received[i]->isCachedDataproduct());
+		GRAVITY_TEST(!live || value >= cached);
+	}
+
+	subNode.unsubscribe("REPLAY_TEST", subscriber);
+}
+
+void GravityNodeTest::testCacheHistory(void)
+{
+	// Gravity.ini limits this component's cached values to 1 MB
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestCachePublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestCacheSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	bool allCached;
+
+	// The last historyDepth values of each filter text are kept for a late subscriber, in timestamp order
+	GravityPublicationOptions options;
+	options.historyDepth = 3;
+	PublicationHandle depthHandle;
+	ret = pubNode.registerDataProduct("HISTORY_DEPTH", GravityTransportTypes::TCP, true, options, depthHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	for (int i = 0; i < 10; i++)
+	{
+		int a = i, b = 100 + i;
+		GRAVITY_TEST_EQUALS(pubNode.publish(depthHandle, &a, sizeof(int), "a"), GravityReturnCodes::SUCCESS);
+		GRAVITY_TEST_EQUALS(pubNode.publish(depthHandle, &b, sizeof(int), "b"), GravityReturnCodes::SUCCESS);
+	}
+	sleep(100);
+	KeepingSubscriber depthSubscriber;
+	subNode.subscribe("HISTORY_DEPTH", depthSubscriber);
+	sleep(500);
+	std::vector<int> values = receivedValues(depthSubscriber, allCached);
+	int expectedDepth[] = {7, 107, 8, 108, 9, 109};
+	GRAVITY_TEST(values == std::vector<int>(expectedDepth, expectedDepth + 6));
+	GRAVITY_TEST(allCached);
+	subNode.unsubscribe("HISTORY_DEPTH", depthSubscriber);
+
+	// Values older than historyMaxAge are dropped, whether or not later ones are cached after them
+	options.historyDepth = 0;
+	options.historyMaxAge = 300000;
+	PublicationHandle ageHandle, agedOutHandle;
+	ret = pubNode.registerDataProduct("HISTORY_AGE", GravityTransportTypes::TCP, true, options, ageHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.registerDataProduct("HISTORY_AGED_OUT", GravityTransportTypes::TCP, true, options, agedOutHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	publishValues(&pubNode, ageHandle, 5);
+	publishValues(&pubNode, agedOutHandle, 5);
+	sleep(600);
+	for (int i = 5; i < 8; i++)
+	{
+		GRAVITY_TEST_EQUALS(pubNode.publish(ageHandle, &i, sizeof(int)), GravityReturnCodes::SUCCESS);
+	}
+	sleep(100);
+	KeepingSubscriber ageSubscriber, agedOutSubscriber;
+	subNode.subscribe("HISTORY_AGE", ageSubscriber);
+	subNode.subscribe("HISTORY_AGED_OUT", agedOutSubscriber);
+	sleep(500);
+	values = receivedValues(ageSubscriber, allCached);
+	int expectedAge[] = {5, 6, 7};
+	GRAVITY_TEST(values == std::vector<int>(expectedAge, expectedAge + 3));
+	GRAVITY_TEST(allCached);
+	GRAVITY_TEST(agedOutSubscriber.getReceived().empty());
+	subNode.unsubscribe("HISTORY_AGE", ageSubscriber);
+	subNode.unsubscribe("HISTORY_AGED_OUT", agedOutSubscriber);
+
+	// Over PublishCacheLimitMB, the least recently cached or replayed value of any publication is dropped first
+	std::vector<char> data(300 * 1024);
+	const char* ids[] = {"LRU_A", "LRU_B", "LRU_C", "LRU_D"};
+	KeepingSubscriber lruSubscribers[4];
+	for (int i = 0; i < 4; i++)
+	{
+		ret = pubNode.registerDataProduct(ids[i], GravityTransportTypes::TCP, true);
+		GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		GravityDataProduct gdp(ids[i]);
+		data[0] = (char)i;
+		gdp.setData(&data[0], (int)data.size());
+		GRAVITY_TEST_EQUALS(pubNode.publish(gdp), GravityReturnCodes::SUCCESS);
+	}
+	sleep(100);
+	subNode.subscribe("LRU_A", lruSubscribers[0]);
+	sleep(500);
+	GRAVITY_TEST_EQUALS(lruSubscribers[0].getReceived().size(), 1u);
+	GravityDataProduct gdp("LRU_D");
+	data[0] = 3;
+	gdp.setData(&data[0], (int)data.size());
+	GRAVITY_TEST_EQUALS(pubNode.publish(gdp), GravityReturnCodes::SUCCESS);
+	sleep(100);
+	for (int i = 1; i < 4; i++)
+	{
+		subNode.subscribe(ids[i], lruSubscribers[i]);
+	}
+	sleep(500);
+	GRAVITY_TEST(lruSubscribers[1].getReceived().empty());
+	for (int i = 2; i < 4; i++)
+	{
+		std::vector< std::shared_ptr<GravityDataProduct> > received = lruSubscribers[i].getReceived();
+		GRAVITY_TEST_EQUALS(received.size(), 1u);
+		GRAVITY_TEST_EQUALS(((const char*)received[0]->getDataPointer())[0], (char)i);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		subNode.unsubscribe(ids[i], lruSubscribers[i]);
+	}
+}
+
+void GravityNodeTest::testReliablePublish(void)
+{
+	// Gravity.ini gives the subscriber a receive high water mark of 1 and metrics every second, and the publisher a
+	// send high water mark that a burst of large data products overflows but a window of them asked for again doesn't
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestReliablePublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestReliableSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// All of a burst are kept to send again, but only the last of the other
+	GravityPublicationOptions options;
+	options.reliable = true;
+	ret = pubNode.registerDataProduct("RELIABLE_KEPT", GravityTransportTypes::TCP, false, options);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	options.retransmitDepth = 1;
+	ret = pubNode.registerDataProduct("RELIABLE_LOST", GravityTransportTypes::TCP, false, options);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	KeepingSubscriber keptSubscriber, lostSubscriber, metricsSubscriber;
+	subNode.subscribe("RELIABLE_KEPT", keptSubscriber);
+	subNode.subscribe("RELIABLE_LOST", lostSubscriber);
+	subNode.subscribe("GravityMetricsData", metricsSubscriber);
+	sleep(1000);
+
+	// The last is published once the burst has drained, so that any missed at the end of it are found missing too
+	const int count = 1001;
+	std::vector<char> data(64 * 1024);
+	for (int value = 0; value < count; value++)
+	{
+		if (value == count - 1)
+		{
+			sleep(500);
+		}
+		memcpy(&data[0], &value, sizeof(int));
+		GravityDataProduct kept("RELIABLE_KEPT"), lost("RELIABLE_LOST");
+		kept.setData(&data[0], (int)data.size());
+		lost.setData(&data[0], (int)data.size());
+		GRAVITY_TEST_EQUALS(pubNode.publish(kept), GravityReturnCodes::SUCCESS);
+		GRAVITY_TEST_EQUALS(pubNode.publish(lost), GravityReturnCodes::SUCCESS);
+	}
+	for (int i = 0; i < 100 && keptSubscriber.getReceived().size() < (size_t)count; i++)
+	{
+		sleep(100);
+	}
+	sleep(2000);
+
+	// Those missed arrive late, and each once
+	std::vector< std::shared_ptr<GravityDataProduct> > received = keptSubscriber.getReceived();
+	std::set<int> values;
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		int value;
+		memcpy(&value, received[i]->getDataPointer(), sizeof(int));
+		values.insert(value);
+	}
+	GRAVITY_TEST_EQUALS(received.size(), (size_t)count);
+	GRAVITY_TEST_EQUALS(values.size(), (size_t)count);
+	uint32_t gaps, retransmits, lost;
+	sumSubscriptionMetrics(metricsSubscriber, "RELIABLE_KEPT", gaps, retransmits, lost);
+	GRAVITY_TEST(gaps > 0);
+	GRAVITY_TEST_EQUALS(retransmits, gaps);
+	GRAVITY_TEST_EQUALS(lost, 0u);
+
+	// Those no longer kept are counted lost
+	received = lostSubscriber.getReceived();
+	sumSubscriptionMetrics(metricsSubscriber, "RELIABLE_LOST", gaps, retransmits, lost);
+	GRAVITY_TEST(lost > 0);
+	GRAVITY_TEST_EQUALS(received.size() + lost, (size_t)count);
+	GRAVITY_TEST_EQUALS(retransmits + lost, gaps);
+
+	subNode.unsubscribe("RELIABLE_KEPT", keptSubscriber);
+	subNode.unsubscribe("RELIABLE_LOST", lostSubscriber);
+	subNode.unsubscribe("GravityMetricsData", metricsSubscriber);
+}
+
+void GravityNodeTest::testSlowSubscriber(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestSlowPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestSlowSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	// Subscribers that fall more than 100 ms behind for a second are dropped from or conflated
+	GravityPublicationOptions options;
+	options.maxSubscriberLag = 100;
+	options.slowSubscriberTimeout = 1;
+	PublicationHandle dropHandle, conflateHandle;
+	ret = pubNode.registerDataProduct("SLOW_DROP", GravityTransportTypes::TCP, false, options, dropHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	options.slowSubscriberPolicy = GravitySlowSubscriberPolicies::CONFLATE;
+	ret = pubNode.registerDataProduct("SLOW_CONFLATE", GravityTransportTypes::TCP, false, options, conflateHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	LagListener dropListener, conflateListener;
+	GRAVITY_TEST_EQUALS(pubNode.registerSlowSubscriberListener("SLOW_DROP", dropListener), GravityReturnCodes::SUCCESS);
+	GRAVITY_TEST_EQUALS(pubNode.registerSlowSubscriberListener("SLOW_CONFLATE", conflateListener), GravityReturnCodes::SUCCESS);
+
+	// The subscriber is called from the thread that receives data products, so stalling it leaves them queued
+	StallingSubscriber subscriber;
+	subNode.subscribe("SLOW_DROP", subscriber);
+	subNode.subscribe("SLOW_CONFLATE", subscriber);
+	sleep(1000);
+	subscriber.setStall(300);
+	int value = 0;
+	for (int i = 0; i < 500 && !conflateListener.hasEvent(GravitySlowSubscriberEvents::CONFLATED); i++, value++)
+	{
+		GRAVITY_TEST_EQUALS(pubNode.publish(dropHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+		GRAVITY_TEST_EQUALS(pubNode.publish(conflateHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+		sleep(20);
+	}
+	GRAVITY_TEST(dropListener.hasEvent(GravitySlowSubscriberEvents::SLOW));
+	GRAVITY_TEST(conflateListener.hasEvent(GravitySlowSubscriberEvents::SLOW));
+	GRAVITY_TEST(conflateListener.hasEvent(GravitySlowSubscriberEvents::CONFLATED));
+	subscriber.setStall(0);
+	sleep(2000);
+
+	// Once caught up, the subscriber that was dropped from receives everything again, and the conflated one at most
+	// one data product per 100 ms
+	int dropCount = subscriber.getCount("SLOW_DROP"), conflateCount = subscriber.getCount("SLOW_CONFLATE");
+	for (int i = 0; i < 100; i++, value++)
+	{
+		GRAVITY_TEST_EQUALS(pubNode.publish(dropHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+		GRAVITY_TEST_EQUALS(pubNode.publish(conflateHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+		sleep(10);
+	}
+	sleep(500);
+	GRAVITY_TEST_EQUALS(subscriber.getCount("SLOW_DROP") - dropCount, 100);
+	conflateCount = subscriber.getCount("SLOW_CONFLATE") - conflateCount;
+	GRAVITY_TEST(conflateCount > 0);
+	GRAVITY_TEST(conflateCount < 30);
+	GRAVITY_TEST(!dropListener.hasEvent(GravitySlowSubscriberEvents::CONFLATED));
+	GRAVITY_TEST(!dropListener.hasEvent(GravitySlowSubscriberEvents::DISCONNECTED));
+
+	subNode.unsubscribe("SLOW_DROP", subscriber);
+	subNode.unsubscribe("SLOW_CONFLATE", subscriber);
+	pubNode.unregisterSlowSubscriberListener("SLOW_DROP");
+	pubNode.unregisterSlowSubscriberListener("SLOW_CONFLATE");
+}
+
+void GravityNodeTest::testChunkedPublish(void)
+{
+	// Gravity.ini limits the subscriber to reassembling 1 MB at once
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestChunkPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestChunkSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	GravityPublicationOptions options;
+	options.chunkSize = 64 * 1024;
+	ret = pubNode.registerDataProduct("CHUNKED", GravityTransportTypes::TCP, false, options);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	KeepingSubscriber subscriber;
+	subNode.subscribe("CHUNKED", subscriber);
+	sleep(1000);
+
+	// Sent in chunks and reassembled whole, unless larger than the subscriber may reassemble
+	size_t sizes[] = {700 * 1024 + 1, 2 * 1024 * 1024, 100 * 1024};
+	for (int i = 0; i < 3; i++)
+	{
+		std::vector<char> data(sizes[i]);
+		for (size_t j = 0; j < data.size(); j++)
+		{
+			data[j] = (char)((j * 31 + i) % 251);
+		}
+		GravityDataProduct gdp("CHUNKED");
+		gdp.setData(&data[0], (int)data.size());
+		GRAVITY_TEST_EQUALS(pubNode.publish(gdp), GravityReturnCodes::SUCCESS);
+		sleep(500);
+	}
+
+	std::vector< std::shared_ptr<GravityDataProduct> > received = subscriber.getReceived();
+	GRAVITY_TEST_EQUALS(received.size(), 2u);
+	int published[] = {0, 2};
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		int index = published[i];
+		GRAVITY_TEST_EQUALS((size_t)received[i]->getDataSize(), sizes[index]);
+		const char* data = received[i]->getDataPointer();
+		bool intact = true;
+		for (size_t j = 0; j < sizes[index] && intact; j++)
+		{
+			intact = data[j] == (char)((j * 31 + index) % 251);
+		}
+		GRAVITY_TEST(intact);
+	}
+	subNode.unsubscribe("CHUNKED", subscriber);
+}
+
+void GravityNodeTest::testPredicateSubscription(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestPredicatePublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestPredicateSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+
+	ret = pubNode.registerDataProduct("PREDICATE_TEST", GravityTransportTypes::TCP);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	KeepingSubscriber allSubscriber, matchingSubscriber;
+	subNode.subscribe("PREDICATE_TEST", allSubscriber);
+	GravitySubscriptionOptions options;
+	options.predicate = "starttime >= 50 && domain == \"even\" || url == \"all\"";
+	subNode.subscribe("PREDICATE_TEST", matchingSubscriber, "", "", true, options);
+	sleep(1000);
+
+	const int count = 100;
+	for (int i = 0; i < count; i++)
+	{
+		ServiceDirectoryBroadcastPB broadcast;
+		broadcast.set_starttime(i);
+		broadcast.set_domain(i % 2 == 0 ? "even" : "odd");
+		broadcast.set_url(i == 7 ? "all" : "none");
+		GravityDataProduct gdp("PREDICATE_TEST");
+		gdp.setData(broadcast);
+		GRAVITY_TEST_EQUALS(pubNode.publish(gdp), GravityReturnCodes::SUCCESS);
+	}
+	sleep(1000);
+
+	// Only the data products matching the predicate are delivered, in order, to the subscriber that has one
+	GRAVITY_TEST_EQUALS(allSubscriber.getReceived().size(), (size_t)count);
+	std::vector< std::shared_ptr<GravityDataProduct> > received = matchingSubscriber.getReceived();
+	std::vector<int64_t> startTimes, expected;
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		ServiceDirectoryBroadcastPB broadcast;
+		received[i]->populateMessage(broadcast);
+		startTimes.push_back(broadcast.starttime());
+	}
+	expected.push_back(7);
+	for (int i = 50; i < count; i += 2)
+	{
+		expected.push_back(i);
+	}
+	GRAVITY_TEST(startTimes == expected);
+
+	subNode.unsubscribe("PREDICATE_TEST", allSubscriber);
+	subNode.unsubscribe("PREDICATE_TEST", matchingSubscriber);
+}
+
+void GravityNodeTest::testTimeToLive(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestTTLPublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestTTLSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	bool allCached;
+
+	// Values that outlive the publisher's time to live are neither published nor replayed from the cache
+	GravityPublicationOptions options;
+	options.timeToLive = 500000;
+	options.historyDepth = 0;
+	PublicationHandle publishedHandle;
+	ret = pubNode.registerDataProduct("TTL_PUBLISHED", GravityTransportTypes::TCP, true, options, publishedHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	for (int value = 0; value < 4; value++)
+	{
+		uint64_t timestamp = value == 3 ? getCurrentTime() - 1000000 : 0;
+		GRAVITY_TEST_EQUALS(pubNode.publish(publishedHandle, &value, sizeof(int), "", timestamp), GravityReturnCodes::SUCCESS);
+	}
+	sleep(800);
+	for (int value = 4; value < 6; value++)
+	{
+		GRAVITY_TEST_EQUALS(pubNode.publish(publishedHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+	}
+	sleep(100);
+	KeepingSubscriber publishedSubscriber;
+	subNode.subscribe("TTL_PUBLISHED", publishedSubscriber);
+	sleep(300);
+	std::vector<int> values = receivedValues(publishedSubscriber, allCached);
+	int expectedCached[] = {4, 5};
+	GRAVITY_TEST(values == std::vector<int>(expectedCached, expectedCached + 2));
+	GRAVITY_TEST(allCached);
+	for (int value = 6; value < 8; value++)
+	{
+		uint64_t timestamp = value == 6 ? getCurrentTime() - 1000000 : 0;
+		GRAVITY_TEST_EQUALS(pubNode.publish(publishedHandle, &value, sizeof(int), "", timestamp), GravityReturnCodes::SUCCESS);
+	}
+	sleep(300);
+	values = receivedValues(publishedSubscriber, allCached);
+	int expectedPublished[] = {4, 5, 7};
+	GRAVITY_TEST(values == std::vector<int>(expectedPublished, expectedPublished + 3));
+	subNode.unsubscribe("TTL_PUBLISHED", publishedSubscriber);
+
+	// Values that outlive a subscriber's time to live aren't delivered to it, and are counted
+	PublicationHandle subscribedHandle;
+	ret = pubNode.registerDataProduct("TTL_SUBSCRIBED", GravityTransportTypes::TCP, false, GravityPublicationOptions(), subscribedHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	KeepingSubscriber allSubscriber, liveSubscriber;
+	subNode.subscribe("TTL_SUBSCRIBED", allSubscriber);
+	GravitySubscriptionOptions subscriptionOptions;
+	subscriptionOptions.timeToLive = 500000;
+	subNode.subscribe("TTL_SUBSCRIBED", liveSubscriber, "", "", true, subscriptionOptions);
+	sleep(1000);
+	uint64_t past = getCurrentTime() - 1000000;
+	for (int value = 0; value < 10; value++)
+	{
+		uint64_t timestamp = value < 5 ? past + value : 0;
+		GRAVITY_TEST_EQUALS(pubNode.publish(subscribedHandle, &value, sizeof(int), "", timestamp), GravityReturnCodes::SUCCESS);
+	}
+	sleep(500);
+	GRAVITY_TEST_EQUALS(allSubscriber.getReceived().size(), 10u);
+	GRAVITY_TEST_EQUALS(subNode.getExpiredCount(allSubscriber, "TTL_SUBSCRIBED"), 0u);
+	values = receivedValues(liveSubscriber, allCached);
+	int expectedLive[] = {5, 6, 7, 8, 9};
+	GRAVITY_TEST(values == std::vector<int>(expectedLive, expectedLive + 5));
+	GRAVITY_TEST_EQUALS(subNode.getExpiredCount(liveSubscriber, "TTL_SUBSCRIBED"), 5u);
+	subNode.unsubscribe("TTL_SUBSCRIBED", allSubscriber);
+	subNode.unsubscribe("TTL_SUBSCRIBED", liveSubscriber);
+}
+
+void GravityNodeTest::testElidedPublish(void)
+{
+	GravityNode pubNode;
+	GravityReturnCode ret = pubNode.init("TestElidePublisher");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	GravityNode subNode;
+	ret = subNode.init("TestElideSubscriber");
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	bool allCached;
+
+	// Publishes nobody subscribes to are dropped, but the last of each filter text is kept if the last value is cached
+	GravityPublicationOptions options;
+	options.elideWithoutSubscribers = true;
+	PublicationHandle cachedHandle, uncachedHandle;
+	ret = pubNode.registerDataProduct("ELIDE_CACHED", GravityTransportTypes::TCP, true, options, cachedHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	ret = pubNode.registerDataProduct("ELIDE_UNCACHED", GravityTransportTypes::TCP, false, options, uncachedHandle);
+	GRAVITY_TEST_EQUALS(ret, GravityReturnCodes::SUCCESS);
+	for (int value = 0; value < 5; value++)
+	{
+		int b = value + 10;
+		GRAVITY_TEST_EQUALS(pubNode.publish(cachedHandle, &value, sizeof(int), "a"), GravityReturnCodes::SUCCESS);
+		GRAVITY_TEST_EQUALS(pubNode.publish(cachedHandle, &b, sizeof(int), "b"), GravityReturnCodes::SUCCESS);
+		GRAVITY_TEST_EQUALS(pubNode.publish(uncachedHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+	}
+	sleep(100);
+
+	// A late subscriber gets the last of each exactly once, and then what's published live
+	KeepingSubscriber cachedSubscriber, uncachedSubscriber;
+	subNode.subscribe("ELIDE_CACHED", cachedSubscriber);
+	subNode.subscribe("ELIDE_UNCACHED", uncachedSubscriber);
+	sleep(1000);
+	std::vector<int> values = receivedValues(cachedSubscriber, allCached);
+	int expectedCached[] = {4, 14};
+	GRAVITY_TEST(values == std::vector<int>(expectedCached, expectedCached + 2));
+	GRAVITY_TEST(allCached);
+	GRAVITY_TEST(uncachedSubscriber.getReceived().empty());
+
+	int value = 20;
+	GRAVITY_TEST_EQUALS(pubNode.publish(cachedHandle, &value, sizeof(int), "a"), GravityReturnCodes::SUCCESS);
+	GRAVITY_TEST_EQUALS(pubNode.publish(uncachedHandle, &value, sizeof(int)), GravityReturnCodes::SUCCESS);
+	sleep(500);
+	values = receivedValues(cachedSubscriber, allCached);
+	int expectedLive[] = {4, 14, 20};
+	GRAVITY_TEST(values == std::vector<int>(expectedLive, expectedLive + 3));
+	GRAVITY_TEST(!cachedSubscriber.getReceived()[2]->isCachedDataproduct());
+	values = receivedValues(uncachedSubscriber, allCached);
+	GRAVITY_TEST(values == std::vector<int>(1, 20));
+
+	subNode.unsubscribe("ELIDE_CACHED", cachedSubscriber);
+	subNode.unsubscribe("ELIDE_UNCACHED", uncachedSubscriber);
+}
+
 void GravityNodeTest::subscriptionFilled(const std::vector< std::shared_ptr<GravityDataProduct> >& dataProducts)
 {
     std::lock_guard<std::mutex> guard(mtx);
@@ -562,7 +1907,43 @@ int main( int argc, char *argv[] )
     gnTest.testServiceWithDomain();
     printf("\nFinished testServiceWithDomain, about to run testComponentID.\n\n");
     gnTest.testComponentID();
-    printf("\nFinished testComponentID.\n\n");
+    printf("\nFinished testComponentID, about to run testLegacySubscriber.\n\n");
+    gnTest.testLegacySubscriber();
+    printf("\nFinished testLegacySubscriber, about to run testPublishHandoff.\n\n");
+    gnTest.testPublishHandoff();
+    printf("\nFinished testPublishHandoff, about to run testSubscriberCount.\n\n");
+    gnTest.testSubscriberCount();
+    printf("\nFinished testSubscriberCount, about to run testPublishThreads.\n\n");
+    gnTest.testPublishThreads();
+    printf("\nFinished testPublishThreads, about to run testDirectPublish.\n\n");
+    gnTest.testDirectPublish();
+    printf("\nFinished testDirectPublish, about to run testSharedSubscriptionSocket.\n\n");
+    gnTest.testSharedSubscriptionSocket();
+    printf("\nFinished testSharedSubscriptionSocket, about to run testManySubscriptionSockets.\n\n");
+    gnTest.testManySubscriptionSockets();
+    printf("\nFinished testManySubscriptionSockets, about to run testRateLimitedSubscription.\n\n");
+    gnTest.testRateLimitedSubscription();
+    printf("\nFinished testRateLimitedSubscription, about to run testPublishByHandle.\n\n");
+    gnTest.testPublishByHandle();
+    printf("\nFinished testPublishByHandle, about to run testBatchPublish.\n\n");
+    gnTest.testBatchPublish();
+    printf("\nFinished testBatchPublish, about to run testCacheReplay.\n\n");
+    gnTest.testCacheReplay();
+    printf("\nFinished testCacheReplay, about to run testCacheHistory.\n\n");
+    gnTest.testCacheHistory();
+    printf("\nFinished testCacheHistory, about to run testReliablePublish.\n\n");
+    gnTest.testReliablePublish();
+    printf("\nFinished testReliablePublish, about to run testSlowSubscriber.\n\n");
+    gnTest.testSlowSubscriber();
+    printf("\nFinished testSlowSubscriber, about to run testChunkedPublish.\n\n");
+    gnTest.testChunkedPublish();
+    printf("\nFinished testChunkedPublish, about to run testPredicateSubscription.\n\n");
+    gnTest.testPredicateSubscription();
+    printf("\nFinished testPredicateSubscription, about to run testTimeToLive.\n\n");
+    gnTest.testTimeToLive();
+    printf("\nFinished testTimeToLive, about to run testElidedPublish.\n\n");
+    gnTest.testElidedPublish();
+    printf("\nFinished testElidedPublish.\n\n");
 
     GravitySyncTest syncTest;
     syncTest.testSync();
@@ -65,6 +65,24 @@ public:
 	void testSubscribeDomain(void);
 	void testServiceWithDomain(void);
 	void testComponentID(void);
+	void testLegacySubscriber(void);
+	void testPublishHandoff(void);
+	void testSubscriberCount(void);
+	void testPublishThreads(void);
+	void testDirectPublish(void);
+	void testSharedSubscriptionSocket(void);
+	void testManySubscriptionSockets(void);
+	void testRateLimitedSubscription(void);
+	void testPublishByHandle(void);
+	void testBatchPublish(void);
+	void testCacheReplay(void);
+	void testCacheHistory(void);
+	void testReliablePublish(void);
+	void testSlowSubscriber(void);
+	void testChunkedPublish(void);
+	void testPredicateSubscription(void);
+	void testTimeToLive(void);
+	void testElidedPublish(void);
     void subscriptionFilled(const std::vector< std::shared_ptr<gravity::GravityDataProduct> >& dataProducts);
     void requestFilled(std::string serviceID, std::string requestID, const gravity::GravityDataProduct& response);
     std::shared_ptr<gravity::GravityDataProduct> request(const std::string serviceID, const gravity::GravityDataProduct& dataProduct);